@@ -161,6 +161,11 @@ void AiSignWidget::initialize() {
 
 // 信号槽事件处理
 void AiSignWidget::handleEvents() {
+    // 配置文件修改后使用新的调试模式，是否使用摄像头需要重启程序
+    connect(&ConfigInstance, &Config::configChanged, this, [this] {
+        d->debug = ConfigInstance.isDebug();
+    });
+
     // 切换考试后从服务器加载考试单元、考点、考场
     connect(ui->examComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this]() {
         QString examCode = ui->examComboBox->currentData().toString();
@@ -4,23 +4,71 @@
 #define ConfigInstance Singleton<Config>::getInstance()
 
 #include "util/Singleton.h"
+#include <QObject>
 #include <QVariant>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QMutex>
+#include <QSharedPointer>
 
-class QString;
-class QStringList;
-
-class Json;
+class QTimer;
 class QSettings;
+class QFileSystemWatcher;
+
+/**
+ * data/config.json 解析后的配置，加载时一次性解析为字段，发布后不再修改
+ */
+struct ConfigSnapshot {
+    // 数据库
+    QString databaseType;
+    QString databaseHost;
+    QString databaseName;
+    QString databaseUsername;
+    QString databasePassword;
+    QString databaseTestOnBorrowSql;
+    bool    databaseTestOnBorrow = false;
+    int     databaseMaxWaitTime = 5000;
+    int     databaseMaxConnectionCount = 5;
+    int     databasePort = 0;
+    bool    databaseDebug = false;
+    QStringList databaseSqlFiles;
+
+    // UI
+    QStringList qssFiles;
+    QStringList fontFiles;
+    int layoutPadding = 10;
+    int layoutSpacing = 5;
+
+    // URLs
+    QString urlServer;             // urls.server
+    QHash<QString, QString> urls;  // Key 为 urls 下的名字，value 为加上 server 后的 url
+
+    bool signInWithFace = false;
+    bool debug = false;
+};
 
 /**
  * 用于读写配置文件:
  * 1. data/config.json: 存储配置的信息，例如数据库信息，QSS 文件的路径
  * 2. 读取配置，如 ConfigInstance.getDatabaseName();
+ *
+ * config.json 加载时解析为 ConfigSnapshot，读取配置只是访问它的字段，不再查找 JSON。
+ * 使用 QFileSystemWatcher 监视 config.json，修改后重新解析并替换当前的 ConfigSnapshot，然后发射 configChanged()。
+ * getXxx() 通过 snapshot() 取得当前配置的 QSharedPointer (只在加锁时复制指针，增加引用计数)，读取期间配置被替换也有效，
+ * 被替换的配置在最后一个读者释放引用后才释放。需要同时读取多个相关的配置时 (例如数据库的配置) 使用同一个 snapshot()
+ * 得到一致的值。
+ * 编辑器保存时可能连续修改多次，修改后等待 CONFIG_RELOAD_DELAY 毫秒没有新的修改才重新加载，
+ * 修改后的 config.json 无效时 (例如编辑器还没有写完) 继续使用原来的配置。
  */
-class Config {
+class Config : public QObject {
+    Q_OBJECT
     SINGLETON(Config)
 
 public:
+    QSharedPointer<const ConfigSnapshot> snapshot() const; // 当前的配置
+
+
     ////////////////////////////////////////////////////////////////////////////
     /// 数据库信息
     ////////////////////////////////////////////////////////////////////////////
@@ -70,7 +118,14 @@ public:
     // 是否调试模式
     bool isDebug() const;
 
+signals:
+    void configChanged(); // config.json 修改后重新加载完成时发射
+
 private:
+    void reload(); // 重新加载 config.json，成功时替换当前的配置
+    void publish(ConfigSnapshot *snapshot); // 替换当前的配置
+    static ConfigSnapshot* load(const QString &path); // 解析配置文件，无效时返回 nullptr
+
     QVariant getGuiValue(const  QString &groupName, const QString &name, const QVariant &def = QVariant());
     void     setGuiValue(const  QString &groupName, const QString &name, const QVariant &value);
 
@@ -79,7 +134,11 @@ private:
 
 
 private:
-    Json      *config; // 使用Qt的数据封装模式，数据封装在.cpp文件里，暴露给客户的信息尽量少
+    QSharedPointer<const ConfigSnapshot> currentShared; // 当前的配置，snapshot() 加锁读取，destroy() 后仍然有效
+    mutable QMutex mutex;
+    QFileSystemWatcher *watcher;
+    QTimer *reloadTimer; // 修改后延迟重新加载，合并编辑器保存时的多次修改
+    int reloadRetries;   // 编辑器删除后再创建文件时，文件不存在的重试次数
     QSettings *appSettings;
 };
 
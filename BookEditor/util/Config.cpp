@@ -1,13 +1,35 @@
 ﻿#include "Config.h"
 #include "Json.h"
 
+#include <QDebug>
+#include <QFile>
 #include <QString>
 #include <QStringList>
 #include <QSettings>
 #include <QTextCodec>
+#include <QFileSystemWatcher>
+#include <QTimer>
+
+static const char *CONFIG_FILE = "data/config.json"; // 配置文件路径
+static const int CONFIG_RELOAD_DELAY   = 300;   // 文件修改后延迟重新加载的时间，单位为毫秒
+static const int CONFIG_RELOAD_RETRIES = 10;    // 文件不存在时重试的次数
+
+Config::Config() : reloadRetries(0) {
+    // 第一次加载失败时也使用默认值的配置，保证 snapshot() 总是有效
+    ConfigSnapshot *snapshot = load(CONFIG_FILE);
+    publish((nullptr != snapshot) ? snapshot : new ConfigSnapshot());
+
+    reloadTimer = new QTimer(this);
+    reloadTimer->setSingleShot(true);
+    reloadTimer->setInterval(CONFIG_RELOAD_DELAY);
+    connect(reloadTimer, &QTimer::timeout, this, &Config::reload);
+
+    watcher = new QFileSystemWatcher(QStringList() << CONFIG_FILE, this);
+    connect(watcher, &QFileSystemWatcher::fileChanged, this, [this] {
+        reloadRetries = 0;
+        reloadTimer->start(); // 重新开始计时，合并连续的修改
+    });
 
-Config::Config() {
-    json = new Json("data/config.json", true); // 配置文件路径
     appSettings = new QSettings("data/app.data", QSettings::IniFormat);
     appSettings->setIniCodec(QTextCodec::codecForName("UTF8"));
 }
@@ -22,63 +44,149 @@ void Config::destroy() {
         appSettings->sync();
     }
 
-    delete json;
+    delete watcher;
+    delete reloadTimer;
     delete appSettings;
 
-    json = NULL;
+    watcher = NULL;
+    reloadTimer = NULL;
     appSettings = NULL;
 }
 
+// 当前的配置
+QSharedPointer<const ConfigSnapshot> Config::snapshot() const {
+    QMutexLocker locker(&mutex);
+    return currentShared;
+}
+
+// 替换当前的配置，被替换的配置在最后一个持有它的读者释放引用后才释放
+void Config::publish(ConfigSnapshot *snapshot) {
+    QSharedPointer<const ConfigSnapshot> shared(snapshot);
+    QSharedPointer<const ConfigSnapshot> old; // 没有读者持有时在锁外释放
+
+    {
+        QMutexLocker locker(&mutex);
+        old = currentShared;
+        currentShared = shared;
+    }
+}
+
+// 重新加载 config.json，成功时替换当前的配置
+void Config::reload() {
+    // 1. 编辑器保存时可能先删除再创建文件，文件不存在时稍后重试，QFileSystemWatcher 会不再监视它，需要重新加入
+    // 2. 解析配置文件，无效时继续使用原来的配置
+    // 3. 替换当前的配置
+    // 4. 发射 configChanged() 通知配置已经修改
+
+    // [1] 编辑器保存时可能先删除再创建文件，文件不存在时稍后重试，QFileSystemWatcher 会不再监视它，需要重新加入
+    if (!QFile::exists(CONFIG_FILE)) {
+        if (++reloadRetries <= CONFIG_RELOAD_RETRIES) {
+            reloadTimer->start();
+        } else {
+            qWarning() << QString("%1 does not exist, stop watching it").arg(CONFIG_FILE);
+        }
+
+        return;
+    }
+
+    if (!watcher->files().contains(CONFIG_FILE)) {
+        watcher->addPath(CONFIG_FILE);
+    }
+
+    // [2] 解析配置文件，无效时继续使用原来的配置
+    ConfigSnapshot *snapshot = load(CONFIG_FILE);
+
+    if (nullptr == snapshot) {
+        qWarning() << QString("%1 is invalid, keep using the previous config").arg(CONFIG_FILE);
+        return;
+    }
+
+    // [3] 替换当前的配置
+    publish(snapshot);
+
+    // [4] 发射 configChanged() 通知配置已经修改
+    qInfo() << QString("%1 reloaded").arg(CONFIG_FILE);
+    emit configChanged();
+}
+
+// 解析配置文件，无效时返回 nullptr
+ConfigSnapshot* Config::load(const QString &path) {
+    Json json(path, true);
+
+    if (!json.isValid()) {
+        return nullptr;
+    }
+
+    ConfigSnapshot *s = new ConfigSnapshot();
+
+    s->databaseType               = json.getString("database.type");
+    s->databaseHost               = json.getString("database.host");
+    s->databaseName               = json.getString("database.database_name");
+    s->databaseUsername           = json.getString("database.username");
+    s->databasePassword           = json.getString("database.password");
+    s->databaseTestOnBorrow       = json.getBool("database.test_on_borrow", false);
+    s->databaseTestOnBorrowSql    = json.getString("database.test_on_borrow_sql", "SELECT 1");
+    s->databaseMaxWaitTime        = json.getInt("database.max_wait_time", 5000);
+    s->databaseMaxConnectionCount = json.getInt("database.max_connection_count", 5);
+    s->databasePort               = json.getInt("database.port", 0);
+    s->databaseDebug              = json.getBool("database.debug", false);
+    s->databaseSqlFiles           = json.getStringList("database.sql_files");
+
+    s->qssFiles = json.getStringList("qss_files");
+
+    return s;
+}
+
 QString Config::getDatabaseType() const {
-    return json->getString("database.type");
+    return snapshot()->databaseType;
 }
 
 QString Config::getDatabaseHost() const {
-    return json->getString("database.host");
+    return snapshot()->databaseHost;
 }
 
 QString Config::getDatabaseName() const {
-    return json->getString("database.database_name");
+    return snapshot()->databaseName;
 }
 
 QString Config::getDatabaseUsername() const {
-    return json->getString("database.username");
+    return snapshot()->databaseUsername;
 }
 
 QString Config::getDatabasePassword() const {
-    return json->getString("database.password");
+    return snapshot()->databasePassword;
 }
 
 bool Config::getDatabaseTestOnBorrow() const {
-    return json->getBool("database.test_on_borrow", false);
+    return snapshot()->databaseTestOnBorrow;
 }
 
 QString Config::getDatabaseTestOnBorrowSql() const {
-    return json->getString("database.test_on_borrow_sql", "SELECT 1");
+    return snapshot()->databaseTestOnBorrowSql;
 }
 
 int Config::getDatabaseMaxWaitTime() const {
-    return json->getInt("database.max_wait_time", 5000);
+    return snapshot()->databaseMaxWaitTime;
 }
 
 int Config::getDatabaseMaxConnectionCount() const {
-    return json->getInt("database.max_connection_count", 5);
+    return snapshot()->databaseMaxConnectionCount;
 }
 
 int Config::getDatabasePort() const {
-    return json->getInt("database.port", 0);
+    return snapshot()->databasePort;
 }
 
 bool Config::isDatabaseDebug() const {
-    return json->getBool("database.debug", false);
+    return snapshot()->databaseDebug;
 }
 
 QStringList Config::getDatabaseSqlFiles() const {
-    return json->getStringList("database.sql_files");
+    return snapshot()->databaseSqlFiles;
 }
 
 QStringList Config::getQssFiles() const {
-    return json->getStringList("qss_files");
+    return snapshot()->qssFiles;
 }
 
 QString Config::getBooksDir() const {
@@ -21,7 +21,7 @@ VALUES
     <define id="fields">id, username, password, email, mobile</define>
 
     <sql id="findByUserId">
-        SELECT <include defineId="fields"/> FROM user WHERE id=%1
+        SELECT <include defineId="fields"/> FROM user WHERE id=:id
     </sql>
 
     <sql id="findAll">
@@ -37,4 +37,14 @@ VALUES
         UPDATE user SET username=:username, password=:password, email=:email, mobile=:mobile
         WHERE id=:id
     </sql>
+
+    <sql id="search">
+        SELECT <include defineId="fields"/> FROM user
+        <where>
+            <if test="username != null and username != ''">AND username = :username</if>
+            <if test="ids.size > 0">
+                AND id IN <foreach collection="ids" item="id" open="(" separator="," close=")">:id</foreach>
+            </if>
+        </where>
+    </sql>
 </sqls>
@@ -5,18 +5,23 @@
 
 const char * const SQL_NAMESPACE_USER = "User";
 
+// SQL 的句柄在第一次使用时取得，之后不再拼接和查找 namespace::id
 User UserDao::findByUserId(int id) {
-    QString sql = Singleton<Sqls>::getInstance().getSql(SQL_NAMESPACE_USER, "findByUserId").arg(id);
-    return DBUtil::selectBean(mapToUser, sql);
+    static const SqlHandle sql = Sqls::instance().handle(SQL_NAMESPACE_USER, "findByUserId");
+
+    QVariantMap params;
+    params["id"] = id;
+
+    return DBUtil::selectBean(mapToUser, sql, params);
 }
 
 QList<User> UserDao::findtAll() {
-    QString sql = Singleton<Sqls>::getInstance().getSql(SQL_NAMESPACE_USER, "findAll");
+    static const SqlHandle sql = Sqls::instance().handle(SQL_NAMESPACE_USER, "findAll");
     return DBUtil::selectBeans(mapToUser, sql);
 }
 
 int UserDao::insert(const User& user) {
-    QString sql = Singleton<Sqls>::getInstance().getSql(SQL_NAMESPACE_USER, "insert");
+    static const SqlHandle sql = Sqls::instance().handle(SQL_NAMESPACE_USER, "insert");
 
     QVariantMap params;
     params["username"] = user.username;
@@ -28,7 +33,7 @@ int UserDao::insert(const User& user) {
 }
 
 bool UserDao::update(const User& user) {
-    QString sql = Singleton<Sqls>::getInstance().getSql(SQL_NAMESPACE_USER, "update");
+    static const SqlHandle sql = Sqls::instance().handle(SQL_NAMESPACE_USER, "update");
 
     QVariantMap params;
     params["id"]       = user.id;
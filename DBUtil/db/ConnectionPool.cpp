@@ -1,9 +1,16 @@
 #include "ConnectionPool.h"
+#include "StatementCache.h"
 #include "util/Config.h"
 
 #include <QDebug>
+#include <QHash>
+#include <QSet>
 #include <QString>
 #include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QDateTime>
+#include <QElapsedTimer>
 #include <QCoreApplication>
 
 /*-----------------------------------------------------------------------------|
@@ -13,6 +20,25 @@ class ConnectionPoolPrivate {
 public:
     ConnectionPoolPrivate();
 
+    /**
+     * @brief 连接池中的连接的状态，连接本身由 QSqlDatabase 按连接名管理
+     */
+    struct Connection {
+        QThread *thread     = nullptr; // 创建连接的线程，连接只能在这个线程中使用
+        int      borrowed   = 0;       // 借出的次数，为 0 时连接空闲
+        bool     opening    = false;   // 正在创建连接 (已占用名额，创建时不加锁)
+        qint64   createdAt  = 0;       // 创建的时间，单位毫秒
+        qint64   returnedAt = 0;       // 最后一次归还的时间，单位毫秒
+        bool     evicted    = false;   // 待关闭，不再借出，由创建它的线程关闭，关闭前仍然占用名额
+    };
+
+    // 连接只能在创建它的线程中关闭 (包括删除它的预编译语句)，其他线程的连接只标记为待关闭，
+    // 由创建它的线程在下次借连接时或者线程结束时关闭，关闭前仍然占用名额，所以打开的连接数不会超过上限
+    QStringList takeExpired(qint64 now);        // 取出当前线程空闲超时或者超过生命周期的空闲连接的名字，其他线程的标记为待关闭，调用前需要加锁
+    bool evictLeastRecentlyUsedIdle();          // 把其他线程最久没有使用的空闲连接标记为待关闭，调用前需要加锁
+    void closeConnections(const QStringList &names); // 关闭当前线程的连接，调用时不能加锁，因为 removeDatabase 比较慢
+    void watchThread(QThread *thread);          // 线程结束时关闭它创建的连接，调用前需要加锁
+
     // 数据库信息
     QString hostName;
     QString databaseName;
@@ -23,6 +49,20 @@ public:
 
     bool    testOnBorrow;    // 取得连接的时候验证连接有效
     QString testOnBorrowSql; // 测试访问数据库的 SQL
+
+    int maxConnectionCount; // 最大连接数
+    int maxWaitTime;        // 借连接时最长等待的时间
+    int maxIdleTime;        // 空闲连接的最长空闲时间
+    int maxLifetime;        // 连接最长使用的时间
+    int validationInterval; // 空闲超过这个时间的连接借出前先验证
+    int statementCacheSize; // 每个连接缓存的预编译语句数
+
+    QMutex mutex;
+    QWaitCondition released;             // 有连接被归还或者关闭时通知等待的线程
+    QHash<QString, Connection> connections; // key 为连接的全名
+    QSet<QThread *> watchedThreads;      // 已经监听了 finished 信号的线程
+    QHash<QString, StatementCache *> statementCaches; // 连接的预编译语句缓存，key 为连接的全名
+    ConnectionPoolStats counters;        // 累计的统计信息，total、active、idle 在 stats() 中计算
 };
 
 ConnectionPoolPrivate::ConnectionPoolPrivate() {
@@ -37,6 +77,111 @@ ConnectionPoolPrivate::ConnectionPoolPrivate() {
     port            = config.getDatabasePort();
     testOnBorrow    = config.getDatabaseTestOnBorrow();
     testOnBorrowSql = config.getDatabaseTestOnBorrowSql();
+
+    maxConnectionCount = qMax(1, config.getDatabaseMaxConnectionCount());
+    maxWaitTime        = config.getDatabaseMaxWaitTime();
+    maxIdleTime        = config.getDatabaseMaxIdleTime();
+    maxLifetime        = config.getDatabaseMaxLifetime();
+    validationInterval = config.getDatabaseValidationInterval();
+    statementCacheSize = config.getDatabaseStatementCacheSize();
+}
+
+// 取出当前线程空闲超时或者超过生命周期的空闲连接的名字，其他线程的标记为待关闭
+QStringList ConnectionPoolPrivate::takeExpired(qint64 now) {
+    QThread *current = QThread::currentThread();
+    QStringList names;
+
+    for (auto iter = connections.begin(); iter != connections.end();) {
+        Connection &c = iter.value();
+        bool idle    = c.borrowed == 0 && !c.opening;
+        bool expired = c.evicted
+                    || (maxIdleTime > 0 && now - c.returnedAt >= maxIdleTime)
+                    || (maxLifetime > 0 && now - c.createdAt  >= maxLifetime);
+
+        if (idle && expired && c.thread == current) {
+            names << iter.key();
+            iter = connections.erase(iter);
+        } else {
+            c.evicted = c.evicted || (idle && expired);
+            ++iter;
+        }
+    }
+
+    return names;
+}
+
+// 把其他线程最久没有使用的空闲连接标记为待关闭
+bool ConnectionPoolPrivate::evictLeastRecentlyUsedIdle() {
+    QThread *current = QThread::currentThread();
+    auto lru = connections.end();
+
+    for (auto iter = connections.begin(); iter != connections.end(); ++iter) {
+        const Connection &c = iter.value();
+
+        if (c.thread != current && c.borrowed == 0 && !c.opening && !c.evicted
+                && (lru == connections.end() || c.returnedAt < lru.value().returnedAt)) {
+            lru = iter;
+        }
+    }
+
+    if (lru == connections.end()) {
+        return false;
+    }
+
+    lru.value().evicted = true;
+    return true;
+}
+
+// 关闭连接
+void ConnectionPoolPrivate::closeConnections(const QStringList &names) {
+    for (const QString &name : names) {
+        // 先释放预编译的语句，它们引用着连接的驱动
+        mutex.lock();
+        StatementCache *cache = statementCaches.take(name);
+        mutex.unlock();
+        delete cache;
+
+        if (QSqlDatabase::contains(name)) {
+            QSqlDatabase::removeDatabase(name);
+            qDebug().noquote() << QString("Connection deleted: %1").arg(name);
+        }
+    }
+
+    if (!names.isEmpty()) {
+        QMutexLocker locker(&mutex);
+        counters.closed += names.size();
+        released.wakeAll();
+    }
+}
+
+// 线程结束时关闭它创建的连接
+void ConnectionPoolPrivate::watchThread(QThread *thread) {
+    if (qApp == nullptr || watchedThreads.contains(thread)) {
+        return;
+    }
+
+    watchedThreads.insert(thread);
+
+    // DirectConnection: 在结束的线程中执行，连接在创建它的线程中关闭
+    QObject::connect(thread, &QThread::finished, qApp, [this, thread] {
+        QStringList names;
+
+        {
+            QMutexLocker locker(&mutex);
+            watchedThreads.remove(thread);
+
+            for (auto iter = connections.begin(); iter != connections.end();) {
+                if (iter.value().thread == thread && !iter.value().opening) {
+                    names << iter.key();
+                    iter = connections.erase(iter);
+                } else {
+                    ++iter;
+                }
+            }
+        }
+
+        closeConnections(names);
+    }, Qt::DirectConnection);
 }
 
 /*-----------------------------------------------------------------------------|
@@ -49,54 +194,239 @@ ConnectionPool::~ConnectionPool() {
     delete d;
 }
 
-// 获取数据库连接
-QSqlDatabase ConnectionPool::openConnection(const QString &connectionName) {
+// 借出当前线程的数据库连接
+QSqlDatabase ConnectionPool::borrowConnection(int timeoutMs, const QString &connectionName) {
     // 1. 创建连接的全名: 基于线程的地址和传入进来的 connectionName，因为同一个线程可能申请创建多个数据库连接
-    // 2. 如果连接已经存在，复用它，而不是重新创建
-    //    2.1 返回连接前访问数据库，如果连接断开，可以重新建立连接 (测试: 关闭数据库几分钟后再启动，再次访问数据库)
-    // 3. 如果连接不存在，则创建连接
-    // 4. 线程结束时，释放在此线程中创建的数据库连接
+    // 2. 关闭空闲超时和超过生命周期的连接，然后循环直到借到连接或者超时:
+    //    2.1 当前线程已经借出了连接时直接返回这个连接 (可重入)
+    //    2.2 当前线程有空闲的连接时借出它，需要时先验证连接 (测试: 关闭数据库几分钟后再启动，再次访问数据库)
+    //    2.3 连接数没有达到上限时创建新的连接
+    //    2.4 达到上限时把其他线程最久没有使用的一个空闲连接标记为待关闭，它被创建它的线程关闭后才腾出名额
+    //    2.5 等待其他线程归还或者关闭连接，超时则借连接失败
 
     // [1] 创建连接的全名: 基于线程的地址和传入进来的 connectionName，因为同一个线程可能申请创建多个数据库连接
-    QString baseConnectionName = "conn_" + QString::number(quint64(QThread::currentThread()), 16);
+    QThread *thread = QThread::currentThread();
+    QString baseConnectionName = "conn_" + QString::number(quint64(thread), 16);
     QString fullConnectionName = baseConnectionName + connectionName;
 
-    if (QSqlDatabase::contains(fullConnectionName)) {
-        // [2] 如果连接已经存在，复用它，而不是重新创建
-        QSqlDatabase existingDb = QSqlDatabase::database(fullConnectionName);
+    int waitTime = timeoutMs < 0 ? d->maxWaitTime : timeoutMs;
+    QElapsedTimer timer;
+    timer.start();
+    bool waited  = false;
+    bool evicted = false; // 每次借连接最多标记一个其他线程的连接为待关闭
+
+    // [2] 关闭空闲超时和超过生命周期的连接
+    QMutexLocker locker(&d->mutex);
+    QStringList expired = d->takeExpired(QDateTime::currentMSecsSinceEpoch());
+
+    if (!expired.isEmpty()) {
+        locker.unlock();
+        d->closeConnections(expired);
+        locker.relock();
+    }
+
+    while (true) {
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        auto iter  = d->connections.find(fullConnectionName);
+
+        if (iter != d->connections.end() && iter.value().evicted) {
+            // 当前线程的连接被其他线程标记为待关闭 (空闲的)，在当前线程关闭后重新检查
+            d->connections.erase(iter);
+            locker.unlock();
+            d->closeConnections(QStringList() << fullConnectionName);
+            locker.relock();
+            continue;
+        } else if (iter != d->connections.end() && iter.value().borrowed > 0) {
+            // [2.1] 当前线程已经借出了连接时直接返回这个连接 (可重入)
+            ++iter.value().borrowed;
+            return QSqlDatabase::database(fullConnectionName, false);
+        } else if (iter != d->connections.end()) {
+            // [2.2] 当前线程有空闲的连接时借出它，需要时先验证连接
+            bool validate = d->testOnBorrow && now - iter.value().returnedAt >= d->validationInterval;
+            iter.value().borrowed = 1;
+            d->counters.borrows     += 1;
+            d->counters.validations += validate ? 1 : 0;
+            locker.unlock();
+
+            QSqlDatabase db = QSqlDatabase::database(fullConnectionName, false);
+
+            if (validate && !validateConnection(db)) {
+                // 连接已经断开并且不能重新连接，关闭它而不是放回连接池
+                db = QSqlDatabase();
+                locker.relock();
+                d->connections.remove(fullConnectionName);
+                locker.unlock();
+                d->closeConnections(QStringList() << fullConnectionName);
+                return QSqlDatabase();
+            }
 
-        if (d->testOnBorrow) {
-            // [2.1] 返回连接前访问数据库，如果连接断开，可以重新建立连接 (测试: 关闭数据库几分钟后再启动，再次访问数据库)
-            qDebug().noquote() << QString("Test connection on borrow, execute: %1, for connection %2")
-                                  .arg(d->testOnBorrowSql).arg(fullConnectionName);
-            QSqlQuery query(d->testOnBorrowSql, existingDb);
+            return db;
+        } else if (d->connections.size() < d->maxConnectionCount) {
+            // [2.3] 连接数没有达到上限时创建新的连接，创建连接比较慢，先占用名额，创建时不加锁
+            ConnectionPoolPrivate::Connection &c = d->connections[fullConnectionName];
+            c.thread    = thread;
+            c.borrowed  = 1;
+            c.opening   = true;
+            c.createdAt = now;
+            locker.unlock();
 
-            if (query.lastError().type() != QSqlError::NoError && !existingDb.open()) {
-                qDebug().noquote() << "Open datatabase error:" << existingDb.lastError().text();
+            QSqlDatabase db = createConnection(fullConnectionName);
+            locker.relock();
+
+            if (!db.isValid()) {
+                d->connections.remove(fullConnectionName);
+                d->released.wakeAll();
+                locker.unlock();
+
+                QSqlDatabase::removeDatabase(fullConnectionName);
                 return QSqlDatabase();
             }
+
+            d->connections[fullConnectionName].opening = false;
+            d->counters.borrows += 1;
+            d->counters.created += 1;
+            d->watchThread(thread);
+
+            return db;
         }
 
-        return existingDb;
-    } else {
-        // [3] 如果连接不存在，则创建连接
-        if (qApp != nullptr) {
-            // [4] 线程结束时，释放在此线程中创建的数据库连接
-            QObject::connect(QThread::currentThread(), &QThread::finished, qApp, [fullConnectionName] {
-                if (QSqlDatabase::contains(fullConnectionName)) {
-                    QSqlDatabase::removeDatabase(fullConnectionName);
-                    qDebug().noquote() << QString("Connection deleted: %1").arg(fullConnectionName);
-                }
-            });
+        // [2.4] 达到上限时把其他线程最久没有使用的一个空闲连接标记为待关闭，它被创建它的线程关闭后才腾出名额
+        if (!evicted) {
+            evicted = d->evictLeastRecentlyUsedIdle();
         }
 
-        return createConnection(fullConnectionName);
+        // [2.5] 等待其他线程归还或者关闭连接，超时则借连接失败
+        qint64 remaining = waitTime - timer.elapsed();
+
+        if (!waited) {
+            waited = true;
+            d->counters.waits += 1;
+        }
+
+        if (remaining <= 0 || !d->released.wait(&d->mutex, quint64(remaining))) {
+            d->counters.timeouts += 1;
+            qDebug().noquote() << QString("Borrow connection timeout after %1 ms, max connection count: %2")
+                                  .arg(timer.elapsed()).arg(d->maxConnectionCount);
+            return QSqlDatabase();
+        }
+    }
+}
+
+// 归还借出的连接
+void ConnectionPool::returnConnection(const QSqlDatabase &db) {
+    returnConnection(db.connectionName());
+}
+
+// 归还借出的连接
+void ConnectionPool::returnConnection(const QString &connectionName) {
+    // 1. 借出次数减 1，还有借出 (可重入) 时直接返回
+    // 2. 连接超过生命周期时关闭它，否则记录归还的时间
+    // 3. 通知等待的线程
+
+    QMutexLocker locker(&d->mutex);
+    auto iter = d->connections.find(connectionName);
+
+    // [1] 借出次数减 1，还有借出 (可重入) 时直接返回
+    if (iter == d->connections.end() || iter.value().borrowed <= 0 || --iter.value().borrowed > 0) {
+        return;
+    }
+
+    // [2] 连接超过生命周期时关闭它，否则记录归还的时间
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    if (d->maxLifetime > 0 && now - iter.value().createdAt >= d->maxLifetime) {
+        d->connections.erase(iter);
+        locker.unlock();
+        d->closeConnections(QStringList() << connectionName);
+        return;
+    }
+
+    iter.value().returnedAt = now;
+
+    // [3] 通知等待的线程
+    d->released.wakeAll();
+}
+
+// 获取数据库连接
+QSqlDatabase ConnectionPool::openConnection(const QString &connectionName) {
+    // 借出后不归还，线程结束时连接被关闭
+    return borrowConnection(-1, connectionName);
+}
+
+// 在当前线程中预先创建空闲的连接
+bool ConnectionPool::warmUp(const QString &connectionName) {
+    QSqlDatabase db = borrowConnection(-1, connectionName);
+    bool valid = db.isValid();
+    QString name = db.connectionName();
+    db = QSqlDatabase();
+
+    if (valid) {
+        returnConnection(name);
+    }
+
+    return valid;
+}
+
+// 获取连接的预编译语句缓存
+StatementCache* ConnectionPool::statementCache(const QSqlDatabase &db) {
+    QMutexLocker locker(&d->mutex);
+    StatementCache *&cache = d->statementCaches[db.connectionName()];
+
+    if (cache == nullptr) {
+        cache = new StatementCache(db, d->statementCacheSize);
     }
+
+    return cache;
+}
+
+// 获取连接池的统计信息
+ConnectionPoolStats ConnectionPool::stats() {
+    QMutexLocker locker(&d->mutex);
+    ConnectionPoolStats result = d->counters;
+    result.total = d->connections.size();
+
+    for (const ConnectionPoolPrivate::Connection &c : d->connections) {
+        result.active += c.borrowed > 0 ? 1 : 0;
+    }
+
+    result.idle = result.total - result.active;
+
+    return result;
+}
+
+// 验证连接，连接断开时重新建立连接
+bool ConnectionPool::validateConnection(QSqlDatabase &db) {
+    qDebug().noquote() << QString("Test connection on borrow, execute: %1, for connection %2")
+                          .arg(d->testOnBorrowSql).arg(db.connectionName());
+    QSqlQuery query(d->testOnBorrowSql, db);
+
+    if (query.lastError().type() == QSqlError::NoError) {
+        return true;
+    }
+
+    // 重新连接前释放预编译的语句，它们在断开的连接上已经无效
+    query = QSqlQuery();
+    d->mutex.lock();
+    StatementCache *cache = d->statementCaches.value(db.connectionName());
+    d->mutex.unlock();
+
+    if (cache != nullptr) {
+        cache->clear();
+    }
+
+    db.close();
+
+    if (!db.open()) {
+        qDebug().noquote() << "Open datatabase error:" << db.lastError().text();
+        return false;
+    }
+
+    return true;
 }
 
 // 创建数据库连接
 QSqlDatabase ConnectionPool::createConnection(const QString &connectionName) {
-    static int sn = 0;
+    static QAtomicInt sn;
 
     // 创建一个新的数据库连接
     QSqlDatabase db = QSqlDatabase::addDatabase(d->databaseType, connectionName);
@@ -118,3 +448,28 @@ QSqlDatabase ConnectionPool::createConnection(const QString &connectionName) {
     }
 }
 
+/*-----------------------------------------------------------------------------|
+ |                            ScopedConnection 的定义                           |
+ |----------------------------------------------------------------------------*/
+ScopedConnection::ScopedConnection(int timeoutMs, const QString &connectionName) {
+    db = ConnectionPool::instance().borrowConnection(timeoutMs, connectionName);
+}
+
+ScopedConnection::~ScopedConnection() {
+    if (db.isValid()) {
+        // 先释放 db 再归还，归还时连接可能被关闭，关闭时不能还有 QSqlDatabase 引用它
+        QString name = db.connectionName();
+        db = QSqlDatabase();
+        ConnectionPool::instance().returnConnection(name);
+    }
+}
+
+// 借出的连接
+QSqlDatabase ScopedConnection::database() const {
+    return db;
+}
+
+// 是否借到了有效的连接
+bool ScopedConnection::isValid() const {
+    return db.isValid();
+}
@@ -7,29 +7,47 @@
 #include "util/Singleton.h"
 
 /**
- * 实现一个简易的数据库连接池，简化数据库连接的获取和释放。连接使用完后不需要手动关闭，数据库连接池会在使用此连接的线程结束后自动关闭连接。
+ * 数据库连接池，限制同时打开的连接数，简化数据库连接的获取和释放。
  *
- * 由于安全的原因，大概是 Qt 5.4 以后一个线程创建的连接不允许在其他线程中使用 (早一些的版本可以)。一个线程内的函数执行总是串行的，
- * 绝大多数时候一个线程内使用一个数据库连接就可以了，特殊情况下需要多个连接时传入不同的连接名可以获取到不同的数据库连接。
+ * 由于安全的原因，大概是 Qt 5.4 以后一个线程创建的连接不允许在其他线程中使用 (早一些的版本可以)，
+ * 所以连接池中的每个连接都属于创建它的线程，线程借连接时:
+ * 1. 当前线程已经借出了连接时直接返回这个连接 (可重入，嵌套调用 DBUtil 和事务中使用的是同一个连接)
+ * 2. 当前线程有空闲的连接时借出它，空闲超过 validationInterval 并且 testOnBorrow 为 true 时先验证连接，
+ *    不再每次借出都访问一次数据库
+ * 3. 连接数没有达到上限 maxConnectionCount 时创建新的连接
+ * 4. 达到上限时把其他线程最久没有使用的空闲连接标记为待关闭。连接只能在创建它的线程中关闭，
+ *    待关闭的连接由创建它的线程在下次借连接时或者线程结束时关闭，关闭前仍然占用名额
+ * 5. 等待其他线程归还或者关闭连接，超过 maxWaitTime 毫秒后借连接失败，返回无效的连接
  *
- * Qt 程序一般不需要去控制连接数，有以下理由:
- * 1. Qt 程序一般都是客户端的桌面程序，同一个程序中不太可能同时创建很多数据库连接，例如 100 个，如果真有，那么就可以考虑下设计是否合理
- * 2. Qt 很少用来开发服务器端程序，访问数据库向前端提供服务
- * 3. Qt 程序可能访问本地的 Sqlite 数据库的情况更多一些，作为客户端时直接访问远程的 MySQL 等安全上时不允许的，数据库一般都不允许外网访问
- * 基于上面的这些原因，一个简单的数据库连接池就能够满足大多数 Qt 程序的需求了。
+ * 空闲超过 maxIdleTime 或者创建后超过 maxLifetime 的连接在借出、归还时被关闭 (其他线程的标记为待关闭)，线程结束时关闭它创建的连接。
+ * 例如 64 个线程的 QThreadPool 访问数据库时，同时打开的 MySQL 连接不会超过 maxConnectionCount 个。
+ * 大量线程轮流访问数据库时，借连接的线程要等待其他线程再次借连接或者结束时关闭空闲的连接，连接在线程之间被关闭和重新创建，
+ * 等待超过 maxWaitTime 时借连接失败，这种情况推荐使用 DBExecutor 在固定的几个线程中访问数据库。
  *
  * 使用方法:
- * 1. 从数据库连接池里取得连接
- *    QSqlDatabase db = ConnectionPool::instance().openConnection();
+ * 1. 推荐使用 ScopedConnection 借连接，离开作用域时自动归还:
+ *    ScopedConnection conn;
+ *    QSqlQuery query(conn.database());
+ *
+ * 2. 手动借和还:
+ *    QSqlDatabase db = ConnectionPool::instance().borrowConnection();
+ *    ...
+ *    ConnectionPool::instance().returnConnection(db);
  *
- * 2. 使用 db 访问数据库，如
- *    QSqlQuery query(db);
+ * 3. 兼容以前的用法，openConnection() 借出的连接在线程结束时才归还:
+ *    QSqlDatabase db = ConnectionPool::instance().openConnection();
  *
- * 3. 数据库连接使用完后啥都不用管，不需要我们调用 QSqlDatabase::removeDatabase(ConnectionName) 进行关闭
+ * 程序启动时可以调用 warmUp() 在主线程预先创建连接，配置项 (config.json 的 database 下):
+ *     max_connection_count: 最大连接数，默认 5
+ *     max_wait_time       : 借连接时最长等待的时间，单位毫秒，默认 5000
+ *     max_idle_time       : 空闲连接的最长空闲时间，单位毫秒，默认 10 分钟
+ *     max_lifetime        : 连接最长使用的时间，单位毫秒，默认 30 分钟，小于数据库的 wait_timeout
+ *     validation_interval : 空闲超过这个时间的连接借出前先验证，单位毫秒，默认 30 秒，为 0 时每次借出都验证
+ *     statement_cache_size: 每个连接缓存的预编译语句数，默认 64，为 0 时不缓存
  *
  * 关于 testOnBorrow 的说明:
  *     如果 testOnBorrow 为 true，则连接断开后会自动重新连接 (例如数据库程序崩溃了，网络的原因导致连接断了等)，
- *     但是每次获取连接的时候都会先访问一下数据库测试连接是否有效，如果无效则重新建立连接。testOnBorrow 为 true 时，
+ *     空闲超过 validationInterval 的连接借出前先访问一下数据库测试连接是否有效，如果无效则重新建立连接。testOnBorrow 为 true 时，
  *     需要提供一条 SQL 语句用于测试查询，例如 MySQL 下可以用 SELECT 1 FROM dual，SQLite 可以使用 SELECT 1。
  *
  *     如果 testOnBorrow 为 false，则连接断开后不会自动重新连接，这时获取到的连接调用 QSqlDatabase::isOpen() 返回的值
@@ -37,25 +55,118 @@
  */
 
 class QSqlDatabase;
+class StatementCache;
 class ConnectionPoolPrivate;
 
+/**
+ * @brief 连接池的统计信息
+ */
+struct ConnectionPoolStats {
+    int    total       = 0; // 打开的连接数
+    int    active      = 0; // 借出的连接数
+    int    idle        = 0; // 空闲的连接数
+    qint64 borrows     = 0; // 累计借出的次数 (不包括可重入的借出)
+    qint64 waits       = 0; // 因为连接数达到上限而等待的次数
+    qint64 timeouts    = 0; // 等待超时借连接失败的次数
+    qint64 created     = 0; // 累计创建的连接数
+    qint64 closed      = 0; // 累计关闭的连接数 (空闲超时、超过生命周期、为其他线程腾出位置、线程结束)
+    qint64 validations = 0; // 累计验证连接的次数
+};
+
 class ConnectionPool {
     SINGLETON(ConnectionPool)
 
 public:
     /**
-     * @brief 获取数据库连接，连接使用完后不需要手动关闭，数据库连接池会在使用此连接的线程结束后自动关闭连接。
+     * @brief 借出当前线程的数据库连接，使用完后需要调用 returnConnection() 归还，推荐使用 ScopedConnection。
+     *        同一个线程可以多次借出同一个连接 (可重入)，借几次就需要还几次
+     *
+     * @param timeoutMs      连接数达到上限时最长等待的时间，单位为毫秒，-1 表示使用配置的 max_wait_time
+     * @param connectionName 连接的名字，同一个线程需要同时使用多个不同的数据库连接时传入不同的名字
+     * @return 返回数据库连接，失败时返回无效的连接 (isValid() 为 false)
+     */
+    QSqlDatabase borrowConnection(int timeoutMs = -1, const QString &connectionName = QString());
+
+    /**
+     * @brief 归还借出的连接
+     *
+     * @param db 借出的连接
+     */
+    void returnConnection(const QSqlDatabase &db);
+
+    /**
+     * @brief 归还借出的连接，归还后不要再使用这个连接
+     *
+     * @param connectionName 借出的连接的名字 QSqlDatabase::connectionName()
+     */
+    void returnConnection(const QString &connectionName);
+
+    /**
+     * @brief 获取数据库连接，连接使用完后不需要手动关闭，数据库连接池会在使用此连接的线程结束后自动归还和关闭连接。
      * 传入的连接名 connectionName 默认为空 (内部会为连接名基于线程的信息创建一个唯一的前缀)，
      * 如果同一个线程需要使用多个不同的数据库连接，可以传入不同的 connectionName
      *
+     * 注意: 借出的连接在线程结束前一直占用连接池的名额，长时间运行的线程请使用 borrowConnection() 或者 ScopedConnection
+     *
      * @param connectionName 连接的名字
      * @return 返回数据库连接
      */
     QSqlDatabase openConnection(const QString &connectionName = QString());
 
+    /**
+     * @brief 在当前线程中预先创建空闲的连接，例如程序启动时或者访问数据库的工作线程启动时，避免第一次访问数据库时等待建立连接。
+     *        连接只能在创建它的线程中使用，所以每个线程只需要预先创建一个连接
+     *
+     * @param connectionName 连接的名字
+     * @return 创建成功或者连接已经存在返回 true，否则返回 false
+     */
+    bool warmUp(const QString &connectionName = QString());
+
+    /**
+     * @brief 获取连接的预编译语句缓存，只能在借出连接的线程中使用，连接关闭时缓存被释放
+     *
+     * @param db 借出的连接
+     * @return 返回连接的预编译语句缓存
+     */
+    StatementCache* statementCache(const QSqlDatabase &db);
+
+    /**
+     * @brief 获取连接池的统计信息
+     */
+    ConnectionPoolStats stats();
+
 private:
     QSqlDatabase createConnection(const QString &connectionName); // 创建数据库连接
+    bool validateConnection(QSqlDatabase &db); // 验证连接，连接断开时重新建立连接
     ConnectionPoolPrivate *d;
 };
 
+/**
+ * @brief 从连接池借出当前线程的连接，离开作用域时自动归还 (RAII)
+ *
+ * 使用方法:
+ *     ScopedConnection conn;
+ *     if (conn.isValid()) {
+ *         QSqlQuery query(conn.database());
+ *     }
+ */
+class ScopedConnection {
+public:
+    /**
+     * @param timeoutMs      连接数达到上限时最长等待的时间，单位为毫秒，-1 表示使用配置的 max_wait_time
+     * @param connectionName 连接的名字
+     */
+    explicit ScopedConnection(int timeoutMs = -1, const QString &connectionName = QString());
+    ~ScopedConnection();
+
+    ScopedConnection(const ScopedConnection &other) = delete;
+    ScopedConnection& operator=(const ScopedConnection &other) = delete;
+
+    QSqlDatabase database() const; // 借出的连接
+    bool isValid() const;          // 是否借到了有效的连接
+
+private:
+    QSqlDatabase db;
+};
+
 #endif // CONNECTIONPOOL_H
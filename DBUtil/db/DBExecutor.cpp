@@ -0,0 +1,61 @@
+#include "DBExecutor.h"
+#include "util/Config.h"
+
+#include <QTimer>
+#include <QThreadPool>
+#include <QCoreApplication>
+
+// 当前线程正在执行的任务，DBExecutor::isCanceled() 使用
+static thread_local const QFutureInterfaceBase *currentTask = nullptr;
+
+DBExecutor::DBExecutor() : threadPool(new QThreadPool()) {
+    // 线程数为最大连接数减 1，留一个连接给 GUI 线程，线程不过期，每个线程一直使用自己的连接
+    threadPool->setMaxThreadCount(qMax(1, Config::instance().getDatabaseMaxConnectionCount() - 1));
+    threadPool->setExpiryTimeout(-1);
+
+    // 程序退出前等待任务执行完，参考 Singleton 的说明
+    if (qApp != nullptr) {
+        QObject::connect(qApp, &QCoreApplication::aboutToQuit, [this] {
+            threadPool->clear();
+            threadPool->waitForDone();
+        });
+    }
+}
+
+DBExecutor::~DBExecutor() {
+    threadPool->waitForDone();
+    delete threadPool;
+}
+
+// 判断当前任务是否已经被取消或者超时
+bool DBExecutor::isCanceled() {
+    return currentTask != nullptr && currentTask->isCanceled();
+}
+
+// 等待所有的任务执行完
+bool DBExecutor::waitForDone(int msecs) {
+    return threadPool->waitForDone(msecs);
+}
+
+// 把任务放到线程池中执行
+void DBExecutor::start(QRunnable *task) {
+    threadPool->start(task);
+}
+
+// 在主线程中启动超时的定时器
+void DBExecutor::startDeadline(QDeadlineTimer deadline, std::function<void ()> timeout) {
+    if (qApp == nullptr) {
+        return;
+    }
+
+    // 调用 run() 的线程不一定有事件循环，所以定时器在主线程中创建，
+    // 主线程忙时 invokeMethod 会延迟执行，所以定时器只等待剩下的时间，超时仍然从调用 run() 开始计算
+    QMetaObject::invokeMethod(qApp, [deadline, timeout] {
+        QTimer::singleShot(int(qMax<qint64>(0, deadline.remainingTime())), qApp, timeout);
+    });
+}
+
+// 设置当前线程正在执行的任务
+void DBExecutor::setCurrentTask(const QFutureInterfaceBase *task) {
+    currentTask = task;
+}
@@ -0,0 +1,206 @@
+#ifndef DBEXECUTOR_H
+#define DBEXECUTOR_H
+
+#include "util/Singleton.h"
+
+#include <QObject>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QFutureInterface>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include <QDeadlineTimer>
+#include <functional>
+
+class QThreadPool;
+
+/**
+ * 在工作线程中异步访问数据库，避免在 GUI 线程中执行慢的 SQL 时界面卡住。
+ *
+ * 工作线程的数量为连接池的最大连接数 max_connection_count 减 1 (至少 1 个)，留一个连接给 GUI 线程，
+ * 否则工作线程占满所有连接时，GUI 线程中直接调用 DBUtil 会阻塞最多 max_wait_time 毫秒等待连接。
+ * max_connection_count 为 1 时 GUI 线程和工作线程共用一个连接，GUI 线程仍然可能等待。
+ * 线程不会过期退出，每个线程一直使用自己的连接，所以不会因为连接只能在创建它的线程中使用而在线程之间反复关闭和创建连接。
+ *
+ * 使用方法:
+ * 1. 返回 QFuture，可以用 QFutureWatcher 监听:
+ *    QFuture<QList<User>> future = DBExecutor::instance().run<QList<User>>([] {
+ *        return UserDao::findtAll();
+ *    });
+ *
+ * 2. 在 context 所在的线程中 (一般是 GUI 线程) 调用 callback，context 被删除后不再调用:
+ *    DBExecutor::instance().run<QList<User>>([] {
+ *        return UserDao::findtAll();
+ *    }, this, [this](const QFuture<QList<User>> &future) {
+ *        if (!future.isCanceled()) {
+ *            showUsers(future.result());
+ *        }
+ *    }, 3000);
+ *
+ * 取消和超时:
+ *     1. 调用 future.cancel() 或者超过 deadlineMs 还没有执行完时任务被取消，还在排队的任务不会执行
+ *     2. 超时时 future 立即结束 (isCanceled() 为 true)，不用等待正在执行的 SQL，它的结果会被丢弃
+ *     3. 正在执行的任务可以调用 DBExecutor::isCanceled() 判断是否已经被取消，例如在 DBUtil::forEach() 中提前结束遍历
+ */
+class DBExecutor {
+    SINGLETON(DBExecutor)
+
+public:
+    /**
+     * @brief 在工作线程中执行访问数据库的任务
+     *
+     * @param task       访问数据库的任务，在工作线程中执行
+     * @param deadlineMs 超时时间，单位为毫秒，从调用此函数开始计时 (包括排队的时间)，小于等于 0 时不超时
+     * @return 返回任务的 future
+     */
+    template <typename T>
+    QFuture<T> run(std::function<T ()> task, int deadlineMs = 0);
+
+    /**
+     * @brief 在工作线程中执行访问数据库的任务，结束后在 context 所在的线程中调用 callback，需要在 context 所在的线程中调用此函数
+     *
+     * @param task       访问数据库的任务，在工作线程中执行
+     * @param context    callback 的上下文，被删除后不再调用 callback
+     * @param callback   任务结束 (包括取消和超时) 后调用的函数，参数为任务的 future
+     * @param deadlineMs 超时时间，单位为毫秒，小于等于 0 时不超时
+     * @return 返回任务的 future
+     */
+    template <typename T>
+    QFuture<T> run(std::function<T ()> task, QObject *context,
+                   std::function<void (const QFuture<T> &future)> callback, int deadlineMs = 0);
+
+    /**
+     * @brief 在工作线程中执行的任务里调用，判断当前任务是否已经被取消或者超时
+     *
+     * @return 已经被取消或者超时返回 true，不在任务中调用时返回 false
+     */
+    static bool isCanceled();
+
+    /**
+     * @brief 等待所有的任务执行完
+     *
+     * @param msecs 最长等待的时间，单位为毫秒，-1 表示一直等待
+     * @return 所有任务都执行完返回 true，超时返回 false
+     */
+    bool waitForDone(int msecs = -1);
+
+private:
+    template <typename T> class Task;
+
+    void start(QRunnable *task);                                  // 把任务放到线程池中执行
+    void startDeadline(QDeadlineTimer deadline, std::function<void ()> timeout); // 在主线程中启动超时的定时器
+    static void setCurrentTask(const QFutureInterfaceBase *task); // 设置当前线程正在执行的任务
+
+    QThreadPool *threadPool;
+};
+
+/**
+ * @brief 线程池中执行的任务，future 由任务结束、取消或者超时中最先发生的一个结束
+ */
+template <typename T>
+class DBExecutor::Task : public QRunnable {
+public:
+    struct State {
+        QFutureInterface<T>   future;
+        std::function<T ()>   task;
+        QAtomicInt            finished; // 0 表示还没有结束，抢到把它设置为 1 的一方结束 future
+
+        bool claim() { return finished.testAndSetOrdered(0, 1); }
+    };
+
+    explicit Task(QSharedPointer<State> state) : state(state) {}
+
+    void run() override {
+        // 1. 已经取消或者超时的任务不再执行
+        // 2. 执行任务，执行期间 DBExecutor::isCanceled() 可以查询任务是否被取消
+        // 3. 没有被取消或者超时时报告结果
+
+        // [1] 已经取消或者超时的任务不再执行
+        if (state->future.isCanceled()) {
+            if (state->claim()) {
+                state->future.reportFinished();
+            }
+
+            return;
+        }
+
+        // [2] 执行任务，执行期间 DBExecutor::isCanceled() 可以查询任务是否被取消
+        DBExecutor::setCurrentTask(&state->future);
+        execute(static_cast<T *>(nullptr));
+        DBExecutor::setCurrentTask(nullptr);
+    }
+
+private:
+    // [3] 没有被取消或者超时时报告结果，使用参数重载区分 void 和有返回值的任务
+    template <typename R>
+    void execute(R *) {
+        R result = state->task();
+
+        if (state->claim()) {
+            state->future.reportResult(result);
+            state->future.reportFinished();
+        }
+    }
+
+    void execute(void *) {
+        state->task();
+
+        if (state->claim()) {
+            state->future.reportFinished();
+        }
+    }
+
+    QSharedPointer<State> state;
+};
+
+/*-----------------------------------------------------------------------------|
+ |                          DBExecutor Implementation                          |
+ |----------------------------------------------------------------------------*/
+template <typename T>
+QFuture<T> DBExecutor::run(std::function<T ()> task, int deadlineMs) {
+    // 1. 创建任务的状态，future 设置为已经开始
+    // 2. 任务放到线程池中排队执行
+    // 3. 设置了超时时间时，超时后取消任务并结束 future
+
+    // [1] 创建任务的状态，future 设置为已经开始，超时从现在开始计时
+    QDeadlineTimer deadline(deadlineMs);
+    QSharedPointer<typename Task<T>::State> state(new typename Task<T>::State());
+    state->task = task;
+    state->future.reportStarted();
+    QFuture<T> future = state->future.future();
+
+    // [2] 任务放到线程池中排队执行
+    start(new Task<T>(state));
+
+    // [3] 设置了超时时间时，超时后取消任务并结束 future
+    if (deadlineMs > 0) {
+        startDeadline(deadline, [state] {
+            if (state->claim()) {
+                state->future.reportCanceled();
+                state->future.reportFinished();
+            }
+        });
+    }
+
+    return future;
+}
+
+template <typename T>
+QFuture<T> DBExecutor::run(std::function<T ()> task, QObject *context,
+                           std::function<void (const QFuture<T> &future)> callback, int deadlineMs) {
+    // watcher 是 context 的子对象，context 被删除时 watcher 也被删除，不会再调用 callback
+    QFutureWatcher<T> *watcher = new QFutureWatcher<T>(context);
+
+    QObject::connect(watcher, &QFutureWatcherBase::finished, watcher, [watcher, callback] {
+        callback(watcher->future());
+        watcher->deleteLater();
+    });
+
+    QFuture<T> future = run<T>(task, deadlineMs);
+    watcher->setFuture(future);
+
+    return future;
+}
+
+#endif // DBEXECUTOR_H
@@ -0,0 +1,339 @@
+#include "DBProfiler.h"
+#include "SqlTable.h"
+#include "util/Config.h"
+
+#include <QDebug>
+#include <QSqlQuery>
+#include <QMutexLocker>
+#include <algorithm>
+
+static const int PROFILER_HISTOGRAM_BUCKETS = 32; // 最后一个桶的下界约为 18 分钟
+
+// 当前线程正在处理结果的 SQL，DBProfiler::materialized() 使用
+static thread_local DBProfiler::Sample *currentSample = nullptr;
+
+/*-----------------------------------------------------------------------------|
+ |                                 QueryStats                                  |
+ |----------------------------------------------------------------------------*/
+// 执行时间的百分位数，取所在桶的上界
+qint64 QueryStats::percentile(double p) const {
+    qint64 target = qMax(qint64(1), qint64(p * count + 0.5));
+    qint64 sum    = 0;
+
+    for (int i = 0; i < histogram.size(); ++i) {
+        sum += histogram.at(i);
+
+        if (sum >= target) {
+            return qMin(qint64(1) << i, maxUs);
+        }
+    }
+
+    return maxUs;
+}
+
+/*-----------------------------------------------------------------------------|
+ |                                 DBProfiler                                  |
+ |----------------------------------------------------------------------------*/
+DBProfiler::DBProfiler() {
+    enabled.store(Config::instance().isDatabaseProfile() ? 1 : 0);
+    threshold.store(Config::instance().getDatabaseSlowQueryThreshold());
+}
+
+DBProfiler::~DBProfiler() {
+}
+
+bool DBProfiler::isEnabled() const {
+    return enabled.load() != 0;
+}
+
+void DBProfiler::setEnabled(bool enabled) {
+    this->enabled.store(enabled ? 1 : 0);
+}
+
+int DBProfiler::slowQueryThreshold() const {
+    return threshold.load();
+}
+
+void DBProfiler::setSlowQueryThreshold(int ms) {
+    threshold.store(ms);
+}
+
+// 取得总执行时间最长的 n 条 SQL 的统计数据
+QList<QueryStats> DBProfiler::top(int n) const {
+    QList<QueryStats> result;
+
+    {
+        QMutexLocker locker(&mutex);
+        result = stats.values();
+    }
+
+    std::sort(result.begin(), result.end(), [](const QueryStats &a, const QueryStats &b) {
+        return a.totalUs > b.totalUs;
+    });
+
+    if (n >= 0 && result.size() > n) {
+        result.erase(result.begin() + n, result.end());
+    }
+
+    return result;
+}
+
+// 生成总执行时间最长的 n 条 SQL 的报表
+QString DBProfiler::report(int n) const {
+    QList<QueryStats> result = top(n);
+    QString text = QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10  %11\n")
+            .arg("total(ms)", 10).arg("count", 8).arg("errors", 6).arg("avg(ms)", 9).arg("p50(ms)", 9)
+            .arg("p95(ms)", 9).arg("p99(ms)", 9).arg("max(ms)", 9).arg("rows", 10).arg("bytes", 12).arg("sql");
+
+    for (const QueryStats &s : result) {
+        text += QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10  %11\n")
+                .arg(s.totalUs / 1000.0, 10, 'f', 1)
+                .arg(s.count, 8)
+                .arg(s.errors, 6)
+                .arg(s.count > 0 ? s.totalUs / 1000.0 / s.count : 0.0, 9, 'f', 2)
+                .arg(s.percentile(0.50) / 1000.0, 9, 'f', 2)
+                .arg(s.percentile(0.95) / 1000.0, 9, 'f', 2)
+                .arg(s.percentile(0.99) / 1000.0, 9, 'f', 2)
+                .arg(s.maxUs / 1000.0, 9, 'f', 2)
+                .arg(s.rows, 10)
+                .arg(s.bytes, 12)
+                .arg(s.key);
+    }
+
+    return text;
+}
+
+// 清空统计数据
+void DBProfiler::reset() {
+    QMutexLocker locker(&mutex);
+    stats.clear();
+}
+
+void DBProfiler::materialized(const QVariant &value) {
+    if (currentSample != nullptr) {
+        currentSample->addRows(value.isValid() ? 1 : 0, sizeOf(value));
+    }
+}
+
+void DBProfiler::materialized(const QStringList &values) {
+    if (currentSample != nullptr) {
+        qint64 bytes = 0;
+
+        for (const QString &value : values) {
+            bytes += value.size() * 2;
+        }
+
+        currentSample->addRows(values.size(), bytes);
+    }
+}
+
+void DBProfiler::materialized(const QList<QVariantMap> &rows) {
+    if (currentSample != nullptr) {
+        qint64 bytes = 0;
+
+        for (const QVariantMap &row : rows) {
+            for (auto iter = row.constBegin(); iter != row.constEnd(); ++iter) {
+                bytes += iter.key().size() * 2 + sizeOf(iter.value());
+            }
+        }
+
+        currentSample->addRows(rows.size(), bytes);
+    }
+}
+
+void DBProfiler::materialized(const SqlTable &table) {
+    if (currentSample != nullptr) {
+        currentSample->addRows(table.rowCount(), sizeOf(table));
+    }
+}
+
+// 估算值在内存中的字节数，只计算数据的大小，不计算 QVariant 和容器本身的开销
+qint64 DBProfiler::sizeOf(const QVariant &value) {
+    switch (value.type()) {
+    case QVariant::Invalid:   return 0;
+    case QVariant::String:    return value.toString().size() * 2;
+    case QVariant::ByteArray: return value.toByteArray().size();
+    case QVariant::List: {
+        qint64 bytes = 0;
+
+        for (const QVariant &item : value.toList()) {
+            bytes += sizeOf(item);
+        }
+
+        return bytes;
+    }
+    default:
+        return 8;
+    }
+}
+
+// 估算表的数据在内存中的字节数
+qint64 DBProfiler::sizeOf(const SqlTable &table) {
+    qint64 bytes = 0;
+
+    for (int column = 0; column < table.columnCount(); ++column) {
+        switch (table.columnType(column)) {
+        case SqlTable::String:
+            for (const QString &value : table.stringColumn(column)) {
+                bytes += value.size() * 2;
+            }
+            break;
+        case SqlTable::Variant:
+            for (int row = 0; row < table.rowCount(); ++row) {
+                bytes += sizeOf(table.value(row, column));
+            }
+            break;
+        default:
+            bytes += qint64(table.rowCount()) * 8;
+        }
+    }
+
+    return bytes;
+}
+
+// SQL 的统计 key
+QString DBProfiler::key(const QString &sql, SqlHandle handle) {
+    // 1. Sqls 中的 SQL 使用 namespace::id，动态 SQL 展开后的 SQL 使用展开前的 SQL 的
+    // 2. 其他 SQL 把字符串和数字替换为 ?，连续的空白替换为一个空格
+
+    // [1] Sqls 中的 SQL 使用 namespace::id，动态 SQL 展开后的 SQL 使用展开前的 SQL 的
+    if (handle.isValid()) {
+        const SqlStatement &s = Sqls::instance().statement(handle);
+        return s.sqlNamespace + "::" + s.id;
+    }
+
+    // [2] 其他 SQL 把字符串和数字替换为 ?，连续的空白替换为一个空格
+    QString result;
+    result.reserve(sql.size());
+    int n = sql.size();
+
+    for (int i = 0; i < n; ++i) {
+        QChar ch = sql.at(i);
+
+        if (ch == '\'' || ch == '"') {
+            int end = i + 1;
+
+            while (end < n && sql.at(end) != ch) {
+                ++end;
+            }
+
+            result += '?';
+            i = end;
+        } else if (ch.isDigit() && (result.isEmpty() || !(result.at(result.size() - 1).isLetterOrNumber() || result.at(result.size() - 1) == '_'))) {
+            while (i + 1 < n && (sql.at(i + 1).isDigit() || sql.at(i + 1) == '.')) {
+                ++i;
+            }
+
+            result += '?';
+        } else if (ch.isSpace()) {
+            if (!result.isEmpty() && result.at(result.size() - 1) != ' ') {
+                result += ' ';
+            }
+        } else {
+            result += ch;
+        }
+    }
+
+    return result.trimmed();
+}
+
+// 记录一次执行
+void DBProfiler::record(const Sample &sample, qint64 elapsedUs, bool ok) {
+    // 1. 执行时间超过慢查询的阈值时，输出 SQL 和绑定的参数
+    // 2. 开启了统计时，累加到 SQL 的统计数据中
+
+    // [1] 执行时间超过慢查询的阈值时，输出 SQL 和绑定的参数
+    int slowMs = threshold.load();
+
+    if (slowMs > 0 && elapsedUs >= qint64(slowMs) * 1000) {
+        qWarning().noquote() << QString("==> Slow SQL: %1 ms, %2 rows, %3 bytes: %4")
+                                .arg(elapsedUs / 1000.0, 0, 'f', 1).arg(sample.rows).arg(sample.bytes).arg(sample.sql);
+
+        if (!sample.params.isEmpty()) {
+            qWarning().noquote() << "==> Slow SQL Params:" << sample.params;
+        }
+    }
+
+    if (!isEnabled()) {
+        return;
+    }
+
+    // [2] 开启了统计时，累加到 SQL 的统计数据中
+    QString statsKey = key(sample.sql, sample.handle);
+    int bucket = 0;
+
+    while (bucket < PROFILER_HISTOGRAM_BUCKETS - 1 && (qint64(1) << bucket) <= elapsedUs) {
+        ++bucket;
+    }
+
+    QMutexLocker locker(&mutex);
+    QueryStats &s = stats[statsKey];
+
+    if (s.histogram.isEmpty()) {
+        s.key = statsKey;
+        s.histogram.fill(0, PROFILER_HISTOGRAM_BUCKETS);
+    }
+
+    s.count   += 1;
+    s.errors  += ok ? 0 : 1;
+    s.totalUs += elapsedUs;
+    s.maxUs    = qMax(s.maxUs, elapsedUs);
+    s.rows    += sample.rows;
+    s.bytes   += sample.bytes;
+    s.histogram[bucket] += 1;
+}
+
+/*-----------------------------------------------------------------------------|
+ |                                   Sample                                    |
+ |----------------------------------------------------------------------------*/
+void DBProfiler::Sample::start(const SqlRef &sql, const QVariantMap &params) {
+    DBProfiler &profiler = DBProfiler::instance();
+    active = profiler.isEnabled() || profiler.slowQueryThreshold() > 0;
+
+    if (!active) {
+        return;
+    }
+
+    // 动态 SQL 展开后的 SQL 按展开前的 SQL 统计
+    const SqlStatement &s = Sqls::instance().statement(sql.handle());
+
+    this->sql    = sql.sql();
+    this->handle = s.source.isValid() ? s.source : sql.handle();
+    this->params = params;
+    rows    = 0;
+    bytes   = 0;
+    counted = false;
+    timer.start();
+}
+
+void DBProfiler::Sample::addRows(int rows, qint64 bytes) {
+    this->rows  += rows;
+    this->bytes += bytes;
+    counted = true;
+}
+
+// 结束计时并记录
+void DBProfiler::Sample::finish(const QSqlQuery &query, bool ok) {
+    if (!active) {
+        return;
+    }
+
+    active = false;
+
+    if (!counted && ok && !query.isSelect()) {
+        rows = qMax(0, query.numRowsAffected());
+    }
+
+    DBProfiler::instance().record(*this, timer.nsecsElapsed() / 1000, ok);
+}
+
+/*-----------------------------------------------------------------------------|
+ |                                    Scope                                    |
+ |----------------------------------------------------------------------------*/
+DBProfiler::Scope::Scope(Sample *sample) : previous(currentSample) {
+    currentSample = sample->isActive() ? sample : nullptr;
+}
+
+DBProfiler::Scope::~Scope() {
+    currentSample = previous;
+}
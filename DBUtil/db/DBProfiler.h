@@ -0,0 +1,149 @@
+#ifndef DBPROFILER_H
+#define DBPROFILER_H
+
+#include "util/Singleton.h"
+#include "Sqls.h"
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QVector>
+#include <QString>
+#include <QVariant>
+#include <QVariantMap>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+
+class QSqlQuery;
+class SqlTable;
+
+/**
+ * @brief 一条 SQL 的统计数据，Sqls 中的 SQL 按 namespace::id 统计 (动态 SQL 的所有形状合并在一起)，
+ *        其他 SQL 按把字符串和数字替换为 ? 后的 SQL 统计
+ */
+struct QueryStats {
+    QString key;
+    qint64 count   = 0; // 执行次数
+    qint64 errors  = 0; // 执行失败的次数
+    qint64 totalUs = 0; // 总执行时间，单位为微秒
+    qint64 maxUs   = 0; // 最长执行时间，单位为微秒
+    qint64 rows    = 0; // 返回或者影响的总行数
+    qint64 bytes   = 0; // 读取到内存中的结果的估算字节数
+    QVector<qint64> histogram; // 执行时间的直方图，第 i 个桶为执行时间在 [2^(i-1), 2^i) 微秒的次数
+
+    /**
+     * @brief 执行时间的百分位数，取所在桶的上界，单位为微秒
+     *
+     * @param p 百分位，例如 0.95
+     */
+    qint64 percentile(double p) const;
+};
+
+/**
+ * 统计 DBUtil 执行的 SQL，用于找出耗时最多的 DAO 调用:
+ *     1. database.profile 为 true 时统计每条 SQL 的执行次数、时间的直方图、行数和读取的字节数
+ *     2. database.slow_query_threshold 大于 0 时，执行时间超过它 (毫秒) 的 SQL 和绑定的参数输出到日志
+ *
+ * 都没有开启时不计时，对 DBUtil 的性能没有影响。执行时间包含执行 SQL 和读取结果的时间，游标为打开到关闭的时间。
+ *
+ * 使用方法:
+ *     DBProfiler::instance().setEnabled(true);
+ *     ... 生成报表
+ *     qDebug().noquote() << DBProfiler::instance().report(20); // 总执行时间最长的 20 条 SQL
+ */
+class DBProfiler {
+    SINGLETON(DBProfiler)
+
+public:
+    class Sample;
+    class Scope;
+
+    bool isEnabled() const;              // 是否统计 SQL
+    void setEnabled(bool enabled);       // 开启或者关闭统计，关闭后已有的统计数据保留
+    int  slowQueryThreshold() const;     // 慢查询的阈值，单位为毫秒，小于等于 0 时不输出慢查询
+    void setSlowQueryThreshold(int ms);  // 设置慢查询的阈值
+
+    /**
+     * @brief 取得总执行时间最长的 n 条 SQL 的统计数据
+     *
+     * @param n 最多返回的条数，小于 0 时返回所有的
+     * @return 按总执行时间从大到小排序的统计数据
+     */
+    QList<QueryStats> top(int n = -1) const;
+
+    /**
+     * @brief 生成总执行时间最长的 n 条 SQL 的报表，每条 SQL 一行
+     */
+    QString report(int n = 20) const;
+
+    /**
+     * @brief 清空统计数据
+     */
+    void reset();
+
+    /**
+     * @brief DBUtil 读取结果后调用，行数和估算的字节数计入当前线程正在统计的 SQL，没有在统计时什么都不做
+     */
+    static void materialized(const QVariant &value);
+    static void materialized(const QStringList &values);
+    static void materialized(const QList<QVariantMap> &rows);
+    static void materialized(const SqlTable &table);
+
+    static qint64 sizeOf(const QVariant &value); // 估算值在内存中的字节数
+    static qint64 sizeOf(const SqlTable &table); // 估算表的数据在内存中的字节数
+
+    /**
+     * @brief SQL 的统计 key，Sqls 中的 SQL 为 namespace::id，其他 SQL 把字符串和数字替换为 ?
+     */
+    static QString key(const QString &sql, SqlHandle handle);
+
+private:
+    void record(const Sample &sample, qint64 elapsedUs, bool ok); // 记录一次执行
+
+    QAtomicInt enabled;
+    QAtomicInt threshold;
+    mutable QMutex mutex;
+    QHash<QString, QueryStats> stats; // Key 是 SQL 的统计 key
+};
+
+/**
+ * @brief 一次 SQL 的执行，start() 时开始计时，finish() 时记录，统计和慢查询都没有开启时 start() 什么都不做
+ */
+class DBProfiler::Sample {
+public:
+    void start(const SqlRef &sql, const QVariantMap &params);
+    void addRows(int rows, qint64 bytes);
+
+    /**
+     * @brief 结束计时并记录，没有读取结果时 (例如 INSERT、UPDATE) 行数为 query 影响的行数
+     */
+    void finish(const QSqlQuery &query, bool ok);
+
+    bool isActive() const { return active; }
+
+private:
+    QString       sql;
+    SqlHandle     handle;
+    QVariantMap   params;
+    QElapsedTimer timer;
+    qint64 rows   = 0;
+    qint64 bytes  = 0;
+    bool   active = false;
+    bool   counted = false; // 是否读取过结果
+
+    friend class DBProfiler;
+};
+
+/**
+ * @brief 作用域中 DBProfiler::materialized() 的行数和字节数计入 sample，用于处理 SQL 执行的结果
+ */
+class DBProfiler::Scope {
+public:
+    explicit Scope(Sample *sample);
+    ~Scope();
+
+private:
+    Sample *previous;
+};
+
+#endif // DBPROFILER_H
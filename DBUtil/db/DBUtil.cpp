@@ -1,8 +1,17 @@
 #include "DBUtil.h"
 #include "ConnectionPool.h"
+#include "DBExecutor.h"
+#include "DBProfiler.h"
+#include "StatementCache.h"
+#include "Sqls.h"
 #include "util/Config.h"
 
-int DBUtil::insert(const QString &sql, const QVariantMap &params) {
+#include <QRegularExpression>
+
+// 当前线程中嵌套的事务的层数，DBUtil 在一个线程中只使用一个连接，所以按线程计数
+static thread_local int transactionDepth = 0;
+
+int DBUtil::insert(const SqlRef &sql, const QVariantMap &params) {
     int id = -1;
 
     executeSql(sql, params, [&id](QSqlQuery *query) {
@@ -12,7 +21,7 @@ int DBUtil::insert(const QString &sql, const QVariantMap &params) {
     return id;
 }
 
-bool DBUtil::update(const QString &sql, const QVariantMap &params) {
+bool DBUtil::update(const SqlRef &sql, const QVariantMap &params) {
     bool result;
 
     executeSql(sql, params, [&result](QSqlQuery *query) {
@@ -22,68 +31,292 @@ bool DBUtil::update(const QString &sql, const QVariantMap &params) {
     return result;
 }
 
-int DBUtil::selectInt(const QString &sql, const QVariantMap &params) {
+int DBUtil::insertBatch(const SqlRef &sql, const QList<QVariantMap> &rows) {
+    // 1. 在事务中插入，嵌套在外部的事务中时使用保存点
+    // 2. MySQL 下把多行合并为一条 INSERT 语句，每批最多 MAX_BATCH_ROWS 行，参数不超过 65535 个，
+    //    最后不满一批的行按 2 的幂分为几批 (例如 37 行分为 32、4、1 行)，不同行数的 SQL 最多 log2(MAX_BATCH_ROWS) + 1 种
+    // 3. 不能合并时使用 execBatch 批量插入
+    // 4. 全部插入成功后提交事务，失败时 transaction 析构时回滚
+
+    if (rows.isEmpty()) {
+        return 0;
+    }
+
+    // 动态 SQL 按每行的参数展开，所有行展开后的 SQL 必须相同
+    SqlRef expanded = sql;
+    QList<QVariantMap> boundRows;
+
+    if (!expandRows(sql, rows, &expanded, &boundRows)) {
+        return -1;
+    }
+
+    // [1] 在事务中插入，嵌套在外部的事务中时使用保存点
+    Transaction transaction;
+
+    if (!transaction.isActive()) {
+        return -1;
+    }
+
+    QSqlDatabase db = transaction.database();
+    QSqlDriver::DbmsType dbmsType = db.driver()->dbmsType();
+    StatementCache *cache = ConnectionPool::instance().statementCache(db);
+    QString prefix, tuple, suffix;
+    QStringList names;
+    int count = 0;
+
+    if (dbmsType == QSqlDriver::MySqlServer && splitValues(expanded.sql(), dbmsType, &prefix, &tuple, &suffix, &names)) {
+        // [2] MySQL 下把多行合并为一条 INSERT 语句，每批最多 MAX_BATCH_ROWS 行，参数不超过 65535 个
+        int batchRows = qMax(1, qMin(MAX_BATCH_ROWS, 65535 / names.size()));
+
+        for (int start = 0, size = 0; start < boundRows.size(); start += size) {
+            // 最后不满一批的行按 2 的幂分为几批
+            int remaining = boundRows.size() - start;
+            size = remaining >= batchRows ? batchRows : 1;
+
+            while (size * 2 <= qMin(remaining, batchRows)) {
+                size *= 2;
+            }
+
+            QStringList tuples;
+
+            for (int i = 0; i < size; ++i) {
+                tuples << tuple;
+            }
+
+            // 每批的行数只有有限的几种，SQL 相同的批复用缓存的预编译语句，缓存不会因为每次插入的行数不同而增长
+            PreparedStatement *statement = cache->take(prefix + tuples.join(", ") + suffix);
+            int index = 0;
+
+            for (int i = start; i < start + size; ++i) {
+                for (const QString &name : names) {
+                    statement->query.bindValue(index++, boundRows.at(i).value(name));
+                }
+            }
+
+            DBProfiler::Sample sample;
+            sample.start(expanded, QVariantMap());
+            bool ok = statement->query.exec();
+            count += ok ? statement->query.numRowsAffected() : 0;
+            sample.finish(statement->query, ok);
+            debug(statement->query, QVariantMap());
+            cache->put(statement, ok);
+
+            if (!ok) {
+                return -1;
+            }
+        }
+    } else {
+        // [3] 不能合并时使用 execBatch 批量插入
+        if (!executeBatch(cache, expanded, boundRows)) {
+            return -1;
+        }
+
+        count = boundRows.size();
+    }
+
+    // [4] 全部插入成功后提交事务，失败时 transaction 析构时回滚
+    return transaction.commit() ? count : -1;
+}
+
+bool DBUtil::updateBatch(const SqlRef &sql, const QList<QVariantMap> &rows) {
+    if (rows.isEmpty()) {
+        return true;
+    }
+
+    SqlRef expanded = sql;
+    QList<QVariantMap> boundRows;
+
+    if (!expandRows(sql, rows, &expanded, &boundRows)) {
+        return false;
+    }
+
+    Transaction transaction;
+
+    if (!transaction.isActive()) {
+        return false;
+    }
+
+    StatementCache *cache = ConnectionPool::instance().statementCache(transaction.database());
+
+    return executeBatch(cache, expanded, boundRows) && transaction.commit();
+}
+
+int DBUtil::forEach(const SqlRef &sql, const QVariantMap &params,
+                    std::function<bool (const SqlTable::Row &row)> callback, int batchSize) {
+    Cursor cursor(sql, params, batchSize);
+    int count = 0;
+
+    if (!cursor.isValid()) {
+        return -1;
+    }
+
+    while (cursor.next()) {
+        ++count;
+
+        // 在 DBExecutor 中执行时，任务被取消或者超时后也停止遍历
+        if (!callback(cursor.row()) || DBExecutor::isCanceled()) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+int DBUtil::selectInt(const SqlRef &sql, const QVariantMap &params) {
     return selectVariant(sql, params).toInt();
 }
 
-qint64 DBUtil::selectInt64(const QString &sql, const QVariantMap &params) {
+qint64 DBUtil::selectInt64(const SqlRef &sql, const QVariantMap &params) {
     return selectVariant(sql, params).toLongLong();
 }
 
-QString DBUtil::selectString(const QString &sql, const QVariantMap &params) {
+QString DBUtil::selectString(const SqlRef &sql, const QVariantMap &params) {
     return selectVariant(sql, params).toString();
 }
 
-QDate DBUtil::selectDate(const QString &sql, const QVariantMap &params) {
+QDate DBUtil::selectDate(const SqlRef &sql, const QVariantMap &params) {
     return selectVariant(sql, params).toDate();
 }
 
-QDateTime DBUtil::selectDateTime(const QString &sql, const QVariantMap &params) {
+QDateTime DBUtil::selectDateTime(const SqlRef &sql, const QVariantMap &params) {
     return selectVariant(sql, params).toDateTime();
 }
 
-QVariant DBUtil::selectVariant(const QString &sql, const QVariantMap &params) {
+QVariant DBUtil::selectVariant(const SqlRef &sql, const QVariantMap &params) {
     QVariant result;
 
     executeSql(sql, params, [&result](QSqlQuery *query) {
         if (query->next()) {
             result = query->value(0);
         }
+
+        DBProfiler::materialized(result);
     });
 
     return result;
 }
 
-QStringList DBUtil::selectStrings(const QString &sql, const QVariantMap &params) {
+QStringList DBUtil::selectStrings(const SqlRef &sql, const QVariantMap &params) {
     QStringList strings;
 
     executeSql(sql, params, [&strings](QSqlQuery *query) {
         while (query->next()) {
             strings.append(query->value(0).toString());
         }
+
+        DBProfiler::materialized(strings);
     });
 
     return strings;
 }
 
-QVariantMap DBUtil::selectMap(const QString &sql, const QVariantMap &params) {
+QVariantMap DBUtil::selectMap(const SqlRef &sql, const QVariantMap &params) {
     return selectMaps(sql, params).value(0);
 }
 
-QList<QVariantMap> DBUtil::selectMaps(const QString &sql, const QVariantMap &params) {
+QList<QVariantMap> DBUtil::selectMaps(const SqlRef &sql, const QVariantMap &params) {
     QList<QVariantMap> maps;
 
     executeSql(sql, params, [&maps](QSqlQuery *query) {
         maps = queryToMaps(query);
+        DBProfiler::materialized(maps);
     });
 
     return maps;
 }
 
-void DBUtil::bindValues(QSqlQuery *query, const QVariantMap &params) {
-    for (QVariantMap::const_iterator i=params.constBegin(); i!=params.constEnd(); ++i) {
-        query->bindValue(":" + i.key(), i.value());
+bool DBUtil::executeBatch(StatementCache *cache, const SqlRef &sql, const QList<QVariantMap> &rows) {
+    // 第 i 个参数绑定所有行的这个参数组成的 list
+    PreparedStatement *statement = cache->take(sql.sql(), sql.handle());
+
+    for (int i = 0; i < statement->placeholders.size(); ++i) {
+        const QString &name = statement->placeholders.at(i);
+        QVariantList values;
+        values.reserve(rows.size());
+
+        for (const QVariantMap &row : rows) {
+            values << row.value(name);
+        }
+
+        statement->query.bindValue(i, values);
     }
+
+    DBProfiler::Sample sample;
+    sample.start(sql, QVariantMap());
+    bool ok = statement->query.execBatch();
+    sample.finish(statement->query, ok);
+    debug(statement->query, QVariantMap());
+    cache->put(statement, ok);
+
+    return ok;
+}
+
+bool DBUtil::splitValues(const QString &sql, QSqlDriver::DbmsType dbmsType,
+                         QString *prefix, QString *tuple, QString *suffix, QStringList *names) {
+    // 1. 找到 VALUES 后的括号和与它匹配的右括号 (跳过引号中的内容，MySQL 的字符串中 \ 转义下一个字符)
+    // 2. 参数必须都在括号中，否则不能合并 (例如 ON DUPLICATE KEY UPDATE 中有参数)
+    // 3. 括号中的命名参数替换为 ?，合并后的 SQL 按位置绑定参数
+
+    // [1] 找到 VALUES 后的括号和与它匹配的右括号 (跳过引号中的内容，MySQL 的字符串中 \ 转义下一个字符)
+    static const QRegularExpression valuesPattern("\\bVALUES\\s*\\(", QRegularExpression::CaseInsensitiveOption);
+    QRegularExpressionMatch match = valuesPattern.match(sql);
+
+    if (!match.hasMatch()) {
+        return false;
+    }
+
+    int open  = match.capturedEnd() - 1;
+    int close = -1;
+    int depth = 0;
+    bool backslashEscapes = dbmsType == QSqlDriver::MySqlServer;
+    QChar closingQuote;
+
+    for (int i = open; i < sql.size() && close < 0; ++i) {
+        QChar ch = sql.at(i);
+
+        if (!closingQuote.isNull() && backslashEscapes && ch == '\\' && closingQuote != '`') {
+            ++i; // 跳过被转义的字符，例如 'a\'b' 中的 '
+        } else if (!closingQuote.isNull()) {
+            closingQuote = ch == closingQuote ? QChar() : closingQuote;
+        } else if (ch == '\'' || ch == '"' || ch == '`') {
+            closingQuote = ch;
+        } else if (ch == '(') {
+            ++depth;
+        } else if (ch == ')' && --depth == 0) {
+            close = i;
+        }
+    }
+
+    // [2] 参数必须都在括号中，否则不能合并 (例如 ON DUPLICATE KEY UPDATE 中有参数)
+    QList<int> positions;
+    *names = StatementCache::placeholders(sql, dbmsType, &positions);
+
+    if (close < 0 || names->isEmpty() || positions.first() < open || positions.last() > close) {
+        return false;
+    }
+
+    // [3] 括号中的命名参数替换为 ?，合并后的 SQL 按位置绑定参数
+    *tuple = sql.mid(open, close - open + 1);
+
+    for (int i = positions.size() - 1; i >= 0; --i) {
+        tuple->replace(positions.at(i) - open, names->at(i).size() + 1, "?");
+    }
+
+    *prefix = sql.left(open);
+    *suffix = sql.mid(close + 1);
+
+    return true;
+}
+
+SqlTable DBUtil::selectTable(const SqlRef &sql, const QVariantMap &params) {
+    SqlTable table;
+
+    executeSql(sql, params, [&table](QSqlQuery *query) {
+        table.load(query);
+        DBProfiler::materialized(table);
+    });
+
+    return table;
 }
 
 QStringList DBUtil::getFieldNames(const QSqlQuery &query) {
@@ -115,6 +348,45 @@ QList<QVariantMap > DBUtil::queryToMaps(QSqlQuery *query) {
     return rowMaps;
 }
 
+SqlRef DBUtil::expand(const SqlRef &sql, const QVariantMap &params, QVariantMap *boundParams) {
+    if (sql.handle().isValid() && Sqls::instance().isDynamic(sql.handle())) {
+        return Sqls::instance().expand(sql.handle(), params, boundParams);
+    }
+
+    *boundParams = params;
+    return sql;
+}
+
+bool DBUtil::expandRows(const SqlRef &sql, const QList<QVariantMap> &rows, SqlRef *expanded, QList<QVariantMap> *boundRows) {
+    if (!sql.handle().isValid() || !Sqls::instance().isDynamic(sql.handle())) {
+        *boundRows = rows;
+        return true;
+    }
+
+    boundRows->reserve(rows.size());
+
+    for (int i = 0; i < rows.size(); ++i) {
+        QVariantMap boundParams;
+        SqlRef ref = expand(sql, rows.at(i), &boundParams);
+        boundRows->append(boundParams);
+
+        if (i == 0) {
+            *expanded = ref;
+        } else if (ref.handle().value != expanded->handle().value || ref.sql() != expanded->sql()) {
+            qDebug().noquote() << "==> SQL Error: 批量执行的动态 SQL 每行展开后的 SQL 必须相同:" << ref.sql();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void DBUtil::checkParams(const SqlRef &sql, const QVariantMap &params) {
+    if (sql.handle().isValid() && Config::instance().isDatabaseDebug()) {
+        Sqls::instance().checkParams(sql.handle(), params);
+    }
+}
+
 void DBUtil::debug(const QSqlQuery &query, const QVariantMap &params) {
     if (Config::instance().isDatabaseDebug()) {
         if (query.lastError().type() != QSqlError::NoError) {
@@ -129,17 +401,245 @@ void DBUtil::debug(const QSqlQuery &query, const QVariantMap &params) {
     }
 }
 
-void DBUtil::executeSql(const QString &sql,
+void DBUtil::executeSql(const SqlRef &sql,
                         const QVariantMap &params,
                         std::function<void (QSqlQuery *query)> handleResult) {
-    QSqlDatabase db = ConnectionPool::instance().openConnection();
+    // 1. 从连接池借连接，借出的连接在离开作用域时归还给连接池
+    // 2. 动态 SQL 根据参数展开，从连接的缓存中取出预编译的语句，按位置绑定参数
+    // 3. 执行 SQL，成功时处理结果，然后把语句放回缓存，失败时释放语句 (连接可能断开了)
+    // 4. 开启了 DBProfiler 时统计执行 SQL 和处理结果的时间、结果的行数和字节数
+
+    // [1] 从连接池借连接，借出的连接在离开作用域时归还给连接池
+    ScopedConnection conn;
+
+    if (!conn.isValid()) {
+        qDebug().noquote() << "==> SQL Error: 借数据库连接失败:" << sql.sql();
+        return;
+    }
+
+    // [2] 动态 SQL 根据参数展开，从连接的缓存中取出预编译的语句，按位置绑定参数
+    QVariantMap boundParams;
+    SqlRef expanded = expand(sql, params, &boundParams);
+    StatementCache *cache = ConnectionPool::instance().statementCache(conn.database());
+    PreparedStatement *statement = cache->take(expanded.sql(), expanded.handle());
+    statement->bindValues(boundParams);
+    checkParams(expanded, boundParams);
+
+    // [3] 执行 SQL，成功时处理结果，然后把语句放回缓存，失败时释放语句 (连接可能断开了)
+    // [4] 开启了 DBProfiler 时统计执行 SQL 和处理结果的时间、结果的行数和字节数
+    DBProfiler::Sample sample;
+    sample.start(expanded, boundParams);
+    bool ok = statement->query.exec();
+
+    if (ok) {
+        DBProfiler::Scope scope(&sample);
+        handleResult(&statement->query);
+    }
+
+    sample.finish(statement->query, ok);
+    debug(statement->query, boundParams);
+    cache->put(statement, ok);
+}
+
+/*-----------------------------------------------------------------------------|
+ |                                 Transaction                                 |
+ |----------------------------------------------------------------------------*/
+DBUtil::Transaction::Transaction() {
+    // 1. 借出当前线程的连接，事务结束前一直占用，作用域中的 DBUtil 调用借到的都是这个连接
+    // 2. 最外层的事务开始数据库的事务，嵌套的事务创建保存点
+
+    // [1] 借出当前线程的连接，事务结束前一直占用，作用域中的 DBUtil 调用借到的都是这个连接
+    db = ConnectionPool::instance().borrowConnection();
+
+    if (!db.isValid()) {
+        qDebug().noquote() << "==> SQL Error: 借数据库连接失败，不能开始事务";
+        return;
+    }
+
+    // [2] 最外层的事务开始数据库的事务，嵌套的事务创建保存点
+    if (transactionDepth == 0) {
+        active = db.transaction();
+    } else {
+        savepoint = QString("sp_%1").arg(transactionDepth);
+        active = execute("SAVEPOINT " + savepoint);
+    }
+
+    if (active) {
+        ++transactionDepth;
+    } else {
+        qDebug().noquote() << "==> SQL Error: 开始事务失败:" << db.lastError().text().trimmed();
+    }
+}
+
+DBUtil::Transaction::~Transaction() {
+    if (active) {
+        rollback();
+    }
+
+    if (db.isValid()) {
+        // 先释放 db 再归还，归还时连接可能被关闭
+        QString name = db.connectionName();
+        db = QSqlDatabase();
+        ConnectionPool::instance().returnConnection(name);
+    }
+}
+
+// 提交事务
+bool DBUtil::Transaction::commit() {
+    if (!active) {
+        return false;
+    }
+
+    bool ok = savepoint.isEmpty() ? db.commit() : execute("RELEASE SAVEPOINT " + savepoint);
+
+    if (!ok) {
+        qDebug().noquote() << "==> SQL Error: 提交事务失败:" << db.lastError().text().trimmed();
+        rollback();
+        return false;
+    }
+
+    active = false;
+    --transactionDepth;
+
+    return true;
+}
+
+// 回滚事务
+bool DBUtil::Transaction::rollback() {
+    if (!active) {
+        return false;
+    }
+
+    bool ok = savepoint.isEmpty() ? db.rollback() : execute("ROLLBACK TO SAVEPOINT " + savepoint);
+    active = false;
+    --transactionDepth;
+
+    return ok;
+}
+
+bool DBUtil::Transaction::isActive() const {
+    return active;
+}
+
+QSqlDatabase DBUtil::Transaction::database() const {
+    return db;
+}
+
+// 执行保存点的 SQL
+bool DBUtil::Transaction::execute(const QString &sql) {
     QSqlQuery query(db);
-    query.prepare(sql);
-    bindValues(&query, params);
+    bool ok = query.exec(sql);
+
+    if (!ok) {
+        qDebug().noquote() << "==> SQL Error: " << sql << query.lastError().text().trimmed();
+    }
+
+    return ok;
+}
+
+/*-----------------------------------------------------------------------------|
+ |                                   Cursor                                    |
+ |----------------------------------------------------------------------------*/
+DBUtil::Cursor::Cursor(const SqlRef &sql, const QVariantMap &params, int batchSize)
+    : batchSize(batchSize > 0 ? batchSize : qMax(1, Config::instance().getDatabaseFetchBatchSize())) {
+    // 1. 借出当前线程的连接，游标关闭前一直占用
+    // 2. 动态 SQL 根据参数展开，从连接的缓存中取出预编译的语句 (只向前)，绑定参数后执行
+    // 3. 确定列名和类型，数据在 next() 中按批读取
+
+    // [1] 借出当前线程的连接，游标关闭前一直占用
+    db = ConnectionPool::instance().borrowConnection();
+
+    if (!db.isValid()) {
+        qDebug().noquote() << "==> SQL Error: 借数据库连接失败:" << sql.sql();
+        return;
+    }
 
-    if (query.exec()) {
-        handleResult(&query);
+    // [2] 动态 SQL 根据参数展开，从连接的缓存中取出预编译的语句 (只向前)，绑定参数后执行
+    QVariantMap boundParams;
+    SqlRef expanded = expand(sql, params, &boundParams);
+    cache     = ConnectionPool::instance().statementCache(db);
+    statement = cache->take(expanded.sql(), expanded.handle());
+    statement->bindValues(boundParams);
+    checkParams(expanded, boundParams);
+    sample.start(expanded, boundParams);
+    valid = statement->query.exec();
+    more  = valid;
+    debug(statement->query, boundParams);
+
+    // [3] 确定列名和类型，数据在 next() 中按批读取
+    if (valid) {
+        batch.loadColumns(&statement->query);
+    } else {
+        close();
     }
+}
+
+DBUtil::Cursor::~Cursor() {
+    close();
+}
+
+// 移动到下一行
+bool DBUtil::Cursor::next() {
+    if (statement == nullptr) {
+        return false;
+    }
+
+    // 当前批还有数据时移动到下一行，否则读取下一批
+    if (++index < batch.rowCount()) {
+        return true;
+    }
+
+    if (more) {
+        more  = batch.fetch(&statement->query, batchSize) == batchSize;
+        index = 0;
+
+        if (sample.isActive()) {
+            sample.addRows(batch.rowCount(), DBProfiler::sizeOf(batch));
+        }
+    }
+
+    if (index >= batch.rowCount()) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+// 释放结果和连接
+void DBUtil::Cursor::close() {
+    if (statement != nullptr) {
+        sample.finish(statement->query, valid);
+        cache->put(statement, valid);
+        statement = nullptr;
+    }
+
+    if (db.isValid()) {
+        QString name = db.connectionName();
+        db = QSqlDatabase();
+        ConnectionPool::instance().returnConnection(name);
+    }
+
+    more = false;
+    index = batch.rowCount();
+}
+
+bool DBUtil::Cursor::isValid() const {
+    return valid;
+}
+
+SqlTable::Row DBUtil::Cursor::row() const {
+    return batch.row(index);
+}
+
+QVariant DBUtil::Cursor::value(int column) const {
+    return batch.value(index, column);
+}
+
+QVariant DBUtil::Cursor::value(const QString &name) const {
+    return batch.row(index).value(name);
+}
 
-    debug(query, params);
+QStringList DBUtil::Cursor::columnNames() const {
+    return batch.columnNames();
 }
@@ -10,6 +10,13 @@
 #include <QVariantMap>
 #include <functional>
 
+#include "Sqls.h"
+#include "SqlTable.h"
+#include "DBProfiler.h"
+
+class StatementCache;
+struct PreparedStatement;
+
 /**
  * 封装了一些操作数据库的通用方法，例如插入、更新操作、查询结果返回整数、时间类型，
  * 还可以把查询结果映射成 map，甚至通过传入的映射函数把 map 映射成对象等，也就是 Bean，
@@ -17,7 +24,7 @@
  *
  * 所谓的 bean，就是一个简单的对象，只有属性 (也可以有 getter 和 setter 方法)，主要目的是用来传输数据，
  *
- * sql 可以是一个简单的 SQL 语句，如 SELECT id, username, password FROM user，
+ * sql 可以是一个简单的 SQL 语句，如 SELECT id, username, password FROM user，也可以是 Sqls 中 SQL 的句柄 SqlHandle，
  * 也可以是一个需要绑定参数的 SQL，如 UPDATE user SET username=:username, password=:password WHERE id=:id，
  * 这时需要把要绑定的参数放在 map 里然后与 sql 一起作为参数传入，如
  *      QVariantMap params;
@@ -46,7 +53,7 @@ public:
      * @param params
      * @return 如果执行成功返插入的记录的 id，否则返回 -1.
      */
-    static int insert(const QString &sql, const QVariantMap &params = QVariantMap());
+    static int insert(const SqlRef &sql, const QVariantMap &params = QVariantMap());
 
     /**
      * 执行更新语句 (update 和 delete 语句都是更新语句).
@@ -55,7 +62,28 @@ public:
      * @param params
      * @return 如没有错误返回 true， 有错误返回 false.
      */
-    static bool update(const QString &sql, const QVariantMap &params = QVariantMap());
+    static bool update(const SqlRef &sql, const QVariantMap &params = QVariantMap());
+
+    /**
+     * 批量执行插入语句，所有行在一个事务中插入，在 Transaction 的作用域中调用时使用保存点，失败时只回滚这次插入.
+     * MySQL 下 INSERT ... VALUES (...) 的语句会把多行合并为一条 INSERT ... VALUES (...), (...) 分批执行，
+     * 其他数据库使用 QSqlQuery::execBatch() 执行.
+     *
+     * @param sql  插入一行的 SQL，例如 INSERT INTO user (username, email) VALUES (:username, :email)
+     * @param rows 每一行的参数
+     * @return 如果执行成功返回插入的行数，否则返回 -1.
+     */
+    static int insertBatch(const SqlRef &sql, const QList<QVariantMap> &rows);
+
+    /**
+     * 使用 QSqlQuery::execBatch() 批量执行更新语句 (update 和 delete 语句都是更新语句)，所有行在一个事务中执行，
+     * 在 Transaction 的作用域中调用时使用保存点，失败时只回滚这次更新.
+     *
+     * @param sql  更新一行的 SQL
+     * @param rows 每一行的参数
+     * @return 如没有错误返回 true， 有错误返回 false.
+     */
+    static bool updateBatch(const SqlRef &sql, const QList<QVariantMap> &rows);
 
     /**
      * 执行查询语句，查询到一条记录，并把其映射成 map: key 是列名，value 是列值.
@@ -64,7 +92,7 @@ public:
      * @param params
      * @return 返回记录映射的 map.
      */
-    static QVariantMap selectMap(const QString &sql, const QVariantMap &params = QVariantMap());
+    static QVariantMap selectMap(const SqlRef &sql, const QVariantMap &params = QVariantMap());
 
     /**
      * 执行查询语句，查询到多条记录，并把每一条记录其映射成一个 map，Key 是列名，Value 是列值.
@@ -74,7 +102,43 @@ public:
      * @param params
      * @return 返回记录映射的 map 的 list.
      */
-    static QList<QVariantMap> selectMaps(const QString &sql, const QVariantMap &params = QVariantMap());
+    static QList<QVariantMap> selectMaps(const SqlRef &sql, const QVariantMap &params = QVariantMap());
+
+    /**
+     * 执行查询语句，查询结果按列保存，列名只保存一次，每列的值保存在对应类型的 vector 中，
+     * 不需要为每一行创建 map，适合行数很多的查询，例如报表.
+     *
+     * @param sql
+     * @param params
+     * @return 返回按列保存的查询结果，参考 SqlTable.
+     */
+    static SqlTable selectTable(const SqlRef &sql, const QVariantMap &params = QVariantMap());
+
+    /**
+     * 使用只向前的游标遍历查询结果，每次从结果中读取 batchSize 行，然后逐行调用 callback，
+     * DBUtil 中最多只有一批数据. callback 返回 false 时停止遍历，在 DBExecutor 中执行时任务被取消或者超时后也停止遍历.
+     *
+     * 驱动中缓存多少数据由驱动决定:
+     *     QSQLITE: 逐行读取，内存中只有一批数据，适合导出等结果比内存还大的查询
+     *     QPSQL  : Qt 5.12 以后只向前的查询使用 single row mode 逐行读取，同上
+     *     QMYSQL : 预编译的语句执行后 mysql_stmt_store_result() 把整个结果读取到客户端，内存占用和结果的大小成正比，
+     *              forEach() 只能减少 DBUtil 中的内存，结果很大时使用 keyset 分页分多次查询，
+     *              例如 WHERE id>:lastId ORDER BY id LIMIT 1000，每次把最后一行的 id 作为下一次的 lastId
+     *
+     * 例如:
+     *     DBUtil::forEach("SELECT * FROM audit_log", QVariantMap(), [](const SqlTable::Row &row) {
+     *         out << row.string(0);
+     *         return true;
+     *     });
+     *
+     * @param sql
+     * @param params
+     * @param callback  处理一行的函数，返回 false 时停止遍历，参数 row 只在 callback 中有效
+     * @param batchSize 每批读取的行数，小于等于 0 时使用配置的 fetch_batch_size
+     * @return 返回遍历的行数，执行失败返回 -1.
+     */
+    static int forEach(const SqlRef &sql, const QVariantMap &params,
+                       std::function<bool (const SqlTable::Row &row)> callback, int batchSize = 0);
 
     /**
      * 查询结果是一个整数值，如查询记录的个数、和等.
@@ -84,7 +148,7 @@ public:
      * @param params
      * @return 返回 int
      */
-    static int selectInt(const QString &sql, const QVariantMap &params = QVariantMap());
+    static int selectInt(const SqlRef &sql, const QVariantMap &params = QVariantMap());
 
     /**
      * 查询结果是一个长整数值, 如果返回的是时间戳时很方便.
@@ -94,7 +158,7 @@ public:
      * @param params
      * @return 返回长整数
      */
-    static qint64 selectInt64(const QString &sql, const QVariantMap &params = QVariantMap());
+    static qint64 selectInt64(const SqlRef &sql, const QVariantMap &params = QVariantMap());
 
     /**
      * 查询结果是一个字符串.
@@ -103,7 +167,7 @@ public:
      * @param params
      * @return 返回字符串
      */
-    static QString selectString(const QString &sql, const QVariantMap &params = QVariantMap());
+    static QString selectString(const SqlRef &sql, const QVariantMap &params = QVariantMap());
 
     /**
      * 查询结果是多个字符串.
@@ -113,7 +177,7 @@ public:
      * @param params
      * @return 返回 string list.
      */
-    static QStringList selectStrings(const QString &sql, const QVariantMap &params = QVariantMap());
+    static QStringList selectStrings(const SqlRef &sql, const QVariantMap &params = QVariantMap());
 
     /**
      * 查询结果是一个日期类型.
@@ -123,7 +187,7 @@ public:
      * @param params
      * @return 返回 date
      */
-    static QDate selectDate(const QString &sql, const QVariantMap &params = QVariantMap());
+    static QDate selectDate(const SqlRef &sql, const QVariantMap &params = QVariantMap());
 
     /**
      * 查询结果是一个日期时间类型.
@@ -133,7 +197,7 @@ public:
      * @param params
      * @return 返回 date time
      */
-    static QDateTime selectDateTime(const QString &sql, const QVariantMap &params = QVariantMap());
+    static QDateTime selectDateTime(const SqlRef &sql, const QVariantMap &params = QVariantMap());
 
     /**
      * 查询结果是一个 QVariant.
@@ -143,7 +207,7 @@ public:
      * @param params
      * @return 返回 variant
      */
-    static QVariant selectVariant(const QString &sql, const QVariantMap &params = QVariantMap());
+    static QVariant selectVariant(const SqlRef &sql, const QVariantMap &params = QVariantMap());
 
     /**
      * 查询结果封装成一个对象 bean.
@@ -153,7 +217,7 @@ public:
      * @return 返回查找到的 bean, 如果没有查找到，返回 T 的默认对象，其 id 最好是 -1，这样便于有效的对象区别。
      */
     template <typename T>
-    static T selectBean(T mapToBean(const QVariantMap &rowMap), const QString &sql, const QVariantMap &params = QVariantMap()) {
+    static T selectBean(T mapToBean(const QVariantMap &rowMap), const SqlRef &sql, const QVariantMap &params = QVariantMap()) {
         // 把 map 都映射成一个 bean 对象
         return mapToBean(selectMap(sql, params));
     }
@@ -167,7 +231,7 @@ public:
      * @return 返回 bean 的 list，如果没有查找到，返回空的 list.
      */
     template<typename T>
-    static QList<T> selectBeans(T mapToBean(const QVariantMap &rowMap), const QString &sql, const QVariantMap &params = QVariantMap()) {
+    static QList<T> selectBeans(T mapToBean(const QVariantMap &rowMap), const SqlRef &sql, const QVariantMap &params = QVariantMap()) {
         QList<T> beans;
 
         // 每一个 map 都映射成一个 bean 对象
@@ -178,15 +242,44 @@ public:
         return beans;
     }
 
+    class Transaction;
+    class Cursor;
+
 private:
     /**
-     * 定义了访问数据库算法的骨架，SQL 语句执行的结果使用传进来的 Lambda 表达式处理
+     * 定义了访问数据库算法的骨架，SQL 语句执行的结果使用传进来的 Lambda 表达式处理，
+     * 同一个连接上执行过的 SQL 会缓存预编译的语句，再次执行时不需要重新 prepare
      *
      * @param sql
      * @param params
      * @param fn - 处理 SQL 语句执行的结果的 Lambda 表达式
      */
-    static void executeSql(const QString &sql, const QVariantMap &params, std::function<void(QSqlQuery *query)> fn);
+    static void executeSql(const SqlRef &sql, const QVariantMap &params, std::function<void(QSqlQuery *query)> fn);
+
+    /**
+     * 使用 execBatch 批量执行 SQL，第 i 个参数绑定所有行的这个参数组成的 list.
+     *
+     * @param cache 连接的预编译语句缓存
+     * @param sql
+     * @param rows 每一行的参数
+     * @return 成功返回 true，否则返回 false.
+     */
+    static bool executeBatch(StatementCache *cache, const SqlRef &sql, const QList<QVariantMap> &rows);
+
+    /**
+     * 把 INSERT ... VALUES (...) ... 的 SQL 拆分为 VALUES 前面的部分、括号中的一行和后面的部分，
+     * 括号中的命名参数替换为 ?，用于把多行合并为一条 INSERT 语句.
+     *
+     * @param sql
+     * @param dbmsType 数据库的类型
+     * @param prefix 保存 VALUES 和它前面的部分
+     * @param tuple  保存一行的括号和其中的内容
+     * @param suffix 保存括号后面的部分
+     * @param names  保存括号中按顺序的参数名
+     * @return 可以合并时返回 true，例如没有 VALUES 或者参数不都在括号中时返回 false.
+     */
+    static bool splitValues(const QString &sql, QSqlDriver::DbmsType dbmsType,
+                            QString *prefix, QString *tuple, QString *suffix, QStringList *names);
 
     /**
      * 取得 query 的 labels (没用别名就是数据库里的列名).
@@ -197,26 +290,159 @@ private:
     static QStringList getFieldNames(const QSqlQuery &query);
 
     /**
-     * 把 map 中的 key 和 value 绑定到 query 里.
+     * 把 query 中的查询得到的所有行映射为 map 的 list.
      *
      * @param query
+     * @return 返回 key 为列名，值为列的值的 map 的 list.
+     */
+    static QList<QVariantMap> queryToMaps(QSqlQuery *query);
+
+    /**
+     * 如果 sql 是动态 SQL 的句柄，根据参数展开，否则直接返回 sql.
+     *
+     * @param sql
      * @param params
+     * @param boundParams 保存需要绑定的参数
+     * @return 返回展开后的 SQL.
      */
-    static void bindValues(QSqlQuery *query, const QVariantMap &params);
+    static SqlRef expand(const SqlRef &sql, const QVariantMap &params, QVariantMap *boundParams);
 
     /**
-     * 把 query 中的查询得到的所有行映射为 map 的 list.
+     * 批量执行时按每一行的参数展开动态 SQL，所有行展开后的 SQL 必须相同.
      *
-     * @param query
-     * @return 返回 key 为列名，值为列的值的 map 的 list.
+     * @param sql
+     * @param rows 每一行的参数
+     * @param expanded 保存展开后的 SQL
+     * @param boundRows 保存每一行需要绑定的参数
+     * @return 成功返回 true，有的行展开后的 SQL 不同时返回 false.
      */
-    static QList<QVariantMap> queryToMaps(QSqlQuery *query);
+    static bool expandRows(const SqlRef &sql, const QList<QVariantMap> &rows, SqlRef *expanded, QList<QVariantMap> *boundRows);
+
+    /**
+     * 如果 config.json 里 database.debug 为 true 并且 sql 是 Sqls 的句柄，检查绑定的参数和 SQL 中的参数是否一致.
+     *
+     * @param sql
+     * @param params
+     */
+    static void checkParams(const SqlRef &sql, const QVariantMap &params);
 
     /**
      * 如果 config.json 里 database.debug 为 true，则输出执行的 SQL，如果为 false，则不输出.
      * @param query
      */
     static void debug(const QSqlQuery &query, const QVariantMap &params);
+
+    static const int MAX_BATCH_ROWS = 500; // MySQL 下合并为一条 INSERT 语句的最大行数
+};
+
+/**
+ * 事务的作用域 (RAII)，构造时开始事务，离开作用域前没有 commit() 时自动回滚。
+ * 作用域中当前线程的 DBUtil 调用都使用同一个连接，所以都在这个事务中执行。
+ *
+ * 事务可以嵌套，嵌套的事务使用保存点 (SAVEPOINT) 实现，回滚嵌套的事务只回滚到它开始的地方，不影响外层的事务:
+ *     DBUtil::Transaction transaction;
+ *     DBUtil::insert(...);
+ *
+ *     {
+ *         DBUtil::Transaction nested; // SAVEPOINT
+ *         DBUtil::update(...);
+ *     }                               // 没有提交，ROLLBACK TO SAVEPOINT，insert 仍然有效
+ *
+ *     transaction.commit();
+ *
+ * 注意: 事务对象只能在创建它的线程中使用，并且按创建的相反顺序结束 (放在栈上使用即可)。
+ */
+class DBUtil::Transaction {
+public:
+    Transaction();
+    ~Transaction();
+
+    Transaction(const Transaction &other) = delete;
+    Transaction& operator=(const Transaction &other) = delete;
+
+    /**
+     * @brief 提交事务，嵌套的事务释放保存点，修改在外层事务提交时才生效
+     *
+     * @return 成功返回 true，否则返回 false，失败时事务被回滚
+     */
+    bool commit();
+
+    /**
+     * @brief 回滚事务，嵌套的事务回滚到保存点
+     *
+     * @return 成功返回 true，否则返回 false
+     */
+    bool rollback();
+
+    bool isActive() const;          // 事务是否已经开始并且还没有提交或者回滚
+    QSqlDatabase database() const;  // 事务使用的连接
+
+private:
+    bool execute(const QString &sql); // 执行保存点的 SQL
+
+    QSqlDatabase db;
+    QString savepoint; // 嵌套的事务的保存点，为空时是最外层的事务
+    bool active = false;
+};
+
+/**
+ * 只向前的游标，forEach() 的迭代器形式，按批从查询结果中读取数据，DBUtil 中最多只有一批数据，
+ * 驱动中缓存的数据见 forEach() 的说明 (QMYSQL 会在客户端缓存整个结果)。
+ * 游标打开期间一直占用当前线程的连接，遍历结束、调用 close() 或者析构时释放。
+ *
+ * 使用方法:
+ *     DBUtil::Cursor cursor("SELECT id, username FROM user WHERE id>:id", params);
+ *
+ *     while (cursor.next()) {
+ *         qDebug() << cursor.value(0) << cursor.value("username");
+ *
+ *         if (...) {
+ *             break; // 提前结束，cursor 析构时释放剩下的结果
+ *         }
+ *     }
+ */
+class DBUtil::Cursor {
+public:
+    /**
+     * @param sql
+     * @param params
+     * @param batchSize 每批读取的行数，小于等于 0 时使用配置的 fetch_batch_size
+     */
+    explicit Cursor(const SqlRef &sql, const QVariantMap &params = QVariantMap(), int batchSize = 0);
+    ~Cursor();
+
+    Cursor(const Cursor &other) = delete;
+    Cursor& operator=(const Cursor &other) = delete;
+
+    /**
+     * @brief 移动到下一行，第一次调用时移动到第一行，需要时读取下一批数据
+     *
+     * @return 有下一行返回 true，遍历结束或者执行失败返回 false
+     */
+    bool next();
+
+    /**
+     * @brief 释放结果和连接，之后 next() 返回 false
+     */
+    void close();
+
+    bool isValid() const; // SQL 是否执行成功
+
+    SqlTable::Row row() const;                   // 当前行的视图，读取下一批数据后失效
+    QVariant value(int column) const;            // 当前行的列的值
+    QVariant value(const QString &name) const;   // 当前行的列的值，列名不存在时返回无效的 QVariant
+    QStringList columnNames() const;             // 所有列的名字
+
+private:
+    QSqlDatabase db;
+    StatementCache *cache = nullptr;
+    PreparedStatement *statement = nullptr;
+    SqlTable batch;   // 当前批的数据
+    int batchSize = 0;
+    int index = -1;   // 当前行在 batch 中的位置
+    bool valid = false;
+    bool more  = false; // query 中是否可能还有数据
+    DBProfiler::Sample sample; // 统计打开到关闭的时间和读取的行数
 };
 
 #endif // DBUTIL_H
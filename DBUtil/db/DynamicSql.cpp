@@ -0,0 +1,526 @@
+#include "DynamicSql.h"
+#include "StatementCache.h"
+
+#include <QDebug>
+#include <QDataStream>
+#include <QRegularExpression>
+#include <functional>
+
+static const char * const SQL_TAGNAME_IF      = "if";
+static const char * const SQL_TAGNAME_WHERE   = "where";
+static const char * const SQL_TAGNAME_SET     = "set";
+static const char * const SQL_TAGNAME_FOREACH = "foreach";
+
+/*-----------------------------------------------------------------------------|
+ |                                TestEvaluator                                |
+ |----------------------------------------------------------------------------*/
+/**
+ * @brief 计算 <if test> 的条件，使用递归下降解析分词后的表达式:
+ *     or      := and (('or' | '||') and)*
+ *     and     := not (('and' | '&&') not)*
+ *     not     := ('not' | '!') not | compare
+ *     compare := primary (('==' | '!=' | '>' | '>=' | '<' | '<=') primary)?
+ *     primary := '(' or ')' | 字符串 | 数字 | null | true | false | 参数名[.size | .length]
+ */
+class TestEvaluator {
+public:
+    TestEvaluator(const QStringList &tokens, std::function<QVariant (const QString &name)> lookup)
+        : tokens(tokens), lookup(lookup) {}
+
+    // 计算条件，表达式错误时返回 false
+    bool evaluate(const QString &test) {
+        QVariant value = parseOr();
+
+        if (error || pos != tokens.size()) {
+            qDebug().noquote() << QString("Invalid test expression: %1").arg(test);
+            return false;
+        }
+
+        return truthy(value);
+    }
+
+    static QStringList tokenize(const QString &expression);
+
+private:
+    QVariant parseOr();
+    QVariant parseAnd();
+    QVariant parseNot();
+    QVariant parseCompare();
+    QVariant parsePrimary();
+
+    bool accept(const QString &token) {
+        if (pos < tokens.size() && tokens.at(pos).compare(token, Qt::CaseInsensitive) == 0) {
+            ++pos;
+            return true;
+        }
+
+        return false;
+    }
+
+    static bool truthy(const QVariant &value);
+    static bool toNumber(const QVariant &value, double *number);
+    static bool compare(const QVariant &a, const QString &op, const QVariant &b);
+
+    const QStringList &tokens;
+    std::function<QVariant (const QString &name)> lookup;
+    int  pos   = 0;
+    bool error = false;
+};
+
+// 分词，字符串的分词以引号开头，用于和参数名区分
+QStringList TestEvaluator::tokenize(const QString &expression) {
+    QStringList result;
+    int n = expression.size();
+    int i = 0;
+
+    while (i < n) {
+        QChar ch = expression.at(i);
+
+        if (ch.isSpace()) {
+            ++i;
+        } else if (ch == '\'' || ch == '"') {
+            int end = expression.indexOf(ch, i + 1);
+            end = end < 0 ? n : end;
+            result << QString(ch) + expression.mid(i + 1, end - i - 1);
+            i = end + 1;
+        } else if (ch.isDigit()) {
+            int end = i;
+
+            while (end < n && (expression.at(end).isDigit() || expression.at(end) == '.')) {
+                ++end;
+            }
+
+            result << expression.mid(i, end - i);
+            i = end;
+        } else if (ch.isLetter() || ch == '_') {
+            int end = i;
+
+            while (end < n && (expression.at(end).isLetterOrNumber() || expression.at(end) == '_' || expression.at(end) == '.')) {
+                ++end;
+            }
+
+            result << expression.mid(i, end - i);
+            i = end;
+        } else {
+            QString two = expression.mid(i, 2);
+
+            if (two == "==" || two == "!=" || two == ">=" || two == "<=" || two == "&&" || two == "||") {
+                result << two;
+                i += 2;
+            } else {
+                result << QString(ch);
+                ++i;
+            }
+        }
+    }
+
+    return result;
+}
+
+QVariant TestEvaluator::parseOr() {
+    QVariant value = parseAnd();
+
+    while (accept("or") || accept("||")) {
+        bool right = truthy(parseAnd());
+        value = truthy(value) || right;
+    }
+
+    return value;
+}
+
+QVariant TestEvaluator::parseAnd() {
+    QVariant value = parseNot();
+
+    while (accept("and") || accept("&&")) {
+        bool right = truthy(parseNot());
+        value = truthy(value) && right;
+    }
+
+    return value;
+}
+
+QVariant TestEvaluator::parseNot() {
+    if (accept("not") || accept("!")) {
+        return !truthy(parseNot());
+    }
+
+    return parseCompare();
+}
+
+QVariant TestEvaluator::parseCompare() {
+    QVariant left = parsePrimary();
+
+    for (const char *op : { "==", "!=", ">=", "<=", ">", "<" }) {
+        if (accept(op)) {
+            return compare(left, op, parsePrimary());
+        }
+    }
+
+    return left;
+}
+
+QVariant TestEvaluator::parsePrimary() {
+    if (pos >= tokens.size()) {
+        error = true;
+        return QVariant();
+    }
+
+    QString token = tokens.at(pos++);
+    QChar first   = token.at(0);
+
+    if (token == "(") {
+        QVariant value = parseOr();
+        error = error || !accept(")");
+        return value;
+    } else if (first == '\'' || first == '"') {
+        return token.mid(1);
+    } else if (first.isDigit()) {
+        return token.toDouble();
+    } else if (token.compare("null", Qt::CaseInsensitive) == 0) {
+        return QVariant();
+    } else if (token.compare("true", Qt::CaseInsensitive) == 0) {
+        return true;
+    } else if (token.compare("false", Qt::CaseInsensitive) == 0) {
+        return false;
+    } else if (first.isLetter() || first == '_') {
+        // 参数名后加 .size 或者 .length 取得 list、字符串的长度
+        if (token.endsWith(".size") || token.endsWith(".length")) {
+            QVariant value = lookup(token.left(token.lastIndexOf('.')));
+
+            if (value.type() == QVariant::String) {
+                return value.toString().size();
+            } else if (value.type() == QVariant::Map) {
+                return value.toMap().size();
+            }
+
+            return value.toList().size();
+        }
+
+        return lookup(token);
+    }
+
+    error = true;
+    return QVariant();
+}
+
+// 值作为条件时是否成立: null、false、0、空字符串、空 list 不成立
+bool TestEvaluator::truthy(const QVariant &value) {
+    if (!value.isValid() || value.isNull()) {
+        return false;
+    }
+
+    switch (value.type()) {
+    case QVariant::Bool:       return value.toBool();
+    case QVariant::String:     return !value.toString().isEmpty();
+    case QVariant::List:
+    case QVariant::StringList: return !value.toList().isEmpty();
+    case QVariant::Map:        return !value.toMap().isEmpty();
+    default:
+        double number = 0;
+        return toNumber(value, &number) ? number != 0 : true;
+    }
+}
+
+bool TestEvaluator::toNumber(const QVariant &value, double *number) {
+    bool ok = false;
+
+    switch (value.type()) {
+    case QVariant::Bool:
+    case QVariant::Int:
+    case QVariant::UInt:
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+    case QVariant::Double:
+        *number = value.toDouble();
+        return true;
+    case QVariant::String:
+        *number = value.toString().toDouble(&ok);
+        return ok;
+    default:
+        return false;
+    }
+}
+
+// 比较: 和 null 只能比较是否相等，都是字符串时按字符串比较，都能转为数字时按数字比较，否则转为字符串比较
+bool TestEvaluator::compare(const QVariant &a, const QString &op, const QVariant &b) {
+    bool aNull = !a.isValid() || a.isNull();
+    bool bNull = !b.isValid() || b.isNull();
+
+    if (aNull || bNull) {
+        return op == "==" ? aNull == bNull : (op == "!=" ? aNull != bNull : false);
+    }
+
+    int result = 0;
+    double x = 0;
+    double y = 0;
+
+    if (a.type() != QVariant::String || b.type() != QVariant::String) {
+        if (toNumber(a, &x) && toNumber(b, &y)) {
+            result = x < y ? -1 : (x > y ? 1 : 0);
+        } else {
+            result = a.toString().compare(b.toString());
+        }
+    } else {
+        result = a.toString().compare(b.toString());
+    }
+
+    if (op == "==") { return result == 0; }
+    if (op == "!=") { return result != 0; }
+    if (op == ">")  { return result >  0; }
+    if (op == ">=") { return result >= 0; }
+    if (op == "<")  { return result <  0; }
+
+    return result <= 0;
+}
+
+/*-----------------------------------------------------------------------------|
+ |                                  Expander                                   |
+ |----------------------------------------------------------------------------*/
+/**
+ * @brief 展开动态 SQL 时的状态，sql 为 nullptr 时只计算形状和绑定的参数
+ */
+struct Expander {
+    const QVariantMap *params;
+    QVariantMap  locals; // foreach 中的 item 和 index
+    QString     *shapeKey;
+    QVariantMap *boundParams;
+    int counter = 0;     // foreach 中生成的参数名的序号，形状相同时生成的参数名相同
+
+    QVariant lookup(const QString &name) const {
+        return locals.contains(name) ? locals.value(name) : params->value(name);
+    }
+
+    void expand(const SqlNode &node, QString *sql);
+    void expandChildren(const SqlNode &node, QString *sql);
+    void expandForeach(const SqlNode &node, QString *sql);
+    static QString rename(const QString &sql, const QHash<QString, QString> &names); // 替换 SQL 中的参数名
+};
+
+void Expander::expand(const SqlNode &node, QString *sql) {
+    static const QRegularExpression leadingAndOr("^(AND|OR)\\b", QRegularExpression::CaseInsensitiveOption);
+
+    switch (node.type) {
+    case SqlNode::Text:
+        if (sql != nullptr) {
+            *sql += node.text;
+        }
+        break;
+    case SqlNode::Block:
+        expandChildren(node, sql);
+        break;
+    case SqlNode::If: {
+        // 条件成立时展开子节点，形状中记录条件是否成立
+        TestEvaluator evaluator(node.tokens, [this](const QString &name) { return lookup(name); });
+        bool ok = evaluator.evaluate(node.test);
+        *shapeKey += ok ? '1' : '0';
+
+        if (ok) {
+            expandChildren(node, sql);
+        }
+        break;
+    }
+    case SqlNode::Where:
+    case SqlNode::Set: {
+        // 内容不为空时加上 WHERE 或者 SET，去掉 WHERE 的内容开头的 AND、OR，SET 的内容结尾的逗号
+        QString content;
+        expandChildren(node, sql != nullptr ? &content : nullptr);
+
+        if (sql != nullptr) {
+            content = content.trimmed();
+
+            if (node.type == SqlNode::Where) {
+                content.remove(leadingAndOr);
+            } else if (content.endsWith(',')) {
+                content.chop(1);
+            }
+
+            content = content.trimmed();
+
+            if (!content.isEmpty()) {
+                *sql += (node.type == SqlNode::Where ? " WHERE " : " SET ") + content + " ";
+            }
+        }
+        break;
+    }
+    case SqlNode::Foreach:
+        expandForeach(node, sql);
+        break;
+    }
+}
+
+void Expander::expandChildren(const SqlNode &node, QString *sql) {
+    for (const QSharedPointer<SqlNode> &child : node.children) {
+        expand(*child, sql);
+    }
+}
+
+void Expander::expandForeach(const SqlNode &node, QString *sql) {
+    // 1. 形状中记录元素的个数，没有元素时不生成任何内容
+    // 2. 每个元素的 item 和 index 生成唯一的参数名，值加到绑定的参数中
+    // 3. 展开子节点，把其中的 :item 和 :index 替换为生成的参数名
+
+    // [1] 形状中记录元素的个数，没有元素时不生成任何内容
+    QVariantList values = lookup(node.collection).toList();
+    *shapeKey += QString("[%1]").arg(values.size());
+
+    if (values.isEmpty()) {
+        return;
+    }
+
+    QVariant oldItem  = locals.value(node.item);
+    QVariant oldIndex = locals.value(node.index);
+    bool hadItem  = locals.contains(node.item);
+    bool hadIndex = locals.contains(node.index);
+    QStringList parts;
+
+    for (int i = 0; i < values.size(); ++i) {
+        // [2] 每个元素的 item 和 index 生成唯一的参数名，值加到绑定的参数中
+        int n = counter++;
+        QHash<QString, QString> names;
+
+        if (!node.item.isEmpty()) {
+            names[node.item] = QString("__%1_%2").arg(node.item).arg(n);
+            boundParams->insert(names[node.item], values.at(i));
+            locals[node.item] = values.at(i);
+        }
+
+        if (!node.index.isEmpty()) {
+            names[node.index] = QString("__%1_%2").arg(node.index).arg(n);
+            boundParams->insert(names[node.index], i);
+            locals[node.index] = i;
+        }
+
+        // [3] 展开子节点，把其中的 :item 和 :index 替换为生成的参数名
+        QString part;
+        expandChildren(node, sql != nullptr ? &part : nullptr);
+
+        if (sql != nullptr) {
+            parts << rename(part, names).trimmed();
+        }
+    }
+
+    // 恢复外层 foreach 的 item 和 index
+    locals.remove(node.item);
+    locals.remove(node.index);
+
+    if (hadItem) {
+        locals.insert(node.item, oldItem);
+    }
+
+    if (hadIndex) {
+        locals.insert(node.index, oldIndex);
+    }
+
+    if (sql != nullptr) {
+        *sql += " " + node.open + parts.join(node.separator.isEmpty() ? " " : node.separator) + node.close + " ";
+    }
+}
+
+// 替换 SQL 中的参数名
+QString Expander::rename(const QString &sql, const QHash<QString, QString> &names) {
+    QList<int> positions;
+    QStringList placeholders = StatementCache::placeholders(sql, QSqlDriver::UnknownDbms, &positions);
+    QString result = sql;
+
+    for (int i = placeholders.size() - 1; i >= 0; --i) {
+        if (names.contains(placeholders.at(i))) {
+            result.replace(positions.at(i) + 1, placeholders.at(i).size(), names.value(placeholders.at(i)));
+        }
+    }
+
+    return result;
+}
+
+/*-----------------------------------------------------------------------------|
+ |                                 DynamicSql                                  |
+ |----------------------------------------------------------------------------*/
+// 是否为动态 SQL 的元素
+bool DynamicSql::isDynamicElement(const QString &tagName) {
+    return SQL_TAGNAME_IF == tagName || SQL_TAGNAME_WHERE == tagName
+        || SQL_TAGNAME_SET == tagName || SQL_TAGNAME_FOREACH == tagName;
+}
+
+// 节点和它的子节点是否都是文本
+bool DynamicSql::isStatic(const SqlNode &node) {
+    if (node.type != SqlNode::Text && node.type != SqlNode::Block) {
+        return false;
+    }
+
+    for (const QSharedPointer<SqlNode> &child : node.children) {
+        if (!isStatic(*child)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// 节点和它的子节点的文本拼接在一起
+QString DynamicSql::text(const SqlNode &node) {
+    QString result = node.text;
+
+    for (const QSharedPointer<SqlNode> &child : node.children) {
+        result += text(*child);
+    }
+
+    return result;
+}
+
+// 编译节点和它的子节点
+void DynamicSql::compile(SqlNode &node) {
+    if (node.type == SqlNode::If) {
+        node.tokens = TestEvaluator::tokenize(node.test);
+    }
+
+    for (QSharedPointer<SqlNode> &child : node.children) {
+        compile(*child);
+    }
+}
+
+// 根据参数展开动态 SQL
+void DynamicSql::expand(const SqlNode &root, const QVariantMap &params,
+                        QString *shapeKey, QVariantMap *boundParams, QString *sql) {
+    Expander expander;
+    expander.params      = &params;
+    expander.shapeKey    = shapeKey;
+    expander.boundParams = boundParams;
+    *boundParams = params;
+
+    expander.expand(root, sql);
+
+    if (sql != nullptr) {
+        *sql = sql->simplified();
+    }
+}
+
+/*-----------------------------------------------------------------------------|
+ |                             SqlNode 的序列化                                 |
+ |----------------------------------------------------------------------------*/
+QDataStream& operator<<(QDataStream &out, const SqlNode &node) {
+    out << qint32(node.type) << node.text << node.test << node.collection << node.item
+        << node.index << node.open << node.close << node.separator << qint32(node.children.size());
+
+    for (const QSharedPointer<SqlNode> &child : node.children) {
+        out << *child;
+    }
+
+    return out;
+}
+
+QDataStream& operator>>(QDataStream &in, SqlNode &node) {
+    qint32 type  = 0;
+    qint32 count = 0;
+
+    in >> type >> node.text >> node.test >> node.collection >> node.item
+       >> node.index >> node.open >> node.close >> node.separator >> count;
+    node.type = SqlNode::Type(type);
+    node.children.clear();
+
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QSharedPointer<SqlNode> child(new SqlNode());
+        in >> *child;
+        node.children.append(child);
+    }
+
+    return in;
+}
@@ -0,0 +1,92 @@
+#ifndef DYNAMICSQL_H
+#define DYNAMICSQL_H
+
+#include <QVector>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+#include <QSharedPointer>
+
+class QDataStream;
+
+/**
+ * @brief 动态 SQL 的节点，加载 SQL 文件时创建，之后不再修改
+ */
+struct SqlNode {
+    enum Type {
+        Text,    // 文本
+        Block,   // <sql> 的根节点
+        If,      // <if test="...">
+        Where,   // <where>
+        Set,     // <set>
+        Foreach  // <foreach collection="..." item="..." index="..." open="..." close="..." separator="...">
+    };
+
+    Type    type = Text;
+    QString text;       // Text 的内容
+    QString test;       // If 的条件
+    QString collection; // Foreach 遍历的参数名
+    QString item;       // Foreach 中元素的名字
+    QString index;      // Foreach 中下标的名字
+    QString open;       // Foreach 开始的字符串
+    QString close;      // Foreach 结束的字符串
+    QString separator;  // Foreach 元素之间的分隔符
+    QVector<QSharedPointer<SqlNode>> children;
+
+    QStringList tokens; // If 的条件分词后的结果，加载时生成，不保存到缓存文件
+};
+
+QDataStream& operator<<(QDataStream &out, const SqlNode &node);
+QDataStream& operator>>(QDataStream &in, SqlNode &node);
+
+/**
+ * 类似 MyBatis 的动态 SQL，根据参数生成 SQL 语句，支持的元素:
+ *     <if test="name != null and name != ''">AND name = :name</if>
+ *     <where>...</where>: 内容不为空时加上 WHERE，并去掉内容开头的 AND 或者 OR
+ *     <set>...</set>    : 内容不为空时加上 SET，并去掉内容结尾的逗号
+ *     <foreach collection="ids" item="id" open="(" separator="," close=")">:id</foreach>
+ *
+ * test 的表达式支持: 参数名、字符串 ('abc' 或者 "abc")、数字、null、true、false，
+ * 比较运算 == != > >= < <=，逻辑运算 and or not && || !，括号，参数名后加 .size 或者 .length 取得 list、字符串的长度。
+ *
+ * foreach 中的 :item 和 :index 在生成的 SQL 中被替换为唯一的参数名 (例如 :__id_0, :__id_1)，值加到绑定的参数中。
+ *
+ * 生成 SQL 时先计算出 SQL 的形状 (每个 if 是否成立、每个 foreach 的元素个数)，形状相同的参数生成的 SQL 相同，
+ * Sqls 按形状缓存生成的 SQL，形状已经生成过时只需要计算绑定的参数，不需要再拼接 SQL。
+ */
+class DynamicSql {
+public:
+    /**
+     * @brief 是否为动态 SQL 的元素
+     */
+    static bool isDynamicElement(const QString &tagName);
+
+    /**
+     * @brief 节点和它的子节点是否都是文本 (没有动态 SQL 的元素)
+     */
+    static bool isStatic(const SqlNode &node);
+
+    /**
+     * @brief 节点和它的子节点的文本拼接在一起，用于静态的 SQL
+     */
+    static QString text(const SqlNode &node);
+
+    /**
+     * @brief 加载完成后编译节点和它的子节点: If 的条件分词
+     */
+    static void compile(SqlNode &node);
+
+    /**
+     * @brief 根据参数展开动态 SQL
+     *
+     * @param root        <sql> 的根节点
+     * @param params      参数
+     * @param shapeKey    保存 SQL 的形状，形状相同时生成的 SQL 相同
+     * @param boundParams 保存绑定的参数: params 加上 foreach 的元素
+     * @param sql         不为 nullptr 时保存生成的 SQL，形状已经缓存过时传入 nullptr，不拼接 SQL
+     */
+    static void expand(const SqlNode &root, const QVariantMap &params,
+                       QString *shapeKey, QVariantMap *boundParams, QString *sql);
+};
+
+#endif // DYNAMICSQL_H
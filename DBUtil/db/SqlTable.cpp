@@ -0,0 +1,233 @@
+#include "SqlTable.h"
+
+#include <QtSql>
+
+int SqlTable::rowCount() const {
+    return rows;
+}
+
+int SqlTable::columnCount() const {
+    return columns.size();
+}
+
+// 所有列的名字
+QStringList SqlTable::columnNames() const {
+    QStringList names;
+
+    for (const Column &column : columns) {
+        names << column.name;
+    }
+
+    return names;
+}
+
+QString SqlTable::columnName(int column) const {
+    return columns.at(column).name;
+}
+
+// 列名对应的列号
+int SqlTable::columnIndex(const QString &name) const {
+    for (int i = 0; i < columns.size(); ++i) {
+        if (columns.at(i).name == name) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+SqlTable::ColumnType SqlTable::columnType(int column) const {
+    return columns.at(column).type;
+}
+
+bool SqlTable::isNull(int row, int column) const {
+    return columns.at(column).nulls.at(row);
+}
+
+qint64 SqlTable::int64(int row, int column) const {
+    const Column &c = columns.at(column);
+    return c.type == Int64 ? c.ints.at(row) : value(row, column).toLongLong();
+}
+
+double SqlTable::real(int row, int column) const {
+    const Column &c = columns.at(column);
+    return c.type == Double ? c.reals.at(row) : value(row, column).toDouble();
+}
+
+QString SqlTable::string(int row, int column) const {
+    const Column &c = columns.at(column);
+    return c.type == String ? c.strings.at(row) : value(row, column).toString();
+}
+
+QDateTime SqlTable::dateTime(int row, int column) const {
+    const Column &c = columns.at(column);
+    return c.type == DateTime ? c.dateTimes.at(row) : value(row, column).toDateTime();
+}
+
+// 单元格的值
+QVariant SqlTable::value(int row, int column) const {
+    const Column &c = columns.at(column);
+
+    if (c.nulls.at(row)) {
+        return QVariant();
+    }
+
+    switch (c.type) {
+    case Int64: {
+        // 恢复数据库返回的类型，例如 bool 列返回 bool 而不是 qint64
+        QVariant result(c.ints.at(row));
+        result.convert(int(c.valueType));
+        return result;
+    }
+    case Double:   return c.reals.at(row);
+    case String:   return c.strings.at(row);
+    case DateTime: return c.dateTimes.at(row);
+    default:       return c.variants.at(row);
+    }
+}
+
+const QVector<qint64>& SqlTable::int64Column(int column) const {
+    return columns.at(column).ints;
+}
+
+const QVector<double>& SqlTable::realColumn(int column) const {
+    return columns.at(column).reals;
+}
+
+const QVector<QString>& SqlTable::stringColumn(int column) const {
+    return columns.at(column).strings;
+}
+
+const QVector<QDateTime>& SqlTable::dateTimeColumn(int column) const {
+    return columns.at(column).dateTimes;
+}
+
+SqlTable::Row SqlTable::row(int row) const {
+    return Row(this, row);
+}
+
+SqlTable::ConstIterator SqlTable::begin() const {
+    return ConstIterator(this, 0);
+}
+
+SqlTable::ConstIterator SqlTable::end() const {
+    return ConstIterator(this, rows);
+}
+
+// 读取 query 的所有行
+void SqlTable::load(QSqlQuery *query) {
+    loadColumns(query);
+    fetch(query, -1);
+}
+
+// 根据 query 的字段确定列名和每列的类型
+void SqlTable::loadColumns(QSqlQuery *query) {
+    QSqlRecord record = query->record();
+    columns.clear();
+    columns.resize(record.count());
+    rows = 0;
+
+    for (int i = 0; i < record.count(); ++i) {
+        Column &column = columns[i];
+        column.name      = record.fieldName(i);
+        column.valueType = record.field(i).type();
+
+        // ULongLong 可能超过 qint64 的范围，保存为 QVariant
+        switch (column.valueType) {
+        case QVariant::Bool:
+        case QVariant::Int:
+        case QVariant::UInt:
+        case QVariant::LongLong:
+            column.type = Int64;
+            break;
+        case QVariant::Double:
+            column.type = Double;
+            break;
+        case QVariant::String:
+            column.type = String;
+            break;
+        case QVariant::DateTime:
+            column.type = DateTime;
+            break;
+        default:
+            column.type = Variant;
+        }
+    }
+}
+
+// 从 query 的当前位置继续读取最多 maxRows 行
+int SqlTable::fetch(QSqlQuery *query, int maxRows) {
+    // 1. 清空已经读取的行，分批读取时复用每列已经分配的空间
+    // 2. 预先分配每列的空间: 分批读取时为批的大小，否则数据库能返回行数时为行数
+    // 3. 按列号读取每一行的值，追加到对应类型的列中
+
+    // [1] 清空已经读取的行，分批读取时复用每列已经分配的空间
+    rows = 0;
+
+    for (Column &column : columns) {
+        column.nulls.resize(0);
+        column.ints.resize(0);
+        column.reals.resize(0);
+        column.strings.resize(0);
+        column.dateTimes.resize(0);
+        column.variants.resize(0);
+    }
+
+    // [2] 预先分配每列的空间: 分批读取时为批的大小，否则数据库能返回行数时为行数
+    int size = maxRows >= 0 ? maxRows : query->size();
+
+    if (size > 0) {
+        for (Column &column : columns) {
+            column.nulls.reserve(size);
+
+            switch (column.type) {
+            case Int64:    column.ints.reserve(size);      break;
+            case Double:   column.reals.reserve(size);     break;
+            case String:   column.strings.reserve(size);   break;
+            case DateTime: column.dateTimes.reserve(size); break;
+            default:       column.variants.reserve(size);
+            }
+        }
+    }
+
+    // [3] 按列号读取每一行的值，追加到对应类型的列中
+    while ((maxRows < 0 || rows < maxRows) && query->next()) {
+        for (int i = 0; i < columns.size(); ++i) {
+            Column &column = columns[i];
+            QVariant value = query->value(i);
+            column.nulls.append(value.isNull());
+
+            switch (column.type) {
+            case Int64:    column.ints.append(value.toLongLong());     break;
+            case Double:   column.reals.append(value.toDouble());      break;
+            case String:   column.strings.append(value.toString());    break;
+            case DateTime: column.dateTimes.append(value.toDateTime()); break;
+            default:       column.variants.append(value);
+            }
+        }
+
+        ++rows;
+    }
+
+    return rows;
+}
+
+/*-----------------------------------------------------------------------------|
+ |                                SqlTable::Row                                |
+ |----------------------------------------------------------------------------*/
+// 按列名取值
+QVariant SqlTable::Row::value(const QString &name) const {
+    int column = table->columnIndex(name);
+    return column >= 0 ? table->value(row, column) : QVariant();
+}
+
+// 转为 key 是列名，value 是列值的 map
+QVariantMap SqlTable::Row::toMap() const {
+    QVariantMap map;
+
+    for (int i = 0; i < table->columnCount(); ++i) {
+        map.insert(table->columnName(i), table->value(row, i));
+    }
+
+    return map;
+}
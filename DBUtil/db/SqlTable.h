@@ -0,0 +1,155 @@
+#ifndef SQLTABLE_H
+#define SQLTABLE_H
+
+#include <QVector>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVariantMap>
+#include <QDateTime>
+
+class QSqlQuery;
+
+/**
+ * 按列存储的查询结果，由 DBUtil::selectTable() 返回。
+ *
+ * 列名只保存一次，每列的值按类型保存在一个连续的 vector 中，通过行号和列号访问，
+ * 不像 selectMaps() 那样为每一行创建一个 QVariantMap，大量数据的报表查询时内存按列分配，而不是按单元格分配。
+ *
+ * 列的类型由数据库返回的字段类型决定:
+ *     Int64   : 整数和 bool，value() 和 toMap() 返回数据库原来的类型 (例如 bool)，和 selectMaps() 一致
+ *     Double  : 浮点数
+ *     String  : 字符串
+ *     DateTime: 日期时间
+ *     Variant : 其他类型，例如 QDate、QByteArray、无符号 64 位整数 (可能超过 qint64 的范围)，保存为 QVariant
+ *
+ * 使用方法:
+ *     SqlTable table = DBUtil::selectTable("SELECT id, username FROM user");
+ *     int usernameColumn = table.columnIndex("username");
+ *
+ *     for (int row = 0; row < table.rowCount(); ++row) {
+ *         qDebug() << table.int64(row, 0) << table.string(row, usernameColumn);
+ *     }
+ *
+ *     // 也可以使用行的视图访问，toMap() 转为 selectMaps() 中的 map
+ *     for (const SqlTable::Row &row : table) {
+ *         qDebug() << row.value("username") << row.toMap();
+ *     }
+ */
+class SqlTable {
+public:
+    enum ColumnType {
+        Int64,
+        Double,
+        String,
+        DateTime,
+        Variant
+    };
+
+    class Row;
+    class ConstIterator;
+
+    int rowCount() const;    // 行数
+    int columnCount() const; // 列数
+
+    QStringList columnNames() const;             // 所有列的名字
+    QString columnName(int column) const;        // 列的名字
+    int columnIndex(const QString &name) const;  // 列名对应的列号，不存在时返回 -1
+    ColumnType columnType(int column) const;     // 列的类型
+
+    bool      isNull(int row, int column) const;   // 单元格的值是否为 NULL
+    qint64    int64(int row, int column) const;    // Int64 列的值，其他类型的列转换为整数
+    double    real(int row, int column) const;     // Double 列的值，其他类型的列转换为浮点数
+    QString   string(int row, int column) const;   // String 列的值，其他类型的列转换为字符串
+    QDateTime dateTime(int row, int column) const; // DateTime 列的值，其他类型的列转换为日期时间
+    QVariant  value(int row, int column) const;    // 单元格的值，NULL 时返回无效的 QVariant
+
+    // 整列的值，只能访问对应类型的列，NULL 的单元格为类型的默认值
+    const QVector<qint64>&    int64Column(int column) const;
+    const QVector<double>&    realColumn(int column) const;
+    const QVector<QString>&   stringColumn(int column) const;
+    const QVector<QDateTime>& dateTimeColumn(int column) const;
+
+    Row row(int row) const; // 行的视图
+
+    ConstIterator begin() const;
+    ConstIterator end() const;
+
+    /**
+     * @brief 读取 query 的所有行，query 必须是已经执行成功的查询
+     */
+    void load(QSqlQuery *query);
+
+    /**
+     * @brief 根据 query 的字段确定列名和每列的类型，不读取数据
+     */
+    void loadColumns(QSqlQuery *query);
+
+    /**
+     * @brief 清空已经读取的行，然后从 query 的当前位置继续读取最多 maxRows 行，用于分批读取
+     *
+     * @param query   调用过 loadColumns() 的查询
+     * @param maxRows 最多读取的行数，小于 0 时读取所有的行
+     * @return 返回读取的行数
+     */
+    int fetch(QSqlQuery *query, int maxRows);
+
+private:
+
+    struct Column {
+        QString    name;
+        ColumnType type = Variant;
+        QVariant::Type valueType = QVariant::Invalid; // 数据库返回的值的类型，Int64 列的 value() 转为这个类型
+        QVector<qint64>    ints;
+        QVector<double>    reals;
+        QVector<QString>   strings;
+        QVector<QDateTime> dateTimes;
+        QVector<QVariant>  variants;
+        QVector<bool>      nulls;
+    };
+
+    QVector<Column> columns;
+    int rows = 0;
+};
+
+/**
+ * @brief 一行的视图，只保存表的指针和行号，表释放后不能再使用
+ */
+class SqlTable::Row {
+public:
+    Row(const SqlTable *table, int row) : table(table), row(row) {}
+
+    int index() const { return row; } // 行号
+
+    bool      isNull(int column) const   { return table->isNull(row, column);   }
+    qint64    int64(int column) const    { return table->int64(row, column);    }
+    double    real(int column) const     { return table->real(row, column);     }
+    QString   string(int column) const   { return table->string(row, column);   }
+    QDateTime dateTime(int column) const { return table->dateTime(row, column); }
+    QVariant  value(int column) const    { return table->value(row, column);    }
+    QVariant  value(const QString &name) const; // 按列名取值，列不存在时返回无效的 QVariant
+
+    QVariantMap toMap() const; // 转为 key 是列名，value 是列值的 map
+
+private:
+    const SqlTable *table;
+    int row;
+};
+
+/**
+ * @brief 按行遍历的迭代器，用于 range-based for
+ */
+class SqlTable::ConstIterator {
+public:
+    ConstIterator(const SqlTable *table, int row) : table(table), row(row) {}
+
+    Row operator*() const { return Row(table, row); }
+    ConstIterator& operator++() { ++row; return *this; }
+    bool operator!=(const ConstIterator &other) const { return row != other.row; }
+
+private:
+    const SqlTable *table;
+    int row;
+};
+
+#endif // SQLTABLE_H
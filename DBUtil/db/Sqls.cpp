@@ -1,8 +1,14 @@
 #include "Sqls.h"
+#include "StatementCache.h"
 #include "util/Config.h"
 
 #include <QFile>
 #include <QDebug>
+#include <QSaveFile>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QFileInfo>
+#include <QDataStream>
 #include <QXmlInputSource>
 #include <QXmlAttributes>
 #include <QXmlParseException>
@@ -16,6 +22,30 @@ static const char * const SQL_TAGNAME_SQLS       = "sqls";
 static const char * const SQL_TAGNAME_DEFINE     = "define";
 static const char * const SQL_TAGNAME_INCLUDE    = "include";
 static const char * const SQL_NAMESPACE          = "namespace";
+static const char * const SQL_TEST               = "test";
+static const char * const SQL_COLLECTION         = "collection";
+static const char * const SQL_ITEM               = "item";
+static const char * const SQL_INDEX              = "index";
+static const char * const SQL_OPEN               = "open";
+static const char * const SQL_CLOSE              = "close";
+static const char * const SQL_SEPARATOR          = "separator";
+
+static const quint32 SQL_CACHE_MAGIC   = 0x53514C53; // "SQLS"
+static const quint32 SQL_CACHE_VERSION = 3;
+static const int     SQL_MAX_SHAPES    = 4096; // 动态 SQL 展开后缓存的形状的最大数量
+
+// 解析 SQL 中的参数时使用的数据库类型，PostgreSQL 的 [] 不是引号，MySQL 的字符串中 \ 转义下一个字符
+static QSqlDriver::DbmsType sqlDbmsType() {
+    QString type = Config::instance().getDatabaseType();
+
+    if (type == "QPSQL") {
+        return QSqlDriver::PostgreSQL;
+    } else if (type == "QMYSQL") {
+        return QSqlDriver::MySqlServer;
+    } else {
+        return QSqlDriver::UnknownDbms;
+    }
+}
 
 /*-----------------------------------------------------------------------------|
  |                         SqlsPrivate implementation                          |
@@ -35,7 +65,10 @@ protected:
     bool fatalError(const QXmlParseException &exception);
 
 private:
+    void appendText(const QString &text); // 文本加入 <sql> 的当前节点
+
     QHash<QString, QString> defines;
+    QVector<QSharedPointer<SqlNode>> nodeStack; // <sql> 中从根节点到当前节点的路径，不在 <sql> 中时为空
     QString sqlNamespace;
     QString currentText;
     QString currentSqlId;
@@ -74,11 +107,14 @@ bool SqlsPrivate::startElement(const QString &namespaceURI,
     Q_UNUSED(localName)
 
     // 1. 取得 SQL 得 xml 文档中得 namespace, sql id, include 的 defineId, include 的 id
-    // 2. 如果是 <sql> 标签，清空 currentText
+    // 2. 如果是 <sql> 标签，创建 SQL 的根节点
     // 3. 如果是 <define> 标签，清空 currentText
+    // 4. 如果是 <sql> 中的动态 SQL 元素，创建节点加入当前节点，并作为新的当前节点
     if (SQL_TAGNAME_SQL == qName) {
         currentSqlId = attributes.value(SQL_ID);
-        currentText = "";
+        nodeStack.clear();
+        nodeStack.append(QSharedPointer<SqlNode>(new SqlNode()));
+        nodeStack.last()->type = SqlNode::Block;
     } else if (SQL_TAGNAME_INCLUDE == qName) {
         currentIncludedDefineId = attributes.value(SQL_INCLUDED_DEFINE_ID);
     } else if (SQL_TAGNAME_DEFINE == qName) {
@@ -86,6 +122,20 @@ bool SqlsPrivate::startElement(const QString &namespaceURI,
         currentText = "";
     } else if (SQL_TAGNAME_SQLS == qName) {
         sqlNamespace = attributes.value(SQL_NAMESPACE);
+    } else if (!nodeStack.isEmpty() && DynamicSql::isDynamicElement(qName)) {
+        QSharedPointer<SqlNode> node(new SqlNode());
+        node->type = qName == "if" ? SqlNode::If : qName == "where" ? SqlNode::Where
+                   : qName == "set" ? SqlNode::Set : SqlNode::Foreach;
+        node->test       = attributes.value(SQL_TEST);
+        node->collection = attributes.value(SQL_COLLECTION);
+        node->item       = attributes.value(SQL_ITEM);
+        node->index      = attributes.value(SQL_INDEX);
+        node->open       = attributes.value(SQL_OPEN);
+        node->close      = attributes.value(SQL_CLOSE);
+        node->separator  = attributes.value(SQL_SEPARATOR);
+
+        nodeStack.last()->children.append(node);
+        nodeStack.append(node);
     }
 
     return true;
@@ -95,34 +145,62 @@ bool SqlsPrivate::endElement(const QString &namespaceURI, const QString &localNa
     Q_UNUSED(namespaceURI)
     Q_UNUSED(localName)
 
-    // 1. 如果是 <sql> 标签，则插入 sqls
+    // 1. 如果是 <sql> 标签，则插入 sqls，没有动态 SQL 元素时保存为静态的 SQL
     // 2. 如果是 <include> 标签，则从 defines 里取其内容加入 sql
     // 3. 如果是 <define> 标签，则存入 defines
+    // 4. 如果是 <sql> 中的动态 SQL 元素，回到上一层节点
     if (SQL_TAGNAME_SQL == qName) {
         // 取到一个完整的 SQL 语句
-        context->sqls.insert(buildKey(sqlNamespace, currentSqlId), currentText.simplified());
-        currentText = "";
+        QSharedPointer<SqlNode> root = nodeStack.first();
+        nodeStack.clear();
+
+        if (DynamicSql::isStatic(*root)) {
+            context->addSql(sqlNamespace, currentSqlId, DynamicSql::text(*root).simplified());
+        } else {
+            DynamicSql::compile(*root);
+            context->addSql(sqlNamespace, currentSqlId, QString(), root);
+        }
     } else if (SQL_TAGNAME_INCLUDE == qName) {
         QString defKey = buildKey(sqlNamespace, currentIncludedDefineId);
         QString def    = defines.value(defKey);
 
         if (!def.isEmpty()) {
-            currentText += def;
+            appendText(" " + def + " ");
         } else {
             qDebug() << "Cannot find define: " << defKey;
         }
     } else if (SQL_TAGNAME_DEFINE == qName) {
         defines.insert(buildKey(sqlNamespace, currentDefineId), currentText.simplified());
+    } else if (nodeStack.size() > 1 && DynamicSql::isDynamicElement(qName)) {
+        nodeStack.removeLast();
     }
 
     return true;
 }
 
 bool SqlsPrivate::characters(const QString &str) {
-    currentText += str;
+    appendText(str);
     return true;
 }
 
+// 文本加入 <sql> 的当前节点，和前一个文本节点合并，不在 <sql> 中时加入 currentText
+void SqlsPrivate::appendText(const QString &text) {
+    if (nodeStack.isEmpty()) {
+        currentText += text;
+        return;
+    }
+
+    QVector<QSharedPointer<SqlNode>> &children = nodeStack.last()->children;
+
+    if (!children.isEmpty() && children.last()->type == SqlNode::Text) {
+        children.last()->text += text;
+    } else {
+        QSharedPointer<SqlNode> node(new SqlNode());
+        node->text = text;
+        children.append(node);
+    }
+}
+
 bool SqlsPrivate::fatalError(const QXmlParseException &exception) {
     qDebug() << QString("Parse error at line %1, column %2, message: %3")
                 .arg(exception.lineNumber())
@@ -135,18 +213,286 @@ bool SqlsPrivate::fatalError(const QXmlParseException &exception) {
  |                             Sqls implementation                             |
  |----------------------------------------------------------------------------*/
 Sqls::Sqls() {
-    SqlsPrivate(this); // 读取 SQL 文件，内容放到 QHash sqls 里
+    // 1. 配置了缓存文件并且 SQL 文件没有修改过时，直接加载缓存文件
+    // 2. 否则读取 SQL 文件，内容放到 statements 里，然后保存缓存文件
+    QStringList sqlFiles = Config::instance().getDatabaseSqlFiles();
+    QString cacheFile    = Config::instance().getDatabaseSqlCacheFile();
+
+    // [1] 配置了缓存文件并且 SQL 文件没有修改过时，直接加载缓存文件
+    if (!cacheFile.isEmpty() && loadCache(cacheFile, sqlFiles)) {
+        return;
+    }
+
+    // [2] 否则读取 SQL 文件，内容放到 statements 里，然后保存缓存文件
+    SqlsPrivate(this);
+
+    if (!cacheFile.isEmpty()) {
+        saveCache(cacheFile, sqlFiles);
+    }
 }
 
 Sqls::~Sqls() {
 }
 
 QString Sqls::getSql(const QString &sqlNamespace, const QString &sqlId) {
-    QString sql = sqls.value(SqlsPrivate::buildKey(sqlNamespace, sqlId));
+    SqlHandle h = handle(sqlNamespace, sqlId);
 
-    if (sql.isEmpty()) {
+    if (!h.isValid()) {
         qDebug() << QString("Cannot find SQL for %1::%2").arg(sqlNamespace).arg(sqlId);
     }
 
-    return sql;
+    return statement(h).sql;
+}
+
+// 取得 SQL 语句的句柄
+SqlHandle Sqls::handle(const QString &sqlNamespace, const QString &sqlId) const {
+    SqlHandle h;
+    h.value = handles.value(SqlsPrivate::buildKey(sqlNamespace, sqlId), -1);
+
+    return h;
+}
+
+// 取得句柄对应的 SQL 语句
+const SqlStatement& Sqls::statement(SqlHandle handle) const {
+    static const SqlStatement EMPTY;
+
+    if (handle.value < 0) {
+        return EMPTY;
+    } else if (handle.value < statements.size()) {
+        return statements.at(handle.value);
+    }
+
+    // 动态 SQL 展开后的 SQL，添加后不会删除，所以离开锁后返回的引用仍然有效
+    QReadLocker locker(&shapesLock);
+    int index = handle.value - statements.size();
+
+    return index < shapes.size() ? *shapes.at(index) : EMPTY;
+}
+
+// 检查绑定的参数是否和 SQL 中的参数一致
+bool Sqls::checkParams(SqlHandle handle, const QVariantMap &params) const {
+    const SqlStatement &s = statement(handle);
+    QStringList missing;
+    QStringList unused;
+
+    for (const QString &name : s.parameters) {
+        if (!params.contains(name)) {
+            missing << name;
+        }
+    }
+
+    // 动态 SQL 展开后，条件不成立的部分中的参数不会被使用，所以不检查多余的参数
+    for (auto iter = params.constBegin(); iter != params.constEnd() && !s.source.isValid(); ++iter) {
+        if (!s.parameters.contains(iter.key())) {
+            unused << iter.key();
+        }
+    }
+
+    if (missing.isEmpty() && unused.isEmpty()) {
+        return true;
+    }
+
+    qDebug().noquote() << QString("Params mismatch for %1::%2, missing: [%3], unused: [%4]")
+                          .arg(s.sqlNamespace).arg(s.id).arg(missing.join(", ")).arg(unused.join(", "));
+    return false;
+}
+
+// 句柄对应的 SQL 是否为动态 SQL
+bool Sqls::isDynamic(SqlHandle handle) const {
+    return !statement(handle).root.isNull();
+}
+
+// 根据参数展开动态 SQL
+SqlRef Sqls::expand(SqlHandle handle, const QVariantMap &params, QVariantMap *boundParams) {
+    // 1. 不是动态 SQL 时直接返回
+    // 2. 计算 SQL 的形状和绑定的参数，形状已经缓存过时返回它的句柄，不拼接 SQL
+    // 3. 形状没有缓存过时生成 SQL，缓存的形状没有超过上限时分配新的句柄，否则只返回 SQL 语句
+
+    // [1] 不是动态 SQL 时直接返回
+    const SqlStatement &s = statement(handle);
+
+    if (s.root.isNull()) {
+        *boundParams = params;
+        return SqlRef(handle);
+    }
+
+    // [2] 计算 SQL 的形状和绑定的参数，形状已经缓存过时返回它的句柄，不拼接 SQL
+    QString shapeKey = QString::number(handle.value) + ":";
+    DynamicSql::expand(*s.root, params, &shapeKey, boundParams, nullptr);
+
+    SqlHandle shape;
+    {
+        QReadLocker locker(&shapesLock);
+        shape.value = shapeHandles.value(shapeKey, -1);
+    }
+
+    if (shape.isValid()) {
+        return SqlRef(shape);
+    }
+
+    // [3] 形状没有缓存过时生成 SQL，缓存的形状没有超过上限时分配新的句柄，否则只返回 SQL 语句
+    QString sql;
+    QString key;
+    DynamicSql::expand(*s.root, params, &key, boundParams, &sql);
+
+    QSharedPointer<SqlStatement> expanded(new SqlStatement());
+    expanded->sqlNamespace = s.sqlNamespace;
+    expanded->id           = s.id;
+    expanded->sql          = sql;
+    expanded->placeholders = StatementCache::placeholders(sql, sqlDbmsType());
+    expanded->parameters   = expanded->placeholders;
+    expanded->parameters.removeDuplicates();
+    expanded->source       = handle;
+
+    QWriteLocker locker(&shapesLock);
+    shape.value = shapeHandles.value(shapeKey, -1); // 其他线程可能已经添加了这个形状
+
+    if (!shape.isValid()) {
+        if (shapes.size() >= SQL_MAX_SHAPES) {
+            return SqlRef(sql);
+        }
+
+        shape.value = statements.size() + shapes.size();
+        shapes.append(expanded);
+        shapeHandles.insert(shapeKey, shape.value);
+    }
+
+    locker.unlock();
+    return SqlRef(shape);
+}
+
+// 添加 SQL 语句
+void Sqls::addSql(const QString &sqlNamespace, const QString &sqlId, const QString &sql, QSharedPointer<SqlNode> root) {
+    // 1. 解析 SQL 中的参数，PostgreSQL 的 [] 不是引号，动态 SQL 展开后再解析
+    // 2. 同名的 SQL 替换以前的，使用以前的句柄，否则分配新的句柄
+
+    // [1] 解析 SQL 中的参数，PostgreSQL 的 [] 不是引号，动态 SQL 展开后再解析
+    SqlStatement s;
+    s.sqlNamespace = sqlNamespace;
+    s.id           = sqlId;
+    s.sql          = sql;
+    s.placeholders = StatementCache::placeholders(sql, sqlDbmsType());
+    s.parameters   = s.placeholders;
+    s.parameters.removeDuplicates();
+    s.root         = root;
+
+    // [2] 同名的 SQL 替换以前的，使用以前的句柄，否则分配新的句柄
+    QString key = SqlsPrivate::buildKey(sqlNamespace, sqlId);
+    int h = handles.value(key, -1);
+
+    if (h >= 0) {
+        statements[h] = s;
+    } else {
+        handles.insert(key, statements.size());
+        statements.append(s);
+    }
+}
+
+// 加载二进制的缓存文件
+bool Sqls::loadCache(const QString &cacheFile, const QStringList &sqlFiles) {
+    // 1. 缓存文件不存在，或者有 SQL 文件比它新时不使用缓存
+    // 2. 检查文件头和版本，缓存的 SQL 文件列表和解析参数时的数据库类型需要和配置的相同
+    // 3. 读取所有的 SQL 语句，按顺序分配句柄，动态 SQL 的节点需要重新编译
+
+    // [1] 缓存文件不存在，或者有 SQL 文件比它新时不使用缓存
+    QFileInfo cacheInfo(cacheFile);
+
+    if (!cacheInfo.exists()) {
+        return false;
+    }
+
+    for (const QString &sqlFile : sqlFiles) {
+        QFileInfo info(sqlFile);
+
+        if (!info.exists() || info.lastModified() > cacheInfo.lastModified()) {
+            return false;
+        }
+    }
+
+    // [2] 检查文件头和版本，缓存的 SQL 文件列表和解析参数时的数据库类型需要和配置的相同 (参数的位置和数据库类型有关)
+    QFile file(cacheFile);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic   = 0;
+    quint32 version = 0;
+    QStringList files;
+    qint32 dbmsType = 0;
+    qint32 count = 0;
+    in >> magic >> version;
+
+    if (magic != SQL_CACHE_MAGIC || version != SQL_CACHE_VERSION) {
+        return false;
+    }
+
+    in >> files >> dbmsType >> count;
+
+    if (files != sqlFiles || dbmsType != qint32(sqlDbmsType()) || count < 0) {
+        return false;
+    }
+
+    // [3] 读取所有的 SQL 语句，按顺序分配句柄，动态 SQL 的节点需要重新编译
+    QVector<SqlStatement> loaded;
+    loaded.reserve(count);
+
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        SqlStatement s;
+        bool dynamic = false;
+        in >> s.sqlNamespace >> s.id >> s.sql >> s.placeholders >> s.parameters >> dynamic;
+
+        if (dynamic) {
+            s.root.reset(new SqlNode());
+            in >> *s.root;
+            DynamicSql::compile(*s.root);
+        }
+
+        loaded.append(s);
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        qDebug() << QString("Invalid SQL cache file: %1").arg(cacheFile);
+        return false;
+    }
+
+    statements = loaded;
+    handles.clear();
+
+    for (int i = 0; i < statements.size(); ++i) {
+        handles.insert(SqlsPrivate::buildKey(statements.at(i).sqlNamespace, statements.at(i).id), i);
+    }
+
+    qDebug() << QString("Loaded SQL cache file: %1, %2 statements").arg(cacheFile).arg(count);
+    return true;
+}
+
+// 保存二进制的缓存文件
+void Sqls::saveCache(const QString &cacheFile, const QStringList &sqlFiles) const {
+    // 写入临时文件后再替换，避免程序中途退出时缓存文件不完整
+    QSaveFile file(cacheFile);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << QString("Cannot save SQL cache file: %1").arg(cacheFile);
+        return;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << SQL_CACHE_MAGIC << SQL_CACHE_VERSION << sqlFiles << qint32(sqlDbmsType()) << qint32(statements.size());
+
+    for (const SqlStatement &s : statements) {
+        out << s.sqlNamespace << s.id << s.sql << s.placeholders << s.parameters << !s.root.isNull();
+
+        if (!s.root.isNull()) {
+            out << *s.root;
+        }
+    }
+
+    if (!file.commit()) {
+        qDebug() << QString("Cannot save SQL cache file: %1").arg(cacheFile);
+    }
 }
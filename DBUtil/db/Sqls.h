@@ -2,15 +2,55 @@
 #define SQLS_H
 
 #include "util/Singleton.h"
+#include "DynamicSql.h"
 
 #include <QHash>
+#include <QVector>
 #include <QString>
+#include <QStringList>
+#include <QVariantMap>
+#include <QSharedPointer>
+#include <QReadWriteLock>
 
+class SqlRef;
 class SqlsPrivate;
 
+/**
+ * @brief SQL 语句的句柄，加载 SQL 文件后固定不变，可以保存在静态变量中，使用时不需要再拼接和 hash 字符串
+ */
+struct SqlHandle {
+    int value = -1;
+
+    bool isValid() const { return value >= 0; }
+};
+
+/**
+ * @brief SQL 文件中的一条 SQL 语句，<include> 在加载时已经替换为 <define> 的内容
+ */
+struct SqlStatement {
+    QString     sqlNamespace;
+    QString     id;
+    QString     sql;
+    QStringList placeholders; // SQL 中按出现顺序的命名参数 (不带冒号)，同一个参数出现多次时也出现多次
+    QStringList parameters;   // 去掉重复的参数名，用于检查 DAO 绑定的参数
+    QSharedPointer<SqlNode> root; // 动态 SQL 的根节点，静态 SQL 为 null，动态 SQL 的 sql 为空，需要先展开
+    SqlHandle   source;       // 动态 SQL 展开后的 SQL 对应的动态 SQL 的句柄，其他 SQL 为无效的句柄
+};
+
 /**
  * 用于加载 SQL 语句，用法.
  * qDebug() << Sqls::instance().getSql("User", "findByUserId");
+ *
+ * 频繁执行的 SQL 推荐使用句柄，句柄可以直接传给 DBUtil，预编译语句的缓存按句柄查找，参数的位置在加载时已经解析好:
+ *     static const SqlHandle SQL_FIND_ALL = Sqls::instance().handle("User", "findAll");
+ *     DBUtil::selectMaps(SQL_FIND_ALL);
+ *
+ * 配置了 database.sql_cache_file 时，SQL 文件解析后保存为二进制的缓存文件，
+ * 下次启动时如果 SQL 文件没有修改过 (文件列表相同并且都比缓存文件旧)，并且数据库类型没有改变 (解析参数的规则和它有关)，
+ * 直接加载缓存文件，不再解析 XML.
+ *
+ * <sql> 中可以使用 <if>、<where>、<set>、<foreach> 编写动态 SQL (参考 DynamicSql)，DBUtil 执行时根据参数展开，
+ * 展开后的 SQL 按形状缓存并分配新的句柄，形状相同的参数使用同一个句柄，也就复用同一个预编译的语句.
  */
 class Sqls {
     SINGLETON(Sqls)
@@ -18,11 +58,79 @@ class Sqls {
 public:
     QString getSql(const QString &sqlNamespace, const QString &sqlId); // 取得 SQL 语句
 
+    /**
+     * @brief 取得 SQL 语句的句柄
+     *
+     * @param sqlNamespace SQL 的 namespace
+     * @param sqlId        SQL 的 id
+     * @return 返回句柄，找不到 SQL 时返回无效的句柄
+     */
+    SqlHandle handle(const QString &sqlNamespace, const QString &sqlId) const;
+
+    /**
+     * @brief 取得句柄对应的 SQL 语句，句柄无效时返回空的 SqlStatement
+     */
+    const SqlStatement& statement(SqlHandle handle) const;
+
+    /**
+     * @brief 检查绑定的参数是否和 SQL 中的参数一致，缺少的参数会绑定为 NULL，多余的参数不会被使用
+     *
+     * @param handle SQL 的句柄
+     * @param params 绑定的参数
+     * @return 一致时返回 true，否则输出缺少和多余的参数，返回 false
+     */
+    bool checkParams(SqlHandle handle, const QVariantMap &params) const;
+
+    /**
+     * @brief 句柄对应的 SQL 是否为动态 SQL
+     */
+    bool isDynamic(SqlHandle handle) const;
+
+    /**
+     * @brief 根据参数展开动态 SQL，形状相同的参数返回同一个句柄，形状已经缓存过时不再拼接 SQL
+     *
+     * @param handle      动态 SQL 的句柄，不是动态 SQL 时直接返回它
+     * @param params      参数
+     * @param boundParams 保存需要绑定的参数: params 加上 <foreach> 生成的参数
+     * @return 返回展开后的 SQL 的句柄，缓存的形状超过 SQL_MAX_SHAPES 个时返回不带句柄的 SQL 语句
+     */
+    SqlRef expand(SqlHandle handle, const QVariantMap &params, QVariantMap *boundParams);
+
 private:
-    QHash<QString, QString> sqls; // Key 是 id, value 是 SQL 语句
+    // 添加 SQL 语句，同名的 SQL 替换以前的，root 不为 null 时为动态 SQL
+    void addSql(const QString &sqlNamespace, const QString &sqlId, const QString &sql,
+                QSharedPointer<SqlNode> root = QSharedPointer<SqlNode>());
+    bool loadCache(const QString &cacheFile, const QStringList &sqlFiles);  // 加载二进制的缓存文件
+    void saveCache(const QString &cacheFile, const QStringList &sqlFiles) const; // 保存二进制的缓存文件
+
+    QVector<SqlStatement> statements; // 下标为句柄
+    QHash<QString, int> handles;      // Key 是 namespace::id, value 是句柄
+
+    // 动态 SQL 展开后的 SQL，句柄为 statements.size() + 下标，运行时在多个线程中添加，使用读写锁保护
+    mutable QReadWriteLock shapesLock;
+    QVector<QSharedPointer<SqlStatement>> shapes;
+    QHash<QString, int> shapeHandles; // Key 是动态 SQL 的句柄和形状，value 是句柄
+
     friend class SqlsPrivate;
 };
 
+/**
+ * @brief DBUtil 的 SQL 参数，可以是 SQL 语句，也可以是 Sqls 中 SQL 的句柄，都可以隐式转换为 SqlRef
+ */
+class SqlRef {
+public:
+    SqlRef(const QString &sql) : text(sql) {}
+    SqlRef(const char *sql) : text(QString::fromUtf8(sql)) {}
+    SqlRef(SqlHandle handle) : text(Sqls::instance().statement(handle).sql), id(handle) {}
+
+    const QString& sql() const { return text; } // SQL 语句
+    SqlHandle handle() const { return id; }     // SQL 的句柄，不是 Sqls 中的 SQL 时无效
+
+private:
+    QString   text;
+    SqlHandle id;
+};
+
 #endif // SQLS_H
 
 /**
@@ -36,7 +144,7 @@ SQL 文件定义 Demo:
     <define id="fields">id, username, password, email, mobile</define>
 
     <sql id="findByUserId">
-        SELECT <include defineId="fields"/> FROM user WHERE id=%1
+        SELECT <include defineId="fields"/> FROM user WHERE id=:id
     </sql>
 
     <sql id="findAll">
@@ -53,6 +161,16 @@ SQL 文件定义 Demo:
             email=:email, mobile=:mobile
         WHERE id=:id
     </sql>
+
+    <sql id="search">
+        SELECT <include defineId="fields"/> FROM user
+        <where>
+            <if test="username != null and username != ''">AND username = :username</if>
+            <if test="ids.size > 0">
+                AND id IN <foreach collection="ids" item="id" open="(" separator="," close=")">:id</foreach>
+            </if>
+        </where>
+    </sql>
 </sqls>
 
 */
@@ -0,0 +1,132 @@
+#include "StatementCache.h"
+
+/*-----------------------------------------------------------------------------|
+ |                              PreparedStatement                              |
+ |----------------------------------------------------------------------------*/
+// 按位置绑定参数
+void PreparedStatement::bindValues(const QVariantMap &params) {
+    for (int i = 0; i < placeholders.size(); ++i) {
+        query.bindValue(i, params.value(placeholders.at(i)));
+    }
+}
+
+/*-----------------------------------------------------------------------------|
+ |                               StatementCache                                |
+ |----------------------------------------------------------------------------*/
+StatementCache::StatementCache(const QSqlDatabase &db, int capacity) : db(db) {
+    statements.setMaxCost(qMax(0, capacity));
+}
+
+// 取出 SQL 的预编译语句
+PreparedStatement* StatementCache::take(const QString &sql, SqlHandle handle) {
+    // 1. 缓存中有这条 SQL 的语句时取出它，有句柄时按句柄查找
+    // 2. 否则 prepare 一个新的语句，有句柄时使用 Sqls 解析好的参数，否则解析出参数的位置
+
+    // [1] 缓存中有这条 SQL 的语句时取出它，有句柄时按句柄查找
+    StatementKey key = handle.isValid() ? StatementKey { handle.value, QString() } : StatementKey { -1, sql };
+    PreparedStatement *statement = statements.take(key);
+
+    if (statement != nullptr) {
+        return statement;
+    }
+
+    // [2] 否则 prepare 一个新的语句，有句柄时使用 Sqls 解析好的参数，否则解析出参数的位置
+    statement = new PreparedStatement();
+    statement->sql    = sql;
+    statement->handle = handle;
+    statement->query  = QSqlQuery(db);
+    statement->query.setForwardOnly(true); // DBUtil 只向前遍历结果，QSqlQuery 不需要为向后移动缓存已经读取的行 (QMYSQL 的驱动仍然会缓存整个结果)
+    statement->query.prepare(sql);
+    statement->placeholders = handle.isValid()
+            ? Sqls::instance().statement(handle).placeholders
+            : placeholders(sql, db.driver() ? db.driver()->dbmsType() : QSqlDriver::UnknownDbms);
+
+    return statement;
+}
+
+// 放回 take() 取出的语句
+void StatementCache::put(PreparedStatement *statement, bool reusable) {
+    if (statement == nullptr) {
+        return;
+    }
+
+    // 释放结果集，MySQL 下结果集没有释放时不能再次执行这个语句
+    statement->query.finish();
+
+    if (!reusable || statements.maxCost() == 0) {
+        delete statement;
+        return;
+    }
+
+    // 超过容量时 QCache 释放最久没有使用的语句，insert 失败时 QCache 会释放 statement
+    if (statement->handle.isValid()) {
+        statements.insert(StatementKey { statement->handle.value, QString() }, statement, 1);
+    } else {
+        statements.insert(StatementKey { -1, statement->sql }, statement, 1);
+    }
+}
+
+// 释放所有缓存的语句
+void StatementCache::clear() {
+    statements.clear();
+}
+
+// 解析 SQL 中按出现顺序的命名参数
+QStringList StatementCache::placeholders(const QString &sql, QSqlDriver::DbmsType dbmsType, QList<int> *positions) {
+    // 和 Qt 一样只识别 ASCII 的字母和数字
+    auto isNameChar = [](QChar ch) {
+        ushort u = ch.unicode();
+        return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') || u == '_';
+    };
+
+    QStringList names;
+    QChar closingQuote;
+    bool ignoreBrackets   = dbmsType == QSqlDriver::PostgreSQL;
+    bool backslashEscapes = dbmsType == QSqlDriver::MySqlServer;
+    int n = sql.size();
+    int i = 0;
+
+    while (i < n) {
+        QChar ch = sql.at(i);
+
+        if (!closingQuote.isNull()) {
+            // 引号中的内容，SQL Server 的 ]] 是转义的 ]，MySQL 的字符串中 \ 转义下一个字符 (例如 'a\'b')
+            if (backslashEscapes && ch == '\\' && closingQuote != '`') {
+                ++i;
+            } else if (ch == closingQuote) {
+                if (closingQuote == ']' && i + 1 < n && sql.at(i + 1) == closingQuote) {
+                    ++i;
+                } else {
+                    closingQuote = QChar();
+                }
+            }
+
+            ++i;
+        } else if (ch == ':' && (i == 0 || sql.at(i - 1) != ':') && i + 1 < n && isNameChar(sql.at(i + 1))) {
+            // 命名参数
+            int end = i + 2;
+
+            while (end < n && isNameChar(sql.at(end))) {
+                ++end;
+            }
+
+            names << sql.mid(i + 1, end - i - 1);
+
+            if (positions != nullptr) {
+                positions->append(i);
+            }
+
+            i = end;
+        } else {
+            if (ch == '\'' || ch == '"' || ch == '`') {
+                closingQuote = ch;
+            } else if (!ignoreBrackets && ch == '[') {
+                closingQuote = ']';
+            }
+
+            ++i;
+        }
+    }
+
+    return names;
+}
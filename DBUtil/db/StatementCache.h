@@ -0,0 +1,106 @@
+#ifndef STATEMENTCACHE_H
+#define STATEMENTCACHE_H
+
+#include <QCache>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+#include <QtSql>
+
+#include "Sqls.h"
+
+/**
+ * @brief 预编译好的 SQL 语句，placeholders 为 SQL 中按出现顺序的命名参数 (不带冒号)，
+ *        第 i 个参数绑定到 query 的第 i 个位置，不需要每次执行时拼接 ":" + key 再按名字查找
+ */
+struct PreparedStatement {
+    QString     sql;
+    SqlHandle   handle; // Sqls 中的 SQL 的句柄，不是 Sqls 中的 SQL 时无效
+    QSqlQuery   query;
+    QStringList placeholders;
+
+    /**
+     * @brief 按位置绑定参数，params 中没有的参数绑定为 NULL，避免复用的 query 保留上一次执行时绑定的值
+     *
+     * @param params 参数，key 为参数名
+     */
+    void bindValues(const QVariantMap &params);
+};
+
+/**
+ * @brief 语句缓存的 key，Sqls 中的 SQL 按句柄比较，不需要 hash SQL 语句，其他 SQL 按 SQL 语句比较
+ */
+struct StatementKey {
+    int     handle; // Sqls 中 SQL 的句柄，不是 Sqls 中的 SQL 时为 -1
+    QString sql;    // 没有句柄时为 SQL 语句，有句柄时为空
+
+    bool operator==(const StatementKey &other) const {
+        return handle == other.handle && (handle >= 0 || sql == other.sql);
+    }
+};
+
+inline uint qHash(const StatementKey &key, uint seed = 0) {
+    return key.handle >= 0 ? qHash(key.handle, seed) : qHash(key.sql, seed);
+}
+
+/**
+ * 一个数据库连接的预编译语句缓存，key 为 SQL 语句或者 Sqls 中 SQL 的句柄，两种 key 的语句在同一个 QCache 中，
+ * 共用 capacity，使用 QCache 淘汰最久没有使用的语句 (LRU)。
+ * 重复执行的 SQL 不需要再次 prepare，省去数据库服务端解析 SQL 的时间。
+ *
+ * 连接只能在创建它的线程中使用，所以缓存也只在这个线程中访问，不需要加锁，由 ConnectionPool 为每个连接创建和释放。
+ *
+ * 使用方法:
+ *     PreparedStatement *statement = cache->take(sql); // 取出后缓存中没有它，嵌套执行相同的 SQL 时会 prepare 新的语句
+ *     statement->bindValues(params);
+ *     statement->query.exec();
+ *     cache->put(statement, ok); // 执行成功后放回缓存，失败时释放 (连接可能断开了)
+ */
+class StatementCache {
+public:
+    /**
+     * @param db       数据库连接
+     * @param capacity 最多缓存的语句数，为 0 时不缓存
+     */
+    StatementCache(const QSqlDatabase &db, int capacity);
+
+    /**
+     * @brief 取出 SQL 的预编译语句，缓存中没有时 prepare 一个新的语句，prepare 失败时 query.lastError() 为错误信息。
+     *        传入 Sqls 的句柄时按句柄查找，不需要 hash SQL 语句，新的语句使用 Sqls 加载时解析好的参数
+     *
+     * @param sql    SQL 语句
+     * @param handle SQL 的句柄，不是 Sqls 中的 SQL 时无效
+     * @return 返回预编译的语句，使用完后需要调用 put() 放回
+     */
+    PreparedStatement* take(const QString &sql, SqlHandle handle = SqlHandle());
+
+    /**
+     * @brief 放回 take() 取出的语句
+     *
+     * @param statement 预编译的语句
+     * @param reusable  是否可以复用，为 false 时释放语句
+     */
+    void put(PreparedStatement *statement, bool reusable);
+
+    /**
+     * @brief 释放所有缓存的语句，连接关闭或者重新连接前需要调用
+     */
+    void clear();
+
+    /**
+     * @brief 解析 SQL 中按出现顺序的命名参数，规则和 Qt 把命名参数转为位置参数时相同:
+     *        冒号后跟字母、数字或下划线，跳过引号中的内容和 PostgreSQL 的 :: 类型转换
+     *
+     * @param sql       SQL 语句
+     * @param dbmsType  数据库的类型，PostgreSQL 的 [] 不是引号，MySQL 的字符串中 \ 转义下一个字符
+     * @param positions 不为 nullptr 时保存每个参数的冒号在 SQL 中的位置
+     * @return 返回参数名的 list，不带冒号，同一个参数出现多次时也出现多次
+     */
+    static QStringList placeholders(const QString &sql, QSqlDriver::DbmsType dbmsType, QList<int> *positions = nullptr);
+
+private:
+    QSqlDatabase db;
+    QCache<StatementKey, PreparedStatement> statements; // key 为 Sqls 中 SQL 的句柄或者 SQL 语句
+};
+
+#endif // STATEMENTCACHE_H
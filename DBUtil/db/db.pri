@@ -1,9 +1,19 @@
 HEADERS += \
     $$PWD/ConnectionPool.h \
+    $$PWD/DBExecutor.h \
+    $$PWD/DBProfiler.h \
     $$PWD/DBUtil.h \
-    $$PWD/Sqls.h
+    $$PWD/DynamicSql.h \
+    $$PWD/Sqls.h \
+    $$PWD/SqlTable.h \
+    $$PWD/StatementCache.h
 
 SOURCES += \
     $$PWD/ConnectionPool.cpp \
+    $$PWD/DBExecutor.cpp \
+    $$PWD/DBProfiler.cpp \
     $$PWD/DBUtil.cpp \
-    $$PWD/Sqls.cpp
+    $$PWD/DynamicSql.cpp \
+    $$PWD/Sqls.cpp \
+    $$PWD/SqlTable.cpp \
+    $$PWD/StatementCache.cpp
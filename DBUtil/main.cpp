@@ -4,10 +4,13 @@
 #include "db/Sqls.h"
 #include "db/DBUtil.h"
 #include "db/ConnectionPool.h"
+#include "db/DBExecutor.h"
+#include "db/DBProfiler.h"
 #include "util/Config.h"
 #include "Thread.h"
 
 #include <QDebug>
+#include <QTimer>
 #include <QPluginLoader>
 #include <QApplication>
 #include <QPushButton>
@@ -16,17 +19,24 @@ void useDBUtil();
 void useSqlFromFile();
 void useDao();
 void useThreads();
+void useBatch();
+void useExecutor();
+void useProfiler();
 void testOnBorrow();
 void loadMySqlDriver();
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
+    ConnectionPool::instance().warmUp(); // 预先创建主线程的连接
 
     //    loadMySqlDriver();
     //    useDBUtil();
     //    useSqlFromFile();
     useDao();
     //    useThreads();
+    //    useBatch();
+    //    useExecutor();
+    //    useProfiler();
     //    testOnBorrow();
 
     return app.exec();
@@ -62,6 +72,32 @@ void useDBUtil() {
 
     qDebug() << DBUtil::selectMap("select * from user where id=:id", params);
     qDebug() << DBUtil::selectString("select username from user where id=:id", params);
+
+    // 7. 查询结果按列保存，行数很多时使用
+    qDebug() << "\n7. 查询结果按列保存，行数很多时使用";
+    SqlTable table = DBUtil::selectTable("select id, username, email from user");
+    int usernameColumn = table.columnIndex("username");
+
+    for (int row = 0; row < table.rowCount(); ++row) {
+        qDebug() << table.int64(row, 0) << table.string(row, usernameColumn);
+    }
+
+    for (const SqlTable::Row &row : table) {
+        qDebug() << row.toMap();
+    }
+
+    // 8. 使用游标遍历查询结果，内存中最多只有一批数据，可以提前结束
+    qDebug() << "\n8. 使用游标遍历查询结果，内存中最多只有一批数据，可以提前结束";
+    DBUtil::forEach("select id, username from user", QVariantMap(), [](const SqlTable::Row &row) {
+        qDebug() << row.int64(0) << row.value("username");
+        return row.int64(0) < 10; // id 为 10 时停止
+    }, 100);
+
+    DBUtil::Cursor cursor("select id, username from user where id>:id", params);
+
+    while (cursor.next()) {
+        qDebug() << cursor.value("username");
+    }
 }
 
 void useSqlFromFile() {
@@ -69,7 +105,19 @@ void useSqlFromFile() {
     qDebug() << Sqls::instance().getSql("User", "findByUserId");
     qDebug() << Sqls::instance().getSql("User", "findByUserId");
     qDebug() << Sqls::instance().getSql("User", "findByUserId-1"); // 找不到这条 SQL 语句会有提示
-    qDebug() << DBUtil::selectMap(Sqls::instance().getSql("User", "findByUserId").arg(2));
+
+    // 使用 SQL 的句柄，参数的位置在加载 SQL 文件时已经解析好
+    QVariantMap params;
+    params["id"] = 2;
+    SqlHandle handle = Sqls::instance().handle("User", "findByUserId");
+    qDebug() << Sqls::instance().statement(handle).parameters;
+    qDebug() << DBUtil::selectMap(handle, params);
+
+    // 动态 SQL: 根据参数生成 SELECT ... FROM user WHERE id IN (:__id_0, :__id_1)
+    QVariantMap searchParams;
+    searchParams["ids"] = QVariantList() << 1 << 2;
+    SqlHandle search = Sqls::instance().handle("User", "search");
+    qDebug() << DBUtil::selectMaps(search, searchParams);
 }
 
 void useDao() {
@@ -98,6 +146,83 @@ void useThreads() {
         // 导致部分连接建立失败，于是等待 100 毫秒才启动下一个线程
         QThread::msleep(100);
     }
+
+    // 100 个线程同时打开的连接数不超过 max_connection_count，5 秒后输出连接池的统计信息
+    QTimer::singleShot(5000, [] {
+        ConnectionPoolStats stats = ConnectionPool::instance().stats();
+        qDebug().noquote() << QString("Pool: total %1, active %2, idle %3, borrows %4, waits %5, timeouts %6, created %7, closed %8")
+                              .arg(stats.total).arg(stats.active).arg(stats.idle).arg(stats.borrows)
+                              .arg(stats.waits).arg(stats.timeouts).arg(stats.created).arg(stats.closed);
+    });
+}
+
+// 批量插入和事务
+void useBatch() {
+    QString sql = Sqls::instance().getSql("User", "insert");
+    QList<QVariantMap> rows;
+
+    for (int i = 0; i < 1000; ++i) {
+        QVariantMap row;
+        row["username"] = QString("user-%1").arg(i);
+        row["password"] = "passw0rd";
+        row["email"]    = QString("user-%1@gmail.com").arg(i);
+        row["mobile"]   = "";
+        rows << row;
+    }
+
+    // 1. 1000 行在一个事务中插入，MySQL 下合并为 2 条 INSERT 语句
+    qDebug() << "Inserted:" << DBUtil::insertBatch(sql, rows);
+
+    // 2. 事务中的 DBUtil 调用使用同一个连接，嵌套的事务使用保存点，没有提交时只回滚嵌套的部分
+    DBUtil::Transaction transaction;
+    DBUtil::update("DELETE FROM user WHERE username LIKE 'user-%'");
+
+    {
+        DBUtil::Transaction nested;
+        DBUtil::insertBatch(sql, rows.mid(0, 10));
+    } // 回滚到保存点，这 10 行没有插入
+
+    qDebug() << "Commit:" << transaction.commit();
+}
+
+// 在工作线程中异步访问数据库，点击按钮时界面不会卡住
+void useExecutor() {
+    QPushButton *button = new QPushButton("Async Query");
+    button->show();
+
+    QObject::connect(button, &QPushButton::clicked, [button] {
+        button->setEnabled(false);
+
+        // 结果在 GUI 线程中处理，3 秒还没有查询完时取消
+        DBExecutor::instance().run<QList<User>>([] {
+            return UserDao::findtAll();
+        }, button, [button](const QFuture<QList<User>> &future) {
+            button->setEnabled(true);
+
+            if (future.isCanceled()) {
+                qDebug() << "Query timeout";
+                return;
+            }
+
+            for (const User &user : future.result()) {
+                qDebug() << user.toString();
+            }
+        }, 3000);
+    });
+}
+
+// 统计 SQL 的执行时间，找出耗时最多的 SQL
+void useProfiler() {
+    DBProfiler::instance().setEnabled(true);
+    DBProfiler::instance().setSlowQueryThreshold(100); // 超过 100 毫秒的 SQL 输出到日志
+
+    for (int i = 0; i < 100; ++i) {
+        UserDao::findByUserId(i % 3 + 1);
+        UserDao::findtAll();
+        DBUtil::selectInt(QString("SELECT id FROM user WHERE id=%1").arg(i)); // 按 SELECT id FROM user WHERE id=? 统计
+    }
+
+    qDebug().noquote() << DBProfiler::instance().report(10);
 }
 
 // 测试自动重连数据库，可解决数据库崩溃，MySQL 6 个小时自动断开不活跃连接的问题
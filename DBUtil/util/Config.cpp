@@ -48,6 +48,26 @@ int Config::getDatabaseMaxConnectionCount() const {
     return json->getInt("database.max_connection_count", 5);
 }
 
+int Config::getDatabaseMaxIdleTime() const {
+    return json->getInt("database.max_idle_time", 600000);
+}
+
+int Config::getDatabaseMaxLifetime() const {
+    return json->getInt("database.max_lifetime", 1800000);
+}
+
+int Config::getDatabaseValidationInterval() const {
+    return json->getInt("database.validation_interval", 30000);
+}
+
+int Config::getDatabaseStatementCacheSize() const {
+    return json->getInt("database.statement_cache_size", 64);
+}
+
+int Config::getDatabaseFetchBatchSize() const {
+    return json->getInt("database.fetch_batch_size", 1000);
+}
+
 int Config::getDatabasePort() const {
     return json->getInt("database.port", 0);
 }
@@ -56,10 +76,22 @@ bool Config::isDatabaseDebug() const {
     return json->getBool("database.debug", false);
 }
 
+bool Config::isDatabaseProfile() const {
+    return json->getBool("database.profile", false);
+}
+
+int Config::getDatabaseSlowQueryThreshold() const {
+    return json->getInt("database.slow_query_threshold", 0);
+}
+
 QStringList Config::getDatabaseSqlFiles() const {
     return json->getStringList("database.sql_files");
 }
 
+QString Config::getDatabaseSqlCacheFile() const {
+    return json->getString("database.sql_cache_file");
+}
+
 QStringList Config::getQssFiles() const {
     return json->getStringList("qss_files");
 }
@@ -25,9 +25,17 @@ public:
     bool getDatabaseTestOnBorrow() const;       // 是否验证连接
     int  getDatabaseMaxWaitTime() const;        // 线程获取连接最大等待时间
     int  getDatabaseMaxConnectionCount() const; // 最大连接数
+    int  getDatabaseMaxIdleTime() const;        // 空闲连接的最长空闲时间
+    int  getDatabaseMaxLifetime() const;        // 连接最长使用的时间
+    int  getDatabaseValidationInterval() const; // 空闲超过这个时间的连接借出前先验证
+    int  getDatabaseStatementCacheSize() const; // 每个连接缓存的预编译语句数
+    int  getDatabaseFetchBatchSize() const;     // 游标每批读取的行数
     int  getDatabasePort() const;               // 数据库的端口号
     bool isDatabaseDebug() const;               // 是否打印出执行的 SQL 语句和参数
+    bool isDatabaseProfile() const;             // 是否统计每条 SQL 的执行时间、行数和字节数
+    int  getDatabaseSlowQueryThreshold() const; // 慢查询的阈值，单位为毫秒，执行时间超过它的 SQL 输出到日志，小于等于 0 时不输出
     QStringList getDatabaseSqlFiles() const;    // SQL 语句文件, 可以是多个
+    QString getDatabaseSqlCacheFile() const;    // SQL 语句文件解析后的二进制缓存文件，为空时不使用缓存
 
     // 其它
     QStringList getQssFiles() const; // QSS 样式表文件, 可以是多个
@@ -8,9 +8,30 @@
 #include <QStringList>
 #include <QSettings>
 #include <QWidget>
+#include <QJsonDocument>
+#include <QFileSystemWatcher>
+#include <QTimer>
+
+static const char *CONFIG_FILE = "data/config.json"; // 配置文件路径
+static const int CONFIG_RELOAD_DELAY   = 300;   // 文件修改后延迟重新加载的时间，单位为毫秒
+static const int CONFIG_RELOAD_RETRIES = 10;    // 文件不存在时重试的次数
+
+ConfigUtil::ConfigUtil() : reloadRetries(0) {
+    // 第一次加载失败时也使用默认值的配置，保证 snapshot() 总是有效
+    ConfigSnapshot *snapshot = load(CONFIG_FILE);
+    publish((nullptr != snapshot) ? snapshot : new ConfigSnapshot());
+
+    reloadTimer = new QTimer(this);
+    reloadTimer->setSingleShot(true);
+    reloadTimer->setInterval(CONFIG_RELOAD_DELAY);
+    connect(reloadTimer, &QTimer::timeout, this, &ConfigUtil::reload);
+
+    watcher = new QFileSystemWatcher(QStringList() << CONFIG_FILE, this);
+    connect(watcher, &QFileSystemWatcher::fileChanged, this, [this] {
+        reloadRetries = 0;
+        reloadTimer->start(); // 重新开始计时，合并连续的修改
+    });
 
-ConfigUtil::ConfigUtil() {
-    config = new JsonReader(QString("data/config.json")); // 配置文件路径
     guiSettings = new QSettings("data/gui.ini", QSettings::IniFormat);
     guiSettings->setIniCodec("UTF-8");
 }
@@ -20,8 +41,10 @@ ConfigUtil::~ConfigUtil() {
 }
 
 void ConfigUtil::release() {
-    delete config;
-    config = NULL;
+    delete watcher;
+    watcher = NULL;
+    delete reloadTimer;
+    reloadTimer = NULL;
 
     if (NULL != guiSettings) {
         guiSettings->sync(); // 保存配置
@@ -31,64 +54,167 @@ void ConfigUtil::release() {
     guiSettings = NULL;
 }
 
+// 当前的配置
+QSharedPointer<const ConfigSnapshot> ConfigUtil::snapshot() const {
+    QMutexLocker locker(&mutex);
+    return currentShared;
+}
+
+// 替换当前的配置，被替换的配置在最后一个持有它的读者释放引用后才释放
+void ConfigUtil::publish(ConfigSnapshot *snapshot) {
+    QSharedPointer<const ConfigSnapshot> shared(snapshot);
+    QSharedPointer<const ConfigSnapshot> old; // 没有读者持有时在锁外释放
+
+    {
+        QMutexLocker locker(&mutex);
+        old = currentShared;
+        currentShared = shared;
+    }
+}
+
+// 重新加载 config.json，成功时替换当前的配置
+void ConfigUtil::reload() {
+    // 1. 编辑器保存时可能先删除再创建文件，文件不存在时稍后重试，QFileSystemWatcher 会不再监视它，需要重新加入
+    // 2. 解析配置文件，无效时继续使用原来的配置
+    // 3. 替换当前的配置
+    // 4. 发射 configChanged() 通知配置已经修改
+
+    // [1] 编辑器保存时可能先删除再创建文件，文件不存在时稍后重试，QFileSystemWatcher 会不再监视它，需要重新加入
+    if (!QFile::exists(CONFIG_FILE)) {
+        if (++reloadRetries <= CONFIG_RELOAD_RETRIES) {
+            reloadTimer->start();
+        } else {
+            qWarning() << QString("%1 does not exist, stop watching it").arg(CONFIG_FILE);
+        }
+
+        return;
+    }
+
+    if (!watcher->files().contains(CONFIG_FILE)) {
+        watcher->addPath(CONFIG_FILE);
+    }
+
+    // [2] 解析配置文件，无效时继续使用原来的配置
+    ConfigSnapshot *snapshot = load(CONFIG_FILE);
+
+    if (nullptr == snapshot) {
+        qWarning() << QString("%1 is invalid, keep using the previous config").arg(CONFIG_FILE);
+        return;
+    }
+
+    // [3] 替换当前的配置
+    publish(snapshot);
+
+    // [4] 发射 configChanged() 通知配置已经修改
+    qInfo() << QString("%1 reloaded").arg(CONFIG_FILE);
+    emit configChanged();
+}
+
+// 解析配置文件，无效时返回 nullptr
+ConfigSnapshot* ConfigUtil::load(const QString &path) {
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return nullptr;
+    }
+
+    // JsonReader 不报告解析错误，先检查是否为有效的 JSON 对象
+    QByteArray data = file.readAll();
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(data, &error);
+
+    if (QJsonParseError::NoError != error.error || !document.isObject()) {
+        return nullptr;
+    }
+
+    JsonReader json(data);
+    ConfigSnapshot *s = new ConfigSnapshot();
+
+    s->databaseType               = json.getString("database.type");
+    s->databaseHost               = json.getString("database.host");
+    s->databaseName               = json.getString("database.database_name");
+    s->databaseUsername           = json.getString("database.username");
+    s->databasePassword           = json.getString("database.password");
+    s->databaseTestOnBorrow       = json.getBool("database.test_on_borrow", false);
+    s->databaseTestOnBorrowSql    = json.getString("database.test_on_borrow_sql", "SELECT 1");
+    s->databaseMaxWaitTime        = json.getInt("database.max_wait_time", 5000);
+    s->databaseMaxConnectionCount = json.getInt("database.max_connection_count", 5);
+    s->databasePort               = json.getInt("database.port", 0);
+    s->databaseDebug              = json.getBool("database.debug", false);
+    s->databaseSqlFiles           = json.getStringList("database.sql_files");
+
+    s->qssFiles      = json.getStringList("qss_files");
+    s->layoutPadding = json.getInt("ui.padding", 10);
+    s->layoutSpacing = json.getInt("ui.spacing", 5);
+
+    s->loginUrl       = json.getString("loginUrl");
+    s->cameraUrl      = json.getString("cameraUrl");
+    s->timeServiceUrl = json.getString("timeServiceUrl");
+    s->schoolUrl      = json.getString("schoolUrl");
+    s->manualSignUrl  = json.getString("manualSign");
+    s->debug          = json.getBool("debug");
+
+    return s;
+}
+
 QString ConfigUtil::getDatabaseType() const {
-    return config->getString("database.type");
+    return snapshot()->databaseType;
 }
 
 QString ConfigUtil::getDatabaseHost() const {
-    return config->getString("database.host");
+    return snapshot()->databaseHost;
 }
 
 QString ConfigUtil::getDatabaseName() const {
-    return config->getString("database.database_name");
+    return snapshot()->databaseName;
 }
 
 QString ConfigUtil::getDatabaseUsername() const {
-    return config->getString("database.username");
+    return snapshot()->databaseUsername;
 }
 
 QString ConfigUtil::getDatabasePassword() const {
-    return config->getString("database.password");
+    return snapshot()->databasePassword;
 }
 
 bool ConfigUtil::getDatabaseTestOnBorrow() const {
-    return config->getBool("database.test_on_borrow", false);
+    return snapshot()->databaseTestOnBorrow;
 }
 
 QString ConfigUtil::getDatabaseTestOnBorrowSql() const {
-    return config->getString("database.test_on_borrow_sql", "SELECT 1");
+    return snapshot()->databaseTestOnBorrowSql;
 }
 
 int ConfigUtil::getDatabaseMaxWaitTime() const {
-    return config->getInt("database.max_wait_time", 5000);
+    return snapshot()->databaseMaxWaitTime;
 }
 
 int ConfigUtil::getDatabaseMaxConnectionCount() const {
-    return config->getInt("database.max_connection_count", 5);
+    return snapshot()->databaseMaxConnectionCount;
 }
 
 int ConfigUtil::getDatabasePort() const {
-    return config->getInt("database.port", 0);
+    return snapshot()->databasePort;
 }
 
 bool ConfigUtil::isDatabaseDebug() const {
-    return config->getBool("database.debug", false);
+    return snapshot()->databaseDebug;
 }
 
 QStringList ConfigUtil::getDatabaseSqlFiles() const {
-    return config->getStringList("database.sql_files");
+    return snapshot()->databaseSqlFiles;
 }
 
 QStringList ConfigUtil::getQssFiles() const {
-    return config->getStringList("qss_files");
+    return snapshot()->qssFiles;
 }
 
 int ConfigUtil::getLayoutPadding() const {
-    return config->getInt("ui.padding", 10);
+    return snapshot()->layoutPadding;
 }
 
 int ConfigUtil::getLayoutSpacing() const {
-    return config->getInt("ui.spacing", 5);
+    return snapshot()->layoutSpacing;
 }
 
 void ConfigUtil::saveWindowGeometry(const QString &groupName, QWidget *window) {
@@ -102,27 +228,27 @@ void ConfigUtil::restoreWindowGeometry(const QString &groupName, QWidget *window
 }
 
 QString ConfigUtil::getLoginUrl() const {
-    return config->getString("loginUrl");
+    return snapshot()->loginUrl;
 }
 
 QString ConfigUtil::getCameraUrl() const {
-    return config->getString("cameraUrl");
+    return snapshot()->cameraUrl;
 }
 
 QString ConfigUtil::getTimeServiceUrl() const {
-    return config->getString("timeServiceUrl");
+    return snapshot()->timeServiceUrl;
 }
 
 QString ConfigUtil::getSchoolUrl() const {
-    return config->getString("schoolUrl");
+    return snapshot()->schoolUrl;
 }
 
 QString ConfigUtil::getManualSignUrl() const {
-    return config->getString("manualSign");
+    return snapshot()->manualSignUrl;
 }
 
 bool ConfigUtil::isDebug() const {
-    return config->getBool("debug");
+    return snapshot()->debug;
 }
 
 QVariant ConfigUtil::getGuiValue(const QString& groupName, const QString& name, const QVariant& def) {
@@ -0,0 +1,77 @@
+#include "HttpCircuitBreaker.h"
+
+#include <QDateTime>
+
+HttpCircuitBreaker::HttpCircuitBreaker() {
+}
+
+HttpCircuitBreaker& HttpCircuitBreaker::instance() {
+    static HttpCircuitBreaker breaker; // C++11 保证局部静态变量的初始化是线程安全的
+    return breaker;
+}
+
+// 请求执行前判断是否允许访问主机
+bool HttpCircuitBreaker::allow(const QString &host) {
+    // 1. 没有失败记录或者断路器关闭时允许访问
+    // 2. 打开的时间超过 cooldown 时进入 HalfOpen，放行这个请求作为探测
+    // 3. 探测请求进行中时不允许访问，探测超过 cooldown 还没有结果时允许新的探测
+
+    QMutexLocker locker(&mutex);
+
+    if (threshold <= 0) {
+        return true;
+    }
+
+    // [1] 没有失败记录或者断路器关闭时允许访问
+    auto iter = circuits.find(host);
+
+    if (iter == circuits.end() || iter.value().state == State::Closed) {
+        return true;
+    }
+
+    // [2] 打开的时间超过 cooldown 时进入 HalfOpen，放行这个请求作为探测
+    // [3] 探测请求进行中时不允许访问，探测超过 cooldown 还没有结果时允许新的探测
+    Circuit &circuit = iter.value();
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    if (now - circuit.since < cooldownMs) {
+        return false;
+    }
+
+    circuit.state = State::HalfOpen;
+    circuit.since = now;
+
+    return true;
+}
+
+// 请求结束时记录访问主机的结果
+void HttpCircuitBreaker::record(const QString &host, bool success) {
+    QMutexLocker locker(&mutex);
+
+    if (threshold <= 0) {
+        return;
+    }
+
+    // 成功时删除失败记录，即关闭断路器
+    if (success) {
+        circuits.remove(host);
+        return;
+    }
+
+    // 失败时累计次数，探测失败或者连续失败的次数达到 threshold 时打开断路器
+    Circuit &circuit = circuits[host];
+    ++circuit.failures;
+
+    if (circuit.state == State::HalfOpen || circuit.failures >= threshold) {
+        circuit.state = State::Open;
+        circuit.since = QDateTime::currentMSecsSinceEpoch();
+    }
+}
+
+// 设置连续失败多少次后打开断路器和打开后多久进行探测
+void HttpCircuitBreaker::setPolicy(int threshold, int cooldownMs) {
+    QMutexLocker locker(&mutex);
+    this->threshold  = qMax(0, threshold);
+    this->cooldownMs = qMax(0, cooldownMs);
+    circuits.clear();
+}
@@ -0,0 +1,61 @@
+#ifndef HTTPCIRCUITBREAKER_H
+#define HTTPCIRCUITBREAKER_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+/**
+ * 每个主机一个的断路器，是线程安全的，HttpClient 的请求执行前检查，结束后记录结果:
+ *     1. Closed  : 正常状态，请求正常执行，连续失败 threshold 次 (超时、网络错误、5xx) 后进入 Open
+ *     2. Open    : 后端不可用，请求直接失败，不再访问服务器，经过 cooldown 毫秒后进入 HalfOpen
+ *     3. HalfOpen: 只放行一个探测请求，成功则回到 Closed，失败则再次进入 Open
+ *
+ * 探测请求一直没有结果 (例如被取消) 时，超过 cooldown 毫秒后允许新的探测请求。
+ */
+class HttpCircuitBreaker {
+public:
+    static HttpCircuitBreaker& instance();
+
+    /**
+     * @brief 请求执行前调用，判断是否允许访问主机
+     *
+     * @param host 请求的主机
+     * @return 允许访问返回 true，断路器打开时返回 false
+     */
+    bool allow(const QString &host);
+
+    /**
+     * @brief 请求结束时调用，记录访问主机的结果
+     *
+     * @param host    请求的主机
+     * @param success 主机是否正常，客户端错误 (4xx) 也表示主机正常
+     */
+    void record(const QString &host, bool success);
+
+    /**
+     * @brief 设置连续失败多少次后打开断路器和打开后多久进行探测，threshold 为 0 时不使用断路器
+     *
+     * @param threshold  连续失败的次数
+     * @param cooldownMs 打开后到进行探测的时间，单位为毫秒
+     */
+    void setPolicy(int threshold, int cooldownMs);
+
+private:
+    HttpCircuitBreaker();
+
+    enum class State { Closed, Open, HalfOpen };
+
+    struct Circuit {
+        State  state    = State::Closed;
+        int    failures = 0; // 连续失败的次数
+        qint64 since    = 0; // 进入 Open 或者开始探测的时间
+    };
+
+    QMutex mutex;
+    QHash<QString, Circuit> circuits; // key 为主机，只保存失败过的主机
+    int threshold  = 5;
+    int cooldownMs = 10 * 1000;
+};
+
+#endif // HTTPCIRCUITBREAKER_H
@@ -1,14 +1,257 @@
 #include "HttpClient.h"
+#include "HttpScheduler.h"
+#include "HttpResponseCache.h"
+#include "HttpCircuitBreaker.h"
+#include "HttpCompression.h"
+#include "HttpMetrics.h"
+#include "HttpMultiPartDevice.h"
 
 #include <QDebug>
 #include <QFile>
 #include <QHash>
+#include <QSet>
+#include <QBuffer>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QMutex>
+#include <QTimer>
+#include <QThread>
 #include <QUrlQuery>
+#include <QTextStream>
+#include <QDateTime>
+#include <QAtomicInt>
+#include <QSharedPointer>
+#include <QRandomGenerator>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QCoreApplication>
 #include <QHttpPart>
 #include <QHttpMultiPart>
 #include <QNetworkReply>
 #include <QNetworkRequest>
 #include <QNetworkAccessManager>
+#include <limits>
+#include <algorithm>
+
+/*-----------------------------------------------------------------------------|
+ |                            HttpClientManagerPool                            |
+ |----------------------------------------------------------------------------*/
+/**
+ * @brief 进程内共享的 QNetworkAccessManager 池，每个线程一个 manager (QNetworkAccessManager 只能在创建它的线程中使用)。
+ *
+ * 同一线程的请求共享同一个 manager，从而复用它的连接缓存 (HTTP keep-alive)、TLS 会话和内部的工作线程，
+ * 不再为每个请求创建 manager，进行一次 TCP 和 TLS 握手后又把它们全部丢掉。
+ * 其他线程的 manager 在线程结束时删除，主线程的 manager 随 qApp 删除。
+ */
+class HttpClientManagerPool {
+public:
+    static HttpClientManagerPool& instance();
+
+    /**
+     * @brief 获取当前线程的 manager，如果还没有则创建一个
+     *
+     * @return 返回当前线程的 QNetworkAccessManager 对象
+     */
+    QNetworkAccessManager* manager();
+
+    /**
+     * @brief 请求开始时调用，统计访问 url 所在主机时是新建连接还是复用连接，只统计池中的 manager
+     *
+     * @param manager 执行请求的 manager
+     * @param url     请求的 URL
+     */
+    void track(QNetworkAccessManager *manager, const QUrl &url);
+
+    /**
+     * @brief 请求结束时调用，更新 manager 最后一次访问 url 所在主机的时间，连接空闲的时间从此刻开始计算
+     *
+     * @param manager 执行请求的 manager
+     * @param url     请求的 URL
+     */
+    void touch(QNetworkAccessManager *manager, const QUrl &url);
+
+    /**
+     * @brief 获取池的统计信息
+     */
+    HttpClientPoolStats stats();
+
+    /**
+     * @brief 设置访问 url 所在主机使用的协议，同时取消这个主机的回退
+     *
+     * @param url      主机的 URL
+     * @param protocol 使用的协议
+     */
+    void setProtocol(const QUrl &url, HttpProtocol protocol);
+
+    /**
+     * @brief 获取访问 url 使用的协议: requested 不为 -1 时使用它，否则使用主机的设置，主机已经回退时使用 HTTP/1.1
+     *
+     * @param url       请求的 URL
+     * @param requested 请求设置的协议，-1 表示没有设置
+     * @return 返回使用的协议
+     */
+    HttpProtocol protocol(const QUrl &url, int requested);
+
+    /**
+     * @brief 使用 HTTP/2 或者管线化访问 url 所在的主机时出现协议错误，之后访问这个主机都使用 HTTP/1.1
+     *
+     * @param url 请求的 URL
+     */
+    void fallback(const QUrl &url);
+
+    /**
+     * @brief 统计请求实际使用的协议
+     */
+    void countProtocol(HttpProtocol protocol);
+
+    /**
+     * @brief 主机的 key: scheme://host:port，连接缓存、调度器和断路器都使用它区分主机
+     */
+    static QString hostKey(const QUrl &url);
+
+private:
+    QMutex mutex;
+    QHash<QThread*, QNetworkAccessManager*> managers;                // 线程和它的 manager
+    QHash<QNetworkAccessManager*, QHash<QString, qint64> > hostTimes; // manager 最后一次访问每个主机的时间
+    QHash<QString, HttpProtocol> protocols; // 每个主机使用的协议，key 为 hostKey
+    QSet<QString> fallbacks;                // 出现协议错误回退到 HTTP/1.1 的主机
+    HttpClientPoolStats counters;
+
+    // Qt 缓存空闲的 HTTP 连接 120 秒，超过这个时间再访问同一主机就需要新建连接
+    static const qint64 KEEP_ALIVE_MS = 120 * 1000;
+};
+
+HttpClientManagerPool& HttpClientManagerPool::instance() {
+    static HttpClientManagerPool pool; // C++11 保证局部静态变量的初始化是线程安全的
+    return pool;
+}
+
+// 获取当前线程的 manager，如果还没有则创建一个
+QNetworkAccessManager* HttpClientManagerPool::manager() {
+    // 1. 当前线程已经有 manager 则直接返回
+    // 2. 创建 manager: 主线程的 manager 随 qApp 删除，其他线程的 manager 在线程结束时删除
+    // 3. manager 被删除时从池中移除
+
+    QThread *thread = QThread::currentThread();
+    QMutexLocker locker(&mutex);
+
+    // [1] 当前线程已经有 manager 则直接返回
+    QNetworkAccessManager *manager = managers.value(thread, nullptr);
+
+    if (nullptr != manager) {
+        return manager;
+    }
+
+    // [2] 创建 manager: 主线程的 manager 随 qApp 删除，其他线程的 manager 在线程结束时删除
+    bool mainThread = (nullptr != qApp) && (qApp->thread() == thread);
+    manager = new QNetworkAccessManager(mainThread ? qApp : nullptr);
+
+    if (!mainThread) {
+        QObject::connect(thread, &QThread::finished, manager, &QObject::deleteLater);
+    }
+
+    // [3] manager 被删除时从池中移除
+    QObject::connect(manager, &QObject::destroyed, [this, thread, manager] {
+        QMutexLocker locker(&mutex);
+        managers.remove(thread);
+        hostTimes.remove(manager);
+    });
+
+    managers.insert(thread, manager);
+    hostTimes.insert(manager, QHash<QString, qint64>());
+    ++counters.managerCreated;
+
+    return manager;
+}
+
+// 请求开始时统计访问 url 所在主机时是新建连接还是复用连接
+void HttpClientManagerPool::track(QNetworkAccessManager *manager, const QUrl &url) {
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QMutexLocker locker(&mutex);
+
+    if (!hostTimes.contains(manager)) {
+        return;
+    }
+
+    QHash<QString, qint64> &times = hostTimes[manager];
+    QString key = hostKey(url);
+    auto iter   = times.constFind(key);
+
+    if (iter != times.constEnd() && now - iter.value() < KEEP_ALIVE_MS) {
+        ++counters.reusedConnections;
+    } else {
+        ++counters.newConnections;
+    }
+
+    times[key] = now;
+}
+
+// 请求结束时更新 manager 最后一次访问 url 所在主机的时间
+void HttpClientManagerPool::touch(QNetworkAccessManager *manager, const QUrl &url) {
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QMutexLocker locker(&mutex);
+
+    if (hostTimes.contains(manager)) {
+        hostTimes[manager][hostKey(url)] = now;
+    }
+}
+
+// 获取池的统计信息
+HttpClientPoolStats HttpClientManagerPool::stats() {
+    QMutexLocker locker(&mutex);
+    HttpClientPoolStats result = counters;
+    result.managerCount = managers.size();
+
+    return result;
+}
+
+// 设置访问 url 所在主机使用的协议
+void HttpClientManagerPool::setProtocol(const QUrl &url, HttpProtocol protocol) {
+    QMutexLocker locker(&mutex);
+    protocols.insert(hostKey(url), protocol);
+    fallbacks.remove(hostKey(url));
+}
+
+// 获取访问 url 使用的协议
+HttpProtocol HttpClientManagerPool::protocol(const QUrl &url, int requested) {
+    QMutexLocker locker(&mutex);
+    QString key = hostKey(url);
+
+    if (fallbacks.contains(key)) {
+        return HttpProtocol::Http1;
+    }
+
+    return requested >= 0 ? HttpProtocol(requested) : protocols.value(key, HttpProtocol::Http1);
+}
+
+// 出现协议错误，之后访问这个主机都使用 HTTP/1.1
+void HttpClientManagerPool::fallback(const QUrl &url) {
+    QMutexLocker locker(&mutex);
+    fallbacks.insert(hostKey(url));
+}
+
+// 统计请求实际使用的协议
+void HttpClientManagerPool::countProtocol(HttpProtocol protocol) {
+    QMutexLocker locker(&mutex);
+
+    switch (protocol) {
+    case HttpProtocol::Http2:
+        ++counters.http2Requests;
+        break;
+    case HttpProtocol::Pipelining:
+        ++counters.pipelinedRequests;
+        break;
+    default:
+        ++counters.http1Requests;
+        break;
+    }
+}
+
+// 主机的 key: scheme://host:port
+QString HttpClientManagerPool::hostKey(const QUrl &url) {
+    int defaultPort = url.scheme() == "https" ? 443 : 80;
+    return QString("%1://%2:%3").arg(url.scheme()).arg(url.host()).arg(url.port(defaultPort));
+}
 
 /*-----------------------------------------------------------------------------|
  |                              HttpClientPrivate                              |
@@ -19,7 +262,7 @@
  * 注: UPLOAD 不是 HTTP Method，只是为了上传时对请求进行特殊处理而定义的
  */
 enum class HttpClientRequestMethod {
-    GET, POST, PUT, DELETE, UPLOAD
+    GET, POST, PUT, DELETE, HEAD, UPLOAD
 };
 
 /**
@@ -30,12 +273,62 @@ public:
     std::function<void (const QString &)>      successHandler = nullptr;
     std::function<void (const QString &, int)>    failHandler = nullptr;
     std::function<void ()>                    completeHandler = nullptr;
+    std::function<void (const QByteArray &)>     chunkHandler = nullptr;
+    std::function<void ()>                        doneHandler = nullptr;
+    std::function<void (int, const QMap<QString, QString> &)> headersHandler = nullptr;
+    std::function<void (const HttpFailure &)> failureHandler = nullptr;
+    std::function<void ()> retryHandler = nullptr; // 重新执行请求的函数，为 nullptr 时不能重试
+    std::function<void (HttpProtocol)> protocolHandler = nullptr;
+    std::function<void (const HttpTiming &)> timingHandler = nullptr;
     bool debug    = false;
-    bool internal = false;
+    bool internal = false; // 为 true 时 manager 来自共享的 manager 池
+    bool breaker  = true;  // 为 true 时把结果记录到断路器和协议的统计，合并的请求只有一个记录
+    qint64 bufferSize = 0;
+    int timeout    = 0;    // 超时时间，单位为毫秒，0 表示不超时
+    int attempt    = 1;    // 当前是第几次访问服务器
+    int retryDelay = 0;    // 第一次重试前等待的时间
+    QString host;          // 请求的主机，断路器和调度器使用
+    QString route;         // 请求在指标中的路由
+    qint64  queuedMs = 0;  // 在调度器的队列中等待的时间
     QString charset;
     QNetworkAccessManager* manager = nullptr;
 };
 
+/**
+ * 等待重试的请求，被 QTimer::singleShot 的 lambda 持有。
+ * manager 在重试前被删除时 Qt 不执行 lambda，只释放它，析构时执行 abandon 结束请求 (执行失败和结束的回调函数)。
+ */
+struct HttpClientPendingRetry {
+    std::function<void ()> retry;
+    std::function<void ()> abandon;
+    bool done = false;
+
+    ~HttpClientPendingRetry() {
+        if (!done) {
+            abandon();
+        }
+    }
+};
+
+// 所有请求默认的超时时间，单位为毫秒，0 表示不超时 (和以前的行为一致，调用 setDefaultTimeout() 开启)
+static QAtomicInt defaultTimeoutMs(0);
+
+// 重试前等待的最长时间，单位为毫秒
+static const int MAX_RETRY_DELAY_MS = 10 * 1000;
+
+// 请求因为超时被中止时，reply 的这个属性为 true
+static const char * const TIMEOUT_PROPERTY = "HttpClientTimedOut";
+
+// reply 的这个属性保存解压它的响应数据的 HttpInflater，不需要解压时为 nullptr
+static const char * const INFLATER_PROPERTY = "HttpClientInflater";
+
+// reply 的这些属性保存请求开始、TLS 握手完成、收到响应头的时间和发送、接收的字节数，用于计算请求的耗时
+static const char * const STARTED_AT_PROPERTY     = "HttpClientStartedAt";
+static const char * const ENCRYPTED_AT_PROPERTY   = "HttpClientEncryptedAt";
+static const char * const FIRST_BYTE_AT_PROPERTY  = "HttpClientFirstByteAt";
+static const char * const BYTES_SENT_PROPERTY     = "HttpClientBytesSent";
+static const char * const BYTES_RECEIVED_PROPERTY = "HttpClientBytesReceived";
+
 /**
  * @brief HttpClient 的辅助类，封装不希望暴露给客户端的数据和方法，使得 HttpClient 只暴露必要的 API 给客户端。
  */
@@ -53,8 +346,8 @@ class HttpClientPrivate {
     HttpClientPrivateCache cache();
 
     /**
-     * @brief 获取 Manager，如果传入了 manager 则返回此 manager，否则新创建一个 manager，默认会自动创建一个 manager，
-     *        使用传入的 manager 则 interval 被设置为 false，自动创建的 manager 则设置 interval 为 true
+     * @brief 获取 Manager，如果传入了 manager 则返回此 manager，否则返回共享的 manager 池中当前线程的 manager，
+     *        使用传入的 manager 则 internal 被设置为 false，使用池中的 manager 则 internal 为 true
      *
      * @return 返回 QNetworkAccessManager 对象
      */
@@ -77,6 +370,30 @@ class HttpClientPrivate {
      */
     static void executeQuery(HttpClientPrivate *d, HttpClientRequestMethod method);
 
+    /**
+     * @brief 提交请求到调度器，有空闲的名额时执行 execute，否则排队等待，请求结束时释放名额。
+     *        请求可能在 HttpClient 析构后才执行，所以复制一份 d 给 execute 使用，执行后删除
+     *
+     * @param d       HttpClientPrivate 的对象
+     * @param execute 执行请求的函数，参数为复制的 HttpClientPrivate 对象
+     */
+    static void schedule(HttpClientPrivate *d, std::function<void (HttpClientPrivate *)> execute);
+
+    /**
+     * @brief 使用响应缓存执行 GET 请求: 缓存新鲜时直接返回，相同的请求正在进行中时等待它的响应，缓存过期时向服务器验证
+     *
+     * @param d HttpClientPrivate 的对象
+     */
+    static void executeCachedGet(HttpClientPrivate *d);
+
+    /**
+     * @brief 使用缓存的数据结束请求，执行成功和结束的回调函数
+     *
+     * @param cache   HttpClientPrivateCache 缓存对象
+     * @param message 请求成功的消息
+     */
+    static void handleCachedFinish(HttpClientPrivateCache cache, const QString &message);
+
     /**
      * @brief 上传文件或者数据
      *
@@ -86,6 +403,14 @@ class HttpClientPrivate {
      */
     static void upload(HttpClientPrivate *d, const QStringList &paths, const QByteArray &data);
 
+    /**
+     * @brief 流式上传多个部分，数据直接从文件 (内存映射) 或者 QIODevice 读取发送
+     *
+     * @param d     HttpClientPrivate 的对象
+     * @param parts 要上传的部分
+     */
+    static void upload(HttpClientPrivate *d, const QList<HttpUploadPart> &parts);
+
     /**
      * @brief 使用 GET 进行下载，下载的文件保存到 savePath
      *
@@ -110,6 +435,73 @@ class HttpClientPrivate {
      */
     static QString readReply(QNetworkReply *reply, const QString &charset = "UTF-8");
 
+    /**
+     * @brief 读取响应的数据，Qt 没有自动解压时 (请求头设置了 Accept-Encoding) 流式解压 gzip 和 deflate
+     *
+     * @param reply   请求的 QNetworkReply 对象
+     * @param maxSize 最多读取的字节数 (解压前)，-1 表示读取所有可读取的数据
+     * @return 返回 (解压后的) 响应数据
+     */
+    static QByteArray readBody(QNetworkReply *reply, qint64 maxSize = -1);
+
+    /**
+     * @brief 获取解压 reply 的响应数据的 HttpInflater，第一次调用时根据请求头和响应头判断是否需要解压
+     *
+     * @param reply 请求的 QNetworkReply 对象
+     * @return 需要解压时返回 HttpInflater 对象 (reply 的子对象)，否则返回 nullptr
+     */
+    static HttpInflater* inflaterOf(QNetworkReply *reply);
+
+    /**
+     * @brief 检查解压后的响应数据是否完整，请求结束时调用
+     *
+     * @param reply 请求的 QNetworkReply 对象
+     * @return 解压出错或者压缩流没有结束 (响应被截断) 时返回错误信息，否则返回空字符串
+     */
+    static QString inflateError(QNetworkReply *reply);
+
+    /**
+     * @brief 创建 POST、PUT 请求的请求体，设置了压缩并且超过阈值时压缩，并给 request 设置请求头 Content-Encoding
+     *
+     * @param d       HttpClientPrivate 的对象
+     * @param request 请求对象
+     * @return 返回请求体
+     */
+    static QByteArray requestBody(HttpClientPrivate *d, QNetworkRequest *request);
+
+    /**
+     * @brief 使用和 readReply() 相同的方式把响应的数据转换为字符串
+     *
+     * @param data    响应的数据
+     * @param charset 请求响应的字符集，默认使用 UTF-8
+     * @return 返回服务器端响应的字符串
+     */
+    static QString decodeReply(const QByteArray &data, const QString &charset = "UTF-8");
+
+    /**
+     * @brief 接收到响应头时回调 headersHandler
+     *
+     * @param cache HttpClientPrivateCache 缓存对象
+     * @param reply 请求的 QNetworkReply 对象
+     */
+    static void watchHeaders(HttpClientPrivateCache cache, QNetworkReply *reply);
+
+    /**
+     * @brief 流式模式: 限制 reply 的读缓冲为 bufferSize，有数据可读取时分块回调 chunkHandler
+     *
+     * @param cache HttpClientPrivateCache 缓存对象
+     * @param reply 请求的 QNetworkReply 对象
+     */
+    static void streamReply(HttpClientPrivateCache cache, QNetworkReply *reply);
+
+    /**
+     * @brief 流式模式: 按 bufferSize 分块读取 reply 中可读取的数据并回调 chunkHandler
+     *
+     * @param cache HttpClientPrivateCache 缓存对象
+     * @param reply 请求的 QNetworkReply 对象
+     */
+    static void readChunks(HttpClientPrivateCache cache, QNetworkReply *reply);
+
     /**
      * @brief 请求结束的处理函数
      *
@@ -120,6 +512,91 @@ class HttpClientPrivate {
      */
     static void handleFinish(HttpClientPrivateCache cache, QNetworkReply *reply, const QString &successMessage, const QString &failMessage);
 
+    /**
+     * @brief 请求执行后 cache.timeout 毫秒内没有收到也没有发送任何数据时中止请求
+     *
+     * @param cache HttpClientPrivateCache 缓存对象
+     * @param reply 请求的 QNetworkReply 对象
+     */
+    static void watchTimeout(HttpClientPrivateCache cache, QNetworkReply *reply);
+
+    /**
+     * @brief 记录 reply 开始、TLS 握手完成、收到响应头的时间和发送、接收的字节数
+     *
+     * @param reply 请求的 QNetworkReply 对象
+     */
+    static void watchTiming(QNetworkReply *reply);
+
+    /**
+     * @brief 计算请求的耗时
+     *
+     * @param cache     HttpClientPrivateCache 缓存对象
+     * @param reply     结束的请求的 QNetworkReply 对象
+     * @param protocol  实际使用的协议
+     * @return 返回请求的耗时
+     */
+    static HttpTiming timingOf(const HttpClientPrivateCache &cache, QNetworkReply *reply, HttpProtocol protocol);
+
+    /**
+     * @brief 对失败的请求进行分类
+     *
+     * @param cache   HttpClientPrivateCache 缓存对象
+     * @param reply   失败的请求的 QNetworkReply 对象
+     * @param message 失败的原因
+     * @return 返回失败的信息
+     */
+    static HttpFailure classify(const HttpClientPrivateCache &cache, QNetworkReply *reply, const QString &message);
+
+    /**
+     * @brief 创建没有访问服务器的失败信息，例如队列已满、断路器打开、打开文件失败
+     *
+     * @param type    失败的类型
+     * @param message 失败的原因
+     * @return 返回失败的信息
+     */
+    static HttpFailure localFailure(HttpFailureType type, const QString &message);
+
+    /**
+     * @brief 失败的请求是否值得重试: 超时、网络错误、502、503、504 和 429
+     *
+     * @param failure 失败的信息
+     * @return 可以重试返回 true，否则返回 false
+     */
+    static bool retryable(const HttpFailure &failure);
+
+    /**
+     * @brief 计算第 attempt 次访问失败后，重试前等待的时间: 指数增长，在一半到全部之间随机
+     *
+     * @param baseDelay 第一次重试前等待的时间
+     * @param attempt   已经访问服务器的次数
+     * @return 返回等待的时间，单位为毫秒
+     */
+    static int backoff(int baseDelay, int attempt);
+
+    /**
+     * @brief 执行请求失败的回调函数 fail(const QString &, int) 和 fail(const HttpFailure &)
+     *
+     * @param cache   HttpClientPrivateCache 缓存对象
+     * @param failure 失败的信息
+     */
+    static void notifyFail(const HttpClientPrivateCache &cache, const HttpFailure &failure);
+
+    /**
+     * @brief 请求实际使用的协议
+     *
+     * @param reply 请求的 QNetworkReply 对象
+     * @return 返回使用的协议
+     */
+    static HttpProtocol protocolOf(QNetworkReply *reply);
+
+    /**
+     * @brief 使用 HTTP/2 或者管线化的请求出现协议错误时，之后访问这个主机都使用 HTTP/1.1 (重试时也使用 HTTP/1.1)
+     *
+     * @param cache HttpClientPrivateCache 缓存对象
+     * @param reply 请求的 QNetworkReply 对象
+     */
+    static void checkFallback(const HttpClientPrivateCache &cache, QNetworkReply *reply);
+
     /////////////////////////////////////////////////// 成员变量 //////////////////////////////////////////////
     QString   url;                            // 请求的 URL
     QString   json;                           // 请求的参数使用 Json 格式
@@ -129,11 +606,33 @@ class HttpClientPrivate {
     QNetworkAccessManager *manager = nullptr; // 执行 HTTP 请求的 QNetworkAccessManager 对象
     bool useJson  = false;                    // 为 true 时请求使用 Json 格式传递参数，否则使用 Form 格式传递参数
     bool debug    = false;                    // 为 true 时输出请求的 URL 和参数
-    bool internal = true;                     // 是否使用自动创建的 manager
+    bool internal = true;                     // 是否使用共享的 manager 池中的 manager
+    bool useCache = false;                    // 为 true 时 GET 请求使用响应缓存
+    HttpPriority priority = HttpPriority::Interactive; // 请求的优先级
+    int  timeout    = -1;                     // 超时时间，单位为毫秒，-1 表示使用默认的超时时间
+    int  retries    = 0;                      // 失败后最多重试的次数
+    int  retryDelay = 200;                    // 第一次重试前等待的时间
+    int  attempt    = 1;                      // 当前是第几次访问服务器
+    bool idempotent = false;                  // 为 true 时 POST 请求也可以重试
+    int  protocol   = -1;                     // 使用的协议 HttpProtocol，-1 表示使用主机的设置
+    bool compressBody = false;                // 为 true 时压缩超过阈值的请求体
+    int  compressThreshold = 1024;            // 请求体不小于这么多字节时才压缩
+    HttpContentEncoding encoding = HttpContentEncoding::Gzip; // 请求体的压缩格式
+    QString routeName;                        // 请求在指标中的路由名，为空时使用 URL 的路径
+    qint64  queuedAt = 0;                     // 提交到调度器的时间，用于计算排队的时间
 
     std::function<void (const QString &)>   successHandler = nullptr; // 成功的回调函数，参数为响应的字符串
     std::function<void (const QString &, int)> failHandler = nullptr; // 失败的回调函数，参数为失败原因和 HTTP status code
+    std::function<void (const HttpFailure &)> failureHandler = nullptr; // 失败的回调函数，参数为失败的分类和信息
+    std::function<void (HttpProtocol)>       protocolHandler = nullptr; // 报告实际使用的协议的回调函数
+    std::function<void (const HttpTiming &)>   timingHandler = nullptr; // 报告请求的耗时的回调函数
     std::function<void ()>                 completeHandler = nullptr; // 结束的回调函数，无参数
+    std::function<void (const QByteArray &)>  chunkHandler = nullptr; // 流式模式接收响应数据的回调函数，不为 nullptr 时使用流式模式
+    std::function<void ()>                     doneHandler = nullptr; // 流式模式数据接收完成的回调函数，无参数
+    std::function<void (int, const QMap<QString, QString> &)> headersHandler = nullptr; // 接收到响应头的回调函数
+    qint64 bufferSize = 64 * 1024;                                    // 流式模式读缓冲的大小
+    qint64 uploadBufferSize = 4 * 1024 * 1024;                        // 流式上传时已读取未发送的数据的最大字节数
+    std::function<void (int, qint64, qint64)> uploadProgressHandler = nullptr; // 流式上传的进度回调函数
 };
 
 HttpClientPrivate::HttpClientPrivate(const QString &url) : url(url) { }
@@ -142,7 +641,14 @@ HttpClientPrivate::~HttpClientPrivate() {
     manager         = nullptr;
     successHandler  = nullptr;
     failHandler     = nullptr;
+    failureHandler  = nullptr;
+    protocolHandler = nullptr;
+    timingHandler   = nullptr;
     completeHandler = nullptr;
+    chunkHandler    = nullptr;
+    doneHandler     = nullptr;
+    headersHandler  = nullptr;
+    uploadProgressHandler = nullptr;
 }
 
 // 缓存 HttpClientPrivate 的数据成员
@@ -152,9 +658,22 @@ HttpClientPrivateCache HttpClientPrivate::cache() {
     cache.successHandler  = successHandler;
     cache.failHandler     = failHandler;
     cache.completeHandler = completeHandler;
-    cache.debug    = debug;
-    cache.internal = internal;
-    cache.charset  = charset;
+    cache.chunkHandler    = chunkHandler;
+    cache.doneHandler     = doneHandler;
+    cache.headersHandler  = headersHandler;
+    cache.failureHandler  = failureHandler;
+    cache.protocolHandler = protocolHandler;
+    cache.timingHandler   = timingHandler;
+    cache.debug      = debug;
+    cache.internal   = internal;
+    cache.bufferSize = bufferSize;
+    cache.timeout    = timeout >= 0 ? timeout : defaultTimeoutMs.load();
+    cache.attempt    = attempt;
+    cache.retryDelay = retryDelay;
+    cache.host       = HttpClientManagerPool::hostKey(QUrl(url));
+    cache.route      = routeName.isEmpty() ? HttpMetrics::routeOf(QUrl(url).path()) : routeName;
+    cache.queuedMs   = queuedAt > 0 ? QDateTime::currentMSecsSinceEpoch() - queuedAt : 0;
+    cache.charset    = charset;
     cache.manager  = getManager();
 
     return cache;
@@ -167,12 +686,31 @@ void HttpClientPrivate::executeQuery(HttpClientPrivate *d, HttpClientRequestMeth
     // 3. 根据 method 执行不同的请求
     // 4. 请求结束时获取响应数据，在 handleFinish 中执行回调函数
 
+    // GET 请求使用响应缓存 (流式模式不使用缓存)
+    if (method == HttpClientRequestMethod::GET && d->useCache && nullptr == d->chunkHandler) {
+        HttpClientPrivate::executeCachedGet(d);
+        return;
+    }
+
     // [1] 缓存需要的变量，在 lambda 中使用 = 捕获进行值传递 (不能使用引用 &，因为 d 已经被析构)
     HttpClientPrivateCache cache = d->cache();
 
+    // 可以重试时再复制一份 d 给重试使用，它随 cache 一起在请求结束后释放
+    bool idempotent = method != HttpClientRequestMethod::POST || d->idempotent;
+
+    if (d->attempt <= d->retries && idempotent && nullptr == d->chunkHandler) {
+        QSharedPointer<HttpClientPrivate> next(new HttpClientPrivate(*d), [](HttpClientPrivate *p) { delete p; });
+        next->attempt  = d->attempt + 1;
+        next->queuedAt = 0; // 重试不经过调度器的队列
+        cache.retryHandler = [next, method] {
+            HttpClientPrivate::executeQuery(next.data(), method);
+        };
+    }
+
     // [2] 创建请求需要的变量
     QNetworkRequest request = HttpClientPrivate::createRequest(d, method);
     QNetworkReply    *reply = nullptr;
+    HttpClientManagerPool::instance().track(cache.manager, request.url());
 
     // [3] 根据 method 执行不同的请求
     switch (method) {
@@ -180,93 +718,349 @@ void HttpClientPrivate::executeQuery(HttpClientPrivate *d, HttpClientRequestMeth
         reply = cache.manager->get(request);
         break;
     case HttpClientRequestMethod::POST:
-        reply = cache.manager->post(request, d->useJson ? d->json.toUtf8() : d->params.toString(QUrl::FullyEncoded).toUtf8());
+        reply = cache.manager->post(request, HttpClientPrivate::requestBody(d, &request));
         break;
     case HttpClientRequestMethod::PUT:
-        reply = cache.manager->put(request, d->useJson ? d->json.toUtf8() : d->params.toString(QUrl::FullyEncoded).toUtf8());
+        reply = cache.manager->put(request, HttpClientPrivate::requestBody(d, &request));
         break;
     case HttpClientRequestMethod::DELETE:
         reply = cache.manager->deleteResource(request);
         break;
+    case HttpClientRequestMethod::HEAD:
+        reply = cache.manager->head(request);
+        break;
     default:
         break;
     }
 
     // [4] 请求结束时获取响应数据，在 handleFinish 中执行回调函数
-    // 请求结束时一次性读取所有响应数据
-    QObject::connect(reply, &QNetworkReply::finished, [=] {
-        QString successMessage = HttpClientPrivate::readReply(reply, cache.charset.toUtf8());
-        QString failMessage    = reply->errorString();
-        HttpClientPrivate::handleFinish(cache, reply, successMessage, failMessage);
-    });
+    HttpClientPrivate::watchHeaders(cache, reply);
+    HttpClientPrivate::watchTimeout(cache, reply);
+    HttpClientPrivate::watchTiming(reply);
+
+    if (nullptr != cache.chunkHandler) {
+        // 流式模式: 有数据可读取时分块回调，请求结束时读取剩下的数据
+        HttpClientPrivate::streamReply(cache, reply);
+        QObject::connect(reply, &QNetworkReply::finished, [=] {
+            HttpClientPrivate::readChunks(cache, reply);
+            HttpClientPrivate::handleFinish(cache, reply, QString(), reply->errorString());
+        });
+    } else {
+        // 请求结束时一次性读取所有响应数据
+        QObject::connect(reply, &QNetworkReply::finished, [=] {
+            QString successMessage = HttpClientPrivate::readReply(reply, cache.charset.toUtf8());
+            QString failMessage    = reply->errorString();
+            HttpClientPrivate::handleFinish(cache, reply, successMessage, failMessage);
+        });
+    }
 }
 
-// 使用 GET 进行下载，下载的文件保存到 savePath
-void HttpClientPrivate::download(HttpClientPrivate *d, const QString &savePath) {
-    // 1. 打开下载文件，如果打开文件出错，不进行下载
-    // 2. 给请求结束的回调函数注入关闭释放文件的行为
-    // 3. 调用下载的重载函数开始下载
-    QFile *file = new QFile(savePath);
+// 提交请求到调度器
+void HttpClientPrivate::schedule(HttpClientPrivate *d, std::function<void (HttpClientPrivate *)> execute) {
+    // 1. 主机的断路器打开时直接失败
+    // 2. 复制 d，请求结束时 (执行结束的回调函数时) 释放调度器的名额
+    // 3. 提交到调度器，队列已满时执行失败和结束的回调函数
+    // 4. 轮到请求执行时使用复制的 d 执行请求，提交请求的线程已经结束时只释放名额
 
-    // [1] 打开下载文件，如果打开文件出错，不进行下载
-    if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        file->close();
-        file->deleteLater();
+    QString host = HttpClientManagerPool::hostKey(QUrl(d->url));
+
+    // [1] 主机的断路器打开时直接失败
+    if (!HttpCircuitBreaker::instance().allow(host)) {
+        QString failMessage = QString("[错误] 服务器暂时不可用 (断路器已打开): %1").arg(d->url);
 
         if (d->debug) {
-            qDebug().noquote() << QString("[错误] 打开文件出错: %1").arg(savePath);
+            qDebug().noquote() << failMessage;
         }
 
-        if (nullptr != d->failHandler) {
-            d->failHandler(QString("[错误] 打开文件出错: %1").arg(savePath), -1);
+        HttpClientPrivate::notifyFail(d->cache(), localFailure(HttpFailureType::CircuitOpen, failMessage));
+
+        if (nullptr != d->completeHandler) {
+            d->completeHandler();
         }
 
         return;
     }
 
-    // [2] 给请求结束的回调函数注入关闭释放文件的行为
-    std::function<void ()> userCompleteHandler     = d->completeHandler;
-    std::function<void ()> injectedCompleteHandler = [=]() {
-        // 请求结束后释放文件对象
-        file->flush();
-        file->close();
-        file->deleteLater();
-
-        // 执行用户指定的结束回调函数
+    // [2] 复制 d，请求结束时 (执行结束的回调函数时) 释放调度器的名额
+    HttpClientPrivate *copy = new HttpClientPrivate(*d);
+    copy->queuedAt = QDateTime::currentMSecsSinceEpoch();
+    std::function<void ()> userCompleteHandler = d->completeHandler;
+    copy->completeHandler = [=] {
         if (nullptr != userCompleteHandler) {
             userCompleteHandler();
         }
+
+        HttpScheduler::instance().finished(host);
     };
-    d->completeHandler = injectedCompleteHandler;
 
-    // [3] 调用下载的重载函数开始下载
-    HttpClientPrivate::download(d, [=](const QByteArray &data) {
-        file->write(data);
+    // [3] 提交到调度器，队列已满时执行失败和结束的回调函数
+    QObject *context = d->internal ? HttpClientManagerPool::instance().manager() : d->manager;
+    bool accepted = HttpScheduler::instance().submit(d->priority, host, context, [=](bool alive) {
+        // [4] 轮到请求执行时使用复制的 d 执行请求，提交请求的线程已经结束时只释放名额
+        if (alive) {
+            execute(copy);
+        } else {
+            HttpScheduler::instance().finished(host);
+        }
+
+        delete copy;
     });
+
+    if (!accepted) {
+        QString failMessage = QString("[错误] 请求队列已满: %1").arg(d->url);
+
+        if (d->debug) {
+            qDebug().noquote() << failMessage;
+        }
+
+        HttpClientPrivate::notifyFail(d->cache(), localFailure(HttpFailureType::Rejected, failMessage));
+
+        if (nullptr != d->completeHandler) {
+            d->completeHandler();
+        }
+
+        delete copy;
+    }
 }
 
-// 使用 GET 进行下载，当有数据可读取时回调 readyRead(), 大多数情况下应该在 readyRead() 里把数据保存到文件
-void HttpClientPrivate::download(HttpClientPrivate *d, std::function<void (const QByteArray &)> readyRead) {
-    // 1. 缓存需要的变量，在 lambda 中使用 = 捕获进行值传递 (不能使用引用 &，因为 d 已经被析构)
-    // 2. 创建请求需要的变量，执行请求
-    // 3. 有数据可读取时回调 readyRead()
-    // 4. 请求结束时获取响应数据，在 handleFinish 中执行回调函数
+// 使用响应缓存执行 GET 请求
+void HttpClientPrivate::executeCachedGet(HttpClientPrivate *d) {
+    // 1. 缓存需要的变量，创建请求，使用 URL 和请求头作为缓存的 key
+    // 2. 缓存新鲜时直接返回 (异步回调，和访问服务器时的行为一致)
+    // 3. 同一个线程中相同的请求正在进行中时，加入等待它的响应的列表 (reply 只能在创建它的线程中使用)
+    // 4. 缓存过期时，使用 If-None-Match、If-Modified-Since 向服务器验证
+    // 5. 请求结束时，服务器返回 304 则使用缓存的数据，否则缓存新的响应，然后执行所有等待者的回调函数
 
-    // [1] 缓存需要的变量，在 lambda 中使用 = 捕捉使用 (不能使用引用 &，因为 d 已经被析构)
-    HttpClientPrivateCache cache = d->cache();
+    // 正在进行中的请求: key 为线程 + 缓存的 key，value 为等待它的响应的请求
+    static QMutex inFlightMutex;
+    static QHash<QString, QList<HttpClientPrivateCache> > inFlight;
 
-    // [2] 创建请求需要的变量，执行请求
+    // [1] 缓存需要的变量，创建请求，使用 URL 和请求头作为缓存的 key
+    HttpClientPrivateCache cache = d->cache();
     QNetworkRequest request = HttpClientPrivate::createRequest(d, HttpClientRequestMethod::GET);
-    QNetworkReply    *reply = cache.manager->get(request);
+    QString key = request.url().toString(QUrl::FullyEncoded);
+
+    QList<QString> names = d->headers.keys();
+    std::sort(names.begin(), names.end());
+    for (const QString &name : names) {
+        key += "\n" + name + ": " + d->headers.value(name);
+    }
+
+    HttpResponseCache &responseCache = HttpResponseCache::instance();
+    HttpCacheEntry entry;
+    bool cached = responseCache.get(key, &entry);
+
+    // [2] 缓存新鲜时直接返回 (异步回调，和访问服务器时的行为一致)
+    if (cached && entry.expires > QDateTime::currentMSecsSinceEpoch()) {
+        responseCache.countHit();
+        QTimer::singleShot(0, [=] {
+            HttpClientPrivate::handleCachedFinish(cache, HttpClientPrivate::decodeReply(entry.body, cache.charset));
+        });
+        return;
+    }
+
+    // [3] 同一个线程中相同的请求正在进行中时，加入等待它的响应的列表
+    QString flightKey = QString::number(quintptr(QThread::currentThread()), 16) + " " + key;
+    {
+        QMutexLocker locker(&inFlightMutex);
+
+        if (inFlight.contains(flightKey)) {
+            inFlight[flightKey].append(cache);
+            responseCache.countCoalesced();
+            return;
+        }
+
+        inFlight.insert(flightKey, QList<HttpClientPrivateCache>() << cache);
+    }
+
+    // [4] 缓存过期时，使用 If-None-Match、If-Modified-Since 向服务器验证
+    if (cached && !entry.etag.isEmpty()) {
+        request.setRawHeader("If-None-Match", entry.etag);
+    }
+    if (cached && !entry.lastModified.isEmpty()) {
+        request.setRawHeader("If-Modified-Since", entry.lastModified);
+    }
+
+    QNetworkReply *reply = cache.manager->get(request);
+    HttpClientManagerPool::instance().track(cache.manager, request.url());
+    HttpClientPrivate::watchHeaders(cache, reply);
+    HttpClientPrivate::watchTimeout(cache, reply);
+    HttpClientPrivate::watchTiming(reply);
+
+    // [5] 请求结束时，服务器返回 304 则使用缓存的数据，否则缓存新的响应，然后执行所有等待者的回调函数
+    QObject::connect(reply, &QNetworkReply::finished, [=] {
+        QList<HttpClientPrivateCache> waiters;
+        {
+            QMutexLocker locker(&inFlightMutex);
+            waiters = inFlight.take(flightKey);
+        }
+
+        int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        QByteArray body;
+
+        if (reply->error() == QNetworkReply::NoError && status == 304 && cached) {
+            body = entry.body;
+            responseCache.refresh(key, reply);
+            responseCache.countRevalidated();
+        } else if (reply->error() == QNetworkReply::NoError) {
+            body = HttpClientPrivate::readBody(reply);
+            responseCache.put(key, reply, body);
+            responseCache.countMiss();
+        }
+
+        // 所有等待者共享一次访问，只有第一个把结果记录到断路器
+        for (int i = 0; i < waiters.size(); ++i) {
+            HttpClientPrivateCache waiter = waiters.at(i);
+            waiter.breaker = (0 == i);
+            HttpClientPrivate::handleFinish(waiter, reply, HttpClientPrivate::decodeReply(body, waiter.charset), reply->errorString());
+        }
+    });
+}
+
+// 使用缓存的数据结束请求，执行成功和结束的回调函数
+void HttpClientPrivate::handleCachedFinish(HttpClientPrivateCache cache, const QString &message) {
+    if (cache.debug) {
+        qDebug().noquote() << QString("[结束] 成功 (缓存): %1").arg(message);
+    }
+
+    if (nullptr != cache.successHandler) {
+        cache.successHandler(message);
+    }
+
+    if (nullptr != cache.completeHandler) {
+        cache.completeHandler();
+    }
+}
+
+// 接收到响应头时回调 headersHandler
+void HttpClientPrivate::watchHeaders(HttpClientPrivateCache cache, QNetworkReply *reply) {
+    if (nullptr == cache.headersHandler) {
+        return;
+    }
+
+    QObject::connect(reply, &QNetworkReply::metaDataChanged, [=] {
+        QMap<QString, QString> headers;
+        int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+        for (const QNetworkReply::RawHeaderPair &pair : reply->rawHeaderPairs()) {
+            headers[QString::fromLatin1(pair.first).toLower()] = QString::fromLatin1(pair.second);
+        }
+
+        cache.headersHandler(status, headers);
+    });
+}
+
+// 流式模式: 限制 reply 的读缓冲，有数据可读取时分块回调 chunkHandler
+void HttpClientPrivate::streamReply(HttpClientPrivateCache cache, QNetworkReply *reply) {
+    // 读缓冲满了以后 Qt 暂停从 socket 读取数据，直到数据被读走，所以内存中最多只有 bufferSize 字节的响应数据
+    reply->setReadBufferSize(cache.bufferSize);
+
+    QObject::connect(reply, &QNetworkReply::readyRead, [=] {
+        HttpClientPrivate::readChunks(cache, reply);
+    });
+}
+
+// 流式模式: 按 bufferSize 分块读取 reply 中可读取的数据并回调 chunkHandler
+void HttpClientPrivate::readChunks(HttpClientPrivateCache cache, QNetworkReply *reply) {
+    // HTTP 出错时的响应 (如 404 页面) 不是请求的数据，读取后丢弃，失败原因在 handleFinish 中回调
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    bool valid = reply->error() == QNetworkReply::NoError && status < 400;
+
+    while (reply->bytesAvailable() > 0) {
+        QByteArray data = HttpClientPrivate::readBody(reply, cache.bufferSize);
+
+        if (valid && !data.isEmpty()) {
+            cache.chunkHandler(data);
+        }
+    }
+}
+
+// 使用 GET 进行下载，下载的文件保存到 savePath
+void HttpClientPrivate::download(HttpClientPrivate *d, const QString &savePath) {
+    // 1. 打开下载文件，如果打开文件出错，不进行下载
+    // 2. 给请求结束的回调函数注入关闭释放文件的行为，下载失败时删除不完整的文件
+    // 3. 调用下载的重载函数开始下载
+    QFile *file = new QFile(savePath);
+
+    // [1] 打开下载文件，如果打开文件出错，不进行下载
+    if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        file->close();
+        file->deleteLater();
+
+        if (d->debug) {
+            qDebug().noquote() << QString("[错误] 打开文件出错: %1").arg(savePath);
+        }
+
+        HttpClientPrivate::notifyFail(d->cache(), localFailure(HttpFailureType::Local, QString("[错误] 打开文件出错: %1").arg(savePath)));
+
+        if (nullptr != d->completeHandler) {
+            d->completeHandler();
+        }
+
+        return;
+    }
+
+    // [2] 给请求结束的回调函数注入关闭释放文件的行为，下载失败时删除不完整的文件
+    std::function<void (const HttpFailure &)> userFailureHandler = d->failureHandler;
+    d->failureHandler = [=](const HttpFailure &failure) {
+        file->close();
+        file->remove();
+
+        if (nullptr != userFailureHandler) {
+            userFailureHandler(failure);
+        }
+    };
+
+    std::function<void ()> userCompleteHandler     = d->completeHandler;
+    std::function<void ()> injectedCompleteHandler = [=]() {
+        // 请求结束后释放文件对象
+        file->flush();
+        file->close();
+        file->deleteLater();
+
+        // 执行用户指定的结束回调函数
+        if (nullptr != userCompleteHandler) {
+            userCompleteHandler();
+        }
+    };
+    d->completeHandler = injectedCompleteHandler;
+
+    // [3] 调用下载的重载函数开始下载
+    HttpClientPrivate::download(d, [=](const QByteArray &data) {
+        file->write(data);
+    });
+}
+
+// 使用 GET 进行下载，当有数据可读取时回调 readyRead(), 大多数情况下应该在 readyRead() 里把数据保存到文件
+void HttpClientPrivate::download(HttpClientPrivate *d, std::function<void (const QByteArray &)> readyRead) {
+    // 1. 缓存需要的变量，在 lambda 中使用 = 捕获进行值传递 (不能使用引用 &，因为 d 已经被析构)
+    // 2. 创建请求需要的变量，执行请求
+    // 3. 有数据可读取时回调 readyRead()
+    // 4. 请求结束时获取响应数据，在 handleFinish 中执行回调函数
+
+    // [1] 缓存需要的变量，在 lambda 中使用 = 捕捉使用 (不能使用引用 &，因为 d 已经被析构)
+    HttpClientPrivateCache cache = d->cache();
+
+    // [2] 创建请求需要的变量，执行请求
+    QNetworkRequest request = HttpClientPrivate::createRequest(d, HttpClientRequestMethod::GET);
+    QNetworkReply    *reply = cache.manager->get(request);
+    HttpClientManagerPool::instance().track(cache.manager, request.url());
+    HttpClientPrivate::watchHeaders(cache, reply);
+    HttpClientPrivate::watchTimeout(cache, reply);
+    HttpClientPrivate::watchTiming(reply);
 
     // [3] 有数据可读取时回调 readyRead()
     QObject::connect(reply, &QNetworkReply::readyRead, [=] {
-        readyRead(reply->readAll());
+        readyRead(HttpClientPrivate::readBody(reply));
     });
 
-    // [4] 请求结束时获取响应数据，在 handleFinish 中执行回调函数
+    // [4] 请求结束时读取剩下的数据，在 handleFinish 中执行回调函数 (解压出错或者不完整时下载失败)
     QObject::connect(reply, &QNetworkReply::finished, [=] {
-        QString successMessage = "下载完成"; // 请求结束时一次性读取所有响应数据
+        if (reply->bytesAvailable() > 0) {
+            readyRead(HttpClientPrivate::readBody(reply));
+        }
+
+        QString successMessage = "下载完成";
         QString failMessage    = reply->errorString();
         HttpClientPrivate::handleFinish(cache, reply, successMessage, failMessage);
     });
@@ -319,8 +1113,10 @@ void HttpClientPrivate::upload(HttpClientPrivate *d, const QStringList &paths, c
                     qDebug().noquote() << failMessage;
                 }
 
-                if (nullptr != cache.failHandler) {
-                    cache.failHandler(failMessage, -1);
+                HttpClientPrivate::notifyFail(cache, localFailure(HttpFailureType::Local, failMessage));
+
+                if (nullptr != cache.completeHandler) {
+                    cache.completeHandler();
                 }
 
                 multiPart->deleteLater();
@@ -349,6 +1145,9 @@ void HttpClientPrivate::upload(HttpClientPrivate *d, const QStringList &paths, c
     // [4] 创建请求需要的变量，执行请求
     QNetworkRequest request = HttpClientPrivate::createRequest(d, HttpClientRequestMethod::UPLOAD);
     QNetworkReply    *reply = cache.manager->post(request, multiPart);
+    HttpClientManagerPool::instance().track(cache.manager, request.url());
+    HttpClientPrivate::watchTimeout(cache, reply);
+    HttpClientPrivate::watchTiming(reply);
 
     // [5] 请求结束时释放 multiPart 和文件，获取响应数据，在 handleFinish 中执行回调函数
     QObject::connect(reply, &QNetworkReply::finished, [=] {
@@ -360,9 +1159,114 @@ void HttpClientPrivate::upload(HttpClientPrivate *d, const QStringList &paths, c
     });
 }
 
-// 获取 Manager，如果传入了 manager 则返回此 manager，否则新创建一个 manager，默认会自动创建一个 manager
+// 流式上传多个部分
+void HttpClientPrivate::upload(HttpClientPrivate *d, const QList<HttpUploadPart> &parts) {
+    // 1. 缓存需要的变量，在 lambda 中使用 = 捕获进行值传递 (不能使用引用 &，因为 d 已经被析构)
+    // 2. 创建请求体，添加 Form 表单的参数
+    // 3. 添加上传的部分
+    //    3.1 文件使用内存映射读取，映射失败时直接从文件读取
+    //    3.2 使用传入的 device
+    // 4. 创建请求，不允许 Qt 缓存请求体，执行请求
+    // 5. 发送数据后更新请求体的发送进度 (背压控制和每个部分的进度)
+    // 6. 请求结束时释放请求体和打开的文件，获取响应数据，在 handleFinish 中执行回调函数
+
+    // [1] 缓存需要的变量，在 lambda 中使用 = 捕捉使用 (不能使用引用 &，因为 d 已经被析构)
+    HttpClientPrivateCache cache = d->cache();
+
+    // [2] 创建请求体，添加 Form 表单的参数
+    HttpMultiPartDevice *body = new HttpMultiPartDevice(d->uploadBufferSize);
+    body->setProgressHandler(d->uploadProgressHandler);
+
+    QList<QPair<QString, QString> > paramItems = d->params.queryItems();
+    for (int i = 0; i < paramItems.size(); ++i) {
+        body->addTextPart(paramItems.at(i).first, paramItems.at(i).second);
+    }
+
+    // [3] 添加上传的部分
+    for (const HttpUploadPart &part : parts) {
+        QIODevice *device = part.device;
+        qint64     size   = part.size;
+        QString fileName  = part.fileName;
+
+        if (!part.path.isEmpty()) {
+            // [3.1] 文件使用内存映射读取，映射失败时直接从文件读取 (文件随 body 释放，释放文件时取消映射)
+            //       QByteArray 最大只能表示 2G 的数据，更大的文件直接从文件读取
+            QFile *file = new QFile(part.path, body);
+
+            if (!file->open(QIODevice::ReadOnly)) {
+                QString failMessage = QString("打开文件失败[%2]: %1").arg(part.path).arg(file->errorString());
+
+                if (cache.debug) {
+                    qDebug().noquote() << failMessage;
+                }
+
+                HttpClientPrivate::notifyFail(cache, localFailure(HttpFailureType::Local, failMessage));
+
+                if (nullptr != cache.completeHandler) {
+                    cache.completeHandler();
+                }
+
+                body->deleteLater();
+                return;
+            }
+
+            size   = file->size();
+            device = file;
+            bool mappable = size > 0 && size <= std::numeric_limits<int>::max();
+            uchar *memory = mappable ? file->map(0, size) : nullptr;
+
+            if (nullptr != memory) {
+                QBuffer *buffer = new QBuffer(body);
+                buffer->setData(QByteArray::fromRawData(reinterpret_cast<const char *>(memory), int(size)));
+                buffer->open(QIODevice::ReadOnly);
+                device = buffer;
+            }
+
+            if (fileName.isEmpty()) {
+                fileName = QFileInfo(part.path).fileName();
+            }
+        } else if (nullptr != device && size < 0) {
+            // [3.2] 使用传入的 device
+            size = device->size();
+        }
+
+        if (nullptr == device) {
+            continue;
+        }
+
+        body->addDevicePart(part.name, fileName.isEmpty() ? "no-name" : fileName, part.contentType, device, size);
+    }
+
+    // [4] 创建请求，不允许 Qt 缓存请求体，执行请求
+    body->open(QIODevice::ReadOnly);
+    QNetworkRequest request = HttpClientPrivate::createRequest(d, HttpClientRequestMethod::UPLOAD);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "multipart/form-data; boundary=" + body->boundary());
+    request.setHeader(QNetworkRequest::ContentLengthHeader, body->size());
+    request.setAttribute(QNetworkRequest::DoNotBufferUploadDataAttribute, true);
+
+    QNetworkReply *reply = cache.manager->post(request, body);
+    HttpClientManagerPool::instance().track(cache.manager, request.url());
+    HttpClientPrivate::watchTimeout(cache, reply);
+    HttpClientPrivate::watchTiming(reply);
+
+    // [5] 发送数据后更新请求体的发送进度 (背压控制和每个部分的进度)
+    QObject::connect(reply, &QNetworkReply::uploadProgress, [=](qint64 bytesSent, qint64) {
+        body->setBytesSent(bytesSent);
+    });
+
+    // [6] 请求结束时释放请求体和打开的文件，获取响应数据，在 handleFinish 中执行回调函数
+    QObject::connect(reply, &QNetworkReply::finished, [=] {
+        body->deleteLater(); // 释放资源: body + file + buffer
+
+        QString successMessage = HttpClientPrivate::readReply(reply, cache.charset);
+        QString failMessage    = reply->errorString();
+        HttpClientPrivate::handleFinish(cache, reply, successMessage, failMessage);
+    });
+}
+
+// 获取 Manager，如果传入了 manager 则返回此 manager，否则返回共享的 manager 池中当前线程的 manager
 QNetworkAccessManager* HttpClientPrivate::getManager() {
-    return internal ? new QNetworkAccessManager() : manager;
+    return internal ? HttpClientManagerPool::instance().manager() : manager;
 }
 
 // 使用用户设定的 URL、请求头、参数等创建 Request
@@ -371,20 +1275,23 @@ QNetworkRequest HttpClientPrivate::createRequest(HttpClientPrivate *d, HttpClien
     // 2. 调试时输出网址和参数
     // 3. 设置 Content-Type
     // 4. 添加请求头到 request 中
+    // 5. 设置允许使用的协议，HTTP/2 协商失败时 Qt 使用 HTTP/1.1，此时仍然可以管线化
 
-    bool get      = method == HttpClientRequestMethod::GET;
+    bool get      = method == HttpClientRequestMethod::GET || method == HttpClientRequestMethod::HEAD;
     bool upload   = method == HttpClientRequestMethod::UPLOAD;
     bool withForm = !get && !upload && !d->useJson; // PUT、POST 或者 DELETE 请求，且 useJson 为 false
     bool withJson = !get && !upload &&  d->useJson; // PUT、POST 或者 DELETE 请求，且 useJson 为 true
 
-    // [1] 如果是 GET 请求，并且参数不为空，则编码请求的参数，放到 URL 后面
+    // [1] 如果是 GET 请求，并且参数不为空，则编码请求的参数，放到 URL 后面 (不修改 d->url，重试时还会使用它创建请求)
+    QString url = d->url;
+
     if (get && !d->params.isEmpty()) {
-        d->url += "?" + d->params.toString(QUrl::FullyEncoded);
+        url += "?" + d->params.toString(QUrl::FullyEncoded);
     }
 
     // [2] 调试时输出网址和参数
     if (d->debug) {
-        qDebug().noquote() << "[网址]" << d->url;
+        qDebug().noquote() << "[网址]" << url;
 
         if (withJson) {
             qDebug().noquote() << "[参数]" << d->json;
@@ -419,17 +1326,96 @@ QNetworkRequest HttpClientPrivate::createRequest(HttpClientPrivate *d, HttpClien
     }
 
     // [4] 添加请求头到 request 中
-    QNetworkRequest request(QUrl(d->url));
+    QNetworkRequest request((QUrl(url)));
     for (auto i = d->headers.cbegin(); i != d->headers.cend(); ++i) {
         request.setRawHeader(i.key().toUtf8(), i.value().toUtf8());
     }
 
+    // [5] 设置允许使用的协议，HTTP/2 协商失败时 Qt 使用 HTTP/1.1，此时仍然可以管线化
+    HttpProtocol protocol = HttpClientManagerPool::instance().protocol(request.url(), d->protocol);
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, protocol == HttpProtocol::Http2);
+    request.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, protocol != HttpProtocol::Http1);
+
     return request;
 }
 
 // 读取服务器响应的数据
 QString HttpClientPrivate::readReply(QNetworkReply *reply, const QString &charset) {
-    QTextStream in(reply);
+    return HttpClientPrivate::decodeReply(HttpClientPrivate::readBody(reply), charset);
+}
+
+// 读取响应的数据，Qt 没有自动解压时流式解压
+QByteArray HttpClientPrivate::readBody(QNetworkReply *reply, qint64 maxSize) {
+    QByteArray data = maxSize > 0 ? reply->read(maxSize) : reply->readAll();
+    HttpInflater *inflater = HttpClientPrivate::inflaterOf(reply);
+
+    return nullptr != inflater ? inflater->inflate(data) : data;
+}
+
+// 获取解压 reply 的响应数据的 HttpInflater
+HttpInflater* HttpClientPrivate::inflaterOf(QNetworkReply *reply) {
+    // Qt 只在请求头没有 Accept-Encoding 时自动解压，这时响应头中仍然有 Content-Encoding，所以要根据请求头判断
+    QVariant value = reply->property(INFLATER_PROPERTY);
+
+    if (value.isValid()) {
+        return static_cast<HttpInflater *>(value.value<QObject *>());
+    }
+
+    QByteArray encoding = reply->rawHeader("Content-Encoding").trimmed().toLower();
+    bool compressed = encoding == "gzip" || encoding == "x-gzip" || encoding == "deflate";
+    HttpInflater *inflater = nullptr;
+
+    if (compressed && reply->request().hasRawHeader("Accept-Encoding")) {
+        inflater = new HttpInflater(reply);
+    }
+
+    reply->setProperty(INFLATER_PROPERTY, QVariant::fromValue(static_cast<QObject *>(inflater)));
+
+    return inflater;
+}
+
+// 检查解压后的响应数据是否完整
+QString HttpClientPrivate::inflateError(QNetworkReply *reply) {
+    HttpInflater *inflater = static_cast<HttpInflater *>(reply->property(INFLATER_PROPERTY).value<QObject *>());
+
+    if (nullptr == inflater) {
+        return QString();
+    } else if (inflater->hasError()) {
+        return QString("[错误] %1").arg(inflater->errorString());
+    } else if (inflater->hasInput() && !inflater->isFinished()) {
+        return "[错误] 压缩的响应数据不完整";
+    } else {
+        return QString();
+    }
+}
+
+// 创建 POST、PUT 请求的请求体，超过阈值时压缩
+QByteArray HttpClientPrivate::requestBody(HttpClientPrivate *d, QNetworkRequest *request) {
+    QByteArray body = d->useJson ? d->json.toUtf8() : d->params.toString(QUrl::FullyEncoded).toUtf8();
+
+    if (!d->compressBody || body.size() < d->compressThreshold) {
+        return body;
+    }
+
+    // 压缩失败或者压缩后没有变小时发送原始数据
+    QByteArray compressed = HttpCompression::compress(body, d->encoding);
+
+    if (compressed.isEmpty() || compressed.size() >= body.size()) {
+        return body;
+    }
+
+    if (d->debug) {
+        qDebug().noquote() << QString("[压缩] %1 字节压缩为 %2 字节").arg(body.size()).arg(compressed.size());
+    }
+
+    request->setRawHeader("Content-Encoding", HttpCompression::name(d->encoding));
+
+    return compressed;
+}
+
+// 使用和 readReply() 相同的方式把响应的数据转换为字符串
+QString HttpClientPrivate::decodeReply(const QByteArray &data, const QString &charset) {
+    QTextStream in(data);
     QString result;
     in.setCodec(charset.toUtf8());
 
@@ -442,43 +1428,295 @@ QString HttpClientPrivate::readReply(QNetworkReply *reply, const QString &charse
 
 // 请求结束的处理函数
 void HttpClientPrivate::handleFinish(HttpClientPrivateCache cache, QNetworkReply *reply, const QString &successMessage, const QString &failMessage) {
-    // 1. 执行请求成功的回调函数
-    // 2. 执行请求失败的回调函数
-    // 3. 执行请求结束的回调函数
-    // 4. 释放 reply 和 manager 对象
+    // 1. 把访问主机的结果记录到断路器，客户端错误 (4xx) 也说明主机是正常的，报告实际使用的协议，记录请求的耗时
+    // 2. 失败后可以重试时，释放 reply，等待一段时间后重新执行请求，不执行回调函数
+    // 3. 执行请求成功的回调函数
+    // 4. 执行请求失败的回调函数
+    // 5. 执行请求结束的回调函数
+    // 6. 释放 reply 对象 (池中的 manager 由池管理，传入的 manager 由用户管理，都不在这里删除)
+
+    bool succeeded = reply->error() == QNetworkReply::NoError;
+    HttpFailure failure;
+
+    if (!succeeded) {
+        failure = HttpClientPrivate::classify(cache, reply, failMessage);
+    }
+
+    // 响应的数据解压出错或者不完整 (例如压缩流没有结束连接就关闭了) 时请求失败
+    QString inflateMessage = succeeded ? HttpClientPrivate::inflateError(reply) : QString();
+
+    if (!inflateMessage.isEmpty()) {
+        succeeded = false;
+        failure   = HttpClientPrivate::classify(cache, reply, inflateMessage);
+        failure.errorCode = QNetworkReply::ProtocolFailure;
+    }
+
+    // [1] 把访问主机的结果记录到断路器，客户端错误 (4xx) 也说明主机是正常的，报告实际使用的协议，记录请求的耗时
+    HttpProtocol protocol = HttpClientPrivate::protocolOf(reply);
+    HttpTiming   timing   = HttpClientPrivate::timingOf(cache, reply, protocol);
+
+    if (cache.breaker) {
+        HttpCircuitBreaker::instance().record(cache.host, succeeded || failure.type == HttpFailureType::ClientError);
+        HttpClientManagerPool::instance().countProtocol(protocol);
+        HttpClientPrivate::checkFallback(cache, reply);
+        HttpMetrics::instance().record(timing);
+    }
+
+    if (nullptr != cache.protocolHandler) {
+        cache.protocolHandler(protocol);
+    }
+
+    // [2] 失败后可以重试时，释放 reply，等待一段时间后重新执行请求，不执行回调函数 (断路器打开后不再重试)
+    if (!succeeded && nullptr != cache.retryHandler && HttpClientPrivate::retryable(failure)
+            && HttpCircuitBreaker::instance().allow(cache.host)) {
+        int delay = HttpClientPrivate::backoff(cache.retryDelay, cache.attempt);
 
-    if (reply->error() == QNetworkReply::NoError) {
+        if (cache.debug) {
+            qDebug().noquote() << QString("[重试] 第 %1 次失败，%2 毫秒后重试: %3").arg(cache.attempt).arg(delay).arg(failure.message);
+        }
+
+        // manager 在重试前被删除时不再重试，执行失败和结束的回调函数 (结束的回调函数会释放调度器的名额)
+        QSharedPointer<HttpClientPendingRetry> pending(new HttpClientPendingRetry);
+        pending->retry   = cache.retryHandler;
+        pending->abandon = [cache, failure] {
+            HttpClientPrivate::notifyFail(cache, failure);
+
+            if (nullptr != cache.completeHandler) {
+                cache.completeHandler();
+            }
+        };
+
+        QTimer::singleShot(delay, cache.manager, [pending] {
+            pending->done = true;
+            pending->retry();
+        });
+
+        if (cache.internal) {
+            HttpClientManagerPool::instance().touch(cache.manager, reply->url());
+        }
+
+        reply->deleteLater();
+        return;
+    }
+
+    if (nullptr != cache.timingHandler) {
+        cache.timingHandler(timing);
+    }
+
+    if (succeeded) {
         if (cache.debug) {
             qDebug().noquote() << QString("[结束] 成功: %1").arg(successMessage);
         }
 
-        // [1] 执行请求成功的回调函数
-        if (nullptr != cache.successHandler) {
+        // [3] 执行请求成功的回调函数，流式模式下执行数据接收完成的回调函数
+        if (nullptr != cache.chunkHandler) {
+            if (nullptr != cache.doneHandler) {
+                cache.doneHandler();
+            }
+        } else if (nullptr != cache.successHandler) {
             cache.successHandler(successMessage);
         }
     } else {
         if (cache.debug) {
-            qDebug().noquote() << QString("[结束] 失败: %1").arg(failMessage);
+            qDebug().noquote() << QString("[结束] 失败: %1").arg(failure.message);
         }
 
-        // [2] 执行请求失败的回调函数
-        if (nullptr != cache.failHandler) {
-            cache.failHandler(failMessage, reply->error());
-        }
+        // [4] 执行请求失败的回调函数
+        HttpClientPrivate::notifyFail(cache, failure);
     }
 
-    // [3] 执行请求结束的回调函数
+    // [5] 执行请求结束的回调函数
     if (nullptr != cache.completeHandler) {
         cache.completeHandler();
     }
 
-    // [4] 释放 reply 和 manager 对象
+    // [6] 释放 reply 对象，并更新池中 manager 访问主机的时间
     if (nullptr != reply) {
+        if (cache.internal) {
+            HttpClientManagerPool::instance().touch(cache.manager, reply->url());
+        }
+
         reply->deleteLater();
     }
+}
+
+// 请求执行后 cache.timeout 毫秒内没有收到也没有发送任何数据时中止请求
+void HttpClientPrivate::watchTimeout(HttpClientPrivateCache cache, QNetworkReply *reply) {
+    // 定时器随 reply 一起释放，收到或者发送数据时重新计时，超时时标记 reply 后中止请求，然后 reply 会发出 finished 信号
+    if (cache.timeout <= 0) {
+        return;
+    }
+
+    QTimer *timer = new QTimer(reply);
+    timer->setSingleShot(true);
+    timer->setInterval(cache.timeout);
+
+    QObject::connect(timer, &QTimer::timeout, reply, [reply] {
+        reply->setProperty(TIMEOUT_PROPERTY, true);
+        reply->abort();
+    });
+    QObject::connect(reply, &QNetworkReply::metaDataChanged,  timer, [timer] { timer->start(); });
+    QObject::connect(reply, &QNetworkReply::downloadProgress, timer, [timer] { timer->start(); });
+    QObject::connect(reply, &QNetworkReply::uploadProgress,   timer, [timer] { timer->start(); });
+    QObject::connect(reply, &QNetworkReply::finished,         timer, [timer] { timer->stop();  });
+
+    timer->start();
+}
+
+// 记录 reply 开始、TLS 握手完成、收到响应头的时间和发送、接收的字节数
+void HttpClientPrivate::watchTiming(QNetworkReply *reply) {
+    reply->setProperty(STARTED_AT_PROPERTY, QDateTime::currentMSecsSinceEpoch());
+
+#ifndef QT_NO_SSL
+    QObject::connect(reply, &QNetworkReply::encrypted, [reply] {
+        if (!reply->property(ENCRYPTED_AT_PROPERTY).isValid()) {
+            reply->setProperty(ENCRYPTED_AT_PROPERTY, QDateTime::currentMSecsSinceEpoch());
+        }
+    });
+#endif
+    QObject::connect(reply, &QNetworkReply::metaDataChanged, [reply] {
+        if (!reply->property(FIRST_BYTE_AT_PROPERTY).isValid()) {
+            reply->setProperty(FIRST_BYTE_AT_PROPERTY, QDateTime::currentMSecsSinceEpoch());
+        }
+    });
+    QObject::connect(reply, &QNetworkReply::uploadProgress, [reply](qint64 bytesSent, qint64) {
+        reply->setProperty(BYTES_SENT_PROPERTY, bytesSent);
+    });
+    QObject::connect(reply, &QNetworkReply::downloadProgress, [reply](qint64 bytesReceived, qint64) {
+        reply->setProperty(BYTES_RECEIVED_PROPERTY, bytesReceived);
+    });
+}
+
+// 计算请求的耗时
+HttpTiming HttpClientPrivate::timingOf(const HttpClientPrivateCache &cache, QNetworkReply *reply, HttpProtocol protocol) {
+    static const QHash<int, QString> methods = {
+        { QNetworkAccessManager::HeadOperation,   "HEAD"   },
+        { QNetworkAccessManager::GetOperation,    "GET"    },
+        { QNetworkAccessManager::PutOperation,    "PUT"    },
+        { QNetworkAccessManager::PostOperation,   "POST"   },
+        { QNetworkAccessManager::DeleteOperation, "DELETE" }
+    };
+
+    qint64 now       = QDateTime::currentMSecsSinceEpoch();
+    qint64 startedAt = reply->property(STARTED_AT_PROPERTY).toLongLong();
+    QVariant encryptedAt = reply->property(ENCRYPTED_AT_PROPERTY);
+    QVariant firstByteAt = reply->property(FIRST_BYTE_AT_PROPERTY);
+
+    HttpTiming timing;
+    timing.method        = methods.value(reply->operation(), "CUSTOM");
+    timing.host          = cache.host;
+    timing.route         = cache.route;
+    timing.statusCode    = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    timing.succeeded     = reply->error() == QNetworkReply::NoError;
+    timing.attempts      = cache.attempt;
+    timing.protocol      = protocol;
+    timing.queuedMs      = cache.queuedMs;
+    timing.connectMs     = encryptedAt.isValid() ? encryptedAt.toLongLong() - startedAt : -1;
+    timing.firstByteMs   = firstByteAt.isValid() ? firstByteAt.toLongLong() - startedAt : -1;
+    timing.totalMs       = startedAt > 0 ? now - startedAt : 0;
+    timing.bytesSent     = reply->property(BYTES_SENT_PROPERTY).toLongLong();
+    timing.bytesReceived = reply->property(BYTES_RECEIVED_PROPERTY).toLongLong();
+
+    return timing;
+}
+
+// 对失败的请求进行分类
+HttpFailure HttpClientPrivate::classify(const HttpClientPrivateCache &cache, QNetworkReply *reply, const QString &message) {
+    HttpFailure failure;
+    failure.message    = message;
+    failure.errorCode  = reply->error();
+    failure.statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    failure.attempts   = cache.attempt;
+
+    if (reply->property(TIMEOUT_PROPERTY).toBool()) {
+        failure.type    = HttpFailureType::Timeout;
+        failure.message = QString("[错误] 请求超时: %1 毫秒内没有收到数据").arg(cache.timeout);
+    } else if (reply->error() == QNetworkReply::TimeoutError) {
+        failure.type = HttpFailureType::Timeout;
+    } else if (failure.statusCode >= 500) {
+        failure.type = HttpFailureType::ServerError;
+    } else if (failure.statusCode >= 400) {
+        failure.type = HttpFailureType::ClientError;
+    } else {
+        failure.type = HttpFailureType::Network;
+    }
+
+    return failure;
+}
+
+// 创建没有访问服务器的失败信息
+HttpFailure HttpClientPrivate::localFailure(HttpFailureType type, const QString &message) {
+    HttpFailure failure;
+    failure.type    = type;
+    failure.message = message;
+
+    return failure;
+}
+
+// 失败的请求是否值得重试: 超时、网络错误、502、503、504 和 429
+bool HttpClientPrivate::retryable(const HttpFailure &failure) {
+    switch (failure.type) {
+    case HttpFailureType::Timeout:
+        return true;
+    case HttpFailureType::Network:
+        // 证书、协议等错误重试也不会成功
+        return failure.errorCode != QNetworkReply::SslHandshakeFailedError
+            && failure.errorCode != QNetworkReply::ProtocolUnknownError
+            && failure.errorCode != QNetworkReply::OperationCanceledError;
+    case HttpFailureType::ServerError:
+        return failure.statusCode == 502 || failure.statusCode == 503 || failure.statusCode == 504;
+    case HttpFailureType::ClientError:
+        return failure.statusCode == 429;
+    default:
+        return false;
+    }
+}
+
+// 计算重试前等待的时间: 指数增长，在一半到全部之间随机，避免大量客户端同时重试
+int HttpClientPrivate::backoff(int baseDelay, int attempt) {
+    qint64 ceiling = qMin<qint64>(MAX_RETRY_DELAY_MS, qint64(qMax(baseDelay, 1)) << qBound(0, attempt - 1, 20));
+    int    half    = int(ceiling / 2);
+
+    return half + int(QRandomGenerator::global()->bounded(int(ceiling) - half + 1));
+}
+
+// 执行请求失败的回调函数
+void HttpClientPrivate::notifyFail(const HttpClientPrivateCache &cache, const HttpFailure &failure) {
+    if (nullptr != cache.failHandler) {
+        cache.failHandler(failure.message, failure.errorCode);
+    }
+
+    if (nullptr != cache.failureHandler) {
+        cache.failureHandler(failure);
+    }
+}
+
+// 请求实际使用的协议
+HttpProtocol HttpClientPrivate::protocolOf(QNetworkReply *reply) {
+    if (reply->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool()) {
+        return HttpProtocol::Http2;
+    } else if (reply->attribute(QNetworkRequest::HttpPipeliningWasUsedAttribute).toBool()) {
+        return HttpProtocol::Pipelining;
+    } else {
+        return HttpProtocol::Http1;
+    }
+}
+
+// 使用 HTTP/2 或者管线化的请求出现协议错误时，主机回退到 HTTP/1.1
+void HttpClientPrivate::checkFallback(const HttpClientPrivateCache &cache, QNetworkReply *reply) {
+    // 管线化时服务器在返回所有响应前关闭连接也说明它不能正确的处理管线化
+    bool http2      = reply->request().attribute(QNetworkRequest::Http2AllowedAttribute).toBool();
+    bool pipelining = reply->request().attribute(QNetworkRequest::HttpPipeliningAllowedAttribute).toBool();
+    bool broken     = reply->error() == QNetworkReply::ProtocolFailure
+                  || (pipelining && reply->error() == QNetworkReply::RemoteHostClosedError);
+
+    if ((http2 || pipelining) && broken) {
+        if (cache.debug) {
+            qDebug().noquote() << QString("[协议] 出现协议错误，回退到 HTTP/1.1: %1").arg(cache.host);
+        }
 
-    if (cache.internal && nullptr != cache.manager) {
-        cache.manager->deleteLater();
+        HttpClientManagerPool::instance().fallback(reply->url());
+        HttpScheduler::instance().setHostLimit(cache.host, 0);
     }
 }
 
@@ -508,6 +1746,79 @@ HttpClient& HttpClient::debug(bool debug) {
     return *this;
 }
 
+// 设置 GET 请求是否使用响应缓存
+HttpClient& HttpClient::cache(bool cache) {
+    d->useCache = cache;
+
+    return *this;
+}
+
+// 设置请求的优先级
+HttpClient& HttpClient::priority(HttpPriority priority) {
+    d->priority = priority;
+
+    return *this;
+}
+
+// 设置请求的超时时间
+HttpClient& HttpClient::timeout(int ms) {
+    d->timeout = qMax(0, ms);
+
+    return *this;
+}
+
+// 设置请求失败后的重试次数
+HttpClient& HttpClient::retry(int count, int baseDelayMs) {
+    d->retries    = qMax(0, count);
+    d->retryDelay = qMax(0, baseDelayMs);
+
+    return *this;
+}
+
+// 声明请求是否幂等
+HttpClient& HttpClient::idempotent(bool idempotent) {
+    d->idempotent = idempotent;
+
+    return *this;
+}
+
+// 设置压缩超过阈值的请求体
+HttpClient& HttpClient::compress(HttpContentEncoding encoding, int threshold) {
+    d->compressBody      = true;
+    d->encoding          = encoding;
+    d->compressThreshold = qMax(0, threshold);
+
+    return *this;
+}
+
+// 设置请求在指标中的路由名
+HttpClient& HttpClient::route(const QString &name) {
+    d->routeName = name;
+
+    return *this;
+}
+
+// 注册报告请求的耗时的回调函数
+HttpClient& HttpClient::timing(std::function<void (const HttpTiming &)> timingHandler) {
+    d->timingHandler = timingHandler;
+
+    return *this;
+}
+
+// 设置这个请求使用的协议
+HttpClient& HttpClient::protocol(HttpProtocol protocol) {
+    d->protocol = int(protocol);
+
+    return *this;
+}
+
+// 注册报告实际使用的协议的回调函数
+HttpClient& HttpClient::protocolUsed(std::function<void (HttpProtocol)> protocolHandler) {
+    d->protocolHandler = protocolHandler;
+
+    return *this;
+}
+
 // 添加一个请求的参数，可以多次调用添加多个参数
 HttpClient& HttpClient::param(const QString &name, const QVariant &value) {
     d->params.addQueryItem(name, value.toString());
@@ -562,6 +1873,13 @@ HttpClient& HttpClient::fail(std::function<void (const QString &, int)> failHand
     return *this;
 }
 
+// 注册请求失败的回调函数，参数为失败的分类和信息
+HttpClient& HttpClient::fail(std::function<void (const HttpFailure &)> failureHandler) {
+    d->failureHandler = failureHandler;
+
+    return *this;
+}
+
 // 注册请求结束的回调函数，不管成功还是失败都会执行
 HttpClient& HttpClient::complete(std::function<void ()> completeHandler) {
     d->completeHandler = completeHandler;
@@ -569,6 +1887,42 @@ HttpClient& HttpClient::complete(std::function<void ()> completeHandler) {
     return *this;
 }
 
+// 注册接收到响应头时的回调函数
+HttpClient& HttpClient::responseHeaders(std::function<void (int, const QMap<QString, QString> &)> headersHandler) {
+    d->headersHandler = headersHandler;
+
+    return *this;
+}
+
+// 注册分块接收响应数据的回调函数，使用流式模式执行请求
+HttpClient& HttpClient::chunk(std::function<void (const QByteArray &)> chunkHandler, qint64 bufferSize) {
+    d->chunkHandler = chunkHandler;
+    d->bufferSize   = qMax<qint64>(bufferSize, 1024);
+
+    return *this;
+}
+
+// 注册流式模式下所有响应数据接收完成的回调函数
+HttpClient& HttpClient::done(std::function<void ()> doneHandler) {
+    d->doneHandler = doneHandler;
+
+    return *this;
+}
+
+// 注册流式上传的进度回调函数
+HttpClient& HttpClient::uploadProgress(std::function<void (int, qint64, qint64)> progressHandler) {
+    d->uploadProgressHandler = progressHandler;
+
+    return *this;
+}
+
+// 设置流式上传时已读取但还没有发送的数据的最大字节数
+HttpClient& HttpClient::uploadBufferSize(qint64 bufferSize) {
+    d->uploadBufferSize = bufferSize;
+
+    return *this;
+}
+
 // 设置请求响应的编码
 HttpClient& HttpClient::charset(const QString &cs) {
     d->charset = cs;
@@ -578,41 +1932,296 @@ HttpClient& HttpClient::charset(const QString &cs) {
 
 // 执行 GET 请求
 void HttpClient::get() {
-    HttpClientPrivate::executeQuery(d, HttpClientRequestMethod::GET);
+    HttpClientPrivate::schedule(d, [](HttpClientPrivate *d) {
+        HttpClientPrivate::executeQuery(d, HttpClientRequestMethod::GET);
+    });
+}
+
+// 执行 HEAD 请求
+void HttpClient::head() {
+    HttpClientPrivate::schedule(d, [](HttpClientPrivate *d) {
+        HttpClientPrivate::executeQuery(d, HttpClientRequestMethod::HEAD);
+    });
 }
 
 // 执行 POST 请求
 void HttpClient::post() {
-    HttpClientPrivate::executeQuery(d, HttpClientRequestMethod::POST);
+    HttpClientPrivate::schedule(d, [](HttpClientPrivate *d) {
+        HttpClientPrivate::executeQuery(d, HttpClientRequestMethod::POST);
+    });
 }
 
 // 执行 PUT 请求
 void HttpClient::put() {
-    HttpClientPrivate::executeQuery(d, HttpClientRequestMethod::PUT);
+    HttpClientPrivate::schedule(d, [](HttpClientPrivate *d) {
+        HttpClientPrivate::executeQuery(d, HttpClientRequestMethod::PUT);
+    });
 }
 
 // 执行 DELETE 请求
 void HttpClient::remove() {
-    HttpClientPrivate::executeQuery(d, HttpClientRequestMethod::DELETE);
+    HttpClientPrivate::schedule(d, [](HttpClientPrivate *d) {
+        HttpClientPrivate::executeQuery(d, HttpClientRequestMethod::DELETE);
+    });
 }
 
 // 使用 GET 进行下载，下载的文件保存到 savePath
 void HttpClient::download(const QString &savePath) {
-    HttpClientPrivate::download(d, savePath);
+    HttpClientPrivate::schedule(d, [savePath](HttpClientPrivate *d) {
+        HttpClientPrivate::download(d, savePath);
+    });
 }
 
 // 上传文件
 void HttpClient::upload(const QString &path) {
     QStringList paths = { path };
-    HttpClientPrivate::upload(d, paths, QByteArray());
+    HttpClientPrivate::schedule(d, [paths](HttpClientPrivate *d) {
+        HttpClientPrivate::upload(d, paths, QByteArray());
+    });
 }
 
 // 上传文件，文件的内容以及读取到 data 中
 void HttpClient::upload(const QByteArray &data) {
-    HttpClientPrivate::upload(d, QStringList(), data);
+    HttpClientPrivate::schedule(d, [data](HttpClientPrivate *d) {
+        HttpClientPrivate::upload(d, QStringList(), data);
+    });
 }
 
 // 上传多个文件
 void HttpClient::upload(const QStringList &paths) {
-    HttpClientPrivate::upload(d, paths, QByteArray());
+    HttpClientPrivate::schedule(d, [paths](HttpClientPrivate *d) {
+        HttpClientPrivate::upload(d, paths, QByteArray());
+    });
+}
+
+// 流式上传多个部分
+void HttpClient::upload(const QList<HttpUploadPart> &parts) {
+    HttpClientPrivate::schedule(d, [parts](HttpClientPrivate *d) {
+        HttpClientPrivate::upload(d, parts);
+    });
+}
+
+// 使用当前线程共享的 manager 预先和 url 所在的主机建立连接
+void HttpClient::preconnect(const QString &url) {
+    QUrl target(url);
+    QNetworkAccessManager *manager = HttpClientManagerPool::instance().manager();
+
+#ifndef QT_NO_SSL
+    if (target.scheme() == "https") {
+        manager->connectToHostEncrypted(target.host(), target.port(443));
+        HttpClientManagerPool::instance().track(manager, target);
+        return;
+    }
+#endif
+
+    manager->connectToHost(target.host(), target.port(80));
+    HttpClientManagerPool::instance().track(manager, target);
+}
+
+// 获取内部共享的 QNetworkAccessManager 池的统计信息
+HttpClientPoolStats HttpClient::poolStats() {
+    return HttpClientManagerPool::instance().stats();
+}
+
+// 设置响应缓存的数据的最大字节数
+void HttpClient::setCacheLimit(qint64 bytes) {
+    HttpResponseCache::instance().setMaxBytes(bytes);
+}
+
+// 清空响应缓存
+void HttpClient::clearCache() {
+    HttpResponseCache::instance().clear();
+}
+
+// 获取响应缓存的统计信息
+HttpCacheStats HttpClient::cacheStats() {
+    return HttpResponseCache::instance().stats();
+}
+
+// 设置同时进行的请求数的上限
+void HttpClient::setConcurrencyLimits(int global, int perHost, int reserved) {
+    HttpScheduler::instance().setConcurrencyLimits(global, perHost, reserved);
+}
+
+// 设置排队等待的请求数的上限
+void HttpClient::setQueueLimit(int maxQueued) {
+    HttpScheduler::instance().setQueueLimit(maxQueued);
+}
+
+// 获取调度器的统计信息
+HttpSchedulerStats HttpClient::schedulerStats() {
+    return HttpScheduler::instance().stats();
+}
+
+// 设置所有请求默认的超时时间
+void HttpClient::setDefaultTimeout(int ms) {
+    defaultTimeoutMs.store(qMax(0, ms));
+}
+
+// 设置每个主机的断路器
+void HttpClient::setCircuitBreaker(int threshold, int cooldownMs) {
+    HttpCircuitBreaker::instance().setPolicy(threshold, cooldownMs);
+}
+
+// 设置访问 url 所在主机使用的协议
+void HttpClient::setHostProtocol(const QString &url, HttpProtocol protocol) {
+    QUrl target(url);
+    HttpClientManagerPool::instance().setProtocol(target, protocol);
+    HttpScheduler::instance().setHostLimit(HttpClientManagerPool::hostKey(target), protocol == HttpProtocol::Http2 ? 100 : 0);
+}
+
+// 导出所有请求的指标
+QString HttpClient::metrics(HttpMetricsFormat format) {
+    return HttpMetrics::instance().exportAs(format);
+}
+
+// 导出所有请求的指标并写入文件
+bool HttpClient::writeMetrics(const QString &path, HttpMetricsFormat format) {
+    QSaveFile file(path);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    file.write(HttpMetrics::instance().exportAs(format).toUtf8());
+    return file.commit();
+}
+
+// 清空所有请求的指标
+void HttpClient::resetMetrics() {
+    HttpMetrics::instance().reset();
+}
+
+/*-----------------------------------------------------------------------------|
+ |                              JsonStreamReader                               |
+ |----------------------------------------------------------------------------*/
+JsonStreamReader::JsonStreamReader(const QString &arrayKey, std::function<void (const QJsonValue &)> itemHandler)
+    : arrayKey(arrayKey.toUtf8()), itemHandler(itemHandler) {
+}
+
+// 输入一块响应数据，解析出的元素通过 itemHandler 回调
+void JsonStreamReader::feed(const QByteArray &data) {
+    // 1. 字符串中的字符只需要处理转义和结束的引号，如果正在读取元素或者顶层对象的属性名则保存下来
+    // 2. 目标数组中的元素在它所在的深度遇到 , ] 或者空白字符时结束，解析并回调
+    // 3. 目标数组中遇到非分隔符时开始读取新的元素
+    // 4. 维护嵌套深度和顶层对象的属性名，找到目标数组
+
+    for (char c : data) {
+        if (finished) {
+            return;
+        }
+
+        // [1] 字符串中的字符只需要处理转义和结束的引号，如果正在读取元素或者顶层对象的属性名则保存下来
+        if (inString) {
+            if (collecting) {
+                item.append(c);
+            }
+
+            if (escape) {
+                escape = false;
+            } else if (c == '\\') {
+                escape = true;
+            } else if (c == '"') {
+                inString     = false;
+                capturingKey = false;
+                continue;
+            }
+
+            if (capturingKey) {
+                key.append(c);
+            }
+
+            continue;
+        }
+
+        bool separator = (c == ',' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n');
+
+        // [2] 目标数组中的元素在它所在的深度遇到 , ] 或者空白字符时结束，解析并回调
+        if (collecting && depth == targetDepth && separator) {
+            emitItem();
+        }
+
+        // [3] 目标数组中遇到非分隔符时开始读取新的元素
+        if (!collecting && targetDepth > 0 && depth == targetDepth && !separator) {
+            collecting = true;
+        }
+
+        if (collecting) {
+            item.append(c);
+        }
+
+        // [4] 维护嵌套深度和顶层对象的属性名，找到目标数组
+        switch (c) {
+        case '"':
+            inString = true;
+
+            if (!collecting && depth == 1 && rootIsObject && expectingKey) {
+                capturingKey = true;
+                key.clear();
+            }
+            break;
+        case ':':
+            if (depth == 1 && rootIsObject) {
+                currentKey   = key;
+                expectingKey = false;
+            }
+            break;
+        case ',':
+            if (depth == 1 && rootIsObject) {
+                expectingKey = true;
+            }
+            break;
+        case '{':
+        case '[':
+            ++depth;
+
+            if (depth == 1) {
+                rootIsObject = (c == '{');
+                expectingKey = rootIsObject;
+
+                if (c == '[' && arrayKey.isEmpty()) {
+                    targetDepth = 1;
+                }
+            } else if (depth == 2 && c == '[' && rootIsObject && !arrayKey.isEmpty() && currentKey == arrayKey) {
+                targetDepth = 2;
+            }
+            break;
+        case '}':
+        case ']':
+            if (c == ']' && depth == targetDepth) {
+                finished = true;
+            }
+
+            --depth;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// 是否已经解析完目标数组
+bool JsonStreamReader::isFinished() const {
+    return finished;
+}
+
+// 解析元素出错时的错误信息
+QString JsonStreamReader::errorString() const {
+    return error;
+}
+
+// 解析 item 中的元素并回调 itemHandler
+void JsonStreamReader::emitItem() {
+    // Qt 5 的 QJsonDocument 只能解析对象和数组，所以把元素放到数组中解析，标量元素也能解析
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson("[" + item + "]", &parseError);
+
+    if (QJsonParseError::NoError != parseError.error) {
+        error = QString("%1 at: %2").arg(parseError.errorString()).arg(QString::fromUtf8(item.left(64)));
+    } else if (nullptr != itemHandler) {
+        itemHandler(doc.array().at(0));
+    }
+
+    item.clear();
+    collecting = false;
 }
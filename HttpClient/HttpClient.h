@@ -5,12 +5,148 @@
 #include <QMap>
 #include <QVariant>
 #include <QStringList>
+#include <QByteArray>
+#include <QJsonValue>
 
+class QIODevice;
 class QNetworkReply;
 class QNetworkRequest;
 class QNetworkAccessManager;
 class HttpClientPrivate;
 
+/**
+ * @brief HttpClient 内部共享的 QNetworkAccessManager 池的统计信息。
+ *        Qt 没有提供判断请求是否复用了底层连接的 API，新建连接数和复用连接数是按主机估算的:
+ *        同一个 manager 在 keep-alive 时间内再次访问同一个主机认为复用了连接，否则认为新建了连接。
+ */
+struct HttpClientPoolStats {
+    int    managerCount      = 0; // 池中当前的 manager 数量 (每个线程一个)
+    qint64 managerCreated    = 0; // 累计创建的 manager 数量
+    qint64 newConnections    = 0; // 估算的新建连接次数
+    qint64 reusedConnections = 0; // 估算的复用连接次数
+    qint64 http1Requests     = 0; // 使用 HTTP/1.1 (没有管线化) 的请求数
+    qint64 pipelinedRequests = 0; // 使用 HTTP/1.1 管线化的请求数
+    qint64 http2Requests     = 0; // 使用 HTTP/2 的请求数
+};
+
+/**
+ * @brief 访问主机使用的协议:
+ *     Http1     : HTTP/1.1，每个连接同时只有一个请求，Qt 对每个主机最多建立 6 个连接，默认的协议
+ *     Pipelining: HTTP/1.1 管线化，GET、HEAD 请求不等上一个响应就在同一个连接上发送
+ *     Http2     : HTTP/2，所有请求在同一个连接上多路复用，服务器不支持时 (ALPN 协商失败) 回退到 HTTP/1.1 管线化
+ */
+enum class HttpProtocol {
+    Http1, Pipelining, Http2
+};
+
+/**
+ * @brief 请求体的压缩格式，对应请求头 Content-Encoding 的 gzip 和 deflate
+ */
+enum class HttpContentEncoding {
+    Gzip, Deflate
+};
+
+/**
+ * @brief 请求的优先级，调度器按优先级执行排队的请求:
+ *     Interactive: 用户正在等待的请求，例如签到，可以使用为它保留的名额，默认的优先级
+ *     Background : 后台刷新数据等请求
+ *     Bulk       : 批量上传、下载等大量的请求
+ */
+enum class HttpPriority {
+    Interactive = 0, Background = 1, Bulk = 2
+};
+
+/**
+ * @brief HttpClient 请求调度器的统计信息
+ */
+struct HttpSchedulerStats {
+    int    running           = 0; // 正在进行的请求数
+    int    queuedInteractive = 0; // 排队的 Interactive 请求数
+    int    queuedBackground  = 0; // 排队的 Background 请求数
+    int    queuedBulk        = 0; // 排队的 Bulk 请求数
+    int    peakQueued        = 0; // 排队的请求数的最大值
+    qint64 started           = 0; // 累计执行的请求数
+    qint64 rejected          = 0; // 因为队列已满被拒绝的请求数
+};
+
+/**
+ * @brief HttpClient 的 GET 响应缓存的统计信息
+ */
+struct HttpCacheStats {
+    int    entries     = 0; // 缓存的响应数量
+    qint64 bytes       = 0; // 缓存的数据的字节数
+    qint64 hits        = 0; // 缓存新鲜，没有访问服务器的次数
+    qint64 revalidated = 0; // 服务器返回 304，使用缓存的次数
+    qint64 misses      = 0; // 从服务器获取数据的次数
+    qint64 coalesced   = 0; // 合并到正在进行中的相同请求，没有单独访问服务器的次数
+};
+
+/**
+ * @brief 流式上传的一个部分，数据来自文件 path (使用内存映射读取) 或者 device，path 和 device 只能使用一个。
+ *        上传时数据直接从文件或者 device 读取发送，不会复制到中间的缓冲区。
+ */
+struct HttpUploadPart {
+    QString    name = "file";   // 服务器端获取文件的参数名
+    QString    fileName;        // 文件名，为空时使用 path 的文件名，都为空时为 no-name
+    QString    contentType;     // 数据的 Content-Type，为空时使用 application/octet-stream
+    QString    path;            // 要上传的文件的路径
+    QIODevice *device = nullptr; // 数据来源，需要已经打开，并且在上传结束前保持有效，HttpClient 不会删除它
+    qint64     size   = -1;      // device 的数据大小，为 -1 时使用 device->size()，顺序设备 (如 QProcess) 必须指定
+};
+
+/**
+ * @brief 请求失败的分类:
+ *     Network    : 网络错误，例如无法连接、连接被重置、域名解析失败
+ *     Timeout    : 超时，在 timeout() 设置的时间内没有收到也没有发送任何数据
+ *     ClientError: 服务器返回 4xx
+ *     ServerError: 服务器返回 5xx
+ *     CircuitOpen: 主机的断路器已打开 (后端连续失败)，没有访问服务器
+ *     Rejected   : 请求队列已满，没有执行
+ *     Local      : 本地错误，例如打开文件失败
+ */
+enum class HttpFailureType {
+    Network, Timeout, ClientError, ServerError, CircuitOpen, Rejected, Local
+};
+
+/**
+ * @brief 请求最终失败的信息，重试后仍然失败时为最后一次尝试的结果
+ */
+struct HttpFailure {
+    HttpFailureType type = HttpFailureType::Network;
+    QString message;        // 失败的原因
+    int     errorCode  = -1; // QNetworkReply::NetworkError，没有访问服务器时为 -1
+    int     statusCode = 0;  // HTTP 状态码，没有收到响应时为 0
+    int     attempts   = 0;  // 访问服务器的次数 (包含重试)，没有访问服务器时为 0
+};
+
+/**
+ * @brief 一次请求的耗时，时间的单位都是毫秒，从请求发出 (离开调度器的队列) 开始计算。
+ *        Qt 5 的 QNetworkReply 没有 DNS 解析和 TCP 连接完成的信号，所以 DNS + TCP + TLS 合并为 connectMs，
+ *        只有新建的 HTTPS 连接能测到 (TLS 握手完成时)，复用连接或者 HTTP 时为 -1
+ */
+struct HttpTiming {
+    QString method;             // 请求的 Method，例如 GET
+    QString host;               // 请求的主机 scheme://host:port
+    QString route;              // 请求的路由，路径中的数字、UUID 等替换为 :id，或者为 route() 设置的名字
+    int     statusCode = 0;     // HTTP 状态码，没有收到响应时为 0
+    bool    succeeded  = false; // 请求是否成功
+    int     attempts   = 1;     // 第几次访问服务器
+    HttpProtocol protocol = HttpProtocol::Http1; // 实际使用的协议
+    qint64  queuedMs      = 0;  // 在调度器的队列中等待的时间
+    qint64  connectMs     = -1; // DNS + TCP + TLS 握手的时间
+    qint64  firstByteMs   = -1; // 收到响应头的时间 (TTFB)，没有收到响应时为 -1
+    qint64  totalMs       = 0;  // 请求结束的时间
+    qint64  bytesSent     = 0;  // 发送的请求体的字节数
+    qint64  bytesReceived = 0;  // 接收的响应体的字节数
+};
+
+/**
+ * @brief 导出请求指标的格式
+ */
+enum class HttpMetricsFormat {
+    Json, Prometheus
+};
+
 /**
  * 对 QNetworkAccessManager 简单封装的 HTTP 访问客户端，简化 GET、POST、PUT、DELETE、上传、下载等操作。
  * 在执行请求前设置需要的参数和回调函数:
@@ -22,10 +158,21 @@ class HttpClientPrivate;
  *     5. 调用 fail() 注册请求失败的回调函数
  *     6. 调用 complete() 注册请求结束的回调函数
  *        success(), fail(), complete() 的回调函数是可选的，根据需要注册对应的回调函数，也可以一个都不注册
+ *     7. 响应很大时 (例如几百 MB 的 JSON 导出)，调用 chunk() 和 done() 使用流式模式，响应数据分块回调，不会一次性全部读入内存
  * 然后根据请求的类型调用 get(), post(), put(), remove(), download(), upload() 执行 HTTP 请求
  *
- * 默认 HttpClient 会创建一个 QNetworkAccessManager，如果不想使用默认的，调用 manager() 传入即可。
+ * 默认 HttpClient 使用进程内共享的 QNetworkAccessManager 池 (每个线程一个 manager)，同一线程的请求复用 manager 的连接缓存和 TLS 会话，
+ * 如果不想使用默认的，调用 manager() 传入即可。
  * 调用 debug(true) 设置为调试模式，输出调试信息如 URL、参数等。
+ *
+ * 所有请求都经过调度器执行，同时进行的请求数超过全局或者每个主机的上限时排队，按 priority() 设置的优先级执行，
+ * 调用 setConcurrencyLimits() 和 setQueueLimit() 修改上限。
+ *
+ * 请求默认不超时，调用 timeout() 或者 setDefaultTimeout() 设置没有收到也没有发送数据多长时间后超时，
+ * 调用 retry() 在超时、网络错误等情况下自动重试，
+ * 访问某个主机连续失败时它的断路器打开，请求直接失败，见 setCircuitBreaker()。
+ * 调用 setHostProtocol() 或者 protocol() 使用 HTTP/2 或者 HTTP/1.1 管线化，大量并发的小请求共享一个连接。
+ * 所有请求的耗时都记录到进程内的指标中，调用 metrics() 导出，调用 timing() 获取单个请求的耗时。
  */
 class HttpClient {
 public:
@@ -35,7 +182,8 @@ public:
     /**
      * @brief 每创建一个 QNetworkAccessManager 对象都会创建一个线程，当频繁的访问网络时，为了节省线程资源，
      *     可以传入 QNetworkAccessManager 给多个请求共享 (它不会被 HttpClient 删除，用户需要自己手动删除)。
-     *     如果没有使用 manager() 传入一个 QNetworkAccessManager，则 HttpClient 会自动的创建一个，并且在网络访问完成后自动删除它。
+     *     如果没有使用 manager() 传入一个 QNetworkAccessManager，则 HttpClient 使用内部共享的 manager 池中当前线程的 manager，
+     *     它在线程结束时自动删除 (主线程的 manager 随 qApp 删除)，同一线程的请求复用它的连接缓存 (keep-alive) 和 TLS 会话。
      *
      * @param  manager 执行 HTTP 请求的 QNetworkAccessManager 对象
      * @return 返回 HttpClient 的引用，可以用于链式调用
@@ -50,6 +198,106 @@ public:
      */
     HttpClient& debug(bool debug);
 
+    /**
+     * @brief 参数 cache 为 true 则 GET 请求使用进程内共享的响应缓存，默认不使用:
+     *     1. 同一个线程中 URL 和请求头都相同的 GET 请求正在进行中时，不再访问服务器，而是等待它的响应 (合并请求)
+     *     2. 缓存遵循响应头 Cache-Control 和 ETag，缓存新鲜时直接返回，不访问服务器，
+     *        过期后使用 If-None-Match 向服务器验证，服务器返回 304 时使用缓存的数据
+     *     3. 缓存的数据总大小有上限 (默认 16M)，超过时淘汰最久没有使用的缓存，调用 setCacheLimit() 修改
+     *     注意: 使用流式模式 chunk() 的请求不使用缓存
+     *
+     * @param cache 是否使用缓存
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& cache(bool cache);
+
+    /**
+     * @brief 设置请求的优先级，默认为 HttpPriority::Interactive，批量请求应该设置为 Bulk，避免阻塞用户正在等待的请求
+     *
+     * @param priority 请求的优先级
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& priority(HttpPriority priority);
+
+    /**
+     * @brief 设置请求的超时时间: 请求执行后 ms 毫秒内没有收到也没有发送任何数据时中止请求，失败的类型为 Timeout。
+     *        计算的是空闲的时间，持续传输数据的大文件下载、上传不会超时，在调度器中排队的时间也不计算在内。
+     *        默认使用 setDefaultTimeout() 设置的时间，0 表示不超时
+     *
+     * @param ms 超时时间，单位为毫秒
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& timeout(int ms);
+
+    /**
+     * @brief 设置请求失败后的重试次数，默认不重试。只重试超时、网络错误、502、503、504 和 429，
+     *        第 n 次重试前等待 baseDelayMs * 2^(n-1) 毫秒 (最多 10 秒) 的一半到全部之间的随机时间，避免大量客户端同时重试。
+     *        只有幂等的 GET、HEAD、PUT、DELETE 请求会重试，POST 需要调用 idempotent(true) 声明可以重复执行，
+     *        流式模式 chunk()、使用缓存的 GET、上传和下载文件不重试。
+     *        重试期间不执行回调函数，最终成功或者失败时才执行，重试占用同一个调度器的名额
+     *
+     * @param count       最多重试的次数
+     * @param baseDelayMs 第一次重试前等待的时间，单位为毫秒
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& retry(int count, int baseDelayMs = 200);
+
+    /**
+     * @brief 声明请求是否幂等 (重复执行和执行一次的效果相同)，例如带有幂等键的 POST，为 true 时 POST 请求也可以重试
+     *
+     * @param idempotent 是否幂等
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& idempotent(bool idempotent);
+
+    /**
+     * @brief 设置这个请求使用的协议，默认使用 setHostProtocol() 为请求的主机设置的协议，都没有设置时使用 HTTP/1.1。
+     *        使用 HTTP/2 或者管线化时出现协议错误，之后访问这个主机都回退到 HTTP/1.1
+     *
+     * @param protocol 使用的协议
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& protocol(HttpProtocol protocol);
+
+    /**
+     * @brief 注册请求结束时报告实际使用的协议的回调函数，请求成功和失败时都会调用 (在 success 和 fail 之前)
+     *
+     * @param protocolHandler 回调函数，参数为实际使用的协议
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& protocolUsed(std::function<void (HttpProtocol)> protocolHandler);
+
+    /**
+     * @brief POST、PUT 请求的请求体 (Json 或者 Form 参数) 不小于 threshold 字节时压缩后发送，并设置请求头 Content-Encoding，
+     *        需要服务器支持解压请求体，JSON 数据 (例如考生名单) 通常能压缩到原来的 1/5 到 1/10。压缩后没有变小时发送原始数据。
+     *        上传的文件通常已经是压缩格式 (图片、视频、zip)，不压缩。
+     *
+     *        响应的解压不需要设置: 请求头没有 Accept-Encoding 时 Qt 自动请求并流式解压 gzip 和 deflate，
+     *        请求头设置了 Accept-Encoding 时 Qt 不再解压，由 HttpClient 流式解压 gzip 和 deflate，
+     *        所以 success()、chunk() 和 download() 得到的总是解压后的数据。
+     *
+     * @param encoding  压缩的格式，默认 gzip
+     * @param threshold 请求体不小于这么多字节时才压缩，默认 1K，太小的数据压缩后可能反而变大
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& compress(HttpContentEncoding encoding = HttpContentEncoding::Gzip, int threshold = 1024);
+
+    /**
+     * @brief 设置请求在指标中的路由名，默认使用 URL 的路径，其中的数字、UUID 等替换为 :id
+     *
+     * @param name 路由名，例如 signIn
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& route(const QString &name);
+
+    /**
+     * @brief 注册请求结束时报告耗时的回调函数，在 success 和 fail 之前调用，重试时报告最后一次访问服务器的耗时
+     *
+     * @param timingHandler 回调函数，参数为请求的耗时
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& timing(std::function<void (const HttpTiming &)> timingHandler);
+
     /**
      * @brief 添加一个请求的参数，可以多次调用添加多个参数
      *
@@ -110,6 +358,14 @@ public:
      */
     HttpClient& fail(std::function<void (const QString &, int)> failHandler);
 
+    /**
+     * @brief 注册请求失败的回调函数，参数为最终失败的分类和信息，可以和 fail(const QString &, int) 的回调函数同时使用
+     *
+     * @param failureHandler 失败的回调函数，参数为失败的信息
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& fail(std::function<void (const HttpFailure &)> failureHandler);
+
     /**
      * @brief 注册请求结束的回调函数，不管成功还是失败请求结束后都会执行
      *
@@ -118,6 +374,50 @@ public:
      */
     HttpClient& complete(std::function<void ()> completeHandler);
 
+    /**
+     * @brief 注册接收到响应头时的回调函数，在响应的数据之前调用
+     *
+     * @param headersHandler 回调函数，参数为 HTTP 状态码和响应头，响应头的名字都转为小写，例如 content-length
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& responseHeaders(std::function<void (int, const QMap<QString, QString> &)> headersHandler);
+
+    /**
+     * @brief 注册分块接收响应数据的回调函数，使用流式模式执行 GET、POST、PUT 请求:
+     *        有数据可读取时每次最多读取 bufferSize 字节回调 chunkHandler，同时 QNetworkReply 内部的读缓冲也限制为 bufferSize，
+     *        数据没有被读走时不会继续从网络接收，因此无论响应多大，占用的内存都是常量级的。
+     *        流式模式下不会调用 success()，所有数据回调完成后调用 done() 注册的回调函数，可以配合 JsonStreamReader 增量解析 JSON。
+     *
+     * @param chunkHandler 接收响应数据的回调函数，参数为本次读取到的数据
+     * @param bufferSize   读缓冲的大小，单位为字节，默认 64K
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& chunk(std::function<void (const QByteArray &)> chunkHandler, qint64 bufferSize = 64 * 1024);
+
+    /**
+     * @brief 注册流式模式下所有响应数据都成功回调给 chunk() 后的回调函数
+     *
+     * @param doneHandler 数据接收完成的回调函数，无参数
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& done(std::function<void ()> doneHandler);
+
+    /**
+     * @brief 注册流式上传 upload(const QList<HttpUploadPart> &) 的进度回调函数，每个部分的已发送字节数变化时调用
+     *
+     * @param progressHandler 进度的回调函数，参数为部分的编号 (从 0 开始)、此部分已发送的字节数和此部分的总字节数
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& uploadProgress(std::function<void (int, qint64, qint64)> progressHandler);
+
+    /**
+     * @brief 设置流式上传时已读取但还没有发送的数据的最大字节数，默认 4M，上传再大的文件内存中也不会超过这么多的待发送数据
+     *
+     * @param bufferSize 最大字节数
+     * @return 返回 HttpClient 的引用，可以用于链式调用
+     */
+    HttpClient& uploadBufferSize(qint64 bufferSize);
+
     /**
      * @brief 设置请求响应的字符集，默认使用 UTF-8
      *
@@ -131,6 +431,11 @@ public:
      */
     void get();
 
+    /**
+     * @brief 执行 HEAD 请求，只获取响应头，配合 responseHeaders() 使用，例如获取文件的大小
+     */
+    void head();
+
     /**
      * @brief 执行 POST 请求
      */
@@ -149,7 +454,7 @@ public:
     void remove();
 
     /**
-     * @brief 使用 GET 进行下载，下载的文件保存到 savePath
+     * @brief 使用 GET 进行下载，下载的文件保存到 savePath，大文件可以使用 HttpDownloader 分段并行下载，支持断点续传
      *
      * @param savePath 下载的文件保存路径
      */
@@ -179,8 +484,181 @@ public:
      */
     void upload(const QStringList &paths);
 
+    /**
+     * @brief 流式上传多个部分，使用 POST 上传，每个部分的数据直接从文件 (内存映射) 或者 QIODevice 读取发送，
+     *        配合 uploadProgress() 获取每个部分的上传进度，uploadBufferSize() 限制内存中待发送数据的大小，适合上传大文件
+     *
+     * @param parts 要上传的部分
+     */
+    void upload(const QList<HttpUploadPart> &parts);
+
+    /**
+     * @brief 使用当前线程共享的 manager 预先和 url 所在的主机建立连接 (HTTPS 时同时完成 TLS 握手)，
+     *        后续访问此主机的请求可以直接复用这个连接，例如程序启动时预先连接服务器
+     *
+     * @param url 要连接的主机的 URL，只使用其中的 scheme、host 和 port
+     */
+    static void preconnect(const QString &url);
+
+    /**
+     * @brief 获取内部共享的 QNetworkAccessManager 池的统计信息
+     *
+     * @return 返回统计信息
+     */
+    static HttpClientPoolStats poolStats();
+
+    /**
+     * @brief 设置响应缓存的数据的最大字节数，超过时淘汰最久没有使用的缓存
+     *
+     * @param bytes 最大字节数
+     */
+    static void setCacheLimit(qint64 bytes);
+
+    /**
+     * @brief 清空响应缓存，例如数据被修改后
+     */
+    static void clearCache();
+
+    /**
+     * @brief 获取响应缓存的统计信息
+     *
+     * @return 返回统计信息
+     */
+    static HttpCacheStats cacheStats();
+
+    /**
+     * @brief 设置同时进行的请求数的上限，默认全局 32 个，每个主机 6 个，保留 2 个名额只给 Interactive 的请求使用
+     *
+     * @param global   全局的上限
+     * @param perHost  每个主机的上限
+     * @param reserved 全局名额中只给 Interactive 的请求使用的名额数
+     */
+    static void setConcurrencyLimits(int global, int perHost, int reserved = 2);
+
+    /**
+     * @brief 设置排队等待的请求数的上限，超过时新的请求直接失败 (执行 fail 和 complete 的回调函数)，默认 0 表示不限制
+     *
+     * @param maxQueued 排队的请求数的上限
+     */
+    static void setQueueLimit(int maxQueued);
+
+    /**
+     * @brief 获取调度器的统计信息，例如排队的请求数
+     *
+     * @return 返回统计信息
+     */
+    static HttpSchedulerStats schedulerStats();
+
+    /**
+     * @brief 设置所有请求默认的超时时间，默认为 0 不超时，见 timeout()
+     *
+     * @param ms 超时时间，单位为毫秒
+     */
+    static void setDefaultTimeout(int ms);
+
+    /**
+     * @brief 设置每个主机的断路器: 访问主机连续失败 (超时、网络错误、5xx) threshold 次后打开断路器，
+     *        之后访问这个主机的请求直接失败 (类型为 CircuitOpen)，不再等待超时，cooldownMs 毫秒后放行一个探测请求，
+     *        探测成功则恢复正常，失败则继续打开。默认连续失败 5 次，10 秒后探测，threshold 为 0 时不使用断路器
+     *
+     * @param threshold  连续失败的次数
+     * @param cooldownMs 打开后到进行探测的时间，单位为毫秒
+     */
+    static void setCircuitBreaker(int threshold, int cooldownMs);
+
+    /**
+     * @brief 设置访问 url 所在主机使用的协议，例如同一个服务器上大量并发的小请求 (签到、刷新统计) 使用 HTTP/2，
+     *        它们共享一个连接，不再建立 6 个连接排队。使用 HTTP/2 的主机的并发上限提高为 100 (HTTP/2 默认的并发流数)
+     *
+     * @param url      主机的 URL，只使用其中的 scheme、host 和 port
+     * @param protocol 使用的协议
+     */
+    static void setHostProtocol(const QString &url, HttpProtocol protocol);
+
+    /**
+     * @brief 导出所有请求的指标: 按主机、Method 和路由分组的请求数、失败数、字节数，总耗时和 TTFB 的 p50、p95、p99
+     *
+     * @param format 导出的格式，JSON 或者 Prometheus 的文本格式
+     * @return 返回导出的文本
+     */
+    static QString metrics(HttpMetricsFormat format = HttpMetricsFormat::Prometheus);
+
+    /**
+     * @brief 导出所有请求的指标并写入文件，例如定时写入 node_exporter 的 textfile 目录，文件是原子替换的
+     *
+     * @param path   文件的路径
+     * @param format 导出的格式
+     * @return 写入成功返回 true，否则返回 false
+     */
+    static bool writeMetrics(const QString &path, HttpMetricsFormat format = HttpMetricsFormat::Prometheus);
+
+    /**
+     * @brief 清空所有请求的指标
+     */
+    static void resetMetrics();
+
 private:
     HttpClientPrivate *d;
 };
 
+/**
+ * 增量解析 JSON 数组的辅助类，配合 HttpClient::chunk() 使用，每解析出数组中的一个元素就回调一次，
+ * 内存中只保存当前正在解析的元素，可以在常量级的内存中处理几百 MB 的 JSON 响应。
+ *
+ * 支持 2 种格式:
+ *     1. 顶层为数组，arrayKey 为空: [{...}, {...}]
+ *     2. 顶层为对象，解析它的属性 arrayKey 的数组: {"success": true, "data": [{...}, {...}]}
+ *
+ * 使用方法:
+ *     QSharedPointer<JsonStreamReader> reader(new JsonStreamReader("data", [](const QJsonValue &item) {
+ *         qDebug() << item;
+ *     }));
+ *     HttpClient(url).chunk([=](const QByteArray &data) { reader->feed(data); }).get();
+ */
+class JsonStreamReader {
+public:
+    /**
+     * @param arrayKey    要解析的数组的属性名，为空时解析顶层数组
+     * @param itemHandler 解析出数组中的一个元素时的回调函数
+     */
+    JsonStreamReader(const QString &arrayKey, std::function<void (const QJsonValue &)> itemHandler);
+
+    /**
+     * @brief 输入一块响应数据，解析出的元素通过 itemHandler 回调
+     *
+     * @param data 响应数据
+     */
+    void feed(const QByteArray &data);
+
+    /**
+     * @brief 是否已经解析完目标数组
+     */
+    bool isFinished() const;
+
+    /**
+     * @brief 解析元素出错时的错误信息，没有错误时为空
+     */
+    QString errorString() const;
+
+private:
+    void emitItem(); // 解析 item 中的元素并回调 itemHandler
+
+    QByteArray arrayKey;
+    std::function<void (const QJsonValue &)> itemHandler;
+
+    QByteArray item;            // 当前正在解析的元素
+    QByteArray key;             // 顶层对象中当前读取到的属性名
+    QByteArray currentKey;      // 顶层对象中当前值所属的属性名
+    QString    error;           // 错误信息
+    int  depth        = 0;      // 当前的嵌套深度
+    int  targetDepth  = 0;      // 目标数组中元素所在的深度，为 0 表示还没有找到目标数组
+    bool inString     = false;  // 是否在字符串中
+    bool escape       = false;  // 字符串中前一个字符是否为转义符 '\'
+    bool collecting   = false;  // 是否正在读取目标数组的元素
+    bool rootIsObject = false;  // 顶层是否为对象
+    bool expectingKey = false;  // 顶层对象中下一个字符串是否为属性名
+    bool capturingKey = false;  // 是否正在读取顶层对象的属性名
+    bool finished     = false;  // 是否已经解析完目标数组
+};
+
 #endif // HTTPCLIENT_H
@@ -20,6 +20,13 @@ CONFIG(release, debug|release) {
     output = release
 }
 
+# zlib: Windows 和 macOS 上使用 Qt 自带的 zlib，Linux 上使用系统的 zlib
+win32|macx {
+    INCLUDEPATH += $$[QT_INSTALL_HEADERS]/QtZlib
+} else {
+    LIBS += -lz
+}
+
 DESTDIR     = bin
 OBJECTS_DIR = $$output
 MOC_DIR     = $$output
@@ -27,7 +34,21 @@ RCC_DIR     = $$output
 UI_DIR      = $$output
 
 SOURCES += main.cpp \
-    HttpClient.cpp
+    HttpClient.cpp \
+    HttpCircuitBreaker.cpp \
+    HttpCompression.cpp \
+    HttpDownloader.cpp \
+    HttpMetrics.cpp \
+    HttpMultiPartDevice.cpp \
+    HttpResponseCache.cpp \
+    HttpScheduler.cpp
 
 HEADERS += \
-    HttpClient.h
+    HttpClient.h \
+    HttpCircuitBreaker.h \
+    HttpCompression.h \
+    HttpDownloader.h \
+    HttpMetrics.h \
+    HttpMultiPartDevice.h \
+    HttpResponseCache.h \
+    HttpScheduler.h
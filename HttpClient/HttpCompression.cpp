@@ -0,0 +1,145 @@
+#include "HttpCompression.h"
+
+#include <zlib.h>
+
+/*-----------------------------------------------------------------------------|
+ |                               HttpCompression                               |
+ |----------------------------------------------------------------------------*/
+// 压缩数据
+QByteArray HttpCompression::compress(const QByteArray &data, HttpContentEncoding encoding, int level) {
+    // 1. 初始化 zlib，windowBits 加 16 时生成 gzip 格式
+    // 2. 按 deflateBound() 分配输出缓冲，一次压缩完成
+
+    // [1] 初始化 zlib，windowBits 加 16 时生成 gzip 格式
+    z_stream stream = {};
+    int windowBits  = encoding == HttpContentEncoding::Gzip ? 15 + 16 : 15;
+
+    if (deflateInit2(&stream, qBound(1, level, 9), Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return QByteArray();
+    }
+
+    // [2] 按 deflateBound() 分配输出缓冲，一次压缩完成
+    QByteArray result(int(deflateBound(&stream, uLong(data.size()))), Qt::Uninitialized);
+    stream.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in  = uInt(data.size());
+    stream.next_out  = reinterpret_cast<Bytef *>(result.data());
+    stream.avail_out = uInt(result.size());
+
+    int status = deflate(&stream, Z_FINISH);
+    result.resize(int(stream.total_out));
+    deflateEnd(&stream);
+
+    return status == Z_STREAM_END ? result : QByteArray();
+}
+
+// 获取 Content-Encoding 的值
+QByteArray HttpCompression::name(HttpContentEncoding encoding) {
+    return encoding == HttpContentEncoding::Gzip ? "gzip" : "deflate";
+}
+
+/*-----------------------------------------------------------------------------|
+ |                                HttpInflater                                 |
+ |----------------------------------------------------------------------------*/
+struct HttpInflater::Stream {
+    z_stream z = {};
+};
+
+HttpInflater::HttpInflater(QObject *parent, int maxChunkSize)
+    : QObject(parent), stream(new Stream), maxChunkSize(maxChunkSize) {
+    // windowBits 加 32 时自动识别 gzip 和 zlib 格式
+    if (inflateInit2(&stream->z, 15 + 32) != Z_OK) {
+        error = "初始化 zlib 失败";
+    }
+}
+
+HttpInflater::~HttpInflater() {
+    inflateEnd(&stream->z);
+    delete stream;
+}
+
+// 输入一块压缩的数据，返回解压出来的数据
+QByteArray HttpInflater::inflate(const QByteArray &data) {
+    // 1. 出错后或者压缩流已经结束时不再解压
+    // 2. 每次解压出最多 64K 的数据追加到结果中，直到输入的数据用完并且 zlib 中没有待输出的数据
+    // 3. 还没有解压出数据就出错时，可能是原始的 deflate 格式，重新初始化后再解压一次
+    // 4. 解压出来的数据超过 maxChunkSize 时作为出错处理
+
+    // [1] 出错后或者压缩流已经结束时不再解压
+    if (!error.isEmpty() || finished || data.isEmpty()) {
+        return QByteArray();
+    }
+
+    // [2] 每次解压出最多 64K 的数据追加到结果中，直到输入的数据用完并且 zlib 中没有待输出的数据
+    received = true;
+    QByteArray result;
+    char buffer[64 * 1024];
+    z_stream &z = stream->z;
+    z.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    z.avail_in  = uInt(data.size());
+
+    while (true) {
+        z.next_out  = reinterpret_cast<Bytef *>(buffer);
+        z.avail_out = sizeof(buffer);
+
+        int status = ::inflate(&z, Z_NO_FLUSH);
+        result.append(buffer, int(sizeof(buffer) - z.avail_out));
+
+        if (status == Z_STREAM_END) {
+            finished = true;
+            break;
+        }
+
+        // [3] 还没有解压出数据就出错时，可能是原始的 deflate 格式，重新初始化后再解压一次
+        if (status == Z_DATA_ERROR && !started && result.isEmpty()) {
+            inflateEnd(&z);
+            z = z_stream();
+            started = true;
+
+            if (inflateInit2(&z, -15) != Z_OK) {
+                error = "初始化 zlib 失败";
+                return QByteArray();
+            }
+
+            return inflate(data);
+        }
+
+        if (status != Z_OK && status != Z_BUF_ERROR) {
+            error = QString("解压响应的数据失败: %1").arg(z.msg ? z.msg : "unknown");
+            return QByteArray();
+        }
+
+        // [4] 解压出来的数据超过 maxChunkSize 时作为出错处理
+        if (result.size() > maxChunkSize) {
+            error = QString("解压出来的数据超过 %1 字节").arg(maxChunkSize);
+            return QByteArray();
+        }
+
+        if (status == Z_BUF_ERROR || (z.avail_in == 0 && z.avail_out > 0)) {
+            break; // 输入的数据已经用完，等待下一块数据
+        }
+    }
+
+    started = started || !result.isEmpty();
+
+    return result;
+}
+
+// 解压出错时返回错误信息
+QString HttpInflater::errorString() const {
+    return error;
+}
+
+// 解压是否出错
+bool HttpInflater::hasError() const {
+    return !error.isEmpty();
+}
+
+// 是否输入过数据
+bool HttpInflater::hasInput() const {
+    return received;
+}
+
+// 压缩流是否已经结束
+bool HttpInflater::isFinished() const {
+    return finished;
+}
@@ -0,0 +1,74 @@
+#ifndef HTTPCOMPRESSION_H
+#define HTTPCOMPRESSION_H
+
+#include "HttpClient.h"
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+
+/**
+ * 请求体的压缩，使用 zlib 生成 Content-Encoding 为 gzip 或者 deflate 的数据。
+ */
+class HttpCompression {
+public:
+    /**
+     * @brief 压缩数据
+     *
+     * @param data     要压缩的数据
+     * @param encoding 压缩的格式，Gzip 为 RFC 1952，Deflate 为 RFC 1950 (HTTP 的 deflate 是带 zlib 头的格式)
+     * @param level    压缩级别 1 ~ 9，默认 6 兼顾速度和压缩率
+     * @return 返回压缩后的数据，出错时返回空的 QByteArray
+     */
+    static QByteArray compress(const QByteArray &data, HttpContentEncoding encoding, int level = 6);
+
+    /**
+     * @brief 获取 Content-Encoding 的值
+     *
+     * @param encoding 压缩的格式
+     * @return 返回 gzip 或者 deflate
+     */
+    static QByteArray name(HttpContentEncoding encoding);
+};
+
+/**
+ * 流式解压响应的数据，每次输入一块压缩的数据，返回这块数据解压出来的数据，不需要等待全部数据到达。
+ * 自动识别 gzip 和 zlib 格式，有些服务器的 deflate 是不带 zlib 头的原始格式，也能识别。
+ * 每块数据解压出来的数据最多 maxChunkSize 字节，超过时作为出错处理，避免压缩炸弹耗尽内存。
+ * 响应结束时使用 hasError() 和 isFinished() 检查数据是否完整: 收到了数据但是压缩流没有结束说明响应被截断了。
+ *
+ * 作为 reply 的子对象使用，随 reply 一起释放。
+ */
+class HttpInflater : public QObject {
+public:
+    explicit HttpInflater(QObject *parent = nullptr, int maxChunkSize = 64 * 1024 * 1024);
+    ~HttpInflater() override;
+
+    /**
+     * @brief 输入一块压缩的数据
+     *
+     * @param data 压缩的数据
+     * @return 返回解压出来的数据，出错后返回空的 QByteArray
+     */
+    QByteArray inflate(const QByteArray &data);
+
+    bool hasError() const;   // 解压是否出错 (数据格式错误或者解压出来的数据太大)
+    bool hasInput() const;   // 是否输入过数据
+    bool isFinished() const; // 压缩流是否已经结束 (Z_STREAM_END)
+
+    /**
+     * @brief 解压出错时返回错误信息，否则返回空字符串
+     */
+    QString errorString() const;
+
+private:
+    struct Stream;
+    Stream *stream = nullptr;
+    QString error;
+    int  maxChunkSize;     // 每块数据解压出来的数据的最大字节数
+    bool received = false; // 是否输入过数据
+    bool started  = false; // 是否已经解压出数据，没有解压出数据前出错时尝试原始的 deflate 格式
+    bool finished = false;
+};
+
+#endif // HTTPCOMPRESSION_H
@@ -0,0 +1,528 @@
+#include "HttpDownloader.h"
+#include "HttpClient.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QSaveFile>
+#include <QTimer>
+#include <QRandomGenerator>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QEnableSharedFromThis>
+
+/*-----------------------------------------------------------------------------|
+ |                              HttpDownloadTask                               |
+ |----------------------------------------------------------------------------*/
+/**
+ * @brief 下载的一段，下载范围为 [start, end]，end 为 -1 时表示文件大小未知，下载到响应结束
+ */
+struct HttpDownloadSegment {
+    qint64 start    = 0;
+    qint64 end      = -1;
+    qint64 received = 0;     // 此段已经下载的字节数
+    int    failures = 0;     // 此段失败的次数
+    int    status   = 0;     // 此段当前请求的 HTTP 状态码
+    bool   done     = false; // 此段是否已经下载完成
+
+    qint64 length() const { return end < 0 ? -1 : end - start + 1; }
+};
+
+/**
+ * @brief 一次下载的状态，HttpDownloader 析构后由异步回调中的 QSharedPointer 维持它的生命周期
+ */
+class HttpDownloadTask : public QEnableSharedFromThis<HttpDownloadTask> {
+public:
+    explicit HttpDownloadTask(const QString &url) : url(url) {}
+
+    void start();                  // 开始下载: 续传或者请求文件的大小
+    void probed(int status, const QMap<QString, QString> &headers); // 得到文件大小后创建分段并开始下载
+    void startSegments();          // 开始下载所有未完成的段
+    void runSegment(int index);    // 下载一段，从此段已下载的位置继续
+    void write(int index, const QByteArray &data); // 把一段的数据写入文件中对应的位置
+    void segmentDone(int index);   // 一段的请求成功结束
+    void segmentFailed(int index, const QString &error, int errorCode); // 一段的请求失败，重试或者结束下载
+    void finish();                 // 所有段下载完成，校验摘要，重命名临时文件
+    void failed(const QString &error, int errorCode, bool keepJournal = true); // 下载失败
+    bool loadJournal();            // 从日志文件中恢复分段的下载进度，日志和本次下载不匹配时返回 false
+    void saveJournal();            // 保存分段的下载进度到日志文件
+    void prepare(HttpClient &client) const; // 给 client 设置 manager、debug 和请求头
+
+    QString partPath()    const { return savePath + ".part"; }
+    QString journalPath() const { return savePath + ".journal"; }
+
+    QString url;
+    QString savePath;
+    int  segmentCount = 4;
+    int  retries      = 3;
+    bool debug        = false;
+    QNetworkAccessManager *manager = nullptr;
+    QMap<QString, QString> headers;
+    QCryptographicHash::Algorithm algorithm = QCryptographicHash::Sha256;
+    QByteArray expectedChecksum;
+
+    std::function<void (qint64, qint64)>          progressHandler = nullptr;
+    std::function<void (const QString &)>          successHandler = nullptr;
+    std::function<void (const QString &, int)>        failHandler = nullptr;
+
+    QList<HttpDownloadSegment> segments;
+    QFile   file;
+    QString validator;        // 文件的 ETag 或者 Last-Modified，续传时用来判断服务器上的文件是否已经改变
+    qint64  total     = -1;   // 文件的大小，-1 表示未知
+    qint64  received  = 0;    // 已下载的字节数
+    qint64  unsaved   = 0;    // 上次保存日志后下载的字节数
+    bool    ranged    = false; // 服务器是否支持 Range，不支持时只有一段，不能续传
+    bool    finished  = false; // 下载是否已经结束 (成功或者失败)
+
+    static const qint64 MIN_SEGMENT_SIZE  = 1024 * 1024;     // 每段的最小字节数
+    static const qint64 JOURNAL_INTERVAL  = 4 * 1024 * 1024; // 每下载这么多字节保存一次日志
+    static const qint64 CHUNK_SIZE        = 256 * 1024;      // 每次读取响应数据的字节数
+    static const int    RETRY_DELAY       = 1000;            // 第一次重试前等待的毫秒数，之后每次加倍
+    static const int    MAX_RETRY_DELAY   = 30 * 1000;       // 重试前等待的最长毫秒数
+};
+
+// 开始下载: 续传或者请求文件的大小
+void HttpDownloadTask::start() {
+    // 1. 如果有匹配的日志，需要先确认服务器上的文件没有改变，所以总是先请求文件的大小和 ETag
+    // 2. 使用 HEAD 请求文件的大小、是否支持 Range 和 ETag
+
+    QSharedPointer<HttpDownloadTask> self = sharedFromThis();
+    QSharedPointer<int> status(new int(0));
+    QSharedPointer<QMap<QString, QString> > responseHeaders(new QMap<QString, QString>());
+
+    HttpClient client(url);
+    prepare(client);
+    client.responseHeaders([=](int code, const QMap<QString, QString> &hs) {
+        *status = code;
+        *responseHeaders = hs;
+    }).success([=](const QString &) {
+        self->probed(*status, *responseHeaders);
+    }).fail([=](const QString &, int) {
+        // 服务器不支持 HEAD 时 (例如返回 405) 使用普通的单连接下载，网络错误会在下载时报告
+        self->probed(0, QMap<QString, QString>());
+    }).head();
+}
+
+// 得到文件大小后创建分段并开始下载
+void HttpDownloadTask::probed(int status, const QMap<QString, QString> &headers) {
+    // 1. 解析文件大小、是否支持 Range 和 ETag
+    // 2. 日志和本次下载匹配则续传，否则重新创建分段
+    // 3. 打开临时文件，重新下载时预先分配文件的大小
+    // 4. 开始下载所有未完成的段
+
+    // [1] 解析文件大小、是否支持 Range 和 ETag
+    bool sizeKnown = false;
+    total     = headers.value("content-length").toLongLong(&sizeKnown);
+    total     = (sizeKnown && status == 200) ? total : -1;
+    ranged    = total > 0 && headers.value("accept-ranges").contains("bytes");
+    validator = headers.value("etag", headers.value("last-modified"));
+
+    // [2] 日志和本次下载匹配则续传，否则重新创建分段
+    bool resume = ranged && loadJournal();
+
+    if (!resume) {
+        segments.clear();
+        int    count = ranged ? int(qBound<qint64>(1, total / MIN_SEGMENT_SIZE, segmentCount)) : 1;
+        qint64 size  = ranged ? total / count : 0;
+
+        for (int i = 0; i < count; ++i) {
+            HttpDownloadSegment segment;
+            segment.start = i * size;
+            segment.end   = (i == count - 1) ? total - 1 : (i + 1) * size - 1; // 文件大小未知时 end 为 -1
+            segments.append(segment);
+        }
+    }
+
+    received = 0;
+    for (const HttpDownloadSegment &segment : segments) {
+        received += segment.received;
+    }
+
+    // [3] 打开临时文件，重新下载时预先分配文件的大小
+    file.setFileName(partPath());
+    QIODevice::OpenMode mode = QIODevice::ReadWrite | QIODevice::Unbuffered;
+
+    if (!file.open(resume ? mode : mode | QIODevice::Truncate) || (!resume && total > 0 && !file.resize(total))) {
+        failed(QString("[错误] 打开文件出错: %1, %2").arg(partPath()).arg(file.errorString()), -1);
+        return;
+    }
+
+    if (debug) {
+        qDebug().noquote() << QString("[下载] %1, 大小: %2, 分段: %3, 续传: %4")
+                              .arg(url).arg(total).arg(segments.size()).arg(resume ? "是" : "否");
+    }
+
+    // [4] 开始下载所有未完成的段
+    saveJournal();
+    startSegments();
+}
+
+// 开始下载所有未完成的段
+void HttpDownloadTask::startSegments() {
+    bool allDone = true;
+
+    for (int i = 0; i < segments.size(); ++i) {
+        if (!segments.at(i).done) {
+            allDone = false;
+            runSegment(i);
+        }
+    }
+
+    if (allDone) {
+        finish();
+    }
+}
+
+// 下载一段，从此段已下载的位置继续
+void HttpDownloadTask::runSegment(int index) {
+    QSharedPointer<HttpDownloadTask> self = sharedFromThis();
+    HttpDownloadSegment &segment = segments[index];
+    segment.status = 0;
+
+    HttpClient client(url);
+    prepare(client);
+
+    if (ranged) {
+        client.header("Range", QString("bytes=%1-%2").arg(segment.start + segment.received).arg(segment.end));
+    }
+
+    client.responseHeaders([=](int status, const QMap<QString, QString> &) {
+        self->segments[index].status = status;
+    }).chunk([=](const QByteArray &data) {
+        self->write(index, data);
+    }, CHUNK_SIZE).done([=] {
+        self->segmentDone(index);
+    }).fail([=](const QString &error, int errorCode) {
+        self->segmentFailed(index, error, errorCode);
+    }).get();
+}
+
+// 把一段的数据写入文件中对应的位置
+void HttpDownloadTask::write(int index, const QByteArray &data) {
+    // 1. 下载已经结束，或者服务器没有按 Range 返回数据 (状态码不是 206) 时丢弃数据
+    // 2. 数据写入文件中此段已下载数据的后面，不超过此段的范围
+    // 3. 更新进度，每下载 JOURNAL_INTERVAL 字节保存一次日志
+
+    HttpDownloadSegment &segment = segments[index];
+
+    // [1] 下载已经结束，或者服务器没有按 Range 返回数据 (状态码不是 206) 时丢弃数据
+    if (finished || (ranged && segment.status != 206)) {
+        return;
+    }
+
+    // [2] 数据写入文件中此段已下载数据的后面，不超过此段的范围
+    qint64 size = data.size();
+
+    if (segment.length() >= 0) {
+        size = qMin(size, segment.length() - segment.received);
+    }
+
+    if (size <= 0) {
+        return;
+    }
+
+    if (!file.seek(segment.start + segment.received) || file.write(data.constData(), size) != size) {
+        failed(QString("[错误] 写入文件出错: %1, %2").arg(partPath()).arg(file.errorString()), -1);
+        return;
+    }
+
+    // [3] 更新进度，每下载 JOURNAL_INTERVAL 字节保存一次日志
+    segment.received += size;
+    received += size;
+    unsaved  += size;
+
+    if (nullptr != progressHandler) {
+        progressHandler(received, total);
+    }
+
+    if (unsaved >= JOURNAL_INTERVAL) {
+        saveJournal();
+    }
+}
+
+// 一段的请求成功结束
+void HttpDownloadTask::segmentDone(int index) {
+    HttpDownloadSegment &segment = segments[index];
+
+    if (finished) {
+        return;
+    }
+
+    if (ranged && segment.status != 206) {
+        segmentFailed(index, QString("[错误] 服务器不支持 Range 请求，状态码: %1").arg(segment.status), -1);
+        return;
+    }
+
+    // 连接提前关闭时收到的数据可能比此段少，需要继续下载
+    if (segment.length() >= 0 && segment.received < segment.length()) {
+        segmentFailed(index, QString("[错误] 第 %1 段的数据不完整").arg(index), -1);
+        return;
+    }
+
+    segment.done = true;
+    saveJournal();
+
+    if (debug) {
+        qDebug().noquote() << QString("[下载] 第 %1 段完成: %2-%3").arg(index).arg(segment.start).arg(segment.end);
+    }
+
+    for (const HttpDownloadSegment &s : segments) {
+        if (!s.done) {
+            return;
+        }
+    }
+
+    finish();
+}
+
+// 一段的请求失败，重试或者结束下载
+void HttpDownloadTask::segmentFailed(int index, const QString &error, int errorCode) {
+    if (finished) {
+        return;
+    }
+
+    HttpDownloadSegment &segment = segments[index];
+    saveJournal();
+
+    // 不支持 Range 时只能从头下载，已经下载的数据作废
+    if (!ranged) {
+        received -= segment.received;
+        segment.received = 0;
+        file.resize(qMax<qint64>(total, 0));
+    }
+
+    if (++segment.failures <= retries) {
+        // 等待一段时间后重试: 指数增长，在一半到全部之间随机，避免服务器出错时立即用完重试次数
+        int ceiling = int(qMin<qint64>(MAX_RETRY_DELAY, qint64(RETRY_DELAY) << qMin(segment.failures - 1, 20)));
+        int delay   = ceiling / 2 + int(QRandomGenerator::global()->bounded(ceiling - ceiling / 2 + 1));
+        QSharedPointer<HttpDownloadTask> self = sharedFromThis();
+
+        if (debug) {
+            qDebug().noquote() << QString("[下载] 第 %1 段失败，%2 毫秒后第 %3 次重试: %4")
+                                  .arg(index).arg(delay).arg(segment.failures).arg(error);
+        }
+
+        QTimer::singleShot(delay, [self, index] {
+            // 等待期间其他段失败时下载已经结束
+            if (!self->finished) {
+                self->runSegment(index);
+            }
+        });
+    } else {
+        failed(error, errorCode);
+    }
+}
+
+// 所有段下载完成，校验摘要，重命名临时文件
+void HttpDownloadTask::finish() {
+    // 1. 校验文件的摘要，不匹配时删除临时文件和日志，下次重新下载
+    // 2. 把临时文件重命名为 savePath，删除日志文件
+
+    finished = true;
+
+    // [1] 校验文件的摘要，不匹配时删除临时文件和日志，下次重新下载
+    if (!expectedChecksum.isEmpty()) {
+        QCryptographicHash hash(algorithm);
+        file.seek(0);
+        hash.addData(&file);
+
+        if (hash.result().toHex() != expectedChecksum.toLower()) {
+            finished = false;
+            failed(QString("[错误] 文件摘要不匹配: %1").arg(QString::fromLatin1(hash.result().toHex())), -1, false);
+            return;
+        }
+    }
+
+    // [2] 把临时文件重命名为 savePath，删除日志文件
+    file.close();
+    QFile::remove(savePath);
+
+    if (!QFile::rename(partPath(), savePath)) {
+        finished = false;
+        failed(QString("[错误] 重命名文件出错: %1").arg(savePath), -1);
+        return;
+    }
+
+    QFile::remove(journalPath());
+
+    if (debug) {
+        qDebug().noquote() << QString("[下载] 完成: %1").arg(savePath);
+    }
+
+    if (nullptr != successHandler) {
+        successHandler(savePath);
+    }
+}
+
+// 下载失败，keepJournal 为 true 时保留临时文件和日志，下次可以继续，否则删除它们，下次重新下载
+void HttpDownloadTask::failed(const QString &error, int errorCode, bool keepJournal) {
+    if (finished) {
+        return;
+    }
+
+    finished = true;
+
+    if (keepJournal) {
+        saveJournal();
+        file.close();
+    } else {
+        file.close();
+        QFile::remove(partPath());
+        QFile::remove(journalPath());
+    }
+
+    if (debug) {
+        qDebug().noquote() << QString("[下载] 失败: %1").arg(error);
+    }
+
+    if (nullptr != failHandler) {
+        failHandler(error, errorCode);
+    }
+}
+
+// 从日志文件中恢复分段的下载进度，日志和本次下载不匹配时返回 false
+bool HttpDownloadTask::loadJournal() {
+    QFile journal(journalPath());
+
+    if (!journal.open(QIODevice::ReadOnly) || QFileInfo(partPath()).size() != total) {
+        return false;
+    }
+
+    QJsonObject root = QJsonDocument::fromJson(journal.readAll()).object();
+
+    if (root.value("url").toString() != url || qint64(root.value("total").toDouble()) != total
+            || root.value("validator").toString() != validator) {
+        return false;
+    }
+
+    segments.clear();
+    for (const QJsonValue &value : root.value("segments").toArray()) {
+        QJsonObject object = value.toObject();
+        HttpDownloadSegment segment;
+        segment.start    = qint64(object.value("start").toDouble());
+        segment.end      = qint64(object.value("end").toDouble());
+        segment.received = qint64(object.value("received").toDouble());
+        segment.done     = segment.received >= segment.length();
+        segments.append(segment);
+    }
+
+    return !segments.isEmpty();
+}
+
+// 保存分段的下载进度到日志文件，先把数据刷到磁盘，保证日志中记录的数据都已经写入了文件
+void HttpDownloadTask::saveJournal() {
+    if (!ranged) {
+        return;
+    }
+
+    unsaved = 0;
+    file.flush();
+
+    QJsonArray array;
+    for (const HttpDownloadSegment &segment : segments) {
+        QJsonObject object;
+        object.insert("start",    double(segment.start));
+        object.insert("end",      double(segment.end));
+        object.insert("received", double(segment.received));
+        array.append(object);
+    }
+
+    QJsonObject root;
+    root.insert("url", url);
+    root.insert("total", double(total));
+    root.insert("validator", validator);
+    root.insert("segments", array);
+
+    // 使用 QSaveFile 写入，写入过程中程序退出也不会损坏原来的日志
+    QSaveFile journal(journalPath());
+    if (journal.open(QIODevice::WriteOnly)) {
+        journal.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+        journal.commit();
+    }
+}
+
+// 给 client 设置 manager、debug 和请求头，下载使用 Bulk 优先级，不阻塞用户正在等待的请求
+void HttpDownloadTask::prepare(HttpClient &client) const {
+    client.manager(manager).debug(debug).headers(headers).priority(HttpPriority::Bulk);
+}
+
+/*-----------------------------------------------------------------------------|
+ |                               HttpDownloader                                |
+ |----------------------------------------------------------------------------*/
+HttpDownloader::HttpDownloader(const QString &url) : task(new HttpDownloadTask(url)) {
+}
+
+HttpDownloader::~HttpDownloader() {
+}
+
+// 设置并行下载的段数
+HttpDownloader& HttpDownloader::segments(int count) {
+    task->segmentCount = qMax(1, count);
+
+    return *this;
+}
+
+// 设置每段下载失败后的重试次数
+HttpDownloader& HttpDownloader::retries(int count) {
+    task->retries = qMax(0, count);
+
+    return *this;
+}
+
+// 设置下载完成后校验文件的摘要
+HttpDownloader& HttpDownloader::checksum(QCryptographicHash::Algorithm algorithm, const QByteArray &hex) {
+    task->algorithm        = algorithm;
+    task->expectedChecksum = hex;
+
+    return *this;
+}
+
+// 添加请求头
+HttpDownloader& HttpDownloader::header(const QString &name, const QString &value) {
+    task->headers[name] = value;
+
+    return *this;
+}
+
+// 使用传入的 QNetworkAccessManager 执行请求
+HttpDownloader& HttpDownloader::manager(QNetworkAccessManager *manager) {
+    task->manager = manager;
+
+    return *this;
+}
+
+// 设置是否启用调试模式
+HttpDownloader& HttpDownloader::debug(bool debug) {
+    task->debug = debug;
+
+    return *this;
+}
+
+// 注册下载进度的回调函数
+HttpDownloader& HttpDownloader::progress(std::function<void (qint64, qint64)> progressHandler) {
+    task->progressHandler = progressHandler;
+
+    return *this;
+}
+
+// 注册下载成功的回调函数
+HttpDownloader& HttpDownloader::success(std::function<void (const QString &)> successHandler) {
+    task->successHandler = successHandler;
+
+    return *this;
+}
+
+// 注册下载失败的回调函数
+HttpDownloader& HttpDownloader::fail(std::function<void (const QString &, int)> failHandler) {
+    task->failHandler = failHandler;
+
+    return *this;
+}
+
+// 开始下载，下载的文件保存到 savePath
+void HttpDownloader::download(const QString &savePath) {
+    task->savePath = savePath;
+    task->start();
+}
@@ -0,0 +1,128 @@
+#ifndef HTTPDOWNLOADER_H
+#define HTTPDOWNLOADER_H
+
+#include <functional>
+#include <QMap>
+#include <QString>
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QCryptographicHash>
+
+class QNetworkAccessManager;
+class HttpDownloadTask;
+
+/**
+ * 基于 HttpClient 的分段并行下载器，支持断点续传，适合下载几个 G 的视频、数据等大文件。
+ *
+ * 下载过程:
+ *     1. 先使用 HEAD 请求文件的大小 (Content-Length)、是否支持 Range (Accept-Ranges: bytes) 和 ETag，
+ *        服务器不支持 HEAD 或者 Range 时退化为普通的单连接下载 (不支持断点续传)
+ *     2. 把文件分为 N 段，使用 Range 请求并行下载，每段的数据写入预先分配好大小的临时文件 savePath.part 中对应的位置
+ *     3. 下载过程中把每段已经下载的字节数保存到日志文件 savePath.journal 中，
+ *        下载中断后 (网络断开、程序退出等) 再次下载同一个 URL 到同一个路径时，从日志中记录的位置继续下载
+ *     4. 所有段下载完成后校验文件的摘要 (如果指定了)，校验通过则把临时文件重命名为 savePath，删除日志文件
+ *
+ * 使用方法:
+ *     HttpDownloader("http://qtdebug.com/video.mp4").segments(4).checksum(QCryptographicHash::Sha256, "9f86d0...")
+ *         .progress([](qint64 received, qint64 total) {
+ *             qDebug() << received << total;
+ *         }).success([](const QString &path) {
+ *             qDebug() << "下载完成" << path;
+ *         }).fail([](const QString &error, int errorCode) {
+ *             qDebug() << error << errorCode;
+ *         }).download("/Users/Biao/Desktop/video.mp4");
+ *
+ * 注意: 和 HttpClient 一样，download() 后 HttpDownloader 对象可以立即析构，下载在后台继续进行。
+ */
+class HttpDownloader {
+public:
+    HttpDownloader(const QString &url);
+    ~HttpDownloader();
+
+    /**
+     * @brief 设置并行下载的段数，默认为 4，每段不小于 1M
+     *
+     * @param count 段数
+     * @return 返回 HttpDownloader 的引用，可以用于链式调用
+     */
+    HttpDownloader& segments(int count);
+
+    /**
+     * @brief 设置每段下载失败后的重试次数，默认为 3，重试时从此段已下载的位置继续下载，
+     *        重试前等待的时间指数增长 (1 秒、2 秒、4 秒...，最长 30 秒)，在一半到全部之间随机
+     *
+     * @param count 重试次数
+     * @return 返回 HttpDownloader 的引用，可以用于链式调用
+     */
+    HttpDownloader& retries(int count);
+
+    /**
+     * @brief 设置下载完成后校验文件的摘要，不设置则不校验
+     *
+     * @param algorithm 摘要算法，例如 QCryptographicHash::Sha256
+     * @param hex       十六进制表示的摘要
+     * @return 返回 HttpDownloader 的引用，可以用于链式调用
+     */
+    HttpDownloader& checksum(QCryptographicHash::Algorithm algorithm, const QByteArray &hex);
+
+    /**
+     * @brief 添加请求头，例如 token
+     *
+     * @param name  请求头的名字
+     * @param value 请求头的值
+     * @return 返回 HttpDownloader 的引用，可以用于链式调用
+     */
+    HttpDownloader& header(const QString &name, const QString &value);
+
+    /**
+     * @brief 使用传入的 QNetworkAccessManager 执行请求，参考 HttpClient::manager()
+     *
+     * @param manager 执行 HTTP 请求的 QNetworkAccessManager 对象
+     * @return 返回 HttpDownloader 的引用，可以用于链式调用
+     */
+    HttpDownloader& manager(QNetworkAccessManager *manager);
+
+    /**
+     * @brief 参数 debug 为 true 则使用 debug 模式，输出每段的下载信息
+     *
+     * @param debug 是否启用调试模式
+     * @return 返回 HttpDownloader 的引用，可以用于链式调用
+     */
+    HttpDownloader& debug(bool debug);
+
+    /**
+     * @brief 注册下载进度的回调函数
+     *
+     * @param progressHandler 进度的回调函数，参数为已下载的字节数 (包含续传前已经下载的) 和文件的总字节数
+     * @return 返回 HttpDownloader 的引用，可以用于链式调用
+     */
+    HttpDownloader& progress(std::function<void (qint64, qint64)> progressHandler);
+
+    /**
+     * @brief 注册下载成功的回调函数
+     *
+     * @param successHandler 成功的回调函数，参数为保存的文件路径
+     * @return 返回 HttpDownloader 的引用，可以用于链式调用
+     */
+    HttpDownloader& success(std::function<void (const QString &)> successHandler);
+
+    /**
+     * @brief 注册下载失败的回调函数，失败时保留临时文件和日志文件，再次下载时可以继续
+     *
+     * @param failHandler 失败的回调函数，参数为失败原因和错误码 (网络错误为 QNetworkReply::NetworkError，其他错误为 -1)
+     * @return 返回 HttpDownloader 的引用，可以用于链式调用
+     */
+    HttpDownloader& fail(std::function<void (const QString &, int)> failHandler);
+
+    /**
+     * @brief 开始下载，下载的文件保存到 savePath
+     *
+     * @param savePath 下载的文件保存路径
+     */
+    void download(const QString &savePath);
+
+private:
+    QSharedPointer<HttpDownloadTask> task;
+};
+
+#endif // HTTPDOWNLOADER_H
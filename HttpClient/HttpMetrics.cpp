@@ -0,0 +1,189 @@
+#include "HttpMetrics.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QStringList>
+#include <QRegularExpression>
+#include <cmath>
+
+static const int    BUCKET_COUNT = 200; // 1.1^199 毫秒约为 2 天，足够大
+static const double BUCKET_BASE  = 1.1;
+
+HttpMetrics::HttpMetrics() {
+}
+
+HttpMetrics& HttpMetrics::instance() {
+    static HttpMetrics metrics; // C++11 保证局部静态变量的初始化是线程安全的
+    return metrics;
+}
+
+// 记录一次请求的耗时
+void HttpMetrics::record(const HttpTiming &timing) {
+    QMutexLocker locker(&mutex);
+    QString route = timing.route;
+    QString key   = timing.host + " " + timing.method + " " + route;
+
+    // 分组数超过上限时新的路由都记录到 :other
+    if (!series.contains(key) && series.size() >= MAX_SERIES) {
+        route = ":other";
+        key   = timing.host + " " + timing.method + " " + route;
+    }
+
+    Series &s = series[key];
+    s.host   = timing.host;
+    s.method = timing.method;
+    s.route  = route;
+    s.count         += 1;
+    s.errors        += timing.succeeded ? 0 : 1;
+    s.bytesSent     += timing.bytesSent;
+    s.bytesReceived += timing.bytesReceived;
+    s.totalSum      += timing.totalMs;
+    s.total.add(timing.totalMs);
+
+    if (timing.firstByteMs >= 0) {
+        s.firstByteSum += timing.firstByteMs;
+        s.firstByte.add(timing.firstByteMs);
+    }
+}
+
+// 导出所有分组的指标
+QString HttpMetrics::exportAs(HttpMetricsFormat format) {
+    QMutexLocker locker(&mutex);
+    return format == HttpMetricsFormat::Json ? toJson() : toPrometheus();
+}
+
+// 清空所有指标
+void HttpMetrics::reset() {
+    QMutexLocker locker(&mutex);
+    series.clear();
+}
+
+// 计算 URL 路径的路由
+QString HttpMetrics::routeOf(const QString &path) {
+    static const QRegularExpression idPattern("^(\\d+|[0-9a-fA-F]{8}-[0-9a-fA-F]{4}-[0-9a-fA-F]{4}-[0-9a-fA-F]{4}-[0-9a-fA-F]{12}|[0-9a-fA-F]{16,})$");
+
+    QStringList segments = path.split('/');
+
+    for (QString &segment : segments) {
+        if (idPattern.match(segment).hasMatch()) {
+            segment = ":id";
+        }
+    }
+
+    QString route = segments.join('/');
+    return route.isEmpty() ? "/" : route;
+}
+
+// 导出为 JSON
+QString HttpMetrics::toJson() const {
+    QJsonArray items;
+
+    auto quantiles = [](const Histogram &h) {
+        QJsonObject object;
+        object["p50"] = h.percentile(0.50);
+        object["p95"] = h.percentile(0.95);
+        object["p99"] = h.percentile(0.99);
+        object["max"] = h.max;
+        return object;
+    };
+
+    for (const Series &s : series) {
+        QJsonObject item;
+        item["host"]          = s.host;
+        item["method"]        = s.method;
+        item["route"]         = s.route;
+        item["count"]         = s.count;
+        item["errors"]        = s.errors;
+        item["bytesSent"]     = s.bytesSent;
+        item["bytesReceived"] = s.bytesReceived;
+        item["meanMs"]        = s.count > 0 ? double(s.totalSum) / s.count : 0.0;
+        item["totalMs"]       = quantiles(s.total);
+        item["firstByteMs"]   = quantiles(s.firstByte);
+        items.append(item);
+    }
+
+    return QString::fromUtf8(QJsonDocument(items).toJson(QJsonDocument::Indented));
+}
+
+// 导出为 Prometheus 的文本格式，分位数使用 summary 类型
+QString HttpMetrics::toPrometheus() const {
+    // 1. 输出总耗时和 TTFB 的 summary
+    // 2. 输出请求数、失败数、字节数的 counter
+
+    auto escape = [](QString value) {
+        return value.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n");
+    };
+    auto labels = [&](const Series &s) {
+        return QString("host=\"%1\",method=\"%2\",route=\"%3\"").arg(escape(s.host)).arg(escape(s.method)).arg(escape(s.route));
+    };
+
+    QString out;
+
+    // [1] 输出总耗时和 TTFB 的 summary
+    auto summary = [&](const QString &name, const QString &help, bool firstByte) {
+        out += QString("# HELP %1 %2\n# TYPE %1 summary\n").arg(name).arg(help);
+
+        for (const Series &s : series) {
+            const Histogram &h = firstByte ? s.firstByte : s.total;
+
+            for (double q : { 0.5, 0.95, 0.99 }) {
+                out += QString("%1{%2,quantile=\"%3\"} %4\n").arg(name).arg(labels(s)).arg(q).arg(h.percentile(q));
+            }
+
+            out += QString("%1_sum{%2} %3\n").arg(name).arg(labels(s)).arg(firstByte ? s.firstByteSum : s.totalSum);
+            out += QString("%1_count{%2} %3\n").arg(name).arg(labels(s)).arg(h.count);
+        }
+    };
+
+    summary("http_client_request_duration_ms", "Total time of HttpClient requests in milliseconds.", false);
+    summary("http_client_time_to_first_byte_ms", "Time from sending HttpClient requests to receiving the response headers in milliseconds.", true);
+
+    // [2] 输出请求数、失败数、字节数的 counter
+    auto counter = [&](const QString &name, const QString &help, std::function<qint64 (const Series &)> value) {
+        out += QString("# HELP %1 %2\n# TYPE %1 counter\n").arg(name).arg(help);
+
+        for (const Series &s : series) {
+            out += QString("%1{%2} %3\n").arg(name).arg(labels(s)).arg(value(s));
+        }
+    };
+
+    counter("http_client_requests_total", "Number of HttpClient requests.", [](const Series &s) { return s.count; });
+    counter("http_client_request_errors_total", "Number of failed HttpClient requests.", [](const Series &s) { return s.errors; });
+    counter("http_client_bytes_sent_total", "Bytes sent by HttpClient requests.", [](const Series &s) { return s.bytesSent; });
+    counter("http_client_bytes_received_total", "Bytes received by HttpClient requests.", [](const Series &s) { return s.bytesReceived; });
+
+    return out;
+}
+
+// 添加一个耗时到直方图
+void HttpMetrics::Histogram::add(qint64 ms) {
+    if (buckets.isEmpty()) {
+        buckets.fill(0, BUCKET_COUNT);
+    }
+
+    int index = ms <= 1 ? 0 : int(std::ceil(std::log(double(ms)) / std::log(BUCKET_BASE)));
+    ++buckets[qBound(0, index, BUCKET_COUNT - 1)];
+    ++count;
+    max = qMax(max, ms);
+}
+
+// 计算分位数，返回所在的桶的上界，不超过最大值
+qint64 HttpMetrics::Histogram::percentile(double p) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    qint64 target = qMax<qint64>(1, qint64(std::ceil(p * count)));
+    qint64 seen   = 0;
+
+    for (int i = 0; i < buckets.size(); ++i) {
+        seen += buckets.at(i);
+
+        if (seen >= target) {
+            return qMin(max, qint64(std::llround(std::pow(BUCKET_BASE, i))));
+        }
+    }
+
+    return max;
+}
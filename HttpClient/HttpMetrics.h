@@ -0,0 +1,90 @@
+#ifndef HTTPMETRICS_H
+#define HTTPMETRICS_H
+
+#include "HttpClient.h"
+
+#include <QMap>
+#include <QMutex>
+#include <QVector>
+#include <QString>
+
+/**
+ * 进程内共享的 HttpClient 请求指标，是线程安全的，每次访问服务器结束时 (包括每次重试) 记录一次:
+ *     1. 按主机、Method 和路由分组，路由是 URL 的路径，其中的数字、UUID 等替换为 :id，避免每个考生一个分组
+ *     2. 每组统计请求数、失败数、发送和接收的字节数，总耗时和 TTFB 的 p50、p95、p99
+ *     3. 可以导出为 JSON 或者 Prometheus 的文本格式
+ *
+ * 分位数使用对数分桶的直方图计算，每个桶的上界是上一个桶的 1.1 倍，误差不超过 10%，
+ * 每组占用的内存是固定的，不会随请求数增长。
+ */
+class HttpMetrics {
+public:
+    static HttpMetrics& instance();
+
+    /**
+     * @brief 记录一次请求的耗时
+     *
+     * @param timing 请求的耗时
+     */
+    void record(const HttpTiming &timing);
+
+    /**
+     * @brief 导出所有分组的指标
+     *
+     * @param format 导出的格式
+     * @return 返回导出的文本
+     */
+    QString exportAs(HttpMetricsFormat format);
+
+    /**
+     * @brief 清空所有指标
+     */
+    void reset();
+
+    /**
+     * @brief 计算 URL 路径的路由: 去掉参数，路径中的数字、UUID、长的十六进制字符串替换为 :id
+     *
+     * @param path URL 的路径
+     * @return 返回路由，例如 /api/students/123 的路由为 /api/students/:id
+     */
+    static QString routeOf(const QString &path);
+
+private:
+    HttpMetrics();
+
+    /**
+     * @brief 对数分桶的直方图，第 i 个桶的上界为 1.1^i 毫秒
+     */
+    struct Histogram {
+        QVector<qint64> buckets;
+        qint64 count = 0;
+        qint64 max   = 0;
+
+        void add(qint64 ms);
+        qint64 percentile(double p) const;
+    };
+
+    struct Series {
+        QString host;
+        QString method;
+        QString route;
+        qint64  count         = 0;
+        qint64  errors        = 0;
+        qint64  bytesSent     = 0;
+        qint64  bytesReceived = 0;
+        qint64  totalSum      = 0;
+        qint64  firstByteSum  = 0;
+        Histogram total;     // 总耗时
+        Histogram firstByte; // 开始到收到响应头的时间
+    };
+
+    QString toJson() const;       // 调用前需要加锁
+    QString toPrometheus() const; // 调用前需要加锁
+
+    QMutex mutex;
+    QMap<QString, Series> series; // key 为 host + method + route，使用 QMap 使导出的顺序固定
+
+    static const int MAX_SERIES = 1000; // 分组数的上限，超过时新的路由都记录到 :other
+};
+
+#endif // HTTPMETRICS_H
@@ -0,0 +1,218 @@
+#include "HttpMultiPartDevice.h"
+
+#include <QUuid>
+#include <cstring>
+
+HttpMultiPartDevice::HttpMultiPartDevice(qint64 bufferSize, QObject *parent)
+    : QIODevice(parent), bufferSize(qMax<qint64>(bufferSize, 64 * 1024)) {
+    boundaryBytes = "boundary_.oOo._" + QUuid::createUuid().toRfc4122().toHex();
+}
+
+// 添加一个文本的部分 (Form 表单的参数)
+void HttpMultiPartDevice::addTextPart(const QString &name, const QString &value) {
+    QByteArray bytes;
+    bytes += "--" + boundaryBytes + "\r\n";
+    bytes += QString("Content-Disposition: form-data; name=\"%1\"\r\n\r\n").arg(name).toUtf8();
+    bytes += value.toUtf8();
+    bytes += "\r\n";
+
+    appendBytes(bytes);
+}
+
+// 添加一个数据来自 device 的部分
+int HttpMultiPartDevice::addDevicePart(const QString &name, const QString &fileName, const QString &contentType,
+                                       QIODevice *device, qint64 size) {
+    // 1. 添加部分的头
+    // 2. 添加部分的数据，数据在读取时才从 device 中读取
+    // 3. 顺序设备有新数据时，如果 readData() 正在等待数据则通知继续读取
+    // 4. 添加部分结束的换行
+
+    // [1] 添加部分的头
+    QByteArray header;
+    header += "--" + boundaryBytes + "\r\n";
+    header += QString("Content-Disposition: form-data; name=\"%1\"; filename=\"%2\"\r\n").arg(name).arg(fileName).toUtf8();
+    header += QString("Content-Type: %1\r\n\r\n").arg(contentType.isEmpty() ? "application/octet-stream" : contentType).toUtf8();
+    appendBytes(header);
+
+    // [2] 添加部分的数据，数据在读取时才从 device 中读取
+    Segment segment;
+    segment.device = device;
+    segment.offset = totalSize;
+    segment.size   = size;
+    segment.part   = partSent.size();
+    segments.append(segment);
+    partSent.append(0);
+    totalSize += size;
+
+    // [3] 顺序设备有新数据时，如果 readData() 正在等待数据则通知继续读取
+    if (device->isSequential()) {
+        QObject::connect(device, &QIODevice::readyRead, this, [this] {
+            if (waiting) {
+                waiting = false;
+                emit readyRead();
+            }
+        });
+    }
+
+    // [4] 添加部分结束的换行
+    appendBytes("\r\n");
+
+    return segment.part;
+}
+
+// 注册上传进度的回调函数
+void HttpMultiPartDevice::setProgressHandler(std::function<void (int, qint64, qint64)> progressHandler) {
+    this->progressHandler = progressHandler;
+}
+
+// 确认已经发送的字节数
+void HttpMultiPartDevice::setBytesSent(qint64 bytesSent) {
+    // 1. 计算每个部分已发送的字节数，有变化时回调进度
+    // 2. 已读取未发送的数据少于 bufferSize 时，如果 readData() 正在等待则通知继续读取
+
+    this->bytesSent = bytesSent;
+
+    // [1] 计算每个部分已发送的字节数，有变化时回调进度
+    for (const Segment &segment : segments) {
+        if (segment.part < 0) {
+            continue;
+        }
+
+        qint64 sent = qBound<qint64>(0, bytesSent - segment.offset, segment.size);
+
+        if (sent != partSent.at(segment.part)) {
+            partSent[segment.part] = sent;
+
+            if (nullptr != progressHandler) {
+                progressHandler(segment.part, sent, segment.size);
+            }
+        }
+    }
+
+    // [2] 已读取未发送的数据少于 bufferSize 时，如果 readData() 正在等待则通知继续读取
+    if (waiting && pos() - bytesSent < bufferSize) {
+        waiting = false;
+        emit readyRead();
+    }
+}
+
+// 请求体的 boundary
+QByteArray HttpMultiPartDevice::boundary() const {
+    return boundaryBytes;
+}
+
+bool HttpMultiPartDevice::isSequential() const {
+    return false;
+}
+
+qint64 HttpMultiPartDevice::size() const {
+    return totalSize;
+}
+
+bool HttpMultiPartDevice::seek(qint64 pos) {
+    // 顺序设备的数据读取后就没有了，不能回退到已经开始读取的顺序设备的数据 (例如重定向时 Qt 会调用 reset() 重新发送)
+    for (const Segment &segment : segments) {
+        bool started = this->pos() > segment.offset;
+
+        if (nullptr != segment.device && segment.device->isSequential() && started && pos < segment.offset + segment.size) {
+            return false;
+        }
+    }
+
+    bytesSent = qMin(bytesSent, pos);
+    return QIODevice::seek(pos);
+}
+
+bool HttpMultiPartDevice::open(OpenMode mode) {
+    if (mode != QIODevice::ReadOnly) {
+        return false;
+    }
+
+    // 添加结束的 boundary，使用 Unbuffered 使得 pos() 总是下一个要调用 readData() 读取的位置
+    appendBytes("--" + boundaryBytes + "--\r\n");
+
+    return QIODevice::open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+qint64 HttpMultiPartDevice::readData(char *data, qint64 maxSize) {
+    // 1. 计算本次最多能读取的字节数: 已读取未发送的数据不超过 bufferSize，超过时返回 0 等待发送
+    // 2. 从当前位置所在的片段开始依次读取
+    //    2.1 bytes 片段直接复制
+    //    2.2 device 片段从 device 中读取，非顺序设备先定位到片段内的位置
+    //    2.3 顺序设备暂时没有数据时结束本次读取，等设备有新数据时再继续
+
+    // [1] 计算本次最多能读取的字节数: 已读取未发送的数据不超过 bufferSize，超过时返回 0 等待发送
+    qint64 position = pos();
+    qint64 allowed  = qMin(maxSize, bytesSent + bufferSize - position);
+
+    if (allowed <= 0) {
+        waiting = true;
+        return 0;
+    }
+
+    // [2] 从当前位置所在的片段开始依次读取
+    qint64 read = 0;
+
+    for (const Segment &segment : segments) {
+        qint64 cursor = position + read;
+
+        if (read >= allowed) {
+            break;
+        }
+
+        if (cursor >= segment.offset + segment.size) {
+            continue;
+        }
+
+        qint64 local = cursor - segment.offset;
+        qint64 count = qMin(allowed - read, segment.size - local);
+
+        if (nullptr == segment.device) {
+            // [2.1] bytes 片段直接复制
+            std::memcpy(data + read, segment.bytes.constData() + local, size_t(count));
+            read += count;
+            continue;
+        }
+
+        // [2.2] device 片段从 device 中读取，非顺序设备先定位到片段内的位置
+        bool sequential = segment.device->isSequential();
+
+        if (!sequential && segment.device->pos() != local && !segment.device->seek(local)) {
+            return -1;
+        }
+
+        qint64 deviceRead = segment.device->read(data + read, count);
+
+        if (deviceRead < 0 || (deviceRead == 0 && !sequential)) {
+            // 读取出错，或者文件的实际大小比声明的小
+            return -1;
+        }
+
+        read += deviceRead;
+
+        // [2.3] 顺序设备暂时没有数据时结束本次读取，等设备有新数据时再继续
+        if (deviceRead < count) {
+            break;
+        }
+    }
+
+    waiting = (0 == read);
+
+    return read;
+}
+
+qint64 HttpMultiPartDevice::writeData(const char *data, qint64 maxSize) {
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+
+    return -1;
+}
+
+void HttpMultiPartDevice::appendBytes(const QByteArray &bytes) {
+    Segment segment;
+    segment.bytes  = bytes;
+    segment.offset = totalSize;
+    segment.size   = bytes.size();
+    segments.append(segment);
+    totalSize += segment.size;
+}
@@ -0,0 +1,106 @@
+#ifndef HTTPMULTIPARTDEVICE_H
+#define HTTPMULTIPARTDEVICE_H
+
+#include <functional>
+#include <QList>
+#include <QIODevice>
+#include <QByteArray>
+
+/**
+ * 流式上传使用的 multipart/form-data 请求体，各部分的数据直接从它们的 QIODevice 读取，不会复制到中间的缓冲区。
+ *
+ * Qt 的 QHttpMultiPart 在某个部分的设备暂时读不到数据时会在 readData() 里死循环，因此无法做背压控制，所以实现了这个类:
+ *     1. 它是可随机访问的设备，size() 为整个请求体的大小，配合 QNetworkRequest::DoNotBufferUploadDataAttribute，
+ *        QNetworkAccessManager 不会预先把请求体读入内存，而是边发送边读取
+ *     2. 已经被读取但还没有确认发送 (QNetworkReply::uploadProgress) 的数据不超过 bufferSize，
+ *        超过时 readData() 返回 0，等到 setBytesSent() 确认发送后再发射 readyRead() 继续读取
+ *     3. 根据确认发送的字节数计算每个部分的上传进度并回调
+ *
+ * 使用方法:
+ *     HttpMultiPartDevice *body = new HttpMultiPartDevice(1024 * 1024);
+ *     body->addTextPart("name", "Alice");
+ *     body->addDevicePart("file", "photo.jpg", "image/jpeg", file, file->size());
+ *     body->open(QIODevice::ReadOnly);
+ */
+class HttpMultiPartDevice : public QIODevice {
+public:
+    /**
+     * @param bufferSize 已读取但还没有确认发送的数据的最大字节数
+     * @param parent     父对象
+     */
+    explicit HttpMultiPartDevice(qint64 bufferSize, QObject *parent = nullptr);
+
+    /**
+     * @brief 添加一个文本的部分 (Form 表单的参数)
+     *
+     * @param name  参数名
+     * @param value 参数值
+     */
+    void addTextPart(const QString &name, const QString &value);
+
+    /**
+     * @brief 添加一个数据来自 device 的部分，device 需要已经打开，并且在上传结束前保持有效
+     *
+     * @param name        服务器端获取文件的参数名
+     * @param fileName    文件名
+     * @param contentType 数据的 Content-Type，为空时使用 application/octet-stream
+     * @param device      数据来源
+     * @param size        数据的字节数，顺序设备 (如 QProcess) 的 size() 不是数据的大小，必须由调用者指定
+     * @return 返回部分的编号，上传进度回调中使用此编号，从 0 开始
+     */
+    int addDevicePart(const QString &name, const QString &fileName, const QString &contentType, QIODevice *device, qint64 size);
+
+    /**
+     * @brief 注册上传进度的回调函数，每个部分的已发送字节数变化时调用
+     *
+     * @param progressHandler 回调函数，参数为部分的编号、此部分已发送的字节数和此部分的总字节数
+     */
+    void setProgressHandler(std::function<void (int, qint64, qint64)> progressHandler);
+
+    /**
+     * @brief 确认已经发送的字节数，一般在 QNetworkReply::uploadProgress 中调用，用于背压控制和计算每个部分的进度
+     *
+     * @param bytesSent 已发送的字节数
+     */
+    void setBytesSent(qint64 bytesSent);
+
+    /**
+     * @brief 请求体的 boundary，用于设置请求头 Content-Type: multipart/form-data; boundary=xxx
+     */
+    QByteArray boundary() const;
+
+    bool   isSequential() const override;
+    qint64 size() const override;
+    bool   seek(qint64 pos) override;
+    bool   open(OpenMode mode) override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    /**
+     * @brief 请求体由多个片段组成，片段的数据为 bytes (boundary 和部分的头) 或者来自 device (部分的数据)
+     */
+    struct Segment {
+        QByteArray bytes;
+        QIODevice *device = nullptr;
+        qint64 offset = 0;  // 片段在请求体中的偏移
+        qint64 size   = 0;  // 片段的字节数
+        int    part   = -1; // 数据来自 device 时为部分的编号，否则为 -1
+    };
+
+    void appendBytes(const QByteArray &bytes);
+
+    QList<Segment> segments;
+    QList<qint64>  partSent;   // 每个部分已经回调过的发送字节数
+    QByteArray     boundaryBytes;
+    std::function<void (int, qint64, qint64)> progressHandler;
+
+    qint64 totalSize  = 0;     // 请求体的大小 (调用 open() 时结束的 boundary 已经加上)
+    qint64 bufferSize = 0;     // 已读取但还没有确认发送的数据的最大字节数
+    qint64 bytesSent  = 0;     // 已确认发送的字节数
+    bool   waiting    = false; // readData() 是否因为背压或者顺序设备没有数据而返回了 0
+};
+
+#endif // HTTPMULTIPARTDEVICE_H
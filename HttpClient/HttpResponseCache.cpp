@@ -0,0 +1,170 @@
+#include "HttpResponseCache.h"
+
+#include <QDateTime>
+#include <QNetworkReply>
+#include <QRegularExpression>
+
+HttpResponseCache::HttpResponseCache() {
+}
+
+HttpResponseCache& HttpResponseCache::instance() {
+    static HttpResponseCache cache; // C++11 保证局部静态变量的初始化是线程安全的
+    return cache;
+}
+
+// 查找缓存，找到时把它移到 LRU 的最前面
+bool HttpResponseCache::get(const QString &key, HttpCacheEntry *entry) {
+    QMutexLocker locker(&mutex);
+    auto iter = items.find(key);
+
+    if (iter == items.end()) {
+        return false;
+    }
+
+    lru.splice(lru.begin(), lru, iter.value().position);
+    *entry = iter.value().entry;
+
+    return true;
+}
+
+// 根据响应头判断响应能否缓存，能缓存则保存，否则删除 key 原来的缓存
+void HttpResponseCache::put(const QString &key, QNetworkReply *reply, const QByteArray &body) {
+    // 1. 计算缓存新鲜的截止时间，no-store 时不缓存
+    // 2. 既没有过期时间也没有 ETag、Last-Modified 时无法验证，不缓存
+    // 3. 保存缓存，超过 maxBytes 时淘汰最久没有使用的缓存
+
+    // [1] 计算缓存新鲜的截止时间，no-store 时不缓存
+    bool cacheable = true;
+    HttpCacheEntry entry;
+    entry.body         = body;
+    entry.etag         = reply->rawHeader("ETag");
+    entry.lastModified = reply->rawHeader("Last-Modified");
+    entry.expires      = expiresOf(reply, &cacheable);
+
+    QMutexLocker locker(&mutex);
+    remove(key);
+
+    // [2] 既没有过期时间也没有 ETag、Last-Modified 时无法验证，不缓存
+    bool fresh = entry.expires > QDateTime::currentMSecsSinceEpoch();
+
+    if (!cacheable || (!fresh && entry.etag.isEmpty() && entry.lastModified.isEmpty())) {
+        return;
+    }
+
+    // [3] 保存缓存，超过 maxBytes 时淘汰最久没有使用的缓存
+    Item item;
+    item.entry = entry;
+    item.cost  = body.size() + entry.etag.size() + entry.lastModified.size() + key.size() * 2;
+
+    if (item.cost > maxBytes) {
+        return;
+    }
+
+    lru.push_front(key);
+    item.position = lru.begin();
+    items.insert(key, item);
+    bytes += item.cost;
+
+    evict();
+}
+
+// 服务器返回 304 时，根据新的响应头更新缓存新鲜的时间
+void HttpResponseCache::refresh(const QString &key, QNetworkReply *reply) {
+    bool cacheable = true;
+    qint64 expires = expiresOf(reply, &cacheable);
+
+    QMutexLocker locker(&mutex);
+    auto iter = items.find(key);
+
+    if (iter == items.end()) {
+        return;
+    }
+
+    if (!cacheable) {
+        remove(key);
+    } else {
+        iter.value().entry.expires = expires;
+    }
+}
+
+// 清空缓存
+void HttpResponseCache::clear() {
+    QMutexLocker locker(&mutex);
+    items.clear();
+    lru.clear();
+    bytes = 0;
+}
+
+// 设置所有缓存的数据的最大字节数
+void HttpResponseCache::setMaxBytes(qint64 maxBytes) {
+    QMutexLocker locker(&mutex);
+    this->maxBytes = qMax<qint64>(0, maxBytes);
+    evict();
+}
+
+// 获取统计信息
+HttpCacheStats HttpResponseCache::stats() {
+    QMutexLocker locker(&mutex);
+    HttpCacheStats result = counters;
+    result.entries = items.size();
+    result.bytes   = bytes;
+
+    return result;
+}
+
+void HttpResponseCache::countHit() {
+    QMutexLocker locker(&mutex);
+    ++counters.hits;
+}
+
+void HttpResponseCache::countRevalidated() {
+    QMutexLocker locker(&mutex);
+    ++counters.revalidated;
+}
+
+void HttpResponseCache::countMiss() {
+    QMutexLocker locker(&mutex);
+    ++counters.misses;
+}
+
+void HttpResponseCache::countCoalesced() {
+    QMutexLocker locker(&mutex);
+    ++counters.coalesced;
+}
+
+// 根据响应头 Cache-Control 计算缓存新鲜的截止时间
+qint64 HttpResponseCache::expiresOf(QNetworkReply *reply, bool *cacheable) {
+    static const QRegularExpression maxAgePattern("max-age\\s*=\\s*(\\d+)");
+
+    QString cacheControl = QString::fromLatin1(reply->rawHeader("Cache-Control")).toLower();
+    qint64  now = QDateTime::currentMSecsSinceEpoch();
+
+    *cacheable = !cacheControl.contains("no-store");
+
+    // no-cache 表示可以缓存，但是每次使用前都需要向服务器验证
+    if (cacheControl.contains("no-cache")) {
+        return now;
+    }
+
+    QRegularExpressionMatch match = maxAgePattern.match(cacheControl);
+    return match.hasMatch() ? now + match.captured(1).toLongLong() * 1000 : now;
+}
+
+// 删除缓存，调用前需要加锁
+void HttpResponseCache::remove(const QString &key) {
+    auto iter = items.find(key);
+
+    if (iter != items.end()) {
+        bytes -= iter.value().cost;
+        lru.erase(iter.value().position);
+        items.erase(iter);
+    }
+}
+
+// 淘汰最久没有使用的缓存直到不超过 maxBytes，调用前需要加锁
+void HttpResponseCache::evict() {
+    while (bytes > maxBytes && !lru.empty()) {
+        QString key = lru.back();
+        remove(key);
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef HTTPRESPONSECACHE_H
+#define HTTPRESPONSECACHE_H
+
+#include "HttpClient.h"
+
+#include <list>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QByteArray>
+
+class QNetworkReply;
+
+/**
+ * @brief 缓存的一个响应
+ */
+struct HttpCacheEntry {
+    QByteArray body;         // 响应的数据
+    QByteArray etag;         // 响应头 ETag，用于 If-None-Match 验证
+    QByteArray lastModified; // 响应头 Last-Modified，用于 If-Modified-Since 验证
+    qint64     expires = 0;  // 在这个时间 (毫秒) 之前缓存是新鲜的，不需要访问服务器
+};
+
+/**
+ * 进程内共享的 GET 响应缓存，是线程安全的，HttpClient 调用 cache(true) 时使用。
+ *
+ * 1. 使用 LRU 淘汰，所有缓存的数据不超过 maxBytes 字节
+ * 2. 遵循响应头 Cache-Control: no-store 不缓存，no-cache 每次都需要验证，max-age 指定缓存新鲜的时间
+ * 3. 缓存过期后，如果有 ETag 或者 Last-Modified，使用 If-None-Match、If-Modified-Since 向服务器验证，
+ *    服务器返回 304 时继续使用缓存的数据，只传输响应头
+ */
+class HttpResponseCache {
+public:
+    static HttpResponseCache& instance();
+
+    /**
+     * @brief 查找缓存，找到时把它移到 LRU 的最前面
+     *
+     * @param key   缓存的 key
+     * @param entry 找到时保存缓存的响应
+     * @return 找到返回 true，否则返回 false
+     */
+    bool get(const QString &key, HttpCacheEntry *entry);
+
+    /**
+     * @brief 根据响应头判断响应能否缓存，能缓存则保存，否则删除 key 原来的缓存
+     *
+     * @param key   缓存的 key
+     * @param reply 请求的 QNetworkReply 对象，使用它的响应头
+     * @param body  响应的数据
+     */
+    void put(const QString &key, QNetworkReply *reply, const QByteArray &body);
+
+    /**
+     * @brief 服务器返回 304 时，根据新的响应头更新缓存新鲜的时间
+     *
+     * @param key   缓存的 key
+     * @param reply 请求的 QNetworkReply 对象，使用它的响应头
+     */
+    void refresh(const QString &key, QNetworkReply *reply);
+
+    /**
+     * @brief 清空缓存
+     */
+    void clear();
+
+    /**
+     * @brief 设置所有缓存的数据的最大字节数，超过时淘汰最久没有使用的缓存
+     */
+    void setMaxBytes(qint64 maxBytes);
+
+    /**
+     * @brief 获取统计信息
+     */
+    HttpCacheStats stats();
+
+    void countHit();         // 新鲜的缓存命中
+    void countRevalidated(); // 服务器返回 304，使用缓存
+    void countMiss();        // 从服务器获取了数据
+    void countCoalesced();   // 合并到正在进行中的相同请求
+
+private:
+    HttpResponseCache();
+
+    /**
+     * @brief 根据响应头 Cache-Control 计算缓存新鲜的截止时间
+     *
+     * @param reply     请求的 QNetworkReply 对象
+     * @param cacheable 保存响应是否允许缓存 (no-store 时不允许)
+     * @return 返回截止时间，单位为毫秒
+     */
+    static qint64 expiresOf(QNetworkReply *reply, bool *cacheable);
+
+    void remove(const QString &key); // 删除缓存，调用前需要加锁
+    void evict();                    // 淘汰最久没有使用的缓存直到不超过 maxBytes，调用前需要加锁
+
+    struct Item {
+        HttpCacheEntry entry;
+        std::list<QString>::iterator position; // 在 lru 中的位置
+        qint64 cost = 0;
+    };
+
+    QMutex mutex;
+    std::list<QString>   lru;  // 最前面的是最近使用的
+    QHash<QString, Item> items;
+    qint64 bytes    = 0;
+    qint64 maxBytes = 16 * 1024 * 1024;
+    HttpCacheStats counters;
+};
+
+#endif // HTTPRESPONSECACHE_H
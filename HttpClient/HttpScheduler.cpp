@@ -0,0 +1,179 @@
+#include "HttpScheduler.h"
+
+#include <QThread>
+#include <QMetaObject>
+#include <QSharedPointer>
+
+/**
+ * 切换到其他线程执行的请求，被 invokeMethod 的 lambda 持有。
+ * context 在事件执行前被删除时 Qt 丢弃事件并释放 lambda，析构时执行 run(false) 释放请求占用的名额。
+ */
+struct HttpSchedulerPendingRun {
+    std::function<void (bool)> run;
+    bool done = false;
+
+    ~HttpSchedulerPendingRun() {
+        if (!done) {
+            run(false);
+        }
+    }
+};
+
+HttpScheduler::HttpScheduler() {
+}
+
+HttpScheduler& HttpScheduler::instance() {
+    static HttpScheduler scheduler; // C++11 保证局部静态变量的初始化是线程安全的
+    return scheduler;
+}
+
+// 提交请求，有空闲的名额时立即执行，否则进入队列等待
+bool HttpScheduler::submit(HttpPriority priority, const QString &host, QObject *context, std::function<void (bool)> run) {
+    // 1. 队列已满时拒绝请求
+    // 2. 请求加入它的优先级的队列，取出可以执行的请求
+    // 3. 在锁外执行请求 (当前线程的请求会同步执行，执行中可能再次调用调度器)
+
+    QList<Job> jobs;
+    {
+        QMutexLocker locker(&mutex);
+        int queued = queues[0].size() + queues[1].size() + queues[2].size();
+
+        // [1] 队列已满时拒绝请求
+        if (maxQueued > 0 && queued >= maxQueued && !canStart(priority, host)) {
+            ++counters.rejected;
+            return false;
+        }
+
+        // [2] 请求加入它的优先级的队列，取出可以执行的请求
+        Job job;
+        job.priority = priority;
+        job.host     = host;
+        job.thread   = QThread::currentThread();
+        job.context  = context;
+        job.run      = run;
+        queues[int(priority)].append(job);
+
+        counters.peakQueued = qMax(counters.peakQueued, queued + 1);
+        jobs = takeStartable();
+    }
+
+    // [3] 在锁外执行请求
+    start(jobs);
+
+    return true;
+}
+
+// 请求结束，释放它占用的名额，执行队列中等待的请求
+void HttpScheduler::finished(const QString &host) {
+    QList<Job> jobs;
+    {
+        QMutexLocker locker(&mutex);
+        running = qMax(0, running - 1);
+
+        if (--hostRunning[host] <= 0) {
+            hostRunning.remove(host);
+        }
+
+        jobs = takeStartable();
+    }
+
+    start(jobs);
+}
+
+// 设置同时进行的请求数的上限
+void HttpScheduler::setConcurrencyLimits(int global, int perHost, int reserved) {
+    QList<Job> jobs;
+    {
+        QMutexLocker locker(&mutex);
+        this->global   = qMax(1, global);
+        this->perHost  = qMax(1, perHost);
+        this->reserved = qBound(0, reserved, this->global - 1);
+
+        jobs = takeStartable();
+    }
+
+    start(jobs);
+}
+
+// 单独设置某个主机同时进行的请求数的上限
+void HttpScheduler::setHostLimit(const QString &host, int limit) {
+    QList<Job> jobs;
+    {
+        QMutexLocker locker(&mutex);
+
+        if (limit > 0) {
+            hostLimits.insert(host, limit);
+        } else {
+            hostLimits.remove(host);
+        }
+
+        jobs = takeStartable();
+    }
+
+    start(jobs);
+}
+
+// 设置队列中等待的请求数的上限
+void HttpScheduler::setQueueLimit(int maxQueued) {
+    QMutexLocker locker(&mutex);
+    this->maxQueued = qMax(0, maxQueued);
+}
+
+// 获取统计信息
+HttpSchedulerStats HttpScheduler::stats() {
+    QMutexLocker locker(&mutex);
+    HttpSchedulerStats result = counters;
+    result.running           = running;
+    result.queuedInteractive = queues[int(HttpPriority::Interactive)].size();
+    result.queuedBackground  = queues[int(HttpPriority::Background)].size();
+    result.queuedBulk        = queues[int(HttpPriority::Bulk)].size();
+
+    return result;
+}
+
+// 是否有空闲的名额，Interactive 以外的请求不能使用保留的名额
+bool HttpScheduler::canStart(HttpPriority priority, const QString &host) const {
+    int limit = (priority == HttpPriority::Interactive) ? global : global - reserved;
+    return running < limit && hostRunning.value(host, 0) < hostLimits.value(host, perHost);
+}
+
+// 取出队列中可以执行的请求并占用名额，优先级高的先取，某个主机满了时可以先执行其他主机的请求
+QList<HttpScheduler::Job> HttpScheduler::takeStartable() {
+    QList<Job> jobs;
+
+    for (QList<Job> &queue : queues) {
+        for (int i = 0; i < queue.size() && running < global;) {
+            if (canStart(queue.at(i).priority, queue.at(i).host)) {
+                Job job = queue.takeAt(i);
+                ++running;
+                ++hostRunning[job.host];
+                ++counters.started;
+                jobs.append(job);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    return jobs;
+}
+
+// 执行请求: 当前线程的请求直接执行，其他线程的请求切换到它的线程执行
+void HttpScheduler::start(const QList<Job> &jobs) {
+    for (const Job &job : jobs) {
+        if (job.thread == QThread::currentThread()) {
+            job.run(!job.context.isNull());
+        } else if (!job.context.isNull()) {
+            // context 在切换线程前被删除时，pending 随 lambda 释放并执行 run(false)
+            QSharedPointer<HttpSchedulerPendingRun> pending(new HttpSchedulerPendingRun);
+            pending->run = job.run;
+
+            QMetaObject::invokeMethod(job.context.data(), [pending] {
+                pending->done = true;
+                pending->run(true);
+            }, Qt::QueuedConnection);
+        } else {
+            job.run(false);
+        }
+    }
+}
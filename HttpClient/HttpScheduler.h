@@ -0,0 +1,101 @@
+#ifndef HTTPSCHEDULER_H
+#define HTTPSCHEDULER_H
+
+#include "HttpClient.h"
+
+#include <functional>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QPointer>
+
+class QThread;
+
+/**
+ * HttpClient 的请求调度器，所有请求执行前都先提交到这里，是线程安全的:
+ *     1. 限制全局和每个主机同时进行的请求数，超过时请求进入队列等待
+ *     2. 队列按优先级 (Interactive > Background > Bulk) 出队，同一优先级先进先出
+ *     3. 全局名额中保留 reserved 个只给 Interactive 使用，批量请求占满其余的名额时，用户等待的请求仍然能立即执行
+ *     4. 队列中的请求数超过上限时拒绝新的请求
+ *
+ * 请求在提交它的线程中执行 (QNetworkAccessManager 只能在创建它的线程中使用)，
+ * 其他线程的请求结束后轮到它执行时，通过 context 对象的事件循环切换到提交它的线程。
+ */
+class HttpScheduler {
+public:
+    static HttpScheduler& instance();
+
+    /**
+     * @brief 提交请求，有空闲的名额时立即执行，否则进入队列等待，请求结束时必须调用 finished()
+     *
+     * @param priority 请求的优先级
+     * @param host     请求的主机，用于限制每个主机同时进行的请求数
+     * @param context  提交请求的线程中的对象，用于在这个线程中执行请求，被删除时不再执行请求
+     * @param run      执行请求的函数，参数为 false 时表示 context 已经被删除，只需要释放资源，不执行请求
+     * @return 请求被接受返回 true，队列已满被拒绝返回 false
+     */
+    bool submit(HttpPriority priority, const QString &host, QObject *context, std::function<void (bool)> run);
+
+    /**
+     * @brief 请求结束，释放它占用的名额，执行队列中等待的请求
+     *
+     * @param host 请求的主机
+     */
+    void finished(const QString &host);
+
+    /**
+     * @brief 设置同时进行的请求数的上限
+     *
+     * @param global   全局的上限
+     * @param perHost  每个主机的上限
+     * @param reserved 全局名额中只给 Interactive 使用的名额数
+     */
+    void setConcurrencyLimits(int global, int perHost, int reserved);
+
+    /**
+     * @brief 单独设置某个主机同时进行的请求数的上限，例如 HTTP/2 的主机可以在一个连接上同时进行更多的请求
+     *
+     * @param host  请求的主机
+     * @param limit 主机的上限，小于等于 0 时使用 perHost
+     */
+    void setHostLimit(const QString &host, int limit);
+
+    /**
+     * @brief 设置队列中等待的请求数的上限，0 表示不限制
+     */
+    void setQueueLimit(int maxQueued);
+
+    /**
+     * @brief 获取统计信息
+     */
+    HttpSchedulerStats stats();
+
+private:
+    HttpScheduler();
+
+    struct Job {
+        HttpPriority priority;
+        QString      host;
+        QThread     *thread = nullptr;
+        QPointer<QObject> context;
+        std::function<void (bool)> run;
+    };
+
+    bool canStart(HttpPriority priority, const QString &host) const; // 是否有空闲的名额，调用前需要加锁
+    QList<Job> takeStartable();  // 取出队列中可以执行的请求并占用名额，调用前需要加锁
+    void start(const QList<Job> &jobs); // 执行请求，调用时不能加锁
+
+    QMutex mutex;
+    QList<Job> queues[3];            // 每个优先级一个队列，下标为 HttpPriority 的值
+    QHash<QString, int> hostRunning; // 每个主机正在进行的请求数
+    QHash<QString, int> hostLimits;  // 单独设置了上限的主机
+    int running   = 0;               // 正在进行的请求数
+    int global    = 32;
+    int perHost   = 6;               // 和 QNetworkAccessManager 每个主机的 HTTP/1.1 连接数一致
+    int reserved  = 2;
+    int maxQueued = 0;
+    HttpSchedulerStats counters;
+};
+
+#endif // HTTPSCHEDULER_H
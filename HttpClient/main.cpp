@@ -1,6 +1,9 @@
 #include "HttpClient.h"
+#include "HttpDownloader.h"
 
 #include <QDebug>
+#include <QJsonObject>
+#include <QSharedPointer>
 #include <QApplication>
 #include <QNetworkAccessManager>
 
@@ -60,9 +63,8 @@ int main(int argc, char *argv[]) {
 
     {
         // [9] 共享 QNetworkAccessManager
-        // 每创建一个 QNetworkAccessManager 对象都会创建一个线程，当频繁的访问网络时，为了节省线程资源，调用 manager()
-        // 使用共享的 QNetworkAccessManager，它不会被 HttpClient 删除，需要我们自己不用的时候删除它。
-        // 如果下面的代码不传入 QNetworkAccessManager，从任务管理器里可以看到创建了几千个线程。
+        // 每创建一个 QNetworkAccessManager 对象都会创建一个线程，默认 HttpClient 使用内部共享的 manager 池 (每个线程一个)，
+        // 也可以调用 manager() 使用自己的 QNetworkAccessManager，它不会被 HttpClient 删除，需要我们自己不用的时候删除它。
         QNetworkAccessManager *manager = new QNetworkAccessManager();
         for (int i = 0; i < 5000; ++i) {
             HttpClient("http://localhost:8080/api/rest").manager(manager).success([=](const QString &response) {
@@ -71,5 +73,133 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    {
+        // [10] 使用内部共享的 manager 池: 预先建立连接，同一线程的请求复用连接
+        HttpClient::preconnect("http://localhost:8080");
+
+        for (int i = 0; i < 100; ++i) {
+            HttpClient("http://localhost:8080/api/rest").complete([] {
+                HttpClientPoolStats stats = HttpClient::poolStats();
+                qDebug().noquote() << QString("managers: %1, new connections: %2, reused connections: %3")
+                                      .arg(stats.managerCount).arg(stats.newConnections).arg(stats.reusedConnections);
+            }).get();
+        }
+    }
+
+    {
+        // [11] 流式模式: 响应数据分块回调，配合 JsonStreamReader 增量解析 {"data": [...]} 中的元素，内存占用不随响应大小增长
+        QSharedPointer<JsonStreamReader> reader(new JsonStreamReader("data", [](const QJsonValue &item) {
+            qDebug().noquote() << item.toObject().value("name").toString();
+        }));
+
+        HttpClient("http://localhost:8080/api/students").chunk([=](const QByteArray &data) {
+            reader->feed(data);
+        }).done([=] {
+            qDebug().noquote() << "接收完成" << reader->errorString();
+        }).get();
+    }
+
+    {
+        // [12] 流式上传: 文件使用内存映射读取，内存中最多 1M 待发送的数据，回调每个部分的上传进度
+        HttpUploadPart photo;
+        photo.path        = "/Users/Biao/Pictures/ade.jpg";
+        photo.contentType = "image/jpeg";
+
+        HttpUploadPart log;
+        log.name = "log";
+        log.path = "/Users/Biao/Desktop/data.log";
+
+        HttpClient("http://localhost:8080/api/upload").param("name", "Biao").uploadBufferSize(1024 * 1024)
+                .uploadProgress([](int part, qint64 sent, qint64 total) {
+            qDebug().noquote() << QString("part %1: %2/%3").arg(part).arg(sent).arg(total);
+        }).success([](const QString &response) {
+            qDebug().noquote() << response;
+        }).upload(QList<HttpUploadPart>{ photo, log });
+    }
+
+    {
+        // [13] 分段并行下载大文件，支持断点续传: 中断后再次执行同样的下载会从上次的位置继续
+        HttpDownloader("http://qtdebug.com/video/intro.mp4").segments(4).debug(true).progress([](qint64 received, qint64 total) {
+            qDebug().noquote() << QString("%1/%2").arg(received).arg(total);
+        }).success([](const QString &path) {
+            qDebug().noquote() << "下载完成" << path;
+        }).fail([](const QString &error, int errorCode) {
+            qDebug().noquote() << error << errorCode;
+        }).download("/Users/Biao/Desktop/intro.mp4");
+    }
+
+    {
+        // [14] GET 请求使用响应缓存: 同时发出的相同请求只访问一次服务器，之后遵循 Cache-Control 和 ETag 使用缓存
+        for (int i = 0; i < 10; ++i) {
+            HttpClient("http://localhost:8080/api/sites").cache(true).success([](const QString &response) {
+                qDebug().noquote() << response;
+            }).complete([] {
+                HttpCacheStats stats = HttpClient::cacheStats();
+                qDebug().noquote() << QString("hits: %1, revalidated: %2, misses: %3, coalesced: %4")
+                                      .arg(stats.hits).arg(stats.revalidated).arg(stats.misses).arg(stats.coalesced);
+            }).get();
+        }
+    }
+
+    {
+        // [15] 优先级和并发限制: 批量请求使用 Bulk 优先级，用户等待的请求 (默认 Interactive) 不会被它们阻塞
+        HttpClient::setConcurrencyLimits(16, 6, 2);
+        HttpClient::setQueueLimit(3000);
+
+        for (int i = 0; i < 2000; ++i) {
+            HttpClient("http://localhost:8080/api/statistics").priority(HttpPriority::Bulk).param("id", i).get();
+        }
+
+        HttpClient("http://localhost:8080/api/signIn").param("examineeId", 1).success([](const QString &response) {
+            HttpSchedulerStats stats = HttpClient::schedulerStats();
+            qDebug().noquote() << response << QString("running: %1, queued bulk: %2").arg(stats.running).arg(stats.queuedBulk);
+        }).post();
+    }
+
+    {
+        // [16] 超时、重试和断路器: 5 秒没有数据则超时，超时或者 503 时最多重试 2 次，带幂等键的 POST 也可以重试
+        HttpClient::setCircuitBreaker(5, 10 * 1000);
+
+        HttpClient("http://localhost:8080/api/signIn").param("examineeId", 1)
+                .header("Idempotency-Key", "sign-in-1")
+                .timeout(5000).retry(2).idempotent(true)
+                .success([](const QString &response) {
+            qDebug().noquote() << response;
+        }).fail([](const HttpFailure &failure) {
+            qDebug().noquote() << int(failure.type) << failure.statusCode << failure.attempts << failure.message;
+        }).post();
+    }
+
+    {
+        // [17] 同一个主机的大量并发小请求使用 HTTP/2 共享一个连接，服务器不支持时回退到 HTTP/1.1
+        HttpClient::setHostProtocol("https://exam.example.com", HttpProtocol::Http2);
+
+        for (int i = 0; i < 50; ++i) {
+            HttpClient("https://exam.example.com/api/signIn").param("examineeId", i).protocolUsed([](HttpProtocol protocol) {
+                qDebug().noquote() << "protocol:" << int(protocol);
+            }).post();
+        }
+    }
+
+    {
+        // [18] 压缩请求体: 超过 1K 的 JSON 使用 gzip 压缩后发送，响应由 Qt 或者 HttpClient 自动解压
+        QString roster = "[{\"name\": \"Alice\", \"examineeId\": 1}, {\"name\": \"Bob\", \"examineeId\": 2}]";
+
+        HttpClient("http://localhost:8080/api/students").json(roster).compress(HttpContentEncoding::Gzip, 1024)
+                .success([](const QString &response) {
+            qDebug().noquote() << response;
+        }).put();
+    }
+
+    {
+        // [19] 请求的耗时和指标: 单个请求的 TTFB、总耗时，所有请求按主机和路由统计的 p50、p95、p99，导出为 Prometheus 的文本格式
+        HttpClient("http://localhost:8080/api/signIn").route("signIn").param("examineeId", 1).timing([](const HttpTiming &timing) {
+            qDebug().noquote() << timing.route << timing.statusCode << timing.queuedMs << timing.firstByteMs << timing.totalMs;
+        }).complete([] {
+            HttpClient::writeMetrics("http_client.prom");
+            qDebug().noquote() << HttpClient::metrics(HttpMetricsFormat::Json);
+        }).post();
+    }
+
     return a.exec();
 }
@@ -2,23 +2,62 @@
 #define CONFIGUTIL_H
 
 #include "util/Singleton.h"
+#include <QObject>
 #include <QVariant>
+#include <QString>
+#include <QStringList>
+#include <QMutex>
+#include <QSharedPointer>
 
-class QString;
-class QStringList;
-
-class JsonReader;
 class ScheduleDescription;
 class QSettings;
+class QTimer;
+class QFileSystemWatcher;
+
+/**
+ * data/config.json 解析后的配置，加载时一次性解析为字段，发布后不再修改
+ */
+struct ConfigSnapshot {
+    // 数据库
+    QString databaseType;
+    QString databaseHost;
+    QString databaseName;
+    QString databaseUsername;
+    QString databasePassword;
+    QString databaseTestOnBorrowSql;
+    bool    databaseTestOnBorrow = false;
+    int     databaseMaxWaitTime = 5000;
+    int     databaseMaxConnectionCount = 5;
+    int     databasePort = 0;
+    bool    databaseDebug = false;
+    QStringList databaseSqlFiles;
+    bool    signInWithFace = false;
+
+    // UI
+    QStringList qssFiles;
+    int layoutPadding = 10;
+    int layoutSpacing = 5;
+
+    // 其它
+    QString serverUrl;
+};
 
 /**
  * 用于读写配置文件:
  * 1. data/config.json: 存储配置的信息，例如数据库信息，QSS 文件的路径
+ *
+ * config.json 加载时解析为 ConfigSnapshot，getXxx() 只是访问它的字段。
+ * 使用 QFileSystemWatcher 监视 config.json，修改后重新解析并替换当前的 ConfigSnapshot，然后发射 configChanged()，
+ * 修改后的 config.json 无效时继续使用原来的配置。
+ * snapshot() 返回当前配置的 QSharedPointer，读取期间配置被替换也有效，需要一致的多个配置时使用同一个 snapshot()。
  */
-class ConfigUtil {
+class ConfigUtil : public QObject {
+    Q_OBJECT
     SINGLETON(ConfigUtil)
 
 public:
+    QSharedPointer<const ConfigSnapshot> snapshot() const; // 当前的配置
+
     ////////////////////////////////////////////////////////////////////////////
     /// 数据库信息
     ////////////////////////////////////////////////////////////////////////////
@@ -52,7 +91,14 @@ public:
     ////////////////////////////////////////////////////////////////////////////
     QString getServerUrl() const;
 
+signals:
+    void configChanged(); // config.json 修改后重新加载完成时发射
+
 private:
+    void reload(); // 重新加载 config.json，成功时替换当前的配置
+    void publish(ConfigSnapshot *snapshot); // 替换当前的配置
+    static ConfigSnapshot* load(const QString &path); // 解析配置文件，无效时返回 nullptr
+
     QVariant getGuiValue(const  QString &groupName, const QString &name, const QVariant &def = QVariant());
     void     setGuiValue(const  QString &groupName, const QString &name, const QVariant &value);
 
@@ -61,7 +107,11 @@ private:
 
 
 private:
-    JsonReader *config; // 使用Qt的数据封装模式，数据封装在.cpp文件里，暴露给客户的信息尽量少
+    QSharedPointer<const ConfigSnapshot> currentShared; // 当前的配置，snapshot() 加锁读取，release() 后仍然有效
+    mutable QMutex mutex;
+    QFileSystemWatcher *watcher;
+    QTimer *reloadTimer; // 修改后延迟重新加载，合并编辑器保存时的多次修改
+    int reloadRetries;   // 编辑器删除后再创建文件时，文件不存在的重试次数
     QSettings  *guiSettings;
 };
 
@@ -3,23 +3,92 @@
 #include <QDebug>
 #include <QFile>
 #include <QTextStream>
-#include <QRegularExpression>
+#include <QHash>
+#include <QReadWriteLock>
 #include <QJsonParseError>
 
+static const int JSON_PATH_CACHE_SIZE = 1024; // 缓存的编译后的路径的最大个数，超过时清空
+
+/*-----------------------------------------------------------------------------|
+ |                          JsonPath implementation                            |
+ |----------------------------------------------------------------------------*/
+JsonPath::JsonPath(const QString &path) : path(path) {
+    // 1. "" 和 "." 表示根节点，没有属性
+    // 2. 使用 . 分隔属性名字，属性名字后面的 [n] 解析为数组的下标
+
+    // [1] "" 和 "." 表示根节点，没有属性
+    if (path.isEmpty() || "." == path) {
+        return;
+    }
+
+    // [2] 使用 . 分隔属性名字，属性名字后面的 [n] 解析为数组的下标
+    const int size = path.size();
+    int pos = 0;
+
+    while (pos <= size) {
+        int end = pos;
+
+        while (end < size && path.at(end) != '.' && path.at(end) != '[') {
+            ++end;
+        }
+
+        Segment segment;
+        segment.key = path.mid(pos, end - pos);
+        segments.append(segment);
+
+        // 属性名字后面的多个下标，例如 matrix[1][2]
+        while (end < size && path.at(end) == '[') {
+            int close = path.indexOf(']', end);
+            bool ok = false;
+            Segment item;
+            item.index = (close > end) ? path.mid(end + 1, close - end - 1).toInt(&ok) : -1;
+
+            if (!ok || item.index < 0) {
+                valid = false;
+                return;
+            }
+
+            segments.append(item);
+            end = close + 1;
+        }
+
+        if (end < size && path.at(end) != '.') {
+            valid = false;
+            return;
+        }
+
+        pos = end + 1;
+
+        // 下标后面直接结束，不需要再添加空的属性名字
+        if (end >= size) {
+            break;
+        }
+    }
+}
+
 /*-----------------------------------------------------------------------------|
  |                         JsonPrivate implementation                          |
  |----------------------------------------------------------------------------*/
 struct JsonPrivate {
     JsonPrivate(const QString &jsonOrJsonFilePath, bool fromFile);
 
-    void remove(QJsonObject &parent, const QString &path); // 删除 path 对应的属性
-    void setValue(QJsonObject &parent, const QString &path, const QJsonValue &newValue); // 设置 path 的值
-    QJsonValue getValue(const QString &path, const QJsonObject &fromNode) const; // 获取 path 的值
+    JsonPath compile(const QString &path) const; // 取得缓存的编译后的路径，没有时编译并缓存
+
+    // 删除 path 中从第 i 段开始对应的属性，返回修改后的 node
+    QJsonValue removeValue(const QJsonValue &node, const JsonPath &path, int i);
+
+    // 设置 path 中从第 i 段开始对应的属性的值，返回修改后的 node
+    QJsonValue setValue(const QJsonValue &node, const JsonPath &path, int i, const QJsonValue &newValue);
+
+    QJsonValue getValue(const JsonPath &path, const QJsonObject &fromNode) const; // 获取 path 的值
 
     QJsonObject root;    // Json 的根节点
     QJsonDocument doc;   // Json 的文档对象
     bool valid = true;   // Json 是否有效
     QString errorString; // Json 无效时的错误信息
+
+    mutable QHash<QString, JsonPath> paths; // 编译后的路径，key 为路径的字符串
+    mutable QReadWriteLock pathsLock;
 };
 
 JsonPrivate::JsonPrivate(const QString &jsonOrJsonFilePath, bool fromFile) {
@@ -54,67 +123,109 @@ JsonPrivate::JsonPrivate(const QString &jsonOrJsonFilePath, bool fromFile) {
     }
 }
 
-// 删除 path 对应的属性
-void JsonPrivate::remove(QJsonObject &parent, const QString &path) {
-    const int indexOfDot   = path.indexOf('.');     // 第一个 . 的位置
-    const QString property = path.left(indexOfDot); // 第一个 . 之前的内容，如果 indexOfDot 是 -1 则返回整个字符串
-    const QString restPath = (indexOfDot>0) ? path.mid(indexOfDot+1) : QString(); // 第一个 . 后面的内容
-
-    if(restPath.isEmpty()) {
-        // restPath 为空, 说明 property 就是 path 中最后一个 . 右边的部分, 也就是要删除的属性
-        parent.remove(property);
+// 取得缓存的编译后的路径，没有时编译并缓存
+JsonPath JsonPrivate::compile(const QString &path) const {
+    {
+        QReadLocker locker(&pathsLock);
+        auto iter = paths.constFind(path);
+
+        if (iter != paths.constEnd()) {
+            return iter.value();
+        }
+    }
+
+    JsonPath compiled(path);
+    QWriteLocker locker(&pathsLock);
+
+    if (paths.size() >= JSON_PATH_CACHE_SIZE) {
+        paths.clear();
+    }
+
+    paths.insert(path, compiled);
+    return compiled;
+}
+
+// 删除属性，因为 toObject() 等返回的是对象的副本，对其修改不会改变原来的对象，所以返回修改后的副本，由调用者设置回去
+QJsonValue JsonPrivate::removeValue(const QJsonValue &node, const JsonPath &path, int i) {
+    const JsonPath::Segment &segment = path.getSegments().at(i);
+    const bool last = (i == path.getSegments().size() - 1); // 是否为要删除的属性
+
+    if (segment.index >= 0) {
+        QJsonArray array = node.toArray();
+
+        if (segment.index < array.size()) {
+            if (last) {
+                array.removeAt(segment.index);
+            } else {
+                array[segment.index] = removeValue(array.at(segment.index), path, i + 1);
+            }
+        }
+
+        return array;
     } else {
-        // 路径中间的属性，递归访问它的子属性
-        QJsonObject child = parent[property].toObject();
-        remove(child, restPath);
-        parent[property] = child;
+        QJsonObject object = node.toObject();
+
+        if (last) {
+            object.remove(segment.key);
+        } else if (object.contains(segment.key)) {
+            object[segment.key] = removeValue(object.value(segment.key), path, i + 1);
+        }
+
+        return object;
     }
 }
 
-// 使用递归+引用设置 Json 的值，因为 toObject() 等返回的是对象的副本，对其修改不会改变原来的对象，所以需要用引用来实现
-void JsonPrivate::setValue(QJsonObject &parent, const QString &path, const QJsonValue &newValue) {
-    const int indexOfDot   = path.indexOf('.');     // 第一个 . 的位置
-    const QString property = path.left(indexOfDot); // 第一个 . 之前的内容，如果 indexOfDot 是 -1 则返回整个字符串
-    const QString restPath = (indexOfDot>0) ? path.mid(indexOfDot+1) : QString(); // 第一个 . 后面的内容
+// 设置属性的值，不存在的属性会自动创建，数组的下标超出范围时使用 null 填充
+QJsonValue JsonPrivate::setValue(const QJsonValue &node, const JsonPath &path, int i, const QJsonValue &newValue) {
+    const JsonPath::Segment &segment = path.getSegments().at(i);
+    const bool last = (i == path.getSegments().size() - 1); // 是否为要设置的属性
+
+    if (segment.index >= 0) {
+        QJsonArray array = node.toArray();
 
-    QJsonValue fieldValue = parent[property];
+        while (array.size() <= segment.index) {
+            array.append(QJsonValue());
+        }
 
-    if(restPath.isEmpty()) {
-        // restPath 为空, 说明 property 就是 path 中最后一个 . 右边的部分, 也就是要设置的属性
-        parent[property] = newValue; // 如果不存在则会创建
+        array[segment.index] = last ? newValue : setValue(array.at(segment.index), path, i + 1, newValue);
+        return array;
     } else {
-        // 路径中间的属性，递归访问它的子属性
-        QJsonObject child = parent[property].toObject();
-        setValue(child, restPath, newValue);
-        parent[property] = child; // 因为 QJsonObject 操作的都是对象的副本，所以递归结束后需要保存起来再次设置回 parent
+        QJsonObject object = node.toObject();
+        object[segment.key] = last ? newValue : setValue(object.value(segment.key), path, i + 1, newValue);
+        return object;
     }
 }
 
 // 读取属性的值，如果 fromNode 为空，则从跟节点开始访问
-QJsonValue JsonPrivate::getValue(const QString &path, const QJsonObject &fromNode) const {
+QJsonValue JsonPrivate::getValue(const JsonPath &path, const QJsonObject &fromNode) const {
     // 1. 确定搜索的根节点，如果 fromNode 为空则搜索的根节点为 root
-    // 2. 把 path 使用分隔符 . 分解成多个属性名字
-    // 3. 从搜索的根节点开始向下查找到倒数第二个属性名字对应的 QJsonObject parent
-    //    如 "user.address.street"，要设置的属性为 street，它的 parent 是 address
-    // 4. 返回 parent 中属性名为倒数第一个属性名字对应的属性值
+    // 2. 按编译后的路径逐段向下查找，toObject() 和 toArray() 共享数据，不会复制对象，中间的属性不存在时返回 Undefined
+
+    if (!path.isValid()) {
+        return QJsonValue(QJsonValue::Undefined);
+    }
 
     // [1] 确定搜索的根节点，如果 fromNode 为空则搜索的根节点为 root
-    // [2] 把 path 使用分隔符 . 分解成多个属性名字
-    QJsonObject parent = fromNode.isEmpty() ? root : fromNode;
-    QStringList names  = path.split(QRegularExpression("\\."));
-
-    // [3] 从搜索的根节点开始向下查找到倒数第二个属性名字对应的 QJsonObject parent
-    int size = names.size();
-    for (int i = 0; i < size - 1; ++i) {
-        if (parent.isEmpty()) {
-            return QJsonValue();
-        }
+    QJsonValue node = fromNode.isEmpty() ? QJsonValue(root) : QJsonValue(fromNode);
 
-        parent = parent.value(names.at(i)).toObject();
+    // [2] 按编译后的路径逐段向下查找，toObject() 和 toArray() 共享数据，不会复制对象，中间的属性不存在时返回 Undefined
+    for (const JsonPath::Segment &segment : path.getSegments()) {
+        if (segment.index >= 0) {
+            if (!node.isArray()) {
+                return QJsonValue(QJsonValue::Undefined);
+            }
+
+            node = node.toArray().at(segment.index); // 超出范围时返回 Undefined
+        } else {
+            if (!node.isObject()) {
+                return QJsonValue(QJsonValue::Undefined);
+            }
+
+            node = node.toObject().value(segment.key);
+        }
     }
 
-    // [4] 返回 parent 中属性名为倒数第一个属性名字对应的属性值
-    return parent.value(names.last());
+    return node;
 }
 
 /*-----------------------------------------------------------------------------|
@@ -138,22 +249,54 @@ QString Json::errorString() const {
 }
 
 int Json::getInt(const QString &path, int def, const QJsonObject &fromNode) const {
-    return getJsonValue(path, fromNode).toInt(def);
+    return getInt(d->compile(path), def, fromNode);
 }
 
 bool Json::getBool(const QString &path, bool def, const QJsonObject &fromNode) const {
-    return getJsonValue(path, fromNode).toBool(def);
+    return getBool(d->compile(path), def, fromNode);
 }
 
 double Json::getDouble(const QString &path, double def, const QJsonObject &fromNode) const {
-    return getJsonValue(path, fromNode).toDouble(def);
+    return getDouble(d->compile(path), def, fromNode);
 }
 
 QString Json::getString(const QString &path, const QString &def, const QJsonObject &fromNode) const {
-    return getJsonValue(path, fromNode).toString(def);
+    return getString(d->compile(path), def, fromNode);
 }
 
 QStringList Json::getStringList(const QString &path, const QJsonObject &fromNode) const {
+    return getStringList(d->compile(path), fromNode);
+}
+
+QJsonArray Json::getJsonArray(const QString &path, const QJsonObject &fromNode) const {
+    return getJsonArray(d->compile(path), fromNode);
+}
+
+QJsonObject Json::getJsonObject(const QString &path, const QJsonObject &fromNode) const {
+    return getJsonObject(d->compile(path), fromNode);
+}
+
+QJsonValue Json::getJsonValue(const QString &path, const QJsonObject &fromNode) const {
+    return getJsonValue(d->compile(path), fromNode);
+}
+
+int Json::getInt(const JsonPath &path, int def, const QJsonObject &fromNode) const {
+    return getJsonValue(path, fromNode).toInt(def);
+}
+
+bool Json::getBool(const JsonPath &path, bool def, const QJsonObject &fromNode) const {
+    return getJsonValue(path, fromNode).toBool(def);
+}
+
+double Json::getDouble(const JsonPath &path, double def, const QJsonObject &fromNode) const {
+    return getJsonValue(path, fromNode).toDouble(def);
+}
+
+QString Json::getString(const JsonPath &path, const QString &def, const QJsonObject &fromNode) const {
+    return getJsonValue(path, fromNode).toString(def);
+}
+
+QStringList Json::getStringList(const JsonPath &path, const QJsonObject &fromNode) const {
     QStringList result;
     QJsonArray array = getJsonValue(path, fromNode).toArray();
 
@@ -165,26 +308,29 @@ QStringList Json::getStringList(const QString &path, const QJsonObject &fromNode
     return result;
 }
 
-QJsonArray Json::getJsonArray(const QString &path, const QJsonObject &fromNode) const {
+QJsonArray Json::getJsonArray(const JsonPath &path, const QJsonObject &fromNode) const {
     // 如果根节点是数组时特殊处理
-    if (("." == path || "" == path) && fromNode.isEmpty()) {
+    if (path.isRoot() && fromNode.isEmpty()) {
         return d->doc.array();
     }
 
     return getJsonValue(path, fromNode).toArray();
 }
 
-QJsonObject Json::getJsonObject(const QString &path, const QJsonObject &fromNode) const {
+QJsonObject Json::getJsonObject(const JsonPath &path, const QJsonObject &fromNode) const {
     return getJsonValue(path, fromNode).toObject();
 }
 
-QJsonValue Json::getJsonValue(const QString &path, const QJsonObject &fromNode) const {
+QJsonValue Json::getJsonValue(const JsonPath &path, const QJsonObject &fromNode) const {
     return d->getValue(path, fromNode);
 }
 
-
 void Json::set(const QString &path, const QJsonValue &value) {
-    d->setValue(d->root, path, value);
+    JsonPath compiled = d->compile(path);
+
+    if (compiled.isValid() && !compiled.isRoot()) {
+        d->root = d->setValue(d->root, compiled, 0, value).toObject();
+    }
 }
 
 void Json::set(const QString &path, const QStringList &strings) {
@@ -194,12 +340,16 @@ void Json::set(const QString &path, const QStringList &strings) {
         array.append(str);
     }
 
-    d->setValue(d->root, path, array);
+    set(path, QJsonValue(array));
 }
 
 // 删除 path 对应的属性
 void Json::remove(const QString &path) {
-    d->remove(d->root, path);
+    JsonPath compiled = d->compile(path);
+
+    if (compiled.isValid() && !compiled.isRoot()) {
+        d->root = d->removeValue(d->root, compiled, 0).toObject();
+    }
 }
 
 // 把 JSON 保存到 path 指定的文件
@@ -5,9 +5,39 @@
 #include <QJsonValue>
 #include <QJsonObject>
 #include <QJsonDocument>
+#include <QVector>
 
 struct JsonPrivate;
 
+/**
+ * 编译后的 JSON 路径，构造时把 "user.address.street" 分解为属性名字，"user.childrenNames[1]" 中的 [1] 解析为数组的下标，
+ * 查找时不需要再分解路径。频繁访问的路径可以定义为静态变量，例如:
+ *     static const JsonPath HOST("database.host");
+ *     json.getString(HOST);
+ *
+ * 路径为 "" 或者 "." 时表示查找的根节点。
+ */
+class JsonPath {
+public:
+    // 路径中的一段，index 大于等于 0 时为数组的下标，否则为属性名字 key
+    struct Segment {
+        QString key;
+        int index = -1;
+    };
+
+    explicit JsonPath(const QString &path = QString());
+
+    bool isValid() const { return valid; }  // 路径的格式是否正确，例如 "a[x]" 是无效的
+    bool isRoot() const { return segments.isEmpty(); } // 是否表示查找的根节点
+    const QVector<Segment>& getSegments() const { return segments; }
+    const QString& toString() const { return path; }
+
+private:
+    QString path;
+    QVector<Segment> segments;
+    bool valid = true;
+};
+
 /**
  * Qt 的 JSON API 读写多层次的属性不够方便，这个类的目的就是能够使用带 "." 的路径格式访问 Json 的属性，例如
  * "id" 访问的是根节点下的 id，"user.address.street" 访问根节点下 user 的 address 的 street 的属性。
@@ -30,6 +60,7 @@ struct JsonPrivate;
  * 访问 id:     json.getInt("id")，返回 18191
  * 访问 street: json.getString("user.address.street")，返回 "Wiessenstrasse"
  * 访问 childrenNames: json.getStringList("user.childrenNames") 得到字符串列表("Alice", "Bob", "John")
+ * 访问数组中的元素: json.getString("user.childrenNames[1]")，返回 "Bob"
  * 设置 "user.address.postCode" 则可以使用 json.set("user.address.postCode", "056231")
  * 如果根节点是数组，则使用 json.getJsonArray(".") 获取
  *
@@ -39,6 +70,8 @@ struct JsonPrivate;
  *
  * 如果要修改的属性不存在，则会自动的先创建属性，然后设置它的值。
  *
+ * 字符串的路径第一次使用时编译为 JsonPath 并缓存，之后只需要查找缓存，也可以直接传入 JsonPath。
+ *
  * 注意: JSON 文件要使用 UTF-8 编码。
  */
 class Json {
@@ -79,6 +112,17 @@ public:
     QJsonValue  getJsonValue( const QString &path, const QJsonObject &fromNode = QJsonObject()) const;
     QJsonObject getJsonObject(const QString &path, const QJsonObject &fromNode = QJsonObject()) const;
 
+    // 使用编译后的路径访问属性，参数同上
+    int         getInt(const JsonPath &path, int def = 0, const QJsonObject &fromNode = QJsonObject()) const;
+    bool        getBool(const JsonPath &path, bool def = false, const QJsonObject &fromNode = QJsonObject()) const;
+    double      getDouble(const JsonPath &path, double def = 0.0, const QJsonObject &fromNode = QJsonObject()) const;
+    QString     getString(const JsonPath &path, const QString &def = QString(), const QJsonObject &fromNode = QJsonObject()) const;
+    QStringList getStringList(const JsonPath &path, const QJsonObject &fromNode = QJsonObject()) const;
+
+    QJsonArray  getJsonArray( const JsonPath &path, const QJsonObject &fromNode = QJsonObject()) const;
+    QJsonValue  getJsonValue( const JsonPath &path, const QJsonObject &fromNode = QJsonObject()) const;
+    QJsonObject getJsonObject(const JsonPath &path, const QJsonObject &fromNode = QJsonObject()) const;
+
     /**
      * @brief 设置 path 对应的 Json 属性的值
      * @param path  path 带 "." 的路径格
@@ -32,6 +32,11 @@ int main(int argc, char *argv[]) {
     // 第二级的数组
     qDebug() << json.getStringList("admin.roles");
 
+    // 数组中的元素，频繁访问的路径使用编译后的 JsonPath
+    static const JsonPath FIRST_EXAMINEE("roomEnrollmentList[0].examineeName");
+    qDebug() << json.getString("admin.roles[1]");
+    qDebug() << json.getString(FIRST_EXAMINEE);
+
     // 第二级的数组中的值
     QJsonArray array = json.getJsonArray("roomEnrollmentList");
     QJsonObject fromNode = array.at(0).toObject();
@@ -0,0 +1,53 @@
+#ifndef LOGFORMAT_H
+#define LOGFORMAT_H
+
+#include <QtGlobal>
+
+/**
+ * 二进制日志文件的格式，LogHandler 写入，logdecode 读取，使用 QDataStream (Qt_5_6，小端) 编码:
+ *
+ * 文件头: quint32 LOG_BINARY_MAGIC, quint16 LOG_BINARY_VERSION，只在新文件的开头写入一次
+ *
+ * 记录: quint8 记录的类型，然后是记录的内容
+ *     LOG_RECORD_ANCHOR : qint64 epochMs, qint64 elapsedNs
+ *         每次打开文件时写入，表示单调时钟 elapsedNs 对应的时间是 epochMs，
+ *         之后的日志的时间为 epochMs + (日志的 elapsedNs - 这里的 elapsedNs) / 1000000
+ *     LOG_RECORD_SITE   : quint32 siteId, QByteArray file, qint32 line, QByteArray function, QByteArray category
+ *         输出日志的位置，每个位置第一次输出日志时写入一次，打开文件时重新编号
+ *     LOG_RECORD_MESSAGE: quint32 siteId, qint64 elapsedNs, quint8 type, quint64 threadId, QByteArray msg
+ *         一条日志，type 为 QtMsgType，msg 为 UTF-8
+ */
+static const quint32 LOG_BINARY_MAGIC   = 0x514C4F47; // "QLOG"
+static const quint16 LOG_BINARY_VERSION = 1;
+
+enum LogRecordType {
+    LOG_RECORD_ANCHOR  = 'A',
+    LOG_RECORD_SITE    = 'S',
+    LOG_RECORD_MESSAGE = 'M'
+};
+
+// 日志级别的名字，QtMsgType 转为字符串
+inline const char* logLevelName(int type) {
+    switch (type) {
+    case QtDebugMsg:    return "DEBUG";
+    case QtInfoMsg:     return "INFO ";
+    case QtWarningMsg:  return "WARN ";
+    case QtCriticalMsg: return "ERROR";
+    case QtFatalMsg:    return "FATAL";
+    default:            return "";
+    }
+}
+
+// 日志级别的高低，QtMsgType 的值不是按级别排列的 (QtInfoMsg 最大)
+inline int logLevelRank(int type) {
+    switch (type) {
+    case QtDebugMsg:    return 0;
+    case QtInfoMsg:     return 1;
+    case QtWarningMsg:  return 2;
+    case QtCriticalMsg: return 3;
+    case QtFatalMsg:    return 4;
+    default:            return 0;
+    }
+}
+
+#endif // LOGFORMAT_H
@@ -1,55 +1,606 @@
 #include "LogHandler.h"
+#include "LogFormat.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <QDebug>
 #include <QDateTime>
 #include <QMutexLocker>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QThread>
 #include <QtGlobal>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
-#include <QTimer>
 #include <QTextStream>
+#include <QDataStream>
+#include <QHash>
+#include <QSaveFile>
+#include <QRunnable>
+#include <QThreadPool>
 #include <iostream>
+#include <utility>
+#include <algorithm>
 #include <QTextCodec>
+#include <QLoggingCategory>
+#include <signal.h>
+
+static const int LOG_QUEUE_CAPACITY    = 8192; // 队列的容量，必须是 2 的幂
+static const int LOG_SAMPLE_RATE       = 100;  // Sample 策略下队列满时，DEBUG 和 INFO 每多少条保留一条
+static const int LOG_WRITER_IDLE_WAIT  = 50;   // 队列为空时写日志的线程最长等待的时间，单位为毫秒
+static const int LOG_PRODUCER_WAKE_BATCH = 256; // 写日志的线程每取出多少条日志唤醒一次队列满时等待的线程
+static const int LOG_ROTATE_CHECK_TIME = 1000; // 检查日志文件是否需要重命名的间隔，单位为毫秒
+static const int LOG_GZIP_CHUNK_SIZE   = 4 * 1024 * 1024; // 压缩备份文件时每次读取的字节数，每块压缩为一个 gzip member
+
+// 当前线程是否为写日志的线程，写日志的线程中输出的日志直接写入，不放入队列，避免队列满时自己等待自己
+static thread_local bool inWriterThread = false;
+
+/************************************************************************************************************
+ *                                                                                                          *
+ *                                                LogRecord                                                 *
+ *                                                                                                          *
+ ***********************************************************************************************************/
+/**
+ * 一条日志，调用 qDebug 的线程中只保存原始的数据，在写日志的线程中格式化。
+ * QMessageLogContext 的 file、function 和 category 不一定是字符串常量 (例如 QML 的 console.log 使用临时的 QByteArray)，
+ * 消息处理函数返回后可能就无效了，所以在调用 qDebug 的线程中复制。
+ */
+struct LogRecord {
+    QtMsgType   type = QtDebugMsg;
+    qint64      elapsed = 0;        // 输出日志的时间，单调时钟的纳秒数
+    quint64     threadId = 0;       // 输出日志的线程
+    QByteArray  file;
+    QByteArray  function;
+    QByteArray  category;
+    int         line = 0;
+    QString     msg;
+};
+
+/**
+ * 二进制日志中输出日志的位置，同一个位置只写入一次，之后的日志使用它的编号，按内容比较
+ */
+struct LogSite {
+    QByteArray file;
+    QByteArray function;
+    QByteArray category;
+    int line;
+
+    bool operator==(const LogSite &other) const {
+        return line == other.line && file == other.file && function == other.function && category == other.category;
+    }
+};
+
+inline uint qHash(const LogSite &site, uint seed = 0) {
+    return qHash(site.file, seed) ^ qHash(site.function) ^ qHash(site.category) ^ uint(site.line);
+}
+
+/************************************************************************************************************
+ *                                                                                                          *
+ *                                                 LogQueue                                                 *
+ *                                                                                                          *
+ ***********************************************************************************************************/
+/**
+ * 有界的多生产者单消费者无锁队列 (Dmitry Vyukov 的 bounded MPMC queue，只有一个消费者)。
+ *
+ * 每个槽位有一个序号: 等于 pos 时可以写入位置 pos，等于 pos + 1 时位置 pos 已经写入可以读取，
+ * 生产者使用 CAS 抢占写入的位置，写完后发布序号，消费者读完后把序号设置为 pos + 容量，表示下一轮可以写入。
+ */
+class LogQueue {
+public:
+    explicit LogQueue(int capacity) : slots(new Slot[capacity]), mask(quint32(capacity - 1)) {
+        for (int i = 0; i < capacity; ++i) {
+            slots[i].sequence.store(quint32(i));
+        }
+    }
+
+    ~LogQueue() {
+        delete[] slots;
+    }
+
+    // 放入队列，队列满时返回 false，成功时 record 被移走
+    bool tryPush(LogRecord &record) {
+        quint32 pos = enqueuePos.load();
+
+        for (;;) {
+            Slot &slot = slots[pos & mask];
+            qint32 diff = qint32(slot.sequence.loadAcquire() - pos);
+
+            if (diff == 0) {
+                if (enqueuePos.testAndSetRelaxed(pos, pos + 1, pos)) {
+                    slot.record = std::move(record);
+                    slot.sequence.storeRelease(pos + 1);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // 队列满了
+            } else {
+                pos = enqueuePos.load(); // 其他生产者已经抢占了这个位置
+            }
+        }
+    }
+
+    // 从队列中取出，只能在消费者线程中调用，队列为空时返回 false
+    bool tryPop(LogRecord *record) {
+        quint32 pos = dequeuePos.load();
+        Slot &slot  = slots[pos & mask];
+
+        if (qint32(slot.sequence.loadAcquire() - (pos + 1)) < 0) {
+            return false;
+        }
+
+        *record = std::move(slot.record);
+        slot.record.msg = QString();
+        slot.sequence.storeRelease(pos + mask + 1);
+        dequeuePos.store(pos + 1);
+
+        return true;
+    }
+
+    // 只能在消费者线程中调用
+    bool isEmpty() const {
+        quint32 pos = dequeuePos.load();
+        return qint32(slots[pos & mask].sequence.loadAcquire() - (pos + 1)) < 0;
+    }
+
+    quint32 enqueuePosition() const { return enqueuePos.load(); } // 已经抢占的位置
+    quint32 dequeuePosition() const { return dequeuePos.load(); } // 已经读取的位置
+
+private:
+    struct Slot {
+        QAtomicInteger<quint32> sequence;
+        LogRecord record;
+    };
+
+    Slot *slots;
+    quint32 mask;
+    alignas(64) QAtomicInteger<quint32> enqueuePos; // 生产者和消费者的位置放在不同的 cache line，避免伪共享
+    alignas(64) QAtomicInteger<quint32> dequeuePos;
+};
+
+/************************************************************************************************************
+ *                                                                                                          *
+ *                                               LogArchiver                                                *
+ *                                                                                                          *
+ ***********************************************************************************************************/
+/**
+ * 日志文件轮转和保留的设置
+ */
+struct LogRotation {
+    qint64 maxFileSize   = 10 * 1024 * 1024; // 日志文件超过这个大小时轮转，小于等于 0 时只按日期轮转
+    int    maxBackupCount = 30;   // 最多保留的备份文件数，小于等于 0 时不限制
+    int    maxBackupDays  = 30;   // 备份文件最多保留的天数，小于等于 0 时不限制
+    bool   compress       = true; // 是否使用 gzip 压缩备份文件
+};
+
+/**
+ * 在后台线程中压缩备份的日志文件 yyyy-MM-dd[.n].log (二进制日志为 .blog) 为 yyyy-MM-dd[.n].log.gz，然后删除超过保留数量和天数的备份文件，
+ * 写日志的线程只重命名日志文件，不复制和压缩数据。
+ */
+class LogArchiver : public QRunnable {
+public:
+    LogArchiver(const QDir &logDir, const LogRotation &rotation) : logDir(logDir), rotation(rotation) {}
+
+    void run() override;
+
+    static bool gzip(const QString &source, const QString &target); // 使用 gzip 格式压缩文件
+
+private:
+    static quint32 crc32(const QByteArray &data, quint32 crc = 0);   // gzip 使用的 CRC-32
+
+    // 备份文件的日期和序号，从文件名 yyyy-MM-dd[.n].log[.gz] 中取得，文件名不是这个格式时使用修改时间的日期
+    static QPair<QDate, int> backupOrder(const QFileInfo &info);
+
+    QDir logDir;
+    LogRotation rotation;
+};
+
+void LogArchiver::run() {
+    // 1. 压缩所有还没有压缩的备份文件 (包括程序上次退出时没有压缩完的)，压缩成功后删除原文件
+    // 2. 备份文件按文件名中的日期和序号从新到旧排序，删除超过保留数量和天数的
+    //    (不使用修改时间，压缩后的文件的修改时间是压缩的时间)
+
+    // [[1]] 压缩所有还没有压缩的备份文件 (包括程序上次退出时没有压缩完的)，压缩成功后删除原文件
+    if (rotation.compress) {
+        for (const QFileInfo &info : logDir.entryInfoList(QStringList() << "*.log" << "*.blog", QDir::Files)) {
+            if (gzip(info.absoluteFilePath(), info.absoluteFilePath() + ".gz")) {
+                QFile::remove(info.absoluteFilePath());
+            }
+        }
+    }
+
+    // [[2]] 备份文件按文件名中的日期和序号从新到旧排序，删除超过保留数量和天数的
+    QDate expired = QDate::currentDate().addDays(-rotation.maxBackupDays);
+    QFileInfoList backups = logDir.entryInfoList(QStringList() << "*.log" << "*.log.gz" << "*.blog" << "*.blog.gz",
+                                                 QDir::Files);
+
+    std::sort(backups.begin(), backups.end(), [](const QFileInfo &a, const QFileInfo &b) {
+        return backupOrder(a) > backupOrder(b);
+    });
+
+    for (int i = 0; i < backups.size(); ++i) {
+        bool tooMany = rotation.maxBackupCount > 0 && i >= rotation.maxBackupCount;
+        bool tooOld  = rotation.maxBackupDays > 0 && backupOrder(backups.at(i)).first < expired;
+
+        if (tooMany || tooOld) {
+            QFile::remove(backups.at(i).absoluteFilePath());
+        }
+    }
+}
+
+// 备份文件的日期和序号，从文件名 yyyy-MM-dd[.n].log[.gz] 中取得
+QPair<QDate, int> LogArchiver::backupOrder(const QFileInfo &info) {
+    QStringList parts = info.fileName().split('.');
+    QDate date = QDate::fromString(parts.value(0), "yyyy-MM-dd");
+    bool numbered = false;
+    int n = parts.value(1).toInt(&numbered);
+
+    if (!date.isValid()) {
+        return qMakePair(info.lastModified().date(), 0);
+    }
+
+    return qMakePair(date, numbered ? n : 0);
+}
+
+// 使用 gzip 格式压缩文件: 每块使用 qCompress 压缩，去掉 zlib 的头和校验码得到 deflate 的数据，
+// 再加上 gzip 的头和尾组成一个 gzip member，多个 member 连接在一起仍然是合法的 gzip 文件
+bool LogArchiver::gzip(const QString &source, const QString &target) {
+    static const char header[10] = { '\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\xff' };
+    static const char emptyDeflate[2] = { 3, 0 }; // 空数据的 deflate
+
+    QFile in(source);
+    QSaveFile out(target);
+
+    if (!in.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    do {
+        QByteArray chunk = in.read(LOG_GZIP_CHUNK_SIZE);
+        QByteArray zlib  = qCompress(chunk);
+
+        // qCompress 的结果: 4 字节的原始长度 + 2 字节的 zlib 头 + deflate 的数据 + 4 字节的 Adler-32
+        QByteArray deflate = zlib.size() > 10 ? zlib.mid(6, zlib.size() - 10) : QByteArray(emptyDeflate, 2);
+        quint32 crc  = crc32(chunk);
+        quint32 size = quint32(chunk.size());
+        char trailer[8];
+
+        for (int i = 0; i < 4; ++i) {
+            trailer[i]     = char((crc  >> (8 * i)) & 0xFF);
+            trailer[i + 4] = char((size >> (8 * i)) & 0xFF);
+        }
+
+        out.write(header, 10);
+        out.write(deflate);
+        out.write(trailer, 8);
+    } while (!in.atEnd());
+
+    return in.error() == QFileDevice::NoError && out.commit();
+}
+
+// gzip 使用的 CRC-32
+quint32 LogArchiver::crc32(const QByteArray &data, quint32 crc) {
+    static quint32 table[256] = { 0 };
+    static bool initialized = [] {
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+
+            table[i] = c;
+        }
+
+        return true;
+    }();
+    Q_UNUSED(initialized)
+
+    crc = ~crc;
+
+    for (char ch : data) {
+        crc = table[(crc ^ quint8(ch)) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+/************************************************************************************************************
+ *                                                                                                          *
+ *                                            LogCategoryFilter                                             *
+ *                                                                                                          *
+ ***********************************************************************************************************/
+/**
+ * 按分类设置日志的最低级别，级别从配置文件读取，安装为 QLoggingCategory 的过滤函数。
+ * Qt 在分类注册和过滤函数安装时调用过滤函数设置分类每个级别是否开启，qCDebug 等只检查分类的开关，
+ * 关闭时不计算 << 后面的参数，也不调用消息处理函数，所以关闭的日志几乎没有开销。
+ *
+ * 重新加载: 写日志的线程定时检查配置文件的修改时间，Unix 下收到 SIGHUP 时也重新加载，或者调用 LogHandler::reloadCategoryConfig()。
+ */
+struct LogCategoryFilter {
+    static void filter(QLoggingCategory *category); // QLoggingCategory 的过滤函数
+    static void load(const QString &path);          // 设置配置文件并加载
+    static void reload();                           // 重新加载配置文件，并重新设置所有分类的开关
+    static void checkReload();                      // 配置文件修改了或者收到了 SIGHUP 时重新加载，写日志的线程中定时调用
+    static int  levelOf(const QString &name);       // 匹配分类的最低级别，-1 表示没有匹配的，调用时需要持有 mutex
+
+#if defined(Q_OS_UNIX)
+    static void onSignal(int);
+#endif
+
+    static QString path;              // 配置文件的路径
+    static QDateTime lastModified;    // 加载时配置文件的修改时间
+    static QHash<QString, int> levels; // Key 为分类或者以 .* 结尾的前缀，value 为最低级别的 logLevelRank
+    static QLoggingCategory::CategoryFilter previous; // Qt 默认的过滤函数，没有匹配的分类时使用
+    static QMutex mutex;
+    static volatile sig_atomic_t reloadRequested; // 信号处理函数中设置
+};
+
+QString LogCategoryFilter::path;
+QDateTime LogCategoryFilter::lastModified;
+QHash<QString, int> LogCategoryFilter::levels;
+QLoggingCategory::CategoryFilter LogCategoryFilter::previous = nullptr;
+QMutex LogCategoryFilter::mutex;
+volatile sig_atomic_t LogCategoryFilter::reloadRequested = 0;
+
+// QLoggingCategory 的过滤函数
+void LogCategoryFilter::filter(QLoggingCategory *category) {
+    int level = -1;
+    QLoggingCategory::CategoryFilter defaultFilter = nullptr;
+
+    {
+        QMutexLocker locker(&mutex);
+        level = levelOf(QString::fromLatin1(category->categoryName()));
+        defaultFilter = previous;
+    }
+
+    if (level < 0) {
+        if (nullptr != defaultFilter) {
+            defaultFilter(category);
+        }
+
+        return;
+    }
+
+    category->setEnabled(QtDebugMsg,    level <= logLevelRank(QtDebugMsg));
+    category->setEnabled(QtInfoMsg,     level <= logLevelRank(QtInfoMsg));
+    category->setEnabled(QtWarningMsg,  level <= logLevelRank(QtWarningMsg));
+    category->setEnabled(QtCriticalMsg, level <= logLevelRank(QtCriticalMsg));
+}
+
+// 匹配分类的最低级别，优先使用完全相同的，然后是最长的前缀，最后是 *
+int LogCategoryFilter::levelOf(const QString &name) {
+    auto iter = levels.constFind(name);
+
+    if (iter != levels.constEnd()) {
+        return iter.value();
+    }
+
+    for (int pos = name.lastIndexOf('.'); pos > 0; pos = name.lastIndexOf('.', pos - 1)) {
+        iter = levels.constFind(name.left(pos) + ".*");
+
+        if (iter != levels.constEnd()) {
+            return iter.value();
+        }
+    }
+
+    return levels.value("*", -1);
+}
+
+// 设置配置文件并加载
+void LogCategoryFilter::load(const QString &path) {
+    {
+        QMutexLocker locker(&mutex);
+        LogCategoryFilter::path = path;
+    }
+
+#if defined(Q_OS_UNIX)
+    signal(SIGHUP, onSignal);
+#endif
+
+    reload();
+}
+
+// 重新加载配置文件，并重新设置所有分类的开关
+void LogCategoryFilter::reload() {
+    // 1. 读取配置文件，每行为 分类=级别，# 开头的行为注释
+    // 2. 替换所有的级别
+    // 3. 重新安装过滤函数，Qt 会对所有已经注册的分类调用过滤函数
+
+    // [[1]] 读取配置文件，每行为 分类=级别，# 开头的行为注释
+    QString configPath;
+
+    {
+        QMutexLocker locker(&mutex);
+        configPath = path;
+    }
+
+    QStringList names = QStringList() << "debug" << "info" << "warn" << "error" << "off"; // off 只保留 FATAL，Qt 不能关闭 FATAL
+    QHash<QString, int> newLevels;
+    QFile file(configPath);
+
+    if (!configPath.isEmpty() && file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream in(&file);
+        in.setCodec("UTF-8");
+
+        while (!in.atEnd()) {
+            QString line = in.readLine().trimmed();
+            int eq = line.indexOf('=');
+
+            if (line.isEmpty() || line.startsWith('#') || eq <= 0) {
+                continue;
+            }
+
+            int level = names.indexOf(line.mid(eq + 1).trimmed().toLower());
+
+            if (level >= 0) {
+                newLevels.insert(line.left(eq).trimmed(), level);
+            }
+        }
+    }
+
+    // [[2]] 替换所有的级别
+    {
+        QMutexLocker locker(&mutex);
+        levels = newLevels;
+        lastModified = QFileInfo(configPath).lastModified();
+    }
+
+    // [[3]] 重新安装过滤函数，Qt 会对所有已经注册的分类调用过滤函数 (不能持有 mutex，过滤函数中会使用)。
+    //      第一次安装时 Qt 调用过滤函数时还不知道默认的过滤函数，保存后再安装一次，让没有匹配的分类使用默认的过滤函数
+    QLoggingCategory::CategoryFilter old = QLoggingCategory::installFilter(filter);
+
+    if (old != filter) {
+        {
+            QMutexLocker locker(&mutex);
+            previous = old;
+        }
+
+        QLoggingCategory::installFilter(filter);
+    }
+}
+
+// 配置文件修改了或者收到了 SIGHUP 时重新加载
+void LogCategoryFilter::checkReload() {
+    bool modified = false;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        if (path.isEmpty()) {
+            return;
+        }
+
+        modified = QFileInfo(path).lastModified() != lastModified;
+    }
+
+    if (modified || reloadRequested) {
+        reloadRequested = 0;
+        reload();
+    }
+}
+
+#if defined(Q_OS_UNIX)
+// 信号处理函数中只能设置标记，由写日志的线程重新加载
+void LogCategoryFilter::onSignal(int) {
+    reloadRequested = 1;
+}
+#endif
 
 /************************************************************************************************************
  *                                                                                                          *
  *                                               LogHandlerPrivate                                          *
  *                                                                                                          *
  ***********************************************************************************************************/
+class LogWriter;
+
 struct LogHandlerPrivate {
     LogHandlerPrivate();
     ~LogHandlerPrivate();
 
-    // 打开日志文件 log.txt，如果日志文件不是当天创建的，则使用创建日期把其重命名为 yyyy-MM-dd.log，并重新创建一个 log.txt
+    // 打开日志文件 log.txt，如果日志文件不是当天创建的或者超过了最大的大小，则把其重命名为 yyyy-MM-dd[.n].log，并重新创建一个 log.txt
     void openAndBackupLogFile();
 
+    // 打开日志文件，二进制格式时新文件写入文件头，每次打开都写入时间的锚点
+    void openLogFile(QIODevice::OpenMode mode);
+
+    // 把日志文件重命名为备份文件 yyyy-MM-dd[.n].log，并在后台压缩和清理备份文件
+    void backupLogFile();
+
+    // 关闭日志文件
+    void closeLogFile();
+
+    // 使用日志的日期生成备份文件名 yyyy-MM-dd.log，已经存在时加上序号 yyyy-MM-dd.n.log
+    QString backupLogPath() const;
+
+    // 日志文件名 log.txt，二进制格式为 log.bin
+    QString logFileName() const;
+
     // 消息处理函数
     static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg);
 
     // 如果日志所在目录不存在，则创建
     void makeSureLogDirectory() const;
 
+    void enqueue(LogRecord &record); // 放入队列，队列满时按策略处理
+    void wakeWriter();               // 写日志的线程在等待时唤醒它
+    void wakeProducers();            // 唤醒队列满时等待空间的线程
+    void flush();                    // 等待已经放入队列的日志都写入文件
+    void run();                      // 写日志的线程: 从队列中取出日志写入控制台和文件
+    void write(const LogRecord &record); // 格式化并输出一条日志，只在写日志的线程中调用
+    void writeBinary(const LogRecord &record); // 使用二进制格式写入日志文件
+    void flushOutput();              // 刷新控制台和日志文件的缓冲
+
     QDir   logDir;              // 日志文件夹
-    QTimer renameLogFileTimer;  // 重命名日志文件使用的定时器
-    QTimer flushLogFileTimer;   // 刷新输出到日志文件的定时器
     QDate  logFileCreatedDate;  // 日志文件创建的时间
+    QFile *logFile = nullptr;   // 日志文件
+    QTextStream *logOut = nullptr; // 输出日志的 QTextStream
+    QDataStream *binOut = nullptr; // 二进制格式时输出日志的 QDataStream
+    QHash<LogSite, quint32> sites; // 二进制日志中已经写入的位置和它的编号，打开文件时清空
+    int          format;        // 安装时的日志格式
+    LogRotation  rotation;      // 安装时的轮转设置
+    QThreadPool  archivePool;   // 压缩和删除备份文件的线程
+
+    LogQueue   queue;
+    LogWriter *writer;
+    QAtomicInt dropped;         // 丢弃的日志的条数，写日志的线程输出后清零
+    QAtomicInt sampleCounter;   // Sample 策略下队列满时的计数
+    QAtomicInt stopping;        // 为 1 时写日志的线程写完队列中的日志后退出
+    QAtomicInt sleeping;        // 写日志的线程是否在等待
+    QAtomicInt blocked;         // 队列满时等待空间的线程数
+    QAtomicInteger<quint32> flushedPos; // 已经写入文件的位置
+    QMutex         waitMutex;
+    QWaitCondition wakeup;      // 唤醒写日志的线程
+    QWaitCondition flushed;     // 写日志的线程写完一批日志后唤醒 flush() 中等待的线程
+    QWaitCondition spaceAvailable; // 写日志的线程取出日志后唤醒队列满时等待的线程
 
-    static QFile *logFile;      // 日志文件
-    static QTextStream *logOut; // 输出日志的 QTextStream，使用静态对象就是为了减少函数调用的开销
-    static QMutex logMutex;     // 同步使用的 mutex
+    QElapsedTimer clock;        // 日志的单调时钟
+    qint64  clockEpochMs = 0;   // 单调时钟的 0 对应的时间，写日志的线程定时校准
+    qint64  lastSecond = -1;    // 缓存格式化后的时间，同一秒内的日志不需要再格式化
+    QString lastTimeText;
+
+    static QAtomicInt policy;    // 队列满时的处理策略，安装前也可以设置
+    static LogRotation rotationSettings; // 轮转设置，安装时复制到 rotation
+    static int formatSettings;   // 日志格式，安装时复制到 format
+    static QAtomicPointer<LogHandlerPrivate> instance; // 消息处理函数使用的对象
+    static QAtomicInt inHandler; // 正在执行消息处理函数的线程数，卸载时等待它们结束
+    static QMutex logMutex;      // 同步安装和卸载使用的 mutex
+};
+
+/**
+ * 写日志的线程
+ */
+class LogWriter : public QThread {
+public:
+    explicit LogWriter(LogHandlerPrivate *d) : d(d) {}
+
+protected:
+    void run() override {
+        inWriterThread = true;
+        d->run();
+    }
+
+private:
+    LogHandlerPrivate *d;
 };
 
 // 初始化 static 变量
 QMutex LogHandlerPrivate::logMutex;
-QFile* LogHandlerPrivate::logFile = nullptr;
-QTextStream* LogHandlerPrivate::logOut = nullptr;
+QAtomicInt LogHandlerPrivate::inHandler;
+QAtomicInt LogHandlerPrivate::policy(LogHandler::Block);
+LogRotation LogHandlerPrivate::rotationSettings;
+int LogHandlerPrivate::formatSettings = LogHandler::Text;
+QAtomicPointer<LogHandlerPrivate> LogHandlerPrivate::instance;
 
-LogHandlerPrivate::LogHandlerPrivate() {
+LogHandlerPrivate::LogHandlerPrivate()
+    : format(formatSettings), rotation(rotationSettings), queue(LOG_QUEUE_CAPACITY), writer(new LogWriter(this)) {
+    clock.start();
+    clockEpochMs = QDateTime::currentMSecsSinceEpoch();
+    archivePool.setMaxThreadCount(1); // 一个线程依次压缩
     logDir.setPath("log"); // TODO: 日志文件夹的路径，为 exe 所在目录下的 log 文件夹，可从配置文件读取
-    QString logPath = logDir.absoluteFilePath("log.txt"); // 日志的路径
+    QString logPath = logDir.absoluteFilePath(logFileName()); // 日志的路径
     // 日志文件创建的时间
     // QFileInfo::created(): On most Unix systems, this function returns the time of the last status change.
     // 所以不能运行时使用这个函数检查创建时间，因为会在运行时变化，于是在程序启动时保存下日志文件的最后修改时间，
@@ -57,91 +608,145 @@ LogHandlerPrivate::LogHandlerPrivate() {
     // 如果是 Qt 5.10 后，lastModified() 可以使用 birthTime() 代替
     logFileCreatedDate = QFileInfo(logPath).lastModified().date();
 
-    // 打开日志文件，如果不是当天创建的，备份已有日志文件
+    // 打开日志文件，如果不是当天创建的，备份已有日志文件，然后在后台压缩和清理以前的备份文件
     openAndBackupLogFile();
+    archivePool.start(new LogArchiver(logDir, rotation));
 
-    // 十分钟检查一次日志文件创建时间
-    renameLogFileTimer.setInterval(1000 * 60 * 10); // TODO: 可从配置文件读取
-    // renameLogFileTimer.setInterval(1000); // 为了快速测试看到日期变化后是否新创建了对应的日志文件，所以 1 秒检查一次
-    renameLogFileTimer.start();
-    QObject::connect(&renameLogFileTimer, &QTimer::timeout, [this] {
-        QMutexLocker locker(&LogHandlerPrivate::logMutex);
-        openAndBackupLogFile();
-    });
-
-    // 定时刷新日志输出到文件，尽快的能在日志文件里看到最新的日志
-    flushLogFileTimer.setInterval(1000); // TODO: 可从配置文件读取
-    flushLogFileTimer.start();
-    QObject::connect(&flushLogFileTimer, &QTimer::timeout, [] {
-        // qDebug() << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss"); // 测试不停的写入内容到日志文件
-        QMutexLocker locker(&LogHandlerPrivate::logMutex);
-        if (nullptr != logOut) {
-            logOut->flush();
-        }
-    });
+    // 启动写日志的线程，它定时检查日志文件创建时间，写完一批日志后刷新输出，尽快的能在日志文件里看到最新的日志
+    writer->start();
 }
 
 LogHandlerPrivate::~LogHandlerPrivate() {
-    if (nullptr != logFile) {
-        logFile->flush();
-        logFile->close();
-        delete logOut;
-        delete logFile;
-
-        // 因为他们是 static 变量
-        logOut  = nullptr;
-        logFile = nullptr;
+    // 写日志的线程写完队列中的日志后退出
+    stopping.store(1);
+    {
+        QMutexLocker locker(&waitMutex);
+        wakeup.wakeOne();
     }
+    writer->wait();
+    delete writer;
+    archivePool.waitForDone();
+    closeLogFile();
 }
 
-// 打开日志文件 log.txt，如果不是当天创建的，则使用创建日期把其重命名为 yyyy-MM-dd.log，并重新创建一个 log.txt
+// 打开日志文件 log.txt，如果不是当天创建的或者超过了最大的大小，则把其重命名为 yyyy-MM-dd[.n].log，并重新创建一个 log.txt
 void LogHandlerPrivate::openAndBackupLogFile() {
     // 总体逻辑:
-    // 1. 程序启动时 logFile 为 nullptr，初始化 logFile，有可能是同一天打开已经存在的 logFile，所以使用 Append 模式
+    // 1. 程序启动时 logFile 为 nullptr，初始化 logFile，有可能是同一天打开已经存在的 logFile，所以使用 Append 模式，
+    //    二进制格式的日志文件不追加，上次程序崩溃时最后一条日志可能不完整，追加后 logdecode 无法读取后面的日志，所以先备份
     // 2. logFileCreatedDate is nullptr, 说明日志文件在程序开始时不存在，所以记录下创建时间
-    // 3. 程序运行时检查如果 logFile 的创建日期和当前日期不相等，则使用它的创建日期重命名，然后再生成一个新的 log.txt 文件
+    // 3. 程序运行时检查如果 logFile 的创建日期和当前日期不相等，或者大小超过了 maxFileSize，则重命名为备份文件，
+    //    然后再生成一个新的 log.txt 文件，在后台压缩备份文件并删除超过保留数量和天数的备份文件
 
     makeSureLogDirectory(); // 如果日志所在目录不存在，则创建
-    QString logPath = logDir.absoluteFilePath("log.txt"); // 日志的路径
+    QString logPath = logDir.absoluteFilePath(logFileName()); // 日志的路径
 
     // [[1]] 程序启动时 logFile 为 nullptr
     if (nullptr == logFile) {
-        logFile = new QFile(logPath);
-        logOut  = (logFile->open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Append)) ?  new QTextStream(logFile) : nullptr;
-
-        if (nullptr != logOut) {
-            logOut->setCodec("UTF-8");
+        if (LogHandler::Binary == format && QFileInfo(logPath).size() > 0) {
+            backupLogFile();
+            logFileCreatedDate = QDate::currentDate();
         }
 
+        openLogFile(QIODevice::Append);
+
         // [[2]] 如果文件是第一次创建，则创建日期是无效的，把其设置为当前日期
         if (logFileCreatedDate.isNull()) {
             logFileCreatedDate = QDate::currentDate();
         }
+    }
+
+    // [[3]] 程序运行时如果创建日期不是当前日期，或者大小超过了 maxFileSize，则重命名为备份文件，并生成一个新的 log.txt
+    bool expired  = logFileCreatedDate != QDate::currentDate();
+    bool oversize = rotation.maxFileSize > 0 && logFile->size() >= rotation.maxFileSize;
+
+    if (expired || oversize) {
+        closeLogFile();
+        backupLogFile();
+        openLogFile(QIODevice::Truncate);
+        logFileCreatedDate = QDate::currentDate();
+    }
+}
+
+// 把日志文件重命名为备份文件，然后在后台压缩备份文件并删除超过保留数量和天数的备份文件
+void LogHandlerPrivate::backupLogFile() {
+    QString logPath    = logDir.absoluteFilePath(logFileName());
+    QString newLogPath = backupLogPath();
+
+    // 重命名不复制数据，Windows 下文件被其他程序打开时不能重命名，再使用复制
+    if (!QFile::rename(logPath, newLogPath)) {
+        QFile::copy(logPath, newLogPath);
+        QFile::remove(logPath);
+    }
+
+    archivePool.start(new LogArchiver(logDir, rotation));
+}
+
+// 打开日志文件，二进制格式时新文件写入文件头，每次打开都写入时间的锚点
+void LogHandlerPrivate::openLogFile(QIODevice::OpenMode mode) {
+    logFile = new QFile(logDir.absoluteFilePath(logFileName()));
+
+    if (LogHandler::Text == format) {
+        logOut = (logFile->open(QIODevice::WriteOnly | QIODevice::Text | mode)) ?  new QTextStream(logFile) : nullptr;
+
+        if (nullptr != logOut) {
+            logOut->setCodec("UTF-8");
+        }
+
+        return;
+    }
 
-        // TODO: 可以检查日志文件超过 30 个，删除 30 天前的日志文件
+    if (!logFile->open(QIODevice::WriteOnly | mode)) {
+        return;
+    }
+
+    binOut = new QDataStream(logFile);
+    binOut->setVersion(QDataStream::Qt_5_6);
+    binOut->setByteOrder(QDataStream::LittleEndian);
+    sites.clear(); // 新打开的文件重新写入位置
+
+    if (0 == logFile->size()) {
+        (*binOut) << LOG_BINARY_MAGIC << LOG_BINARY_VERSION;
     }
 
-    // [[3]] 程序运行时如果创建日期不是当前日期，则使用创建日期重命名，并生成一个新的 log.txt
-    if (logFileCreatedDate != QDate::currentDate()) {
+    (*binOut) << quint8(LOG_RECORD_ANCHOR) << QDateTime::currentMSecsSinceEpoch() << clock.nsecsElapsed();
+}
+
+// 关闭日志文件
+void LogHandlerPrivate::closeLogFile() {
+    if (nullptr != logFile) {
+        delete logOut;
+        delete binOut;
         logFile->flush();
         logFile->close();
-        delete logOut;
         delete logFile;
 
-        QString newLogPath = logDir.absoluteFilePath(logFileCreatedDate.toString("yyyy-MM-dd.log"));;
-        QFile::copy(logPath, newLogPath); // Bug: 按理说 rename 会更合适，但是 rename 时最后一个文件总是显示不出来，需要 killall Finder 后才出现
-        QFile::remove(logPath); // 删除重新创建，改变创建时间
+        logOut  = nullptr;
+        binOut  = nullptr;
+        logFile = nullptr;
+    }
+}
 
-        logFile = new QFile(logPath);
-        logOut  = (logFile->open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate)) ?  new QTextStream(logFile) : nullptr;
-        logFileCreatedDate = QDate::currentDate();
+// 使用日志的日期生成备份文件名 yyyy-MM-dd.log，已经存在时加上序号 yyyy-MM-dd.n.log
+QString LogHandlerPrivate::backupLogPath() const {
+    QString date   = logFileCreatedDate.toString("yyyy-MM-dd");
+    QString suffix = LogHandler::Text == format ? "log" : "blog";
 
-        if (nullptr != logOut) {
-            logOut->setCodec("UTF-8");
+    for (int n = 0; ; ++n) {
+        QString path = logDir.absoluteFilePath(n == 0 ? QString("%1.%2").arg(date).arg(suffix)
+                                                      : QString("%1.%2.%3").arg(date).arg(n).arg(suffix));
+
+        if (!QFile::exists(path) && !QFile::exists(path + ".gz")) {
+            return path;
         }
     }
 }
 
+// 日志文件名 log.txt，二进制格式为 log.bin
+QString LogHandlerPrivate::logFileName() const {
+    return LogHandler::Text == format ? "log.txt" : "log.bin";
+}
+
 // 如果日志所在目录不存在，则创建
 void LogHandlerPrivate::makeSureLogDirectory() const {
     if (!logDir.exists()) {
@@ -149,52 +754,255 @@ void LogHandlerPrivate::makeSureLogDirectory() const {
     }
 }
 
-// 消息处理函数
+// 消息处理函数: 只把日志的原始数据放入队列，格式化和 IO 在写日志的线程中进行
 void LogHandlerPrivate::messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg) {
-    QMutexLocker locker(&LogHandlerPrivate::logMutex);
-    QString level;
-
-    switch (type) {
-    case QtDebugMsg:
-        level = "DEBUG";
-        break;
-    case QtInfoMsg:
-        level = "INFO ";
-        break;
-    case QtWarningMsg:
-        level = "WARN ";
-        break;
-    case QtCriticalMsg:
-        level = "ERROR";
-        break;
-    case QtFatalMsg:
-        level = "FATAL";
-        break;
-    default:
-        break;
+    inHandler.ref(); // ref() 是 Ordered 的完整内存屏障，和卸载时的 fetchAndStoreOrdered() 配对
+    LogHandlerPrivate *d = instance.loadAcquire();
+
+    if (nullptr == d) {
+        // 正在卸载，直接输出到标准错误
+        std::cerr << msg.toLocal8Bit().constData() << std::endl;
+        inHandler.deref();
+        return;
     }
 
+    LogRecord record;
+    record.type     = type;
+    record.elapsed  = d->clock.nsecsElapsed();
+    record.threadId = quint64(quintptr(QThread::currentThreadId()));
+    record.file     = context.file;
+    record.function = context.function;
+    record.category = context.category;
+    record.line     = context.line;
+    record.msg      = msg;
+
+    if (inWriterThread) {
+        d->write(record);
+    } else {
+        d->enqueue(record);
+
+        // FATAL 的日志写入文件后才返回，之后 Qt 会结束程序
+        if (QtFatalMsg == type) {
+            d->flush();
+        }
+    }
+
+    inHandler.deref();
+}
+
+// 放入队列，队列满时按策略处理
+void LogHandlerPrivate::enqueue(LogRecord &record) {
+    // 1. 队列不满时放入队列，写日志的线程在等待时唤醒它
+    // 2. 队列满时，Drop 策略丢弃，Sample 策略 DEBUG 和 INFO 每 LOG_SAMPLE_RATE 条保留一条
+    // 3. 其他情况等待写日志的线程腾出空间，在 spaceAvailable 上等待，写日志的线程取出日志后唤醒
+
+    // [[1]] 队列不满时放入队列，写日志的线程在等待时唤醒它
+    if (queue.tryPush(record)) {
+        wakeWriter();
+        return;
+    }
+
+    // [[2]] 队列满时，Drop 策略丢弃，Sample 策略 DEBUG 和 INFO 每 LOG_SAMPLE_RATE 条保留一条
+    int overflowPolicy = policy.load();
+    bool low = QtDebugMsg == record.type || QtInfoMsg == record.type;
+
+    if (QtFatalMsg != record.type) {
+        if (LogHandler::Drop == overflowPolicy
+                || (LogHandler::Sample == overflowPolicy && low && sampleCounter.fetchAndAddRelaxed(1) % LOG_SAMPLE_RATE != 0)) {
+            dropped.ref();
+            wakeWriter();
+            return;
+        }
+    }
+
+    // [[3]] 其他情况等待写日志的线程腾出空间，在 spaceAvailable 上等待，写日志的线程取出日志后唤醒
+    //      先增加 blocked 再重试放入队列: 写日志的线程先取出日志再读取 blocked，两边都使用 Ordered 的操作，
+    //      所以要么重试时已经有空间，要么写日志的线程能看到 blocked 而唤醒，不会错过唤醒 (等待有超时，只作为保底)
+    QMutexLocker locker(&waitMutex);
+    blocked.fetchAndAddOrdered(1);
+
+    while (!queue.tryPush(record)) {
+        if (sleeping.loadAcquire()) {
+            wakeup.wakeOne();
+        }
+
+        spaceAvailable.wait(&waitMutex, LOG_WRITER_IDLE_WAIT);
+    }
+
+    blocked.fetchAndAddOrdered(-1);
+    locker.unlock();
+
+    wakeWriter();
+}
+
+// 写日志的线程在等待时唤醒它，没有等待时不加锁
+void LogHandlerPrivate::wakeWriter() {
+    if (sleeping.loadAcquire()) {
+        QMutexLocker locker(&waitMutex);
+        wakeup.wakeOne();
+    }
+}
+
+// 唤醒队列满时等待空间的线程，没有等待的线程时不加锁
+void LogHandlerPrivate::wakeProducers() {
+    if (blocked.fetchAndAddOrdered(0) > 0) {
+        QMutexLocker locker(&waitMutex);
+        spaceAvailable.wakeAll();
+    }
+}
+
+// 等待已经放入队列的日志都写入文件
+void LogHandlerPrivate::flush() {
+    if (inWriterThread) {
+        flushOutput();
+        return;
+    }
+
+    quint32 target = queue.enqueuePosition();
+    QMutexLocker locker(&waitMutex);
+
+    while (qint32(flushedPos.loadAcquire() - target) < 0 && writer->isRunning()) {
+        wakeup.wakeOne();
+        flushed.wait(&waitMutex, LOG_WRITER_IDLE_WAIT);
+    }
+}
+
+// 写日志的线程: 从队列中取出日志写入控制台和文件
+void LogHandlerPrivate::run() {
+    // 1. 取出队列中所有的日志写入，每取出一部分唤醒队列满时等待的线程，写完一批后刷新输出，唤醒 flush() 中等待的线程
+    // 2. 输出丢弃的日志的条数
+    // 3. 写完一批日志后和定时检查日志文件是否需要重命名，检查分类的配置是否需要重新加载
+    // 4. 要退出并且队列为空时结束，否则队列为空时等待新的日志
+
+    QElapsedTimer rotateTimer;
+    rotateTimer.start();
+    LogRecord record;
+
+    for (;;) {
+        // [[1]] 取出队列中所有的日志写入，每取出一部分唤醒队列满时等待的线程，写完一批后刷新输出，唤醒 flush() 中等待的线程
+        int count = 0;
+
+        while (queue.tryPop(&record)) {
+            write(record);
+
+            if (++count % LOG_PRODUCER_WAKE_BATCH == 0) {
+                wakeProducers();
+            }
+        }
+
+        if (count > 0) {
+            wakeProducers();
+        }
+
+        // [[2]] 输出丢弃的日志的条数
+        int droppedCount = dropped.fetchAndStoreRelaxed(0);
+
+        if (droppedCount > 0) {
+            LogRecord warning;
+            warning.type    = QtWarningMsg;
+            warning.elapsed = clock.nsecsElapsed();
+            warning.msg     = QString("Log queue is full, %1 messages dropped").arg(droppedCount);
+            write(warning);
+            ++count;
+        }
+
+        if (count > 0) {
+            flushOutput();
+            flushedPos.storeRelease(queue.dequeuePosition());
+
+            QMutexLocker locker(&waitMutex);
+            flushed.wakeAll();
+        }
+
+        // [[3]] 写完一批日志后和定时检查日志文件是否需要重命名，定时校准单调时钟对应的时间，检查分类的配置是否需要重新加载
+        //      (定时器只在定时的检查中重新开始，一直有日志时也会定时检查)
+        if (rotateTimer.elapsed() >= LOG_ROTATE_CHECK_TIME) {
+            rotateTimer.restart();
+            clockEpochMs = QDateTime::currentMSecsSinceEpoch() - clock.nsecsElapsed() / 1000000;
+            LogCategoryFilter::checkReload();
+            openAndBackupLogFile();
+        } else if (count > 0) {
+            openAndBackupLogFile();
+        }
+
+        // [[4]] 要退出并且队列为空时结束，否则队列为空时等待新的日志
+        QMutexLocker locker(&waitMutex);
+
+        if (queue.isEmpty()) {
+            if (stopping.load()) {
+                break;
+            }
+
+            sleeping.storeRelease(1);
+            wakeup.wait(&waitMutex, LOG_WRITER_IDLE_WAIT);
+            sleeping.storeRelease(0);
+        }
+    }
+}
+
+// 格式化并输出一条日志
+void LogHandlerPrivate::write(const LogRecord &record) {
     // 输出到标准输出: Windows 下 std::cout 使用 GB2312，而 msg 使用 UTF-8，但是程序的 Local 也还是使用 UTF-8
 #if defined(Q_OS_WIN)
-    QByteArray localMsg = QTextCodec::codecForName("GB2312")->fromUnicode(msg); // msg.toLocal8Bit();
+    QByteArray localMsg = QTextCodec::codecForName("GB2312")->fromUnicode(record.msg); // msg.toLocal8Bit();
 #else
-    QByteArray localMsg = msg.toLocal8Bit();
+    QByteArray localMsg = record.msg.toLocal8Bit();
 #endif
 
-    std::cout << std::string(localMsg) << std::endl;
+    std::cout << localMsg.constData() << '\n'; // 写完一批后再刷新
 
-    if (nullptr == LogHandlerPrivate::logOut) {
+    if (nullptr != binOut) {
+        writeBinary(record);
+        return;
+    } else if (nullptr == logOut) {
         return;
     }
 
     // 输出到日志文件, 格式: 时间 - [Level] (文件名:行数, 函数): 消息
-    QString fileName = context.file;
-    int index = fileName.lastIndexOf(QDir::separator());
+    qint64 time   = clockEpochMs + record.elapsed / 1000000;
+    qint64 second = time / 1000;
+
+    if (second != lastSecond) {
+        lastSecond   = second;
+        lastTimeText = QDateTime::fromMSecsSinceEpoch(time).toString("yyyy-MM-dd hh:mm:ss");
+    }
+
+    QString fileName = QString::fromUtf8(record.file);
+    int index = qMax(fileName.lastIndexOf('/'), fileName.lastIndexOf('\\'));
     fileName = fileName.mid(index + 1);
 
-    (*LogHandlerPrivate::logOut) << QString("%1 - [%2] (%3:%4, %5): %6\n")
-                                    .arg(QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss")).arg(level)
-                                    .arg(fileName).arg(context.line).arg(context.function).arg(msg);
+    (*logOut) << lastTimeText << " - [" << logLevelName(record.type) << "] (" << fileName << ":" << record.line << ", "
+              << record.function << "): " << record.msg << "\n";
+}
+
+// 使用二进制格式写入日志文件，不格式化时间和级别，位置第一次出现时写入，之后只写入编号
+void LogHandlerPrivate::writeBinary(const LogRecord &record) {
+    LogSite site = { record.file, record.function, record.category, record.line };
+    auto iter = sites.constFind(site);
+    quint32 siteId = 0;
+
+    if (iter != sites.constEnd()) {
+        siteId = iter.value();
+    } else {
+        siteId = quint32(sites.size());
+        sites.insert(site, siteId);
+        (*binOut) << quint8(LOG_RECORD_SITE) << siteId << record.file << qint32(record.line)
+                  << record.function << record.category;
+    }
+
+    (*binOut) << quint8(LOG_RECORD_MESSAGE) << siteId << record.elapsed << quint8(record.type)
+              << record.threadId << record.msg.toUtf8();
+}
+
+// 刷新控制台和日志文件的缓冲
+void LogHandlerPrivate::flushOutput() {
+    std::cout.flush();
+
+    if (nullptr != logOut) {
+        logOut->flush();
+    } else if (nullptr != logFile) {
+        logFile->flush();
+    }
 }
 
 /************************************************************************************************************
@@ -213,6 +1021,7 @@ void LogHandler::installMessageHandler() {
 
     if (nullptr == d) {
         d = new LogHandlerPrivate();
+        LogHandlerPrivate::instance.storeRelease(d);
         qInstallMessageHandler(LogHandlerPrivate::messageHandler); // 给 Qt 安装自定义消息处理函数
     }
 }
@@ -220,6 +1029,61 @@ void LogHandler::installMessageHandler() {
 void LogHandler::uninstallMessageHandler() {
     QMutexLocker locker(&LogHandlerPrivate::logMutex);
     qInstallMessageHandler(nullptr);
+
+    // 等待正在使用 d 的消息处理函数结束后再释放:
+    // 清空 instance 和读取 inHandler 之间需要完整的内存屏障 (消息处理函数中 ref() 和读取 instance 也是)，
+    // 否则可能读到旧的 inHandler 为 0，而消息处理函数读到旧的 d，所以都使用 Ordered 的操作
+    LogHandlerPrivate::instance.fetchAndStoreOrdered(nullptr);
+
+    while (LogHandlerPrivate::inHandler.fetchAndAddOrdered(0) > 0) {
+        QThread::yieldCurrentThread();
+    }
+
     delete d;
     d = nullptr;
 }
+
+void LogHandler::setOverflowPolicy(OverflowPolicy policy) {
+    LogHandlerPrivate::policy.store(policy);
+}
+
+void LogHandler::setFormat(Format format) {
+    QMutexLocker locker(&LogHandlerPrivate::logMutex);
+    LogHandlerPrivate::formatSettings = format;
+}
+
+void LogHandler::setMaxFileSize(qint64 bytes) {
+    QMutexLocker locker(&LogHandlerPrivate::logMutex);
+    LogHandlerPrivate::rotationSettings.maxFileSize = bytes;
+}
+
+void LogHandler::setMaxBackupCount(int count) {
+    QMutexLocker locker(&LogHandlerPrivate::logMutex);
+    LogHandlerPrivate::rotationSettings.maxBackupCount = count;
+}
+
+void LogHandler::setMaxBackupDays(int days) {
+    QMutexLocker locker(&LogHandlerPrivate::logMutex);
+    LogHandlerPrivate::rotationSettings.maxBackupDays = days;
+}
+
+void LogHandler::setCompressBackup(bool compress) {
+    QMutexLocker locker(&LogHandlerPrivate::logMutex);
+    LogHandlerPrivate::rotationSettings.compress = compress;
+}
+
+void LogHandler::setCategoryConfig(const QString &path) {
+    LogCategoryFilter::load(path);
+}
+
+void LogHandler::reloadCategoryConfig() {
+    LogCategoryFilter::reload();
+}
+
+void LogHandler::flush() {
+    QMutexLocker locker(&LogHandlerPrivate::logMutex);
+
+    if (nullptr != d) {
+        d->flush();
+    }
+}
@@ -3,16 +3,78 @@
 
 #include "Singleton.h"
 
+#include <QLoggingCategory>
+
 #define LogHandlerInstance Singleton<LogHandler>::getInstance()
 
+// 声明和定义日志的分类，例如头文件中 LOG_DECLARE_CATEGORY(logDb)，cpp 中 LOG_CATEGORY(logDb, "app.db")
+#define LOG_DECLARE_CATEGORY(name) Q_DECLARE_LOGGING_CATEGORY(name)
+#define LOG_CATEGORY(name, id)     Q_LOGGING_CATEGORY(name, id)
+
+// 按分类输出日志，例如 LOG_DEBUG(logDb) << sql，分类的这个级别关闭时不计算 << 后面的参数
+#define LOG_DEBUG(category) qCDebug(category)
+#define LOG_INFO(category)  qCInfo(category)
+#define LOG_WARN(category)  qCWarning(category)
+#define LOG_ERROR(category) qCCritical(category)
+
 struct LogHandlerPrivate;
 
+/**
+ * 日志处理: qDebug、qInfo 等输出的日志放入有界的队列，由一个写日志的线程输出到控制台和日志文件，
+ * 调用 qDebug 的线程不需要等待锁和 IO，日志的时间、级别、文件名等在写日志的线程中格式化。
+ *
+ * 队列满时的处理策略:
+ *     Block : 等待写日志的线程腾出空间，不丢失日志 (默认)
+ *     Drop  : 丢弃新的日志，写日志的线程输出丢弃的条数
+ *     Sample: WARN 及以上的日志等待，DEBUG 和 INFO 每 LOG_SAMPLE_RATE 条保留一条，其余丢弃
+ *
+ * FATAL 的日志不管什么策略都会等待写入文件后才返回 (之后 Qt 会结束程序)。
+ *
+ * 日志写入 log/log.txt，日期变化或者大小超过 maxFileSize 时重命名为 yyyy-MM-dd.log (同一天有多个时为 yyyy-MM-dd.n.log)，
+ * 然后在后台线程中压缩为 .log.gz，并删除超过 maxBackupCount 个或者 maxBackupDays 天的备份文件。
+ *
+ * 二进制格式的日志文件只写入原始的数据: 单调时钟的时间、级别、线程、消息，输出日志的位置 (文件、行、函数、分类) 只写入一次，
+ * 不格式化时间和级别，日志文件更小，写入更快，备份文件为 yyyy-MM-dd[.n].blog。
+ *
+ * 每个分类的最低级别在 setCategoryConfig() 设置的配置文件中，每行为 分类=级别，级别为 debug、info、warn、error 或者 off，
+ * 分类以 .* 结尾时匹配前缀，* 匹配所有的分类，qDebug() 等没有分类的日志的分类为 default，例如:
+ *     *=info
+ *     default=warn
+ *     app.db.*=debug
+ *     app.http=off
+ * 配置文件修改后自动重新加载，Unix 下收到 SIGHUP 时也重新加载，可以在程序运行时调整日志的级别。
+ */
 class LogHandler {
     SINGLETON(LogHandler) // 使用单例模式
 public:
-    void uninstallMessageHandler(); // 释放资源
+    enum OverflowPolicy {
+        Block,
+        Drop,
+        Sample
+    };
+
+    enum Format {
+        Text,  // 文本格式，写入 log/log.txt
+        Binary // 二进制格式，写入 log/log.bin，使用 logdecode 转换为文本或者 JSON，格式见 LogFormat.h
+    };
+
+    void uninstallMessageHandler(); // 释放资源，队列中的日志写完后才返回
     void installMessageHandler();   // 给 Qt 安装消息处理函数
 
+    void setOverflowPolicy(OverflowPolicy policy); // 设置队列满时的处理策略
+    void setFormat(Format format); // 设置日志文件的格式，在 installMessageHandler() 前调用，默认为文本格式
+
+    // 日志文件轮转的设置，在 installMessageHandler() 前调用
+    void setMaxFileSize(qint64 bytes);     // 日志文件超过这个大小时轮转，小于等于 0 时只按日期轮转，默认为 10M
+    void setMaxBackupCount(int count);     // 最多保留的备份文件数，小于等于 0 时不限制，默认为 30
+    void setMaxBackupDays(int days);       // 备份文件最多保留的天数，小于等于 0 时不限制，默认为 30
+    void setCompressBackup(bool compress); // 是否使用 gzip 压缩备份文件，默认为 true
+
+    void setCategoryConfig(const QString &path); // 设置每个分类的日志级别的配置文件，并立即加载
+    void reloadCategoryConfig(); // 重新加载分类的配置文件，可以连接到 Qt 的信号
+
+    void flush(); // 等待已经输出的日志都写入文件
+
 private:
     LogHandlerPrivate *d;
 };
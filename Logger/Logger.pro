@@ -33,4 +33,5 @@ SOURCES += main.cpp \
 
 HEADERS += \
     Singleton.h \
-    LogHandler.h
+    LogHandler.h \
+    LogFormat.h
@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# 把 LogHandler 的二进制日志转换为文本或者 JSON
+#
+#-------------------------------------------------
+
+QT      -= gui
+
+TARGET   = logdecode
+TEMPLATE = app
+CONFIG  += console
+CONFIG  -= app_bundle
+
+# Output directory
+CONFIG(debug, debug|release) {
+    output = debug
+}
+CONFIG(release, debug|release) {
+    output = release
+}
+
+DESTDIR     = ../bin
+OBJECTS_DIR = $$output
+MOC_DIR     = $$output
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp
+
+HEADERS += \
+    ../LogFormat.h
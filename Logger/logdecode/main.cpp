@@ -0,0 +1,257 @@
+#include "LogFormat.h"
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+#include <stdio.h>
+#include <climits>
+
+/**
+ * 输出日志的位置
+ */
+struct Site {
+    QByteArray file;
+    QByteArray function;
+    QByteArray category;
+    qint32 line = 0;
+};
+
+/**
+ * 过滤和输出的选项
+ */
+struct Options {
+    bool   json = false;
+    int    minRank = 0;             // 最低的级别
+    qint64 from = LLONG_MIN;        // 开始时间，从 1970 年开始的毫秒数
+    qint64 to   = LLONG_MAX;        // 结束时间
+    QStringList categories;         // 为空时输出所有分类，以 * 结尾时匹配前缀
+};
+
+// 分类是否需要输出
+static bool matchCategory(const Options &options, const QByteArray &category) {
+    if (options.categories.isEmpty()) {
+        return true;
+    }
+
+    QString name = QString::fromUtf8(category);
+
+    for (const QString &pattern : options.categories) {
+        if (pattern.endsWith('*') ? name.startsWith(pattern.left(pattern.size() - 1)) : name == pattern) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief 解码一个二进制日志文件，输出到 out
+ *
+ * @param device  日志文件
+ * @param name    文件名，用于输出错误
+ * @param options 过滤和输出的选项
+ * @param out     输出
+ * @return 文件格式正确且完整时返回 true，否则返回 false
+ */
+static bool decode(QIODevice *device, const QString &name, const Options &options, QTextStream &out) {
+    // 1. 读取并检查文件头
+    // 2. 依次读取记录: 锚点更新时间的基准，位置记录到 sites，日志过滤后输出
+
+    QDataStream in(device);
+    in.setVersion(QDataStream::Qt_5_6);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    // [1] 读取并检查文件头
+    quint32 magic   = 0;
+    quint16 version = 0;
+    in >> magic >> version;
+
+    if (in.status() != QDataStream::Ok || magic != LOG_BINARY_MAGIC) {
+        fprintf(stderr, "%s: not a binary log file\n", qPrintable(name));
+        return false;
+    } else if (version > LOG_BINARY_VERSION) {
+        fprintf(stderr, "%s: unsupported version %d\n", qPrintable(name), version);
+        return false;
+    }
+
+    // [2] 依次读取记录: 锚点更新时间的基准，位置记录到 sites，日志过滤后输出
+    QHash<quint32, Site> sites;
+    qint64 anchorEpochMs = 0;
+    qint64 anchorElapsed = 0;
+
+    while (!in.atEnd()) {
+        quint8 recordType = 0;
+        in >> recordType;
+
+        if (LOG_RECORD_ANCHOR == recordType) {
+            in >> anchorEpochMs >> anchorElapsed;
+            sites.clear(); // 重新打开文件后位置重新编号
+        } else if (LOG_RECORD_SITE == recordType) {
+            quint32 siteId = 0;
+            Site site;
+            in >> siteId >> site.file >> site.line >> site.function >> site.category;
+            sites.insert(siteId, site);
+        } else if (LOG_RECORD_MESSAGE == recordType) {
+            quint32 siteId  = 0;
+            qint64 elapsed  = 0;
+            quint8 type     = 0;
+            quint64 thread  = 0;
+            QByteArray msg;
+            in >> siteId >> elapsed >> type >> thread >> msg;
+
+            if (in.status() != QDataStream::Ok) {
+                break;
+            }
+
+            const Site site = sites.value(siteId);
+            qint64 time = anchorEpochMs + (elapsed - anchorElapsed) / 1000000;
+
+            if (logLevelRank(type) < options.minRank || time < options.from || time > options.to
+                    || !matchCategory(options, site.category)) {
+                continue;
+            }
+
+            QString timeText = QDateTime::fromMSecsSinceEpoch(time).toString("yyyy-MM-dd hh:mm:ss.zzz");
+
+            if (options.json) {
+                QJsonObject object;
+                object["time"]     = timeText;
+                object["level"]    = QString(logLevelName(type)).trimmed();
+                object["thread"]   = QString::number(thread);
+                object["category"] = QString::fromUtf8(site.category);
+                object["file"]     = QString::fromUtf8(site.file);
+                object["line"]     = site.line;
+                object["function"] = QString::fromUtf8(site.function);
+                object["msg"]      = QString::fromUtf8(msg);
+                out << QJsonDocument(object).toJson(QJsonDocument::Compact) << "\n";
+            } else {
+                // 格式: 时间 - [Level] [线程] 分类 (文件名:行数, 函数): 消息
+                out << timeText << " - [" << logLevelName(type) << "] [" << thread << "] " << site.category
+                    << " (" << QFileInfo(QString::fromUtf8(site.file)).fileName() << ":" << site.line << ", "
+                    << site.function << "): " << QString::fromUtf8(msg) << "\n";
+            }
+        } else {
+            fprintf(stderr, "%s: invalid record type %d\n", qPrintable(name), recordType);
+            return false;
+        }
+
+        if (in.status() != QDataStream::Ok) {
+            break;
+        }
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        // 程序崩溃时最后一条日志可能没有写完整
+        fprintf(stderr, "%s: truncated\n", qPrintable(name));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * 把 LogHandler 的二进制日志 (log.bin 和 .blog 备份文件) 转换为文本或者 JSON，例如:
+ *     logdecode log/log.bin
+ *     logdecode --level warn --category "db.*" --from 2016-10-01T00:00:00 log/log.bin
+ *     gunzip -c log/2016-10-01.blog.gz | logdecode --json -
+ */
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("logdecode");
+
+    // [[1]] 解析命令行参数
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Decode binary log files written by LogHandler.");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "json", "Output one JSON object per line." },
+        { "level", "Minimum level: debug, info, warn, error or fatal.", "level", "debug" },
+        { "from", "Only messages at or after this time (ISO 8601).", "time" },
+        { "to", "Only messages at or before this time (ISO 8601).", "time" },
+        { "category", "Only messages of this category, a trailing * matches a prefix. Can be repeated.", "category" }
+    });
+    parser.addPositionalArgument("files", "Binary log files, - reads from standard input.", "files...");
+    parser.process(app);
+
+    Options options;
+    options.json       = parser.isSet("json");
+    options.categories = parser.values("category");
+
+    QStringList levels = QStringList() << "debug" << "info" << "warn" << "error" << "fatal";
+    options.minRank = levels.indexOf(parser.value("level").toLower());
+
+    if (options.minRank < 0) {
+        fprintf(stderr, "Invalid level: %s\n", qPrintable(parser.value("level")));
+        return 1;
+    }
+
+    if (parser.isSet("from")) {
+        QDateTime from = QDateTime::fromString(parser.value("from"), Qt::ISODate);
+
+        if (!from.isValid()) {
+            fprintf(stderr, "Invalid time: %s\n", qPrintable(parser.value("from")));
+            return 1;
+        }
+
+        options.from = from.toMSecsSinceEpoch();
+    }
+
+    if (parser.isSet("to")) {
+        QDateTime to = QDateTime::fromString(parser.value("to"), Qt::ISODate);
+
+        if (!to.isValid()) {
+            fprintf(stderr, "Invalid time: %s\n", qPrintable(parser.value("to")));
+            return 1;
+        }
+
+        options.to = to.toMSecsSinceEpoch();
+    }
+
+    QStringList files = parser.positionalArguments();
+
+    if (files.isEmpty()) {
+        parser.showHelp(1);
+    }
+
+    // [[2]] 依次解码每个文件
+    QTextStream out(stdout);
+    out.setCodec("UTF-8");
+    bool ok = true;
+
+    for (const QString &path : files) {
+        // 标准输入是管道时 atEnd() 不可靠，先全部读取到内存中
+        if (path == "-") {
+            QFile input;
+            input.open(stdin, QIODevice::ReadOnly);
+            QByteArray data = input.readAll();
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::ReadOnly);
+
+            ok = decode(&buffer, "stdin", options, out) && ok;
+            out.flush();
+            continue;
+        }
+
+        QFile file(path);
+
+        if (!file.open(QIODevice::ReadOnly)) {
+            fprintf(stderr, "%s: %s\n", qPrintable(path), qPrintable(file.errorString()));
+            ok = false;
+            continue;
+        }
+
+        ok = decode(&file, path, options, out) && ok;
+        out.flush();
+    }
+
+    return ok ? 0 : 1;
+}
@@ -6,10 +6,17 @@
 #include <QPushButton>
 #include <QTextCodec>
 
+LOG_CATEGORY(logUi, "app.ui")
+
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
 
-    // [[1]] 安装消息处理函数
+    // [[1]] 安装消息处理函数，日志队列满时 DEBUG 和 INFO 的日志抽样保留，不阻塞调用 qDebug 的线程
+    LogHandlerInstance.setOverflowPolicy(LogHandler::Sample);
+    LogHandlerInstance.setMaxFileSize(50 * 1024 * 1024); // 日志文件超过 50M 或者日期变化时备份并压缩，保留 30 天
+    LogHandlerInstance.setMaxBackupDays(30);
+    // LogHandlerInstance.setFormat(LogHandler::Binary); // 二进制格式的日志更小更快，使用 logdecode 查看
+    LogHandlerInstance.setCategoryConfig("log-levels.conf"); // 每个分类的日志级别，修改后自动重新加载
     LogHandlerInstance.installMessageHandler();
 
     // [[2]] 输出测试，查看是否写入到文件
@@ -20,7 +27,7 @@ int main(int argc, char *argv[]) {
     QPushButton *button = new QPushButton("退出");
     button->show();
     QObject::connect(button, &QPushButton::clicked, [&app] {
-        qDebug() << "退出";
+        LOG_DEBUG(logUi) << "退出"; // app.ui 的 DEBUG 关闭时不输出
         app.quit();
     });
 
@@ -2,26 +2,63 @@
 #define CONFIG_H
 
 #include "util/Singleton.h"
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QMutex>
+#include <QSharedPointer>
 
 #define ConfigInstance Singleton<Config>::getInstance()
 
-class Json;
-class QString;
-class QStringList;
 class QSettings;
+class QTimer;
+class QFileSystemWatcher;
+
+/**
+ * data/config.json 解析后的配置，加载时一次性解析为字段，发布后不再修改
+ */
+struct ConfigSnapshot {
+    QString uploadUrl; // 上传的 URL
+
+    // 数据库
+    QString databaseType;
+    QString databaseHost;
+    QString databaseName;
+    QString databaseUsername;
+    QString databasePassword;
+    QString databaseTestOnBorrowSql;
+    bool    databaseTestOnBorrow = false;
+    int     databaseMaxWaitTime = 5000;
+    int     databaseMaxConnectionCount = 5;
+    int     databasePort = 0;
+    bool    databaseDebug = false;
+    QStringList databaseSqlFiles;
+
+    // 其它
+    QStringList qssFiles;
+    QStringList fontFiles;
+};
 
 /**
  * 用于读写配置文件:
  * 1. 配置文件位于: data/config.json，存储配置的信息，例如数据库信息，QSS 文件的路径
  * 2. 读取配置，如 Singleton<Config>::getInstance().getDatabaseName();
+ *
+ * config.json 加载时解析为 ConfigSnapshot，getXxx() 只是访问它的字段。
+ * 使用 QFileSystemWatcher 监视 config.json，修改后重新解析并替换当前的 ConfigSnapshot，然后发射 configChanged()，
+ * 修改后的 config.json 无效时继续使用原来的配置。
+ * snapshot() 返回当前配置的 QSharedPointer，读取期间配置被替换也有效，需要一致的多个配置时使用同一个 snapshot()。
  */
-class Config {
+class Config : public QObject {
+    Q_OBJECT
     SINGLETON(Config)
 
 public:
     // 销毁 Config 的资源，如有必要，在 main 函数结束前调用，例如保存配置文件
     void destroy();
 
+    QSharedPointer<const ConfigSnapshot> snapshot() const; // 当前的配置
+
     QString getUploadUrl() const; // 获取上传的 URL
 
     // 数据库信息
@@ -42,8 +79,19 @@ public:
     QStringList getQssFiles() const;  // QSS 样式表文件, 可以是多个
     QStringList getFontFiles() const; // 字体文件, 可以是多个
 
+signals:
+    void configChanged(); // config.json 修改后重新加载完成时发射
+
 private:
-    Json *json;
+    void reload(); // 重新加载 config.json，成功时替换当前的配置
+    void publish(ConfigSnapshot *snapshot); // 替换当前的配置
+    static ConfigSnapshot* load(const QString &path); // 解析配置文件，无效时返回 nullptr
+
+    QSharedPointer<const ConfigSnapshot> currentShared; // 当前的配置，snapshot() 加锁读取，destroy() 后仍然有效
+    mutable QMutex mutex;
+    QFileSystemWatcher *watcher;
+    QTimer *reloadTimer; // 修改后延迟重新加载，合并编辑器保存时的多次修改
+    int reloadRetries;   // 编辑器删除后再创建文件时，文件不存在的重试次数
     QSettings *appSettings;
 };
 